@@ -1,7 +1,10 @@
 #include "client/async_log_client.h"
 
 #include <event2/http.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <string.h>
+#include <strings.h>
 #include <algorithm>
 #include <iterator>
 #include <memory>
@@ -22,15 +25,24 @@ using ct::DigitallySigned;
 using ct::MerkleAuditProof;
 using ct::SignedCertificateTimestamp;
 using ct::SignedTreeHead;
+using google::protobuf::Arena;
 using std::back_inserter;
 using std::bind;
+using std::make_pair;
+using std::make_shared;
 using std::move;
 using std::placeholders::_1;
+using std::shared_ptr;
 using std::string;
 using std::to_string;
 using std::unique_ptr;
 using std::vector;
 
+DEFINE_bool(get_entries_binary, false,
+            "Ask logs to send get-entries responses in the binary format "
+            "rather than in JSON, which is much cheaper to decode. Logs "
+            "which do not support it answer in JSON anyway.");
+
 namespace {
 
 
@@ -105,6 +117,16 @@ void DoneGetSTH(UrlFetcher::Response* resp, SignedTreeHead* sth,
 }
 
 
+// Parses the body of |resp|, from Response::body_buffer if the fetcher
+// handed it over that way, or from Response::body otherwise.
+json_object* ParseBody(UrlFetcher::Response* resp) {
+  if (resp->body_buffer) {
+    return JsonObject(resp->body_buffer.get()).Extract();
+  }
+  return JsonObject(resp->body).Extract();
+}
+
+
 void DoneGetRoots(UrlFetcher::Response* resp, vector<unique_ptr<Cert>>* roots,
                   const AsyncLogClient::Callback& done, util::Task* task) {
   unique_ptr<UrlFetcher::Response> resp_deleter(CHECK_NOTNULL(resp));
@@ -114,7 +136,7 @@ void DoneGetRoots(UrlFetcher::Response* resp, vector<unique_ptr<Cert>>* roots,
     return;
   }
 
-  JsonObject jresponse(resp->body);
+  JsonObject jresponse(ParseBody(resp));
   if (!jresponse.Ok())
     return done(AsyncLogClient::BAD_RESPONSE);
 
@@ -142,85 +164,245 @@ void DoneGetRoots(UrlFetcher::Response* resp, vector<unique_ptr<Cert>>* roots,
 }
 
 
-void DoneGetEntries(UrlFetcher::Response* resp,
-                    vector<AsyncLogClient::Entry>* entries,
-                    const AsyncLogClient::Callback& done, util::Task* task) {
-  unique_ptr<UrlFetcher::Response> resp_deleter(CHECK_NOTNULL(resp));
-  unique_ptr<util::Task> task_deleter(CHECK_NOTNULL(task));
+// Decodes one get-entries result into |log_entry|. |sct| is null if the
+// response did not include the SCT.
+DeserializeResult DecodeEntry(const LogSerializer& serializer,
+                              util::StringView leaf_input,
+                              util::StringView extra_data,
+                              const util::StringView* sct,
+                              const shared_ptr<Arena>& arena,
+                              AsyncLogClient::Entry* log_entry) {
+  DeserializeResult res(
+      serializer.DeserializeMerkleTreeLeaf(leaf_input, log_entry->leaf));
+  if (res != DeserializeResult::OK) {
+    return res;
+  }
 
-  if (!SanityCheck(resp, done, task)) {
-    return;
+  if (sct) {
+    log_entry->sct =
+        Arena::CreateMessage<SignedCertificateTimestamp>(arena.get());
+    res = Deserializer::DeserializeSCT(*sct, log_entry->sct);
+    if (res != DeserializeResult::OK) {
+      return res;
+    }
   }
 
-  JsonObject jresponse(resp->body);
+  switch (log_entry->leaf->timestamped_entry().entry_type()) {
+    case ct::X509_ENTRY:
+      DeserializeX509Chain(extra_data, log_entry->entry->mutable_x509_entry());
+      break;
+    case ct::PRECERT_ENTRY:
+      DeserializePrecertChainEntry(extra_data,
+                                   log_entry->entry->mutable_precert_entry());
+      break;
+    case ct::X_JSON_ENTRY:
+      // nothing to do
+      break;
+    default:
+      LOG(FATAL) << "Don't understand entry type: "
+                 << log_entry->leaf->timestamped_entry().entry_type();
+  }
+
+  return DeserializeResult::OK;
+}
+
+
+// Neither header names (which UrlFetcher::Headers takes care of) nor
+// media types are case sensitive, and the latter can have parameters.
+bool IsBinaryEntries(const UrlFetcher::Response& resp) {
+  const auto it(resp.headers.find("Content-Type"));
+  if (it == resp.headers.end()) {
+    return false;
+  }
+  const string& type(it->second);
+  const size_t length(strlen(kBinaryEntriesContentType));
+  return strncasecmp(type.c_str(), kBinaryEntriesContentType, length) == 0 &&
+         (type.size() == length || type[length] == ';' ||
+          type[length] == ' ');
+}
+
+
+bool DecodeJsonEntries(const LogSerializer& serializer,
+                       const JsonObject& jresponse,
+                       const shared_ptr<Arena>& arena,
+                       vector<AsyncLogClient::Entry>* entries) {
   if (!jresponse.Ok())
-    return done(AsyncLogClient::BAD_RESPONSE);
+    return false;
 
   JsonArray jentries(jresponse, "entries");
   if (!jentries.Ok())
-    return done(AsyncLogClient::BAD_RESPONSE);
-
-  vector<AsyncLogClient::Entry> new_entries;
-  new_entries.reserve(jentries.Length());
+    return false;
 
+  entries->reserve(jentries.Length());
   for (int n = 0; n < jentries.Length(); ++n) {
     JsonObject entry(jentries, n);
     if (!entry.Ok()) {
-      return done(AsyncLogClient::BAD_RESPONSE);
+      return false;
     }
 
     JsonString leaf_input(entry, "leaf_input");
     if (!leaf_input.Ok()) {
-      return done(AsyncLogClient::BAD_RESPONSE);
-    }
-
-    AsyncLogClient::Entry log_entry;
-    if (Deserializer::DeserializeMerkleTreeLeaf(leaf_input.FromBase64(),
-                                                &log_entry.leaf) !=
-        DeserializeResult::OK) {
-      return done(AsyncLogClient::BAD_RESPONSE);
+      return false;
     }
 
     JsonString extra_data(entry, "extra_data");
     if (!extra_data.Ok()) {
-      return done(AsyncLogClient::BAD_RESPONSE);
+      return false;
     }
 
     // This is an optional non-standard extension, used only by the log
     // internally when running in clustered mode.
     JsonString sct_data(entry, "sct");
-    if (sct_data.Ok()) {
-      unique_ptr<SignedCertificateTimestamp> sct(
-          new SignedCertificateTimestamp);
-      if (Deserializer::DeserializeSCT(sct_data.FromBase64(), sct.get()) !=
-          DeserializeResult::OK) {
-        return done(AsyncLogClient::BAD_RESPONSE);
-      }
-      log_entry.sct = move(sct);
+    const string sct(sct_data.Ok() ? sct_data.FromBase64() : string());
+    const util::StringView sct_view(sct);
+
+    AsyncLogClient::Entry log_entry(arena);
+    if (DecodeEntry(serializer, leaf_input.FromBase64(),
+                    extra_data.FromBase64(),
+                    sct_data.Ok() ? &sct_view : nullptr, arena,
+                    &log_entry) != DeserializeResult::OK) {
+      return false;
     }
 
-    switch (log_entry.leaf.timestamped_entry().entry_type()) {
-      case ct::X509_ENTRY:
-        DeserializeX509Chain(extra_data.FromBase64(),
-                             log_entry.entry.mutable_x509_entry());
-        break;
-      case ct::PRECERT_ENTRY:
-        DeserializePrecertChainEntry(extra_data.FromBase64(),
-                                     log_entry.entry.mutable_precert_entry());
-        break;
-      case ct::X_JSON_ENTRY:
-        // nothing to do
-        break;
-      default:
-        LOG(FATAL) << "Don't understand entry type: "
-                   << log_entry.leaf.timestamped_entry().entry_type();
+    entries->emplace_back(move(log_entry));
+  }
+
+  return true;
+}
+
+
+// Decodes a get-entries response as it is received, in whichever
+// format the log used.
+class EntriesDecoder {
+ public:
+  EntriesDecoder(const LogSerializer& serializer,
+                 const UrlFetcher::Response* resp)
+      : serializer_(serializer),
+        resp_(CHECK_NOTNULL(resp)),
+        arena_(make_shared<Arena>()),
+        started_(false),
+        ok_(true) {
+  }
+
+  // Called by the UrlFetcher with each piece of the body, on its event
+  // loop thread.
+  bool Append(util::StringView data);
+
+  // Called once the whole response has been received. Returns false if
+  // it was not valid, otherwise adds the decoded entries to |entries|.
+  bool Finish(vector<AsyncLogClient::Entry>* entries);
+
+ private:
+  void Start();
+  DeserializeResult AddRecord(const BinaryEntriesDecoder::Record& record);
+
+  const LogSerializer& serializer_;
+  const UrlFetcher::Response* const resp_;
+  const shared_ptr<Arena> arena_;
+  // Only one of these is used, depending on the Content-Type.
+  unique_ptr<BinaryEntriesDecoder> binary_;
+  unique_ptr<JsonTokenizer> json_;
+  vector<AsyncLogClient::Entry> entries_;
+  bool started_;
+  bool ok_;
+};
+
+
+void EntriesDecoder::Start() {
+  if (started_) {
+    return;
+  }
+  started_ = true;
+
+  // The headers are available by the time the body starts arriving.
+  if (IsBinaryEntries(*resp_)) {
+    binary_.reset(
+        new BinaryEntriesDecoder(bind(&EntriesDecoder::AddRecord, this, _1)));
+  } else {
+    json_.reset(new JsonTokenizer);
+  }
+}
+
+
+bool EntriesDecoder::Append(util::StringView data) {
+  // Don't bother with error pages, the request will fail anyway.
+  if (resp_->status_code != HTTP_OK) {
+    return false;
+  }
+  // Once the response is known to be bad, the rest of it is drained
+  // without being looked at, so that the request still completes, and
+  // Finish() can report it as a bad response.
+  if (!ok_) {
+    return true;
+  }
+  Start();
+
+  if (binary_) {
+    ok_ = binary_->Append(data) == DeserializeResult::OK;
+  } else if (!json_->Done()) {
+    // The entries are only decoded once the JSON object is complete,
+    // but that can at least be parsed while the rest arrives.
+    ok_ = json_->Append(data);
+  }
+
+  return true;
+}
+
+
+bool EntriesDecoder::Finish(vector<AsyncLogClient::Entry>* entries) {
+  Start();
+  if (!ok_) {
+    return false;
+  }
+
+  if (binary_) {
+    if (binary_->Finish() != DeserializeResult::OK) {
+      return false;
+    }
+  } else {
+    if (!json_->Done() ||
+        !DecodeJsonEntries(serializer_, JsonObject(json_->Extract()),
+                           arena_, &entries_)) {
+      return false;
     }
+  }
+
+  entries->reserve(entries->size() + entries_.size());
+  move(entries_.begin(), entries_.end(), back_inserter(*entries));
+  entries_.clear();
+
+  return true;
+}
+
+
+DeserializeResult EntriesDecoder::AddRecord(
+    const BinaryEntriesDecoder::Record& record) {
+  AsyncLogClient::Entry log_entry(arena_);
+  const DeserializeResult res(
+      DecodeEntry(serializer_, record.leaf_input, record.extra_data,
+                  record.sct.empty() ? nullptr : &record.sct, arena_,
+                  &log_entry));
+  if (res == DeserializeResult::OK) {
+    entries_.emplace_back(move(log_entry));
+  }
+  return res;
+}
+
 
-    new_entries.emplace_back(move(log_entry));
+void DoneGetEntries(UrlFetcher::Response* resp, EntriesDecoder* decoder,
+                    vector<AsyncLogClient::Entry>* entries,
+                    const AsyncLogClient::Callback& done, util::Task* task) {
+  unique_ptr<UrlFetcher::Response> resp_deleter(CHECK_NOTNULL(resp));
+  unique_ptr<EntriesDecoder> decoder_deleter(CHECK_NOTNULL(decoder));
+  unique_ptr<util::Task> task_deleter(CHECK_NOTNULL(task));
+
+  if (!SanityCheck(resp, done, task)) {
+    return;
   }
 
-  entries->reserve(entries->size() + new_entries.size());
-  move(new_entries.begin(), new_entries.end(), back_inserter(*entries));
+  if (!decoder->Finish(entries)) {
+    return done(AsyncLogClient::BAD_RESPONSE);
+  }
 
   return done(AsyncLogClient::OK);
 }
@@ -381,6 +563,18 @@ AsyncLogClient::AsyncLogClient(util::Executor* const executor,
                                UrlFetcher* fetcher, const string& server_url)
     : executor_(CHECK_NOTNULL(executor)),
       fetcher_(CHECK_NOTNULL(fetcher)),
+      serializer_(nullptr),
+      server_url_(NormalizeURL(server_url)) {
+}
+
+
+AsyncLogClient::AsyncLogClient(util::Executor* const executor,
+                               UrlFetcher* fetcher,
+                               const LogSerializer* serializer,
+                               const string& server_url)
+    : executor_(CHECK_NOTNULL(executor)),
+      fetcher_(CHECK_NOTNULL(fetcher)),
+      serializer_(CHECK_NOTNULL(serializer)),
       server_url_(NormalizeURL(server_url)) {
 }
 
@@ -395,9 +589,13 @@ void AsyncLogClient::GetSTH(SignedTreeHead* sth, const Callback& done) {
 
 void AsyncLogClient::GetRoots(vector<unique_ptr<Cert>>* roots,
                               const Callback& done) {
+  UrlFetcher::Request req(GetURL("get-roots"));
+  // The roots can add up to a large response, parse it from the
+  // received buffer rather than from a copy.
+  req.buffer_response_body = true;
   UrlFetcher::Response* const resp(new UrlFetcher::Response);
 
-  fetcher_->Fetch(GetURL("get-roots"), resp,
+  fetcher_->Fetch(req, resp,
                   new util::Task(bind(DoneGetRoots, resp, roots, done, _1),
                                  executor_));
 }
@@ -430,14 +628,24 @@ void AsyncLogClient::InternalGetEntries(int first, int last,
     return;
   }
 
-  URL url(GetURL("get-entries"));
-  url.SetQuery("start=" + to_string(first) + "&end=" + to_string(last) +
-               (request_scts ? "&include_scts=true" : ""));
+  UrlFetcher::Request req(GetURL("get-entries"));
+  req.url.SetQuery("start=" + to_string(first) + "&end=" + to_string(last) +
+                   (request_scts ? "&include_scts=true" : ""));
+  if (FLAGS_get_entries_binary) {
+    // Logs which do not support it will ignore this, and use JSON.
+    req.headers.insert(make_pair(
+        "Accept", string(kBinaryEntriesContentType) + ", application/json"));
+  }
 
+  // Responses can be large, so they are decoded as they arrive, rather
+  // than being kept around until they are complete.
   UrlFetcher::Response* const resp(new UrlFetcher::Response);
-  fetcher_->Fetch(url, resp,
-                  new util::Task(bind(DoneGetEntries, resp, entries, done, _1),
-                                 executor_));
+  EntriesDecoder* const decoder(new EntriesDecoder(
+      serializer_ ? *serializer_ : Serializer::Configured(), resp));
+  fetcher_->FetchStreaming(
+      req, resp, bind(&EntriesDecoder::Append, decoder, _1),
+      new util::Task(bind(DoneGetEntries, resp, decoder, entries, done, _1),
+                     executor_));
 }
 
 
@@ -1,6 +1,8 @@
 #ifndef CERT_TRANS_CLIENT_ASYNC_LOG_CLIENT_H_
 #define CERT_TRANS_CLIENT_ASYNC_LOG_CLIENT_H_
 
+#include <glog/logging.h>
+#include <google/protobuf/arena.h>
 #include <stdint.h>
 #include <functional>
 #include <memory>
@@ -11,6 +13,12 @@
 #include "net/url_fetcher.h"
 #include "proto/ct.pb.h"
 
+#if __cplusplus >= 202002L
+#include "util/coro.h"
+#endif
+
+class LogSerializer;
+
 namespace util {
 class Executor;
 }  // namespace util
@@ -32,15 +40,31 @@ class AsyncLogClient {
     INVALID_INPUT,
   };
 
+  // An entry returned by get-entries. Its messages are allocated on
+  // |arena|, which is shared by all the entries parsed from the same
+  // response, so that they are freed in one go once the last of them is
+  // destroyed.
   struct Entry {
-    Entry() = default;
-    Entry(Entry&& src)
-        : leaf(src.leaf), entry(src.entry), sct(std::move(src.sct)) {
+    // Allocates the messages on a new arena of their own.
+    Entry() : Entry(std::make_shared<google::protobuf::Arena>()) {
     }
-
-    ct::MerkleTreeLeaf leaf;
-    ct::LogEntry entry;
-    std::unique_ptr<ct::SignedCertificateTimestamp> sct;
+    explicit Entry(const std::shared_ptr<google::protobuf::Arena>& arena)
+        : arena(arena),
+          leaf(google::protobuf::Arena::CreateMessage<ct::MerkleTreeLeaf>(
+              CHECK_NOTNULL(arena.get()))),
+          entry(google::protobuf::Arena::CreateMessage<ct::LogEntry>(
+              arena.get())),
+          sct(nullptr) {
+    }
+    Entry(Entry&& src) = default;
+    Entry& operator=(Entry&& src) = default;
+
+    // Declared first, so that it is destroyed last.
+    std::shared_ptr<google::protobuf::Arena> arena;
+    ct::MerkleTreeLeaf* leaf;
+    ct::LogEntry* entry;
+    // Only set by GetEntriesAndSCTs(), null otherwise.
+    ct::SignedCertificateTimestamp* sct;
   };
 
   typedef std::function<void(Status)> Callback;
@@ -52,6 +76,11 @@ class AsyncLogClient {
   // instead of a string?
   AsyncLogClient(util::Executor* const executor, UrlFetcher* fetcher,
                  const std::string& server_uri);
+  // Decodes the Merkle tree leaves of the log with |serializer|, rather
+  // than with Serializer::Configured(). It must outlive this object.
+  AsyncLogClient(util::Executor* const executor, UrlFetcher* fetcher,
+                 const LogSerializer* serializer,
+                 const std::string& server_uri);
   AsyncLogClient(const AsyncLogClient&) = delete;
   AsyncLogClient& operator=(const AsyncLogClient&) = delete;
 
@@ -90,6 +119,68 @@ class AsyncLogClient {
                        ct::SignedCertificateTimestamp* sct,
                        const Callback& done);
 
+#if __cplusplus >= 202002L
+  // Versions of the methods above for coroutines (see util/coro.h),
+  // where co_await gives the status that would have been passed to the
+  // callback. The output arguments must stay valid until then.
+  auto GetSTH(ct::SignedTreeHead* sth) {
+    return util::AwaitCallback<Status>(
+        [this, sth](const Callback& done) { GetSTH(sth, done); });
+  }
+
+  auto GetRoots(std::vector<std::unique_ptr<Cert>>* roots) {
+    return util::AwaitCallback<Status>(
+        [this, roots](const Callback& done) { GetRoots(roots, done); });
+  }
+
+  auto GetEntries(int first, int last, std::vector<Entry>* entries) {
+    return util::AwaitCallback<Status>(
+        [this, first, last, entries](const Callback& done) {
+          GetEntries(first, last, entries, done);
+        });
+  }
+
+  auto GetEntriesAndSCTs(int first, int last, std::vector<Entry>* entries) {
+    return util::AwaitCallback<Status>(
+        [this, first, last, entries](const Callback& done) {
+          GetEntriesAndSCTs(first, last, entries, done);
+        });
+  }
+
+  auto QueryInclusionProof(const ct::SignedTreeHead& sth,
+                           const std::string& merkle_leaf_hash,
+                           ct::MerkleAuditProof* proof) {
+    return util::AwaitCallback<Status>(
+        [this, &sth, &merkle_leaf_hash, proof](const Callback& done) {
+          QueryInclusionProof(sth, merkle_leaf_hash, proof, done);
+        });
+  }
+
+  auto GetSTHConsistency(int64_t first, int64_t second,
+                         std::vector<std::string>* proof) {
+    return util::AwaitCallback<Status>(
+        [this, first, second, proof](const Callback& done) {
+          GetSTHConsistency(first, second, proof, done);
+        });
+  }
+
+  auto AddCertChain(const CertChain& cert_chain,
+                    ct::SignedCertificateTimestamp* sct) {
+    return util::AwaitCallback<Status>(
+        [this, &cert_chain, sct](const Callback& done) {
+          AddCertChain(cert_chain, sct, done);
+        });
+  }
+
+  auto AddPreCertChain(const PreCertChain& pre_cert_chain,
+                       ct::SignedCertificateTimestamp* sct) {
+    return util::AwaitCallback<Status>(
+        [this, &pre_cert_chain, sct](const Callback& done) {
+          AddPreCertChain(pre_cert_chain, sct, done);
+        });
+  }
+#endif
+
  private:
   URL GetURL(const std::string& subpath) const;
 
@@ -102,6 +193,8 @@ class AsyncLogClient {
 
   util::Executor* const executor_;
   UrlFetcher* const fetcher_;
+  // Null when using Serializer::Configured().
+  const LogSerializer* const serializer_;
   const URL server_url_;
 };
 
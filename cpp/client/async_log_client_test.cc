@@ -0,0 +1,165 @@
+#include "client/async_log_client.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/notification.h"
+#include "net/mock_url_fetcher.h"
+#include "proto/cert_serializer.h"
+#include "util/testing.h"
+#include "util/thread_pool.h"
+#include "util/util.h"
+
+namespace cert_trans {
+namespace {
+
+using std::make_pair;
+using std::string;
+using std::vector;
+using testing::Invoke;
+using testing::_;
+using util::ToBase64;
+
+
+class AsyncLogClientTest : public ::testing::Test {
+ protected:
+  AsyncLogClientTest() : client_(&pool_, &fetcher_, "http://example.com") {
+  }
+
+  // Runs GetEntries() against a response sent in |pieces|, and returns
+  // the status it gives.
+  AsyncLogClient::Status GetEntries(const string& content_type,
+                                    const vector<string>& pieces,
+                                    vector<AsyncLogClient::Entry>* entries) {
+    EXPECT_CALL(fetcher_, FetchStreaming(_, _, _, _))
+        .WillOnce(Invoke([&content_type, &pieces](
+            const UrlFetcher::Request& req, UrlFetcher::Response* resp,
+            const UrlFetcher::BodyCallback& body_cb, util::Task* task) {
+          resp->status_code = 200;
+          // Header names are not case sensitive.
+          resp->headers.insert(make_pair("content-type", content_type));
+          for (const string& piece : pieces) {
+            // The client keeps taking the body, even once it knows that
+            // it is bad.
+            EXPECT_TRUE(body_cb(piece));
+          }
+          task->Return();
+        }));
+
+    Notification done;
+    AsyncLogClient::Status status(AsyncLogClient::UNKNOWN_ERROR);
+    client_.GetEntries(0, 0, entries,
+                       [&done, &status](AsyncLogClient::Status s) {
+                         status = s;
+                         done.Notify();
+                       });
+    done.WaitForNotification();
+    return status;
+  }
+
+  // A valid get-entries result, as the leaf input and extra data.
+  static void MakeEntry(string* leaf_input, string* extra_data) {
+    CHECK_EQ(cert_trans::serialization::SerializeResult::OK,
+             SerializeV1CertSCTMerkleTreeLeaf(1234, "cert", "", leaf_input));
+    CHECK_EQ(cert_trans::serialization::SerializeResult::OK,
+             SerializeX509ChainV1(repeated_string(), extra_data));
+  }
+
+  ThreadPool pool_;
+  MockUrlFetcher fetcher_;
+  AsyncLogClient client_;
+};
+
+
+TEST_F(AsyncLogClientTest, GetEntriesJson) {
+  string leaf_input, extra_data;
+  MakeEntry(&leaf_input, &extra_data);
+  const string body("{\"entries\": [{\"leaf_input\": \"" +
+                    ToBase64(leaf_input) + "\", \"extra_data\": \"" +
+                    ToBase64(extra_data) + "\"}]}");
+
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::OK,
+            GetEntries("application/json",
+                       {body.substr(0, 10), body.substr(10)}, &entries));
+  ASSERT_EQ(1U, entries.size());
+  EXPECT_EQ(1234U, entries[0].leaf->timestamped_entry().timestamp());
+}
+
+
+TEST_F(AsyncLogClientTest, GetEntriesBinary) {
+  string leaf_input, extra_data, body;
+  MakeEntry(&leaf_input, &extra_data);
+  ASSERT_EQ(cert_trans::serialization::SerializeResult::OK,
+            WriteBinaryEntry(leaf_input, extra_data, "", &body));
+
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::OK,
+            GetEntries(kBinaryEntriesContentType,
+                       {body.substr(0, 5), body.substr(5)}, &entries));
+  ASSERT_EQ(1U, entries.size());
+  EXPECT_EQ(1234U, entries[0].leaf->timestamped_entry().timestamp());
+}
+
+
+TEST_F(AsyncLogClientTest, GetEntriesBinaryContentTypeCase) {
+  string leaf_input, extra_data, body;
+  MakeEntry(&leaf_input, &extra_data);
+  ASSERT_EQ(cert_trans::serialization::SerializeResult::OK,
+            WriteBinaryEntry(leaf_input, extra_data, "", &body));
+
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::OK,
+            GetEntries("Application/X-CT-Entries; foo=bar", {body},
+                       &entries));
+  ASSERT_EQ(1U, entries.size());
+  EXPECT_EQ(1234U, entries[0].leaf->timestamped_entry().timestamp());
+}
+
+
+TEST_F(AsyncLogClientTest, GetEntriesOtherContentType) {
+  string leaf_input, extra_data, body;
+  MakeEntry(&leaf_input, &extra_data);
+  ASSERT_EQ(cert_trans::serialization::SerializeResult::OK,
+            WriteBinaryEntry(leaf_input, extra_data, "", &body));
+
+  // Taken for JSON.
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::BAD_RESPONSE,
+            GetEntries(string(kBinaryEntriesContentType) + "-v2", {body},
+                       &entries));
+  EXPECT_TRUE(entries.empty());
+}
+
+
+TEST_F(AsyncLogClientTest, GetEntriesMalformedJson) {
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::BAD_RESPONSE,
+            GetEntries("application/json", {"{\"entries\": ]", "}"},
+                       &entries));
+  EXPECT_TRUE(entries.empty());
+}
+
+
+TEST_F(AsyncLogClientTest, GetEntriesMalformedBinary) {
+  // An empty leaf_input is not allowed.
+  vector<AsyncLogClient::Entry> entries;
+  EXPECT_EQ(AsyncLogClient::BAD_RESPONSE,
+            GetEntries(kBinaryEntriesContentType,
+                       {string("\0\0\0\0\0\0\0\0", 8), "more"}, &entries));
+  EXPECT_TRUE(entries.empty());
+}
+
+
+}  // namespace
+}  // namespace cert_trans
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  ConfigureSerializerForV1CT();
+  return RUN_ALL_TESTS();
+}
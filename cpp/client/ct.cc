@@ -115,6 +115,7 @@ using cert_trans::AsyncLogClient;
 using cert_trans::Cert;
 using cert_trans::CertChain;
 using cert_trans::CertSubmissionHandler;
+using cert_trans::DerTbsCertificate;
 using cert_trans::HTTPLogClient;
 using cert_trans::PreCertChain;
 using cert_trans::ReadPublicKey;
@@ -126,7 +127,6 @@ using cert_trans::ScopedEVP_PKEY;
 using cert_trans::ScopedRSA;
 using cert_trans::ScopedX509;
 using cert_trans::ScopedX509_NAME;
-using cert_trans::TbsCertificate;
 using cert_trans::serialization::SerializeResult;
 using cert_trans::serialization::DeserializeResult;
 using ct::LogEntry;
@@ -203,7 +203,7 @@ static bool PrecertChainToEntry(const cert_trans::PreCertChain& chain,
   entry->mutable_precert_entry()->mutable_pre_cert()->set_issuer_key_hash(
       key_hash);
 
-  TbsCertificate tbs(*chain.LeafCert());
+  DerTbsCertificate tbs(*chain.LeafCert());
   if (!tbs.IsLoaded()) {
     LOG(ERROR) << "Failed to get TbsCertificate.";
     return false;
@@ -631,17 +631,17 @@ static void DiagnoseCertChain() {
   LOG(INFO) << "Embedded SCT extension length is " << serialized_scts.length()
             << " bytes";
 
-  SignedCertificateTimestampList sct_list;
-  if (Deserializer::DeserializeSCTList(serialized_scts, &sct_list) !=
-      DeserializeResult::OK) {
+  SCTListReader sct_list(serialized_scts);
+  if (sct_list.status() != DeserializeResult::OK) {
     LOG(ERROR) << "Failed to parse SCT list from certificate";
     return;
   }
 
-  LOG(INFO) << "Certificate has " << sct_list.sct_list_size() << " SCTs";
-  for (int i = 0; i < sct_list.sct_list_size(); ++i) {
+  LOG(INFO) << "Certificate has " << sct_list.size() << " SCTs";
+  util::StringView serialized_sct;
+  for (int i = 0; sct_list.Next(&serialized_sct); ++i) {
     SignedCertificateTimestamp sct;
-    if (Deserializer::DeserializeSCT(sct_list.sct_list(i), &sct) !=
+    if (Deserializer::DeserializeSCT(serialized_sct, &sct) !=
         DeserializeResult::OK) {
       LOG(ERROR) << "Failed to parse SCT number " << i + 1;
       continue;
@@ -748,21 +748,22 @@ void GetEntries() {
   for (vector<AsyncLogClient::Entry>::const_iterator
            entry = entries.ValueOrDie().begin();
        entry != entries.ValueOrDie().end(); ++entry, ++e) {
-    if (entry->leaf.timestamped_entry().entry_type() == ct::X509_ENTRY) {
-      WriteCertificate(entry->leaf.timestamped_entry().signed_entry().x509(),
+    if (entry->leaf->timestamped_entry().entry_type() == ct::X509_ENTRY) {
+      WriteCertificate(entry->leaf->timestamped_entry().signed_entry().x509(),
                        e, 0, "x509");
-      const ct::X509ChainEntry& x509chain = entry->entry.x509_entry();
+      const ct::X509ChainEntry& x509chain = entry->entry->x509_entry();
       for (int n = 0; n < x509chain.certificate_chain_size(); ++n)
         WriteCertificate(x509chain.certificate_chain(n), e, n + 1, "x509");
     } else {
-      CHECK_EQ(entry->leaf.timestamped_entry().entry_type(),
+      CHECK_EQ(entry->leaf->timestamped_entry().entry_type(),
                ct::PRECERT_ENTRY);
-      WriteCertificate(entry->leaf.timestamped_entry()
+      WriteCertificate(entry->leaf->timestamped_entry()
                            .signed_entry()
                            .precert()
                            .tbs_certificate(),
                        e, 0, "pre");
-      const ct::PrecertChainEntry& precertchain = entry->entry.precert_entry();
+      const ct::PrecertChainEntry& precertchain =
+          entry->entry->precert_entry();
       for (int n = 0; n < precertchain.precertificate_chain_size(); ++n)
         WriteCertificate(precertchain.precertificate_chain(n), e, n + 1,
                          "x509");
@@ -17,7 +17,6 @@ using cert_trans::serialization::DeserializeResult;
 using ct::LogEntry;
 using ct::SSLClientCTData;
 using ct::SignedCertificateTimestamp;
-using ct::SignedCertificateTimestampList;
 using std::string;
 using std::unique_ptr;
 using util::StatusOr;
@@ -61,7 +60,7 @@ int SSLClient::ExtensionCallback(SSL*, unsigned ext_type,
   CHECK_NOTNULL(args);
 
   CHECK(args->ct_extension.empty());
-  args->ct_extension = string(reinterpret_cast<const char*>(in), inlen);
+  args->ct_extension.assign(reinterpret_cast<const char*>(in), inlen);
 
   return 1;
 }
@@ -127,7 +126,7 @@ void SSLClient::GetSSLClientCTData(SSLClientCTData* data) const {
 // proof is re-submitted (or submitted to another log) and the server attaches
 // that proof too, but let's not complicate things for now.
 // static
-LogVerifier::LogVerifyResult SSLClient::VerifySCT(const string& token,
+LogVerifier::LogVerifyResult SSLClient::VerifySCT(util::StringView token,
                                                   LogVerifier* verifier,
                                                   SSLClientCTData* data) {
   CHECK(data->has_reconstructed_entry());
@@ -241,15 +240,15 @@ int SSLClient::VerifyCallback(X509_STORE_CTX* ctx, void* arg) {
       // Only writes the checkpoint if verification succeeds.
       // Note: an optimized client could only verify the signature if it's
       // a certificate it hasn't seen before.
-      SignedCertificateTimestampList sct_list;
-      if (Deserializer::DeserializeSCTList(serialized_scts, &sct_list) !=
-          DeserializeResult::OK) {
+      SCTListReader sct_list(serialized_scts);
+      if (sct_list.status() != DeserializeResult::OK) {
         LOG(ERROR) << "Failed to parse SCT list.";
       } else {
-        LOG(INFO) << "Received " << sct_list.sct_list_size() << " SCTs";
-        for (int i = 0; i < sct_list.sct_list_size(); ++i) {
+        LOG(INFO) << "Received " << sct_list.size() << " SCTs";
+        util::StringView sct;
+        for (int i = 0; sct_list.Next(&sct); ++i) {
           LogVerifier::LogVerifyResult result =
-              VerifySCT(sct_list.sct_list(i), verifier, &args->ct_data);
+              VerifySCT(sct, verifier, &args->ct_data);
 
           if (result == LogVerifier::VERIFY_OK) {
             LOG(INFO) << "SCT number " << i + 1 << " verified";
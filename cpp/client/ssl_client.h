@@ -9,6 +9,7 @@
 #include "log/log_verifier.h"
 #include "proto/ct.pb.h"
 #include "util/openssl_scoped_ssl_types.h"
+#include "util/string_view.h"
 
 class LogVerifier;
 
@@ -49,7 +50,7 @@ class SSLClient {
   void GetSSLClientCTData(ct::SSLClientCTData* data) const;
 
   // Need a static wrapper for the callback.
-  static LogVerifier::LogVerifyResult VerifySCT(const std::string& token,
+  static LogVerifier::LogVerifyResult VerifySCT(util::StringView token,
                                                 LogVerifier* verifier,
                                                 ct::SSLClientCTData* data);
 
@@ -15,6 +15,7 @@
 #include <openssl/pem.h>
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
+#include <stdint.h>
 #include <time.h>
 #include <algorithm>
 #include <memory>
@@ -1111,6 +1112,408 @@ StatusOr<int> TbsCertificate::ExtensionIndex(int extension_nid) const {
 }
 
 
+namespace {
+
+
+const uint8_t kDerBooleanTag = 0x01;
+const uint8_t kDerOctetStringTag = 0x04;
+const uint8_t kDerObjectIdentifierTag = 0x06;
+const uint8_t kDerSequenceTag = 0x30;
+// TBSCertificate.version, [0] EXPLICIT.
+const uint8_t kTbsVersionTag = 0xa0;
+// TBSCertificate.extensions, [3] EXPLICIT.
+const uint8_t kTbsExtensionsTag = 0xa3;
+
+
+// A single DER element (TLV) within a larger encoding.
+struct DerElement {
+  size_t content_offset() const {
+    return offset + header_length;
+  }
+
+  size_t end() const {
+    return content_offset() + content_length;
+  }
+
+  uint8_t tag;
+  size_t offset;
+  size_t header_length;
+  size_t content_length;
+};
+
+
+// Reads the header of the element starting at |offset|, which must end no
+// later than |limit|. Only low tag numbers and definite, minimal length
+// encodings are accepted, which covers everything DER allows in a
+// TBSCertificate.
+bool ReadDerElement(const string& der, size_t offset, size_t limit,
+                    DerElement* element) {
+  if (limit > der.size() || offset >= limit || limit - offset < 2) {
+    return false;
+  }
+
+  const uint8_t tag(der[offset]);
+  if ((tag & 0x1f) == 0x1f) {
+    return false;
+  }
+
+  const uint8_t first_length_byte(der[offset + 1]);
+  size_t header_length(2);
+  size_t content_length(first_length_byte);
+  if (first_length_byte & 0x80) {
+    const size_t length_bytes(first_length_byte & 0x7f);
+    if (length_bytes == 0 || length_bytes > sizeof(uint32_t) ||
+        limit - offset - header_length < length_bytes) {
+      return false;
+    }
+    content_length = 0;
+    for (size_t i = 0; i < length_bytes; ++i) {
+      content_length = (content_length << 8) |
+                       static_cast<uint8_t>(der[offset + header_length + i]);
+    }
+    // Long form must only be used when necessary, and without leading zeros.
+    if (content_length < 0x80 ||
+        (content_length >> (8 * (length_bytes - 1))) == 0) {
+      return false;
+    }
+    header_length += length_bytes;
+  }
+
+  if (limit - offset - header_length < content_length) {
+    return false;
+  }
+
+  element->tag = tag;
+  element->offset = offset;
+  element->header_length = header_length;
+  element->content_length = content_length;
+  return true;
+}
+
+
+void AppendDerLength(size_t length, string* output) {
+  if (length < 0x80) {
+    output->push_back(static_cast<char>(length));
+    return;
+  }
+
+  size_t length_bytes(0);
+  for (size_t l = length; l > 0; l >>= 8) {
+    ++length_bytes;
+  }
+  output->push_back(static_cast<char>(0x80 | length_bytes));
+  for (size_t i = length_bytes; i > 0; --i) {
+    output->push_back(static_cast<char>((length >> (8 * (i - 1))) & 0xff));
+  }
+}
+
+
+// Replaces the bytes in [begin, end) of |der| with |replacement|, and
+// rewrites the headers of the |enclosing| elements to account for the change
+// in length. |enclosing| must be ordered from the outermost element to the
+// innermost one, and they must all contain [begin, end).
+void SpliceDer(const vector<DerElement>& enclosing, size_t begin, size_t end,
+               const string& replacement, string* der) {
+  der->replace(begin, end - begin, replacement);
+
+  // Headers of enclosing elements all come before |begin|, so rewriting
+  // them innermost-first never moves a header we still have to rewrite.
+  int64_t delta(static_cast<int64_t>(replacement.size()) -
+                static_cast<int64_t>(end - begin));
+  for (auto it = enclosing.rbegin(); it != enclosing.rend(); ++it) {
+    string header(1, static_cast<char>(it->tag));
+    AppendDerLength(it->content_length + delta, &header);
+    der->replace(it->offset, it->header_length, header);
+    delta += static_cast<int64_t>(header.size()) -
+             static_cast<int64_t>(it->header_length);
+  }
+}
+
+
+// Locates the fields of a DER-encoded TBSCertificate which DerTbsCertificate
+// needs to modify.
+struct TbsLayout {
+  DerElement tbs;
+  DerElement issuer;
+  bool has_extensions;
+  // The [3] EXPLICIT wrapper, and the SEQUENCE OF Extension within it.
+  DerElement extensions_wrapper;
+  DerElement extensions;
+};
+
+
+bool ParseTbs(const string& der, TbsLayout* layout) {
+  if (!ReadDerElement(der, 0, der.size(), &layout->tbs) ||
+      layout->tbs.tag != kDerSequenceTag || layout->tbs.end() != der.size()) {
+    return false;
+  }
+
+  // version (optional), serialNumber, signature, issuer, validity, subject,
+  // subjectPublicKeyInfo, and then the optional unique IDs and extensions.
+  const size_t end(layout->tbs.end());
+  size_t offset(layout->tbs.content_offset());
+  DerElement element;
+  if (!ReadDerElement(der, offset, end, &element)) {
+    return false;
+  }
+  if (element.tag == kTbsVersionTag) {
+    offset = element.end();
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (!ReadDerElement(der, offset, end, &element)) {
+      return false;
+    }
+    offset = element.end();
+  }
+  if (element.tag != kDerSequenceTag) {
+    return false;
+  }
+  layout->issuer = element;
+
+  layout->has_extensions = false;
+  while (offset < end) {
+    if (!ReadDerElement(der, offset, end, &element)) {
+      return false;
+    }
+    if (element.tag == kTbsExtensionsTag) {
+      layout->has_extensions = true;
+      layout->extensions_wrapper = element;
+      return ReadDerElement(der, element.content_offset(), element.end(),
+                            &layout->extensions) &&
+             layout->extensions.tag == kDerSequenceTag &&
+             layout->extensions.end() == element.end();
+    }
+    offset = element.end();
+  }
+
+  return true;
+}
+
+
+// Finds the first extension with the given DER-encoded |oid| in
+// |layout->extensions|, starting the search at |offset|. On success, sets
+// |extension| to the Extension SEQUENCE and |value| to its extnValue
+// OCTET STRING.
+util::Status FindExtension(const string& der, const TbsLayout& layout,
+                           const string& oid, size_t offset,
+                           DerElement* extension, DerElement* value) {
+  if (!layout.has_extensions) {
+    return util::Status(Code::NOT_FOUND, "Extension not found.");
+  }
+
+  const size_t end(layout.extensions.end());
+  for (; offset < end; offset = extension->end()) {
+    DerElement extn_id;
+    if (!ReadDerElement(der, offset, end, extension) ||
+        extension->tag != kDerSequenceTag ||
+        !ReadDerElement(der, extension->content_offset(), extension->end(),
+                        &extn_id) ||
+        extn_id.tag != kDerObjectIdentifierTag) {
+      return util::Status(Code::INVALID_ARGUMENT, "Malformed extension");
+    }
+    if (der.compare(extn_id.content_offset(), extn_id.content_length, oid) !=
+        0) {
+      continue;
+    }
+
+    // Skip the critical flag, if present.
+    if (!ReadDerElement(der, extn_id.end(), extension->end(), value)) {
+      return util::Status(Code::INVALID_ARGUMENT, "Malformed extension");
+    }
+    if (value->tag == kDerBooleanTag &&
+        !ReadDerElement(der, value->end(), extension->end(), value)) {
+      return util::Status(Code::INVALID_ARGUMENT, "Malformed extension");
+    }
+    if (value->tag != kDerOctetStringTag || value->end() != extension->end()) {
+      return util::Status(Code::INVALID_ARGUMENT, "Malformed extension");
+    }
+    return ::util::OkStatus();
+  }
+
+  return util::Status(Code::NOT_FOUND, "Extension not found.");
+}
+
+
+util::Status ExtensionOid(int extension_nid, string* oid) {
+  const ASN1_OBJECT* const obj(OBJ_nid2obj(extension_nid));
+  if (!obj || OBJ_length(obj) == 0) {
+    LOG(ERROR) << "OpenSSL OBJ_nid2obj returned NULL for NID "
+               << extension_nid << ". Is the NID not recognised?";
+    LOG_OPENSSL_ERRORS(ERROR);
+    return util::Status(Code::INTERNAL,
+                        "Extension lookup failed. Incorrect NID?");
+  }
+  oid->assign(reinterpret_cast<const char*>(OBJ_get0_data(obj)),
+              OBJ_length(obj));
+  return ::util::OkStatus();
+}
+
+
+}  // namespace
+
+
+DerTbsCertificate::DerTbsCertificate(const Cert& cert) {
+  string der_cert;
+  if (!cert.DerEncoding(&der_cert).ok()) {
+    return;
+  }
+
+  DerElement certificate, tbs;
+  if (!ReadDerElement(der_cert, 0, der_cert.size(), &certificate) ||
+      certificate.tag != kDerSequenceTag ||
+      !ReadDerElement(der_cert, certificate.content_offset(),
+                      certificate.end(), &tbs)) {
+    LOG(WARNING) << "Failed to locate the TBS component";
+    return;
+  }
+
+  // Trim in place rather than copying out the TBS.
+  der_cert.erase(tbs.end());
+  der_cert.erase(0, tbs.offset);
+
+  TbsLayout layout;
+  if (!ParseTbs(der_cert, &layout)) {
+    LOG(WARNING) << "Failed to parse the TBS component";
+    return;
+  }
+
+  der_.swap(der_cert);
+}
+
+
+util::Status DerTbsCertificate::DerEncoding(string* result) const {
+  if (!IsLoaded()) {
+    LOG(ERROR) << "TBS not loaded";
+    return util::Status(Code::FAILED_PRECONDITION, "Cert not loaded (TBS)");
+  }
+
+  result->assign(der_);
+  return ::util::OkStatus();
+}
+
+
+util::Status DerTbsCertificate::DeleteExtension(int extension_nid) {
+  if (!IsLoaded()) {
+    LOG(ERROR) << "TBS not loaded";
+    return util::Status(Code::FAILED_PRECONDITION, "Cert not loaded (TBS)");
+  }
+
+  string oid;
+  util::Status status(ExtensionOid(extension_nid, &oid));
+  if (!status.ok()) {
+    return status;
+  }
+
+  TbsLayout layout;
+  CHECK(ParseTbs(der_, &layout));
+
+  DerElement extension, value;
+  // If the extension doesn't exist then there is nothing to do and this
+  // propagates the NOT_FOUND status.
+  status = FindExtension(der_, layout, oid, layout.extensions.content_offset(),
+                         &extension, &value);
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Like TbsCertificate, delete the first occurrence but report duplicates.
+  DerElement duplicate;
+  const util::Status duplicate_status(
+      FindExtension(der_, layout, oid, extension.end(), &duplicate, &value));
+  if (!duplicate_status.ok() &&
+      duplicate_status.CanonicalCode() != Code::NOT_FOUND) {
+    return duplicate_status;
+  }
+
+  SpliceDer({layout.tbs, layout.extensions_wrapper, layout.extensions},
+            extension.offset, extension.end(), string(), &der_);
+
+  if (duplicate_status.ok()) {
+    LOG(WARNING)
+        << "Failed to delete the extension. Does the certificate have "
+        << "duplicate extensions?";
+    return util::Status(Code::ALREADY_EXISTS, "Multiple extensions in cert");
+  }
+
+  return ::util::OkStatus();
+}
+
+
+util::Status DerTbsCertificate::CopyIssuerFrom(const Cert& from) {
+  if (!IsLoaded()) {
+    LOG(ERROR) << "TBS not loaded";
+    return util::Status(Code::FAILED_PRECONDITION, "Cert not loaded (TBS)");
+  }
+
+  const DerTbsCertificate from_tbs(from);
+  if (!from_tbs.IsLoaded()) {
+    LOG(WARNING) << "Failed to parse the issuer certificate";
+    return util::Status(Code::FAILED_PRECONDITION,
+                        "Cert not loaded (issuer TBS)");
+  }
+
+  TbsLayout from_layout;
+  CHECK(ParseTbs(from_tbs.der_, &from_layout));
+
+  TbsLayout layout;
+  CHECK(ParseTbs(der_, &layout));
+  SpliceDer({layout.tbs}, layout.issuer.offset, layout.issuer.end(),
+            from_tbs.der_.substr(from_layout.issuer.offset,
+                                 from_layout.issuer.end() -
+                                     from_layout.issuer.offset),
+            &der_);
+
+  // Verify that the Authority KeyID extensions are compatible.
+  string oid;
+  util::Status status(ExtensionOid(NID_authority_key_identifier, &oid));
+  if (!status.ok()) {
+    return status;
+  }
+
+  CHECK(ParseTbs(der_, &layout));
+  DerElement extension, value;
+  status = FindExtension(der_, layout, oid, layout.extensions.content_offset(),
+                         &extension, &value);
+  if (status.CanonicalCode() == Code::NOT_FOUND) {
+    // No extension found = nothing to copy
+    return ::util::OkStatus();
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to check Authority Key Identifier extension";
+    return util::Status(Code::INTERNAL,
+                        "Failed to check Authority KeyID extension (TBS)");
+  }
+
+  DerElement from_extension, from_value;
+  status = FindExtension(from_tbs.der_, from_layout, oid,
+                         from_layout.extensions.content_offset(),
+                         &from_extension, &from_value);
+  if (status.CanonicalCode() == Code::NOT_FOUND) {
+    // No extension found = cannot copy.
+    LOG(WARNING) << "Unable to copy issuer: destination has an Authority "
+                 << "KeyID extension, but the source has none.";
+    return util::Status(Code::FAILED_PRECONDITION,
+                        "Incompatible Authority KeyID extensions");
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to check Authority Key Identifier extension";
+    return util::Status(Code::INTERNAL,
+                        "Failed to check Authority KeyID extension");
+  }
+
+  // Replace the extnValue only, keeping the critical bit (which should
+  // always be false in a valid cert, mind you).
+  SpliceDer({layout.tbs, layout.extensions_wrapper, layout.extensions,
+             extension},
+            value.offset, value.end(),
+            from_tbs.der_.substr(from_value.offset,
+                                 from_value.end() - from_value.offset),
+            &der_);
+
+  return ::util::OkStatus();
+}
+
+
 CertChain::CertChain(const string& pem_string) {
   // A read-only BIO.
   ScopedBIO bio_in(BIO_new_mem_buf(const_cast<char*>(pem_string.data()),
@@ -261,6 +261,39 @@ class TbsCertificate {
 };
 
 
+// Like TbsCertificate, but works directly on the DER encoding of the
+// certificate: extensions and the issuer are dropped or replaced by splicing
+// the relevant TLV ranges and fixing up the enclosing lengths, instead of
+// round-tripping the whole structure through OpenSSL. Only definite,
+// minimally encoded lengths are accepted.
+class DerTbsCertificate {
+ public:
+  explicit DerTbsCertificate(const Cert& cert);
+  DerTbsCertificate(const DerTbsCertificate&) = delete;
+  DerTbsCertificate& operator=(const DerTbsCertificate&) = delete;
+
+  // False if the certificate could not be encoded, or its TBS component
+  // could not be parsed.
+  bool IsLoaded() const {
+    return !der_.empty();
+  }
+
+  // Sets the DER-encoded TBS structure in |result|.
+  // Returns OK if the encoding succeeded.
+  // Returns FAILED_PRECONDITION if the cert is not loaded.
+  util::Status DerEncoding(std::string* result) const;
+
+  // Same contract as TbsCertificate::DeleteExtension().
+  util::Status DeleteExtension(int extension_nid);
+
+  // Same contract as TbsCertificate::CopyIssuerFrom().
+  util::Status CopyIssuerFrom(const Cert& from);
+
+ private:
+  std::string der_;
+};
+
+
 class CertChain {
  public:
   CertChain() = default;
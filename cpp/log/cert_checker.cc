@@ -216,8 +216,9 @@ Status CertChecker::CheckPreCertChain(PreCertChain* chain,
                  ::util::OkStatus()) {
     return Status(util::error::INTERNAL, "internal error");
   }
-  // A well-formed chain always has a precert.
-  TbsCertificate tbs(*chain->PreCert());
+  // A well-formed chain always has a precert. Splice the TBS straight out of
+  // the precert's encoding rather than re-encoding it.
+  DerTbsCertificate tbs(*chain->PreCert());
   if (!tbs.IsLoaded() || !tbs.DeleteExtension(NID_ct_precert_poison).ok()) {
     return Status(util::error::INTERNAL, "internal error");
   }
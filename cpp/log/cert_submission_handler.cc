@@ -6,16 +6,18 @@
 #include "log/cert.h"
 #include "log/cert_checker.h"
 #include "log/ct_extensions.h"
+#include "merkletree/serial_hasher.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 
 using cert_trans::Cert;
 using cert_trans::CertChain;
 using cert_trans::CertChecker;
+using cert_trans::DerTbsCertificate;
 using cert_trans::PreCertChain;
-using cert_trans::TbsCertificate;
 using ct::LogEntry;
 using ct::PrecertChainEntry;
+using ct::SignedCertificateTimestamp;
 using ct::X509ChainEntry;
 using std::string;
 using util::Status;
@@ -33,7 +35,7 @@ bool SerializedTbs(const Cert& cert, string* result) {
   }
 
   // Delete the embedded proof.
-  TbsCertificate tbs(cert);
+  DerTbsCertificate tbs(cert);
   if (!tbs.IsLoaded()) {
     return false;
   }
@@ -53,16 +55,101 @@ bool SerializedTbs(const Cert& cert, string* result) {
 }
 
 
+// Same as LoggedEntry::Hash().
+string LeafHash(const LogEntry& entry) {
+  return Sha256Hasher::Sha256Digest(Serializer::LeafData(entry));
+}
+
+
+// Builds the entry CertChecker::CheckPreCertChain() would produce for
+// |chain|, but without checking anything beyond what is needed to build it.
+// This may fail for chains that would otherwise be accepted (for example if
+// the root has to be added from the trusted store), which is fine for a
+// cache lookup.
+bool UnverifiedPreCertEntry(const PreCertChain& chain, LogEntry* entry) {
+  if (chain.Length() < 2) {
+    return false;
+  }
+
+  const StatusOr<bool> uses_pre_issuer(chain.UsesPrecertSigningCertificate());
+  if (!uses_pre_issuer.ok()) {
+    return false;
+  }
+
+  const Cert* const issuer(
+      chain.CertAt(uses_pre_issuer.ValueOrDie() ? 2 : 1));
+  string key_hash;
+  if (!issuer || !issuer->SPKISha256Digest(&key_hash).ok()) {
+    return false;
+  }
+
+  DerTbsCertificate tbs(*chain.PreCert());
+  if (!tbs.IsLoaded() || !tbs.DeleteExtension(NID_ct_precert_poison).ok()) {
+    return false;
+  }
+  if (uses_pre_issuer.ValueOrDie() &&
+      !tbs.CopyIssuerFrom(*chain.PrecertIssuingCert()).ok()) {
+    return false;
+  }
+
+  entry->set_type(ct::PRECERT_ENTRY);
+  ct::PreCert* const pre_cert(
+      entry->mutable_precert_entry()->mutable_pre_cert());
+  pre_cert->set_issuer_key_hash(key_hash);
+  return tbs.DerEncoding(pre_cert->mutable_tbs_certificate()).ok();
+}
+
+
 }  // namespace
 
 
 // TODO(ekasper): handle Cert errors consistently and log some errors here
 // if they fail.
-CertSubmissionHandler::CertSubmissionHandler(const CertChecker* cert_checker)
-    : cert_checker_(cert_checker) {
+CertSubmissionHandler::CertSubmissionHandler(const CertChecker* cert_checker,
+                                             SCTCache* sct_cache)
+    : cert_checker_(cert_checker), sct_cache_(sct_cache) {
   CHECK(cert_checker != nullptr);
 }
 
+
+bool CertSubmissionHandler::LookupX509Submission(
+    const CertChain& chain, SignedCertificateTimestamp* sct) const {
+  if (!sct_cache_ || !chain.IsLoaded()) {
+    return false;
+  }
+
+  LogEntry entry;
+  entry.set_type(ct::X509_ENTRY);
+  if (!chain.LeafCert()
+           ->DerEncoding(
+               entry.mutable_x509_entry()->mutable_leaf_certificate())
+           .ok()) {
+    return false;
+  }
+
+  return sct_cache_->Lookup(LeafHash(entry), sct);
+}
+
+
+bool CertSubmissionHandler::LookupPreCertSubmission(
+    const PreCertChain& chain, SignedCertificateTimestamp* sct) const {
+  LogEntry entry;
+  if (!sct_cache_ || !chain.IsLoaded() ||
+      !UnverifiedPreCertEntry(chain, &entry)) {
+    return false;
+  }
+
+  return sct_cache_->Lookup(LeafHash(entry), sct);
+}
+
+
+void CertSubmissionHandler::RecordSubmission(
+    const LogEntry& entry, const SignedCertificateTimestamp& sct) const {
+  if (sct_cache_) {
+    sct_cache_->Insert(LeafHash(entry), sct);
+  }
+}
+
 // static
 bool CertSubmissionHandler::X509ChainToEntry(const CertChain& chain,
                                              LogEntry* entry) {
@@ -4,6 +4,7 @@
 #include <string>
 
 #include "log/cert_checker.h"
+#include "log/sct_cache.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 #include "util/status.h"
@@ -17,8 +18,10 @@ namespace cert_trans {
 // log entry structure.
 class CertSubmissionHandler {
  public:
-  // Does not take ownership of the cert_checker.
-  explicit CertSubmissionHandler(const cert_trans::CertChecker* cert_checker);
+  // Does not take ownership of the cert_checker or the sct_cache. If
+  // |sct_cache| is null, the duplicate submission fast path is disabled.
+  explicit CertSubmissionHandler(const cert_trans::CertChecker* cert_checker,
+                                 cert_trans::SCTCache* sct_cache = nullptr);
   CertSubmissionHandler(const CertSubmissionHandler&) = delete;
   CertSubmissionHandler& operator=(const CertSubmissionHandler&) = delete;
 
@@ -29,6 +32,22 @@ class CertSubmissionHandler {
   util::Status ProcessPreCertSubmission(cert_trans::PreCertChain* chain,
                                         ct::LogEntry* entry) const;
 
+  // Duplicate submission fast path, to be tried before the corresponding
+  // Process*Submission method. Builds the entry |chain| would produce,
+  // *without* validating the chain, and looks its leaf hash up in the SCT
+  // cache. If the leaf was logged before, sets |sct| to the SCT issued for
+  // it and returns true: the submission can then be answered without any
+  // signature verification or signing.
+  bool LookupX509Submission(const cert_trans::CertChain& chain,
+                            ct::SignedCertificateTimestamp* sct) const;
+  bool LookupPreCertSubmission(const cert_trans::PreCertChain& chain,
+                               ct::SignedCertificateTimestamp* sct) const;
+
+  // Records the SCT issued for a validated |entry|, so that resubmissions
+  // can take the fast path above.
+  void RecordSubmission(const ct::LogEntry& entry,
+                        const ct::SignedCertificateTimestamp& sct) const;
+
   // For clients, to reconstruct the bytestring under the signature
   // from the observed chain. Does not check whether the entry
   // has valid format (i.e., does not check length limits).
@@ -37,6 +56,7 @@ class CertSubmissionHandler {
 
  private:
   const cert_trans::CertChecker* const cert_checker_;
+  cert_trans::SCTCache* const sct_cache_;
 };
 
 
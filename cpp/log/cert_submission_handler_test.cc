@@ -8,6 +8,8 @@
 #include "log/cert_checker.h"
 #include "log/cert_submission_handler.h"
 #include "log/ct_extensions.h"
+#include "log/sct_cache.h"
+#include "proto/cert_serializer.h"
 #include "proto/ct.pb.h"
 #include "util/status_test_util.h"
 #include "util/testing.h"
@@ -37,7 +39,9 @@ using cert_trans::CertChain;
 using cert_trans::CertChecker;
 using cert_trans::CertSubmissionHandler;
 using cert_trans::PreCertChain;
+using cert_trans::SCTCache;
 using ct::LogEntry;
+using ct::SignedCertificateTimestamp;
 using std::string;
 using util::testing::StatusIs;
 
@@ -53,15 +57,18 @@ class CertSubmissionHandlerTest : public ::testing::Test {
   const string cert_dir_;
   CertSubmissionHandler* handler_;
   CertChecker* checker_;
+  SCTCache sct_cache_;
 
   CertSubmissionHandlerTest()
-      : cert_dir_(FLAGS_test_srcdir + "/test/testdata"), handler_(NULL) {
+      : cert_dir_(FLAGS_test_srcdir + "/test/testdata"),
+        handler_(NULL),
+        sct_cache_(100) {
   }
 
   void SetUp() {
     checker_ = new CertChecker();
     checker_->LoadTrustedCertificates(cert_dir_ + "/" + kCaCert);
-    handler_ = new CertSubmissionHandler(checker_);
+    handler_ = new CertSubmissionHandler(checker_, &sct_cache_);
     CHECK(util::ReadBinaryFile(cert_dir_ + "/" + kCaCert, &ca_))
         << "Could not read test data from " << cert_dir_
         << ". Wrong --test_srcdir?";
@@ -206,6 +213,76 @@ TEST_F(CertSubmissionHandlerTest, SubmitInvalidPreCertChain) {
   EXPECT_FALSE(handler_->ProcessPreCertSubmission(&submission, &entry).ok());
 }
 
+TEST_F(CertSubmissionHandlerTest, DuplicateCert) {
+  CertChain submission(leaf_);
+  SignedCertificateTimestamp sct;
+  EXPECT_FALSE(handler_->LookupX509Submission(submission, &sct));
+
+  LogEntry entry;
+  ASSERT_OK(handler_->ProcessX509Submission(&submission, &entry));
+  SignedCertificateTimestamp issued_sct;
+  issued_sct.set_timestamp(1234);
+  handler_->RecordSubmission(entry, issued_sct);
+
+  // The same leaf is found again, even with a different chain.
+  CertChain resubmission(leaf_ + ca_);
+  ASSERT_TRUE(handler_->LookupX509Submission(resubmission, &sct));
+  EXPECT_EQ(1234U, sct.timestamp());
+
+  CertChain other_submission(chain_leaf_ + intermediate_);
+  EXPECT_FALSE(handler_->LookupX509Submission(other_submission, &sct));
+}
+
+TEST_F(CertSubmissionHandlerTest, DuplicatePreCert) {
+  PreCertChain submission(precert_ + ca_);
+  SignedCertificateTimestamp sct;
+  EXPECT_FALSE(handler_->LookupPreCertSubmission(submission, &sct));
+
+  LogEntry entry;
+  ASSERT_OK(handler_->ProcessPreCertSubmission(&submission, &entry));
+  SignedCertificateTimestamp issued_sct;
+  issued_sct.set_timestamp(1234);
+  handler_->RecordSubmission(entry, issued_sct);
+
+  PreCertChain resubmission(precert_ + ca_);
+  ASSERT_TRUE(handler_->LookupPreCertSubmission(resubmission, &sct));
+  EXPECT_EQ(1234U, sct.timestamp());
+
+  // Not the same leaf as an X.509 submission.
+  CertChain x509_submission(precert_ + ca_);
+  EXPECT_FALSE(handler_->LookupX509Submission(x509_submission, &sct));
+}
+
+TEST_F(CertSubmissionHandlerTest, DuplicatePreCertUsingPreCA) {
+  PreCertChain submission(precert_with_preca_ + ca_precert_ + ca_);
+  LogEntry entry;
+  ASSERT_OK(handler_->ProcessPreCertSubmission(&submission, &entry));
+  SignedCertificateTimestamp issued_sct;
+  issued_sct.set_timestamp(1234);
+  handler_->RecordSubmission(entry, issued_sct);
+
+  PreCertChain resubmission(precert_with_preca_ + ca_precert_ + ca_);
+  SignedCertificateTimestamp sct;
+  ASSERT_TRUE(handler_->LookupPreCertSubmission(resubmission, &sct));
+  EXPECT_EQ(1234U, sct.timestamp());
+
+  // Without the root, the issuer key hash cannot be computed without
+  // validating the chain, so this takes the slow path.
+  PreCertChain partial_resubmission(precert_with_preca_ + ca_precert_);
+  EXPECT_FALSE(handler_->LookupPreCertSubmission(partial_resubmission, &sct));
+}
+
+TEST_F(CertSubmissionHandlerTest, NoCache) {
+  CertSubmissionHandler handler(checker_);
+  CertChain submission(leaf_);
+  LogEntry entry;
+  ASSERT_OK(handler.ProcessX509Submission(&submission, &entry));
+  handler.RecordSubmission(entry, SignedCertificateTimestamp());
+
+  SignedCertificateTimestamp sct;
+  EXPECT_FALSE(handler.LookupX509Submission(submission, &sct));
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -213,5 +290,6 @@ int main(int argc, char** argv) {
   OpenSSL_add_all_algorithms();
   ERR_load_crypto_strings();
   cert_trans::LoadCtExtensions();
+  ConfigureSerializerForV1CT();
   return RUN_ALL_TESTS();
 }
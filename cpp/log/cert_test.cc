@@ -15,6 +15,7 @@
 
 using cert_trans::Cert;
 using cert_trans::CertChain;
+using cert_trans::DerTbsCertificate;
 using cert_trans::PreCertChain;
 using cert_trans::TbsCertificate;
 using std::string;
@@ -345,6 +346,7 @@ class CertTest : public ::testing::Test {
 };
 
 class TbsCertificateTest : public CertTest {};
+class DerTbsCertificateTest : public CertTest {};
 class CertChainTest : public CertTest {};
 
 TEST_F(CertTest, LoadInvalid) {
@@ -621,6 +623,65 @@ TEST_F(TbsCertificateTest, CopyIssuer) {
   EXPECT_EQ(der_before2, der_after2);
 }
 
+TEST_F(DerTbsCertificateTest, DerEncoding) {
+  DerTbsCertificate tbs(*leaf_cert_);
+  ASSERT_TRUE(tbs.IsLoaded());
+
+  string cert_tbs_der, raw_tbs_der;
+  EXPECT_OK(leaf_cert_->DerEncodedTbsCertificate(&cert_tbs_der));
+  EXPECT_OK(tbs.DerEncoding(&raw_tbs_der));
+  EXPECT_EQ(cert_tbs_der, raw_tbs_der);
+}
+
+TEST_F(DerTbsCertificateTest, DeleteExtensionMatchesTbsCertificate) {
+  TbsCertificate tbs(*leaf_cert_);
+  DerTbsCertificate der_tbs(*leaf_cert_);
+  EXPECT_OK(tbs.DeleteExtension(NID_authority_key_identifier));
+  EXPECT_OK(der_tbs.DeleteExtension(NID_authority_key_identifier));
+  string expected, spliced;
+  EXPECT_OK(tbs.DerEncoding(&expected));
+  EXPECT_OK(der_tbs.DerEncoding(&spliced));
+  EXPECT_EQ(expected, spliced);
+
+  ASSERT_TRUE(precert_cert_->HasExtension(NID_ct_precert_poison).ValueOrDie());
+  TbsCertificate pre_tbs(*precert_cert_);
+  DerTbsCertificate der_pre_tbs(*precert_cert_);
+  EXPECT_OK(pre_tbs.DeleteExtension(NID_ct_precert_poison));
+  EXPECT_OK(der_pre_tbs.DeleteExtension(NID_ct_precert_poison));
+  EXPECT_OK(pre_tbs.DerEncoding(&expected));
+  EXPECT_OK(der_pre_tbs.DerEncoding(&spliced));
+  EXPECT_EQ(expected, spliced);
+}
+
+TEST_F(DerTbsCertificateTest, DeleteMissingExtension) {
+  ASSERT_FALSE(leaf_cert_->HasExtension(NID_ct_precert_poison).ValueOrDie());
+  DerTbsCertificate tbs(*leaf_cert_);
+  string der_before, der_after;
+  EXPECT_OK(tbs.DerEncoding(&der_before));
+  EXPECT_THAT(tbs.DeleteExtension(NID_ct_precert_poison),
+              StatusIs(util::error::NOT_FOUND));
+  EXPECT_OK(tbs.DerEncoding(&der_after));
+  EXPECT_EQ(der_before, der_after);
+}
+
+TEST_F(DerTbsCertificateTest, CopyIssuerMatchesTbsCertificate) {
+  TbsCertificate tbs(*leaf_cert_);
+  DerTbsCertificate der_tbs(*leaf_cert_);
+  EXPECT_OK(tbs.CopyIssuerFrom(*leaf_with_intermediate_cert_));
+  EXPECT_OK(der_tbs.CopyIssuerFrom(*leaf_with_intermediate_cert_));
+  string expected, spliced;
+  EXPECT_OK(tbs.DerEncoding(&expected));
+  EXPECT_OK(der_tbs.DerEncoding(&spliced));
+  EXPECT_EQ(expected, spliced);
+
+  DerTbsCertificate der_tbs2(*leaf_cert_);
+  string der_before, der_after;
+  EXPECT_OK(der_tbs2.DerEncoding(&der_before));
+  EXPECT_OK(der_tbs2.CopyIssuerFrom(*leaf_cert_));
+  EXPECT_OK(der_tbs2.DerEncoding(&der_after));
+  EXPECT_EQ(der_before, der_after);
+}
+
 TEST_F(CertChainTest, LoadValid) {
   // A single certificate.
   CertChain chain(leaf_pem_);
@@ -5,12 +5,18 @@
 #include <openssl/evp.h>
 #include <openssl/opensslv.h>
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
 
+#include "base/notification.h"
 #include "merkletree/serial_hasher.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
+#include "util/thread_pool.h"
 #include "util/util.h"
 
+using cert_trans::Notification;
+using cert_trans::ThreadPool;
 using cert_trans::Verifier;
 using cert_trans::serialization::SerializeResult;
 using cert_trans::serialization::DeserializeResult;
@@ -19,7 +25,11 @@ using ct::LogEntry;
 using ct::LogEntryType;
 using ct::SignedCertificateTimestamp;
 using ct::SignedTreeHead;
+using std::function;
+using std::min;
 using std::string;
+using std::unique_ptr;
+using std::vector;
 
 #if OPENSSL_VERSION_NUMBER < 0x10000000
 #error "Need OpenSSL >= 1.0.0"
@@ -27,6 +37,11 @@ using std::string;
 
 namespace {
 
+// Number of signatures verified by each closure of a batch verification.
+// Large enough to amortise setting up the context, small enough to spread
+// the work over the thread pool.
+const size_t kVerifyChunkSize = 64;
+
 LogSigVerifier::VerifyResult ConvertStatus(const Verifier::Status status) {
   switch (status) {
     case Verifier::OK:
@@ -43,7 +58,12 @@ LogSigVerifier::VerifyResult ConvertStatus(const Verifier::Status status) {
 
 }  // namespace
 
-LogSigner::LogSigner(EVP_PKEY* pkey) : cert_trans::Signer(pkey) {
+LogSigner::LogSigner(EVP_PKEY* pkey)
+    : cert_trans::Signer(pkey), serializer_(nullptr) {
+}
+
+LogSigner::LogSigner(EVP_PKEY* pkey, const LogSerializer* serializer)
+    : cert_trans::Signer(pkey), serializer_(CHECK_NOTNULL(serializer)) {
 }
 
 LogSigner::~LogSigner() {
@@ -63,7 +83,7 @@ LogSigner::SignResult LogSigner::SignV1CertificateTimestamp(
 
   string serialized_input;
   SerializeResult res =
-      Serializer::SerializeSCTSignatureInput(sct, entry, &serialized_input);
+      serializer().SerializeSCTSignatureInput(sct, entry, &serialized_input);
 
   if (res != SerializeResult::OK)
     return GetSerializeError(res);
@@ -93,7 +113,7 @@ LogSigner::SignResult LogSigner::SignV1PrecertificateTimestamp(
 
   string serialized_input;
   SerializeResult res =
-      Serializer::SerializeSCTSignatureInput(sct, entry, &serialized_input);
+      serializer().SerializeSCTSignatureInput(sct, entry, &serialized_input);
 
   if (res != SerializeResult::OK)
     return GetSerializeError(res);
@@ -112,7 +132,7 @@ LogSigner::SignResult LogSigner::SignCertificateTimestamp(
 
   string serialized_input;
   SerializeResult res =
-      Serializer::SerializeSCTSignatureInput(*sct, entry, &serialized_input);
+      serializer().SerializeSCTSignatureInput(*sct, entry, &serialized_input);
 
   if (res != SerializeResult::OK)
     return GetSerializeError(res);
@@ -180,7 +200,13 @@ LogSigner::SignResult LogSigner::GetSerializeError(SerializeResult result) {
   return sign_result;
 }
 
-LogSigVerifier::LogSigVerifier(EVP_PKEY* pkey) : Verifier(pkey) {
+LogSigVerifier::LogSigVerifier(EVP_PKEY* pkey)
+    : Verifier(pkey), serializer_(nullptr) {
+}
+
+LogSigVerifier::LogSigVerifier(EVP_PKEY* pkey,
+                               const LogSerializer* serializer)
+    : Verifier(pkey), serializer_(CHECK_NOTNULL(serializer)) {
 }
 
 LogSigVerifier::~LogSigVerifier() {
@@ -208,7 +234,7 @@ LogSigVerifier::VerifyResult LogSigVerifier::VerifyV1CertSCTSignature(
 
   string serialized_sct;
   SerializeResult serialize_result =
-      Serializer::SerializeSCTSignatureInput(sct, entry, &serialized_sct);
+      serializer().SerializeSCTSignatureInput(sct, entry, &serialized_sct);
 
   if (serialize_result != SerializeResult::OK)
     return GetSerializeError(serialize_result);
@@ -238,7 +264,7 @@ LogSigVerifier::VerifyResult LogSigVerifier::VerifyV1PrecertSCTSignature(
 
   string serialized_sct;
   SerializeResult serialize_result =
-      Serializer::SerializeSCTSignatureInput(sct, entry, &serialized_sct);
+      serializer().SerializeSCTSignatureInput(sct, entry, &serialized_sct);
   if (serialize_result != SerializeResult::OK)
     return GetSerializeError(serialize_result);
   return ConvertStatus(Verify(serialized_sct, signature));
@@ -257,7 +283,7 @@ LogSigVerifier::VerifyResult LogSigVerifier::VerifySCTSignature(
 
   string serialized_input;
   SerializeResult serialize_result =
-      Serializer::SerializeSCTSignatureInput(sct, entry, &serialized_input);
+      serializer().SerializeSCTSignatureInput(sct, entry, &serialized_input);
   if (serialize_result != SerializeResult::OK)
     return GetSerializeError(serialize_result);
   return ConvertStatus(Verify(serialized_input, sct.signature()));
@@ -294,6 +320,86 @@ LogSigVerifier::VerifyResult LogSigVerifier::VerifySTHSignature(
   return ConvertStatus(Verify(serialized_sth, sth.signature()));
 }
 
+void LogSigVerifier::VerifySCTSignatures(
+    const vector<SCTAndEntry>& scts, ThreadPool* pool,
+    vector<VerifyResult>* results) const {
+  const LogSerializer* const serializer(&this->serializer());
+  VerifyBatch(scts.size(), pool,
+              [this, serializer, &scts](size_t index, Context* context,
+                                        string* buffer) {
+                const LogEntry& entry(*scts[index].first);
+                const SignedCertificateTimestamp& sct(*scts[index].second);
+                if (sct.id().has_key_id() && sct.id().key_id() != KeyID())
+                  return KEY_ID_MISMATCH;
+                const SerializeResult serialize_result(
+                    serializer->SerializeSCTSignatureInput(sct, entry,
+                                                           buffer));
+                if (serialize_result != SerializeResult::OK)
+                  return GetSerializeError(serialize_result);
+                return ConvertStatus(
+                    VerifyWithContext(*buffer, sct.signature(), context));
+              },
+              results);
+}
+
+void LogSigVerifier::VerifySTHSignatures(
+    const vector<const SignedTreeHead*>& sths, ThreadPool* pool,
+    vector<VerifyResult>* results) const {
+  VerifyBatch(sths.size(), pool,
+              [this, &sths](size_t index, Context* context, string* buffer) {
+                const SignedTreeHead& sth(*sths[index]);
+                if (sth.id().has_key_id() && sth.id().key_id() != KeyID())
+                  return KEY_ID_MISMATCH;
+                const SerializeResult serialize_result(
+                    Serializer::SerializeSTHSignatureInput(sth, buffer));
+                if (serialize_result != SerializeResult::OK)
+                  return GetSerializeError(serialize_result);
+                return ConvertStatus(
+                    VerifyWithContext(*buffer, sth.signature(), context));
+              },
+              results);
+}
+
+void LogSigVerifier::VerifyBatch(
+    size_t count, ThreadPool* pool,
+    const function<VerifyResult(size_t, Context*, string*)>& verify,
+    vector<VerifyResult>* results) const {
+  CHECK_NOTNULL(results);
+  results->assign(count, OK);
+
+  const auto verify_chunk = [this, &verify, results](size_t begin,
+                                                     size_t end) {
+    const unique_ptr<Context> context(NewContext());
+    // Reused for every signature input in the chunk, so that it only gets
+    // allocated once.
+    string buffer;
+    for (size_t i = begin; i < end; ++i) {
+      (*results)[i] = verify(i, context.get(), &buffer);
+    }
+  };
+
+  // On a thread of |pool|, waiting for the chunks could deadlock, as
+  // they might need this very thread to run.
+  if (!pool || count <= kVerifyChunkSize || pool->OnWorkerThread()) {
+    verify_chunk(0, count);
+    return;
+  }
+
+  std::atomic<size_t> pending((count + kVerifyChunkSize - 1) /
+                              kVerifyChunkSize);
+  Notification done;
+  for (size_t begin = 0; begin < count; begin += kVerifyChunkSize) {
+    const size_t end(min(count, begin + kVerifyChunkSize));
+    pool->Add([&verify_chunk, &pending, &done, begin, end]() {
+      verify_chunk(begin, end);
+      if (--pending == 0) {
+        done.Notify();
+      }
+    });
+  }
+  done.WaitForNotification();
+}
+
 // static
 LogSigVerifier::VerifyResult LogSigVerifier::GetSerializeError(
     SerializeResult result) {
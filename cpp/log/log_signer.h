@@ -4,15 +4,26 @@
 #include <openssl/evp.h>
 #include <openssl/x509.h>  // for i2d_PUBKEY
 #include <stdint.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "log/signer.h"
 #include "log/verifier.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 
+namespace cert_trans {
+class ThreadPool;
+}  // namespace cert_trans
+
 class LogSigner : public cert_trans::Signer {
  public:
+  // Uses Serializer::Configured() for the SCT signature inputs.
   explicit LogSigner(EVP_PKEY* pkey);
+  // Uses |serializer|, which must outlive this object.
+  LogSigner(EVP_PKEY* pkey, const LogSerializer* serializer);
   virtual ~LogSigner();
 
   enum SignResult {
@@ -52,14 +63,24 @@ class LogSigner : public cert_trans::Signer {
 
   SignResult SignTreeHead(ct::SignedTreeHead* sth) const;
 
+  const LogSerializer& serializer() const {
+    return serializer_ ? *serializer_ : Serializer::Configured();
+  }
+
  private:
   static SignResult GetSerializeError(
       cert_trans::serialization::SerializeResult result);
+
+  // Null when using Serializer::Configured().
+  const LogSerializer* const serializer_;
 };
 
 class LogSigVerifier : public cert_trans::Verifier {
  public:
+  // Uses Serializer::Configured() for the SCT signature inputs.
   explicit LogSigVerifier(EVP_PKEY* pkey);
+  // Uses |serializer|, which must outlive this object.
+  LogSigVerifier(EVP_PKEY* pkey, const LogSerializer* serializer);
   virtual ~LogSigVerifier();
 
   enum VerifyResult {
@@ -103,12 +124,43 @@ class LogSigVerifier : public cert_trans::Verifier {
 
   VerifyResult VerifySTHSignature(const ct::SignedTreeHead& sth) const;
 
+  typedef std::pair<const ct::LogEntry*, const ct::SignedCertificateTimestamp*>
+      SCTAndEntry;
+
+  // Batch versions of VerifySCTSignature() and VerifySTHSignature(),
+  // setting (*results)[i] to the result for the i-th input. The work is
+  // split across |pool| if it is not null, and done on the calling thread
+  // otherwise, or if it is one of the threads of |pool|. Blocks until all
+  // the signatures have been verified.
+  void VerifySCTSignatures(const std::vector<SCTAndEntry>& scts,
+                           cert_trans::ThreadPool* pool,
+                           std::vector<VerifyResult>* results) const;
+
+  void VerifySTHSignatures(const std::vector<const ct::SignedTreeHead*>& sths,
+                           cert_trans::ThreadPool* pool,
+                           std::vector<VerifyResult>* results) const;
+
+  const LogSerializer& serializer() const {
+    return serializer_ ? *serializer_ : Serializer::Configured();
+  }
+
  private:
+  // Runs |verify| for every index in [0, |count|), in chunks, each with its
+  // own Verifier::Context and serialization buffer.
+  void VerifyBatch(size_t count, cert_trans::ThreadPool* pool,
+                   const std::function<VerifyResult(
+                       size_t index, Context* context, std::string* buffer)>&
+                       verify,
+                   std::vector<VerifyResult>* results) const;
+
   static VerifyResult GetSerializeError(
       cert_trans::serialization::SerializeResult result);
 
   static VerifyResult GetDeserializeSignatureError(
       cert_trans::serialization::DeserializeResult result);
+
+  // Null when using Serializer::Configured().
+  const LogSerializer* const serializer_;
 };
 
 #endif  // CERT_TRANS_LOG_LOG_SIGNER_H_
@@ -2,14 +2,18 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <stdint.h>
+#include <set>
 #include <string>
+#include <vector>
 
+#include "base/notification.h"
 #include "log/log_signer.h"
 #include "log/test_signer.h"
 #include "proto/cert_serializer.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 #include "util/testing.h"
+#include "util/thread_pool.h"
 #include "util/util.h"
 
 namespace {
@@ -21,6 +25,8 @@ using ct::SignedCertificateTimestamp;
 using ct::DigitallySigned;
 using ct::SignedTreeHead;
 using std::string;
+using std::unique_ptr;
+using std::vector;
 
 // A slightly shorter notation for constructing hex strings from binary blobs.
 string H(const string& byte_string) {
@@ -153,6 +159,36 @@ TEST_F(LogSignerTest, SignAndVerifyCertSCT) {
                 default_sct.extensions(), serialized_sig));
 }
 
+// Signers and verifiers can each be given the serialization of their
+// log, rather than using the one configured for the process.
+TEST_F(LogSignerTest, SignAndVerifyWithLogSerializer) {
+  const LogSerializer& v1(LogSerializer::ForPolicy<CertV1Policy>());
+  const LogSerializer& v2(LogSerializer::ForPolicy<CertV2Policy>());
+  const unique_ptr<LogSigner> signer(TestSigner::DefaultLogSigner(&v1));
+  const unique_ptr<LogSigVerifier> v1_verifier(
+      TestSigner::DefaultLogSigVerifier(&v1));
+  const unique_ptr<LogSigVerifier> v2_verifier(
+      TestSigner::DefaultLogSigVerifier(&v2));
+  EXPECT_EQ(&v1, &signer->serializer());
+  EXPECT_EQ(&v2, &v2_verifier->serializer());
+
+  LogEntry default_entry;
+  TestSigner::SetDefaults(&default_entry);
+  SignedCertificateTimestamp sct;
+  TestSigner::SetDefaults(&sct);
+  sct.clear_signature();
+
+  EXPECT_EQ(LogSigner::OK,
+            signer->SignCertificateTimestamp(default_entry, &sct));
+  EXPECT_EQ(LogSigVerifier::OK,
+            v1_verifier->VerifySCTSignature(default_entry, sct));
+  EXPECT_EQ(LogSigVerifier::OK,
+            verifier_->VerifySCTSignature(default_entry, sct));
+  // A V1 SCT is not something the V2 serialization signs.
+  EXPECT_NE(LogSigVerifier::OK,
+            v2_verifier->VerifySCTSignature(default_entry, sct));
+}
+
 TEST_F(LogSignerTest, SignAndVerifyPrecertSCT) {
   LogEntry default_entry;
   TestSigner::SetPrecertDefaults(&default_entry);
@@ -232,6 +268,44 @@ TEST_F(LogSignerTest, SignAndVerifySTH) {
                                             default_serialized_sig));
 }
 
+TEST_F(LogSignerTest, SignAndVerifyWithPrecomputation) {
+  const size_t kPoolSize = 4;
+  signer_->EnablePrecomputation(kPoolSize);
+
+  LogEntry default_entry;
+  TestSigner::SetDefaults(&default_entry);
+  SignedCertificateTimestamp default_sct;
+  TestSigner::SetDefaults(&default_sct);
+  SignedTreeHead default_sth;
+  TestSigner::SetDefaults(&default_sth);
+
+  // Sign more than the pool holds, so that some signatures are likely to
+  // be made after it runs dry. Every nonce must only be used once, so all
+  // the signatures differ.
+  std::set<string> signatures;
+  for (size_t i = 0; i < 3 * kPoolSize; ++i) {
+    SignedCertificateTimestamp sct;
+    sct.CopyFrom(default_sct);
+    sct.clear_signature();
+    EXPECT_EQ(LogSigner::OK,
+              signer_->SignCertificateTimestamp(default_entry, &sct));
+    EXPECT_EQ(default_sct.signature().hash_algorithm(),
+              sct.signature().hash_algorithm());
+    EXPECT_EQ(default_sct.signature().sig_algorithm(),
+              sct.signature().sig_algorithm());
+    EXPECT_EQ(LogSigVerifier::OK,
+              verifier_->VerifySCTSignature(default_entry, sct));
+    EXPECT_TRUE(signatures.insert(sct.signature().signature()).second);
+
+    SignedTreeHead sth;
+    sth.CopyFrom(default_sth);
+    sth.clear_signature();
+    EXPECT_EQ(LogSigner::OK, signer_->SignTreeHead(&sth));
+    EXPECT_EQ(LogSigVerifier::OK, verifier_->VerifySTHSignature(sth));
+    EXPECT_TRUE(signatures.insert(sth.signature().signature()).second);
+  }
+}
+
 TEST_F(LogSignerTest, SignAndVerifyCertSCTApiCrossCheck) {
   LogEntry default_entry;
   TestSigner::SetDefaults(&default_entry);
@@ -986,6 +1060,109 @@ TEST_F(LogSignerTest, VerifyBadSerializedSTHSignature) {
   }
 }
 
+TEST_F(LogSignerTest, BatchVerifySCTs) {
+  const int kNumSCTs = 300;
+  LogEntry default_entry, precert_entry, empty_entry;
+  TestSigner::SetDefaults(&default_entry);
+  TestSigner::SetPrecertDefaults(&precert_entry);
+  TestSigner::SetDefaults(&empty_entry);
+  empty_entry.mutable_x509_entry()->clear_leaf_certificate();
+  SignedCertificateTimestamp default_sct, precert_sct;
+  TestSigner::SetDefaults(&default_sct);
+  TestSigner::SetPrecertDefaults(&precert_sct);
+
+  // A mix of good SCTs and SCTs failing in each of the possible ways.
+  vector<SignedCertificateTimestamp> scts(kNumSCTs);
+  vector<LogSigVerifier::SCTAndEntry> inputs;
+  for (int i = 0; i < kNumSCTs; ++i) {
+    const LogEntry* entry(&default_entry);
+    switch (i % 5) {
+      case 0:
+        scts[i].CopyFrom(default_sct);
+        break;
+      case 1:
+        scts[i].CopyFrom(precert_sct);
+        entry = &precert_entry;
+        break;
+      case 2:
+        scts[i].CopyFrom(default_sct);
+        scts[i].set_timestamp(scts[i].timestamp() + 1);
+        break;
+      case 3:
+        scts[i].CopyFrom(default_sct);
+        scts[i].mutable_id()->set_key_id("bogus");
+        break;
+      case 4:
+        scts[i].CopyFrom(default_sct);
+        entry = &empty_entry;
+        break;
+    }
+    inputs.emplace_back(entry, &scts[i]);
+  }
+
+  cert_trans::ThreadPool pool(4);
+  vector<LogSigVerifier::VerifyResult> results;
+  verifier_->VerifySCTSignatures(inputs, &pool, &results);
+  ASSERT_EQ(inputs.size(), results.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(verifier_->VerifySCTSignature(*inputs[i].first,
+                                            *inputs[i].second),
+              results[i])
+        << i;
+  }
+  EXPECT_EQ(LogSigVerifier::OK, results[0]);
+  EXPECT_EQ(LogSigVerifier::OK, results[1]);
+  EXPECT_EQ(LogSigVerifier::INVALID_SIGNATURE, results[2]);
+  EXPECT_EQ(LogSigVerifier::KEY_ID_MISMATCH, results[3]);
+  EXPECT_EQ(LogSigVerifier::EMPTY_CERTIFICATE, results[4]);
+
+  // Same thing without a thread pool.
+  vector<LogSigVerifier::VerifyResult> inline_results;
+  verifier_->VerifySCTSignatures(inputs, nullptr, &inline_results);
+  EXPECT_EQ(results, inline_results);
+}
+
+TEST_F(LogSignerTest, BatchVerifySTHs) {
+  SignedTreeHead default_sth, bad_sth;
+  TestSigner::SetDefaults(&default_sth);
+  bad_sth.CopyFrom(default_sth);
+  bad_sth.set_tree_size(bad_sth.tree_size() + 1);
+
+  const vector<const SignedTreeHead*> sths{&default_sth, &bad_sth,
+                                           &default_sth};
+  vector<LogSigVerifier::VerifyResult> results;
+  verifier_->VerifySTHSignatures(sths, nullptr, &results);
+  const vector<LogSigVerifier::VerifyResult> expected{
+      LogSigVerifier::OK, LogSigVerifier::INVALID_SIGNATURE,
+      LogSigVerifier::OK};
+  EXPECT_EQ(expected, results);
+
+  // Empty batches are fine too.
+  cert_trans::ThreadPool pool(2);
+  verifier_->VerifySTHSignatures({}, &pool, &results);
+  EXPECT_TRUE(results.empty());
+}
+
+TEST_F(LogSignerTest, BatchVerifyOnPoolThread) {
+  SignedTreeHead sth;
+  TestSigner::SetDefaults(&sth);
+  // Enough for several chunks.
+  const vector<const SignedTreeHead*> sths(200, &sth);
+
+  // With a single thread, waiting for the chunks on it would never end.
+  cert_trans::ThreadPool pool(1);
+  vector<LogSigVerifier::VerifyResult> results;
+  cert_trans::Notification done;
+  pool.Add([this, &sths, &pool, &results, &done]() {
+    verifier_->VerifySTHSignatures(sths, &pool, &results);
+    done.Notify();
+  });
+  done.WaitForNotification();
+  EXPECT_EQ(vector<LogSigVerifier::VerifyResult>(sths.size(),
+                                                 LogSigVerifier::OK),
+            results);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
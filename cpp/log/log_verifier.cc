@@ -40,8 +40,8 @@ LogVerifier::LogVerifyResult LogVerifier::VerifySignedCertificateTimestamp(
   // If SCT verification succeeded, then we should never fail here.
   if (merkle_leaf_hash != NULL) {
     CHECK_EQ(SerializeResult::OK,
-             Serializer::SerializeSCTMerkleTreeLeaf(sct, entry,
-                                                    &serialized_leaf));
+             sig_verifier_->serializer().SerializeSCTMerkleTreeLeaf(
+                 sct, entry, &serialized_leaf));
     merkle_leaf_hash->assign(merkle_verifier_->LeafHash(serialized_leaf));
   }
   return VERIFY_OK;
@@ -82,7 +82,8 @@ LogVerifier::LogVerifyResult LogVerifier::VerifyMerkleAuditProof(
 
   string serialized_leaf;
   SerializeResult serialize_result =
-      Serializer::SerializeSCTMerkleTreeLeaf(sct, entry, &serialized_leaf);
+      sig_verifier_->serializer().SerializeSCTMerkleTreeLeaf(
+          sct, entry, &serialized_leaf);
 
   if (serialize_result != SerializeResult::OK)
     return INVALID_FORMAT;
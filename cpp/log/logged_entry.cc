@@ -4,27 +4,229 @@
 #include "proto/serializer.h"
 #include "util/util.h"
 
+using cert_trans::serialization::ByteSink;
 using cert_trans::serialization::SerializeResult;
 using ct::LogEntry;
 using ct::PreCert;
 using ct::SignedCertificateTimestamp;
+using google::protobuf::RepeatedPtrField;
 using std::string;
+using std::unique_ptr;
 using util::RandomString;
 
 namespace cert_trans {
 
+namespace {
 
-string LoggedEntry::Hash() const {
-  return Sha256Hasher::Sha256Digest(Serializer::LeafData(entry()));
+
+class HashingSink : public ByteSink {
+ public:
+  explicit HashingSink(SerialHasher* hasher) : hasher_(CHECK_NOTNULL(hasher)) {
+  }
+
+  void Append(const char* data, size_t size) override {
+    hasher_->Update(data, size);
+  }
+
+ private:
+  SerialHasher* const hasher_;
+};
+
+
+// Compare a field of |a| and |b|, including whether it is set.
+#define SAME_FIELD(f) (a.has_##f() == b.has_##f() && a.f() == b.f())
+#define SAME_MESSAGE(f) (a.has_##f() == b.has_##f() && Equal(a.f(), b.f()))
+
+
+bool Equal(const string& a, const string& b) {
+  return a == b;
+}
+
+
+bool Equal(const ct::SctExtension& a, const ct::SctExtension& b) {
+  return SAME_FIELD(sct_extension_type) && SAME_FIELD(sct_extension_data);
+}
+
+
+template <class T>
+bool Equal(const RepeatedPtrField<T>& a, const RepeatedPtrField<T>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (int i = 0; i < a.size(); ++i) {
+    if (!Equal(a.Get(i), b.Get(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool Equal(const ct::DigitallySigned& a, const ct::DigitallySigned& b) {
+  return SAME_FIELD(hash_algorithm) && SAME_FIELD(sig_algorithm) &&
+         SAME_FIELD(signature);
+}
+
+
+bool Equal(const ct::LogID& a, const ct::LogID& b) {
+  return SAME_FIELD(key_id);
 }
 
 
-bool LoggedEntry::SerializeForLeaf(string* dst) const {
-  return Serializer::SerializeSCTMerkleTreeLeaf(sct(), entry(), dst) ==
+bool Equal(const ct::CertInfo& a, const ct::CertInfo& b) {
+  return SAME_FIELD(issuer_key_hash) && SAME_FIELD(tbs_certificate);
+}
+
+
+bool Equal(const PreCert& a, const PreCert& b) {
+  return SAME_FIELD(issuer_key_hash) && SAME_FIELD(tbs_certificate);
+}
+
+
+bool Equal(const ct::X509ChainEntry& a, const ct::X509ChainEntry& b) {
+  return SAME_FIELD(leaf_certificate) && SAME_MESSAGE(cert_info) &&
+         Equal(a.certificate_chain(), b.certificate_chain());
+}
+
+
+bool Equal(const ct::PrecertChainEntry& a, const ct::PrecertChainEntry& b) {
+  return SAME_FIELD(pre_certificate) && SAME_MESSAGE(pre_cert) &&
+         SAME_MESSAGE(cert_info) &&
+         Equal(a.precertificate_chain(), b.precertificate_chain());
+}
+
+
+bool Equal(const ct::XJSONEntry& a, const ct::XJSONEntry& b) {
+  return SAME_FIELD(json);
+}
+
+
+bool Equal(const LogEntry& a, const LogEntry& b) {
+  return SAME_FIELD(type) && SAME_MESSAGE(x509_entry) &&
+         SAME_MESSAGE(precert_entry) && SAME_MESSAGE(x_json_entry);
+}
+
+
+bool Equal(const SignedCertificateTimestamp& a,
+           const SignedCertificateTimestamp& b) {
+  // Timestamp first, as it is the field most likely to differ.
+  return SAME_FIELD(timestamp) && SAME_FIELD(version) && SAME_MESSAGE(id) &&
+         SAME_MESSAGE(signature) && SAME_FIELD(extensions) &&
+         Equal(a.sct_extension(), b.sct_extension());
+}
+
+
+bool Equal(const ct::LoggedEntryPB::Contents& a,
+           const ct::LoggedEntryPB::Contents& b) {
+  return SAME_MESSAGE(sct) && SAME_MESSAGE(entry);
+}
+
+
+bool Equal(const ct::LoggedEntryPB& a, const ct::LoggedEntryPB& b) {
+  // The cheap fields first, then the contents starting with the SCT
+  // timestamp, before comparing any certificates.
+  return SAME_FIELD(sequence_number) && SAME_FIELD(merkle_leaf_hash) &&
+         SAME_MESSAGE(contents);
+}
+
+
+#undef SAME_MESSAGE
+#undef SAME_FIELD
+
+
+// 64-bit FNV-1a, which is simple and does not depend on the platform
+// or the run, unlike std::hash.
+class Fingerprinter {
+ public:
+  Fingerprinter() : state_(14695981039346656037ULL) {
+  }
+
+  void Add(uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      AddByte(value & 0xff);
+      value >>= 8;
+    }
+  }
+
+  // Strings are prefixed with their length, so that moving bytes from
+  // one field to the next changes the result.
+  void Add(const string& value) {
+    Add(static_cast<uint64_t>(value.size()));
+    for (const char c : value) {
+      AddByte(static_cast<unsigned char>(c));
+    }
+  }
+
+  uint64_t value() const {
+    return state_;
+  }
+
+ private:
+  void AddByte(unsigned char byte) {
+    state_ = (state_ ^ byte) * 1099511628211ULL;
+  }
+
+  uint64_t state_;
+};
+
+
+}  // namespace
+
+
+string LoggedEntry::Hash(const LogSerializer& serializer) const {
+  return Sha256Hasher::Sha256Digest(serializer.LeafData(entry()));
+}
+
+
+bool LoggedEntry::SerializeForLeaf(const LogSerializer& serializer,
+                                   string* dst) const {
+  return serializer.SerializeSCTMerkleTreeLeaf(sct(), entry(), dst) ==
          SerializeResult::OK;
 }
 
 
+uint64_t LoggedEntry::Fingerprint() const {
+  // Only the fields that identify the entry, which is enough for equal
+  // entries to have the same fingerprint.
+  Fingerprinter fingerprint;
+  fingerprint.Add(entry().type());
+  fingerprint.Add(timestamp());
+  switch (entry().type()) {
+    case ct::X509_ENTRY:
+      fingerprint.Add(entry().x509_entry().leaf_certificate());
+      fingerprint.Add(entry().x509_entry().cert_info().tbs_certificate());
+      break;
+    case ct::PRECERT_ENTRY:
+    case ct::PRECERT_ENTRY_V2:
+      fingerprint.Add(entry().precert_entry().pre_cert().issuer_key_hash());
+      fingerprint.Add(entry().precert_entry().pre_cert().tbs_certificate());
+      fingerprint.Add(entry().precert_entry().cert_info().tbs_certificate());
+      break;
+    case ct::X_JSON_ENTRY:
+      fingerprint.Add(entry().x_json_entry().json());
+      break;
+    case ct::UNKNOWN_ENTRY_TYPE:
+      break;
+  }
+  return fingerprint.value();
+}
+
+
+bool LoggedEntry::ComputeMerkleLeafHash(const LogSerializer& serializer,
+                                        const TreeHasher& tree_hasher,
+                                        string* hash) const {
+  CHECK_NOTNULL(hash);
+  const unique_ptr<SerialHasher> hasher(tree_hasher.NewLeafHasher());
+  HashingSink sink(hasher.get());
+  if (serializer.WriteSCTMerkleTreeLeaf(sct(), entry(), &sink) !=
+      SerializeResult::OK) {
+    return false;
+  }
+  *hash = hasher->Final();
+  return true;
+}
+
+
 bool LoggedEntry::SerializeExtraData(string* dst) const {
   switch (entry().type()) {
     case ct::X509_ENTRY:
@@ -49,11 +251,11 @@ bool LoggedEntry::SerializeExtraData(string* dst) const {
 
 
 bool LoggedEntry::CopyFromClientLogEntry(const AsyncLogClient::Entry& entry) {
-  if (entry.leaf.timestamped_entry().entry_type() != ct::X509_ENTRY &&
-      entry.leaf.timestamped_entry().entry_type() != ct::PRECERT_ENTRY &&
-      entry.leaf.timestamped_entry().entry_type() != ct::X_JSON_ENTRY) {
+  if (entry.leaf->timestamped_entry().entry_type() != ct::X509_ENTRY &&
+      entry.leaf->timestamped_entry().entry_type() != ct::PRECERT_ENTRY &&
+      entry.leaf->timestamped_entry().entry_type() != ct::X_JSON_ENTRY) {
     LOG(INFO) << "unsupported entry_type: "
-              << entry.leaf.timestamped_entry().entry_type();
+              << entry.leaf->timestamped_entry().entry_type();
     return false;
   }
 
@@ -61,31 +263,31 @@ bool LoggedEntry::CopyFromClientLogEntry(const AsyncLogClient::Entry& entry) {
 
   ct::SignedCertificateTimestamp* const sct(mutable_contents()->mutable_sct());
   sct->set_version(ct::V1);
-  sct->set_timestamp(entry.leaf.timestamped_entry().timestamp());
-  sct->set_extensions(entry.leaf.timestamped_entry().extensions());
+  sct->set_timestamp(entry.leaf->timestamped_entry().timestamp());
+  sct->set_extensions(entry.leaf->timestamped_entry().extensions());
 
   // It may look like you should just be able to copy entry.entry over
   // contents.entry, but entry.entry is incomplete (when the same
   // information is available in entry.leaf, it will be missing from
   // entry.entry). So we still need to fill in some missing bits...
   LogEntry* const log_entry(mutable_contents()->mutable_entry());
-  log_entry->CopyFrom(entry.entry);
-  log_entry->set_type(entry.leaf.timestamped_entry().entry_type());
+  log_entry->CopyFrom(*entry.entry);
+  log_entry->set_type(entry.leaf->timestamped_entry().entry_type());
   switch (contents().entry().type()) {
     case ct::X509_ENTRY: {
       log_entry->mutable_x509_entry()->set_leaf_certificate(
-          entry.leaf.timestamped_entry().signed_entry().x509());
+          entry.leaf->timestamped_entry().signed_entry().x509());
       break;
     }
 
     case ct::PRECERT_ENTRY: {
       PreCert* const precert(
           log_entry->mutable_precert_entry()->mutable_pre_cert());
-      precert->set_issuer_key_hash(entry.leaf.timestamped_entry()
+      precert->set_issuer_key_hash(entry.leaf->timestamped_entry()
                                        .signed_entry()
                                        .precert()
                                        .issuer_key_hash());
-      precert->set_tbs_certificate(entry.leaf.timestamped_entry()
+      precert->set_tbs_certificate(entry.leaf->timestamped_entry()
                                        .signed_entry()
                                        .precert()
                                        .tbs_certificate());
@@ -94,7 +296,7 @@ bool LoggedEntry::CopyFromClientLogEntry(const AsyncLogClient::Entry& entry) {
 
     case ct::X_JSON_ENTRY: {
       log_entry->mutable_x_json_entry()->set_json(
-          entry.leaf.timestamped_entry().signed_entry().json());
+          entry.leaf->timestamped_entry().signed_entry().json());
       break;
     }
 
@@ -160,4 +362,21 @@ void LoggedEntry::RandomForTest() {
 }
 
 
+bool operator==(const LoggedEntry& lhs, const LoggedEntry& rhs) {
+  return Equal(static_cast<const ct::LoggedEntryPB&>(lhs),
+               static_cast<const ct::LoggedEntryPB&>(rhs));
+}
+
+
+bool operator==(const LogEntry& lhs, const LogEntry& rhs) {
+  return Equal(lhs, rhs);
+}
+
+
+bool operator==(const SignedCertificateTimestamp& lhs,
+                const SignedCertificateTimestamp& rhs) {
+  return Equal(lhs, rhs);
+}
+
+
 }  // namespace cert_trans
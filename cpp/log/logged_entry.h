@@ -2,10 +2,14 @@
 #define CERT_TRANS_LOG_LOGGED_ENTRY_H_
 
 #include <glog/logging.h>
+#include <stdint.h>
+#include <string>
 
 #include "client/async_log_client.h"
 #include "merkletree/serial_hasher.h"
+#include "merkletree/tree_hasher.h"
 #include "proto/ct.pb.h"
+#include "proto/serializer.h"
 
 namespace cert_trans {
 
@@ -30,7 +34,19 @@ class LoggedEntry : private ct::LoggedEntryPB {
     LoggedEntryPB::CopyFrom(from);
   }
 
-  std::string Hash() const;
+  // The methods serializing the entry come in two flavours: with the
+  // LogSerializer of the log the entry belongs to, or without, which
+  // uses Serializer::Configured().
+  std::string Hash(const LogSerializer& serializer) const;
+  std::string Hash() const {
+    return Hash(Serializer::Configured());
+  }
+
+  // A stable 64-bit fingerprint of the entry and its SCT timestamp, for
+  // use as a hash table key: equal entries always have the same
+  // fingerprint. It does not change across runs, nor with the sequence
+  // number or Merkle leaf hash of the entry.
+  uint64_t Fingerprint() const;
 
   uint64_t timestamp() const {
     return sct().timestamp();
@@ -60,7 +76,20 @@ class LoggedEntry : private ct::LoggedEntryPB {
     return mutable_contents()->ParseFromString(src);
   }
 
-  bool SerializeForLeaf(std::string* dst) const;
+  bool SerializeForLeaf(const LogSerializer& serializer,
+                        std::string* dst) const;
+  bool SerializeForLeaf(std::string* dst) const {
+    return SerializeForLeaf(Serializer::Configured(), dst);
+  }
+  // Same as tree_hasher.HashLeaf() of the output of SerializeForLeaf(),
+  // but the leaf is hashed as it is encoded, without being buffered.
+  bool ComputeMerkleLeafHash(const LogSerializer& serializer,
+                             const TreeHasher& tree_hasher,
+                             std::string* hash) const;
+  bool ComputeMerkleLeafHash(const TreeHasher& tree_hasher,
+                             std::string* hash) const {
+    return ComputeMerkleLeafHash(Serializer::Configured(), tree_hasher, hash);
+  }
   bool SerializeExtraData(std::string* dst) const;
 
   // Note that this method will not fully populate the SCT.
@@ -68,35 +97,18 @@ class LoggedEntry : private ct::LoggedEntryPB {
 
   // FIXME(benl): unify with TestSigner?
   void RandomForTest();
+
+ private:
+  friend bool operator==(const LoggedEntry& lhs, const LoggedEntry& rhs);
 };
 
 
-inline bool operator==(const LoggedEntry& lhs, const LoggedEntry& rhs) {
-  // TODO(alcutter): Do this properly
-  std::string l_str, r_str;
-  CHECK(lhs.SerializeToString(&l_str));
-  CHECK(rhs.SerializeToString(&r_str));
-  return l_str == r_str;
-}
-
-
-inline bool operator==(const ct::LogEntry& lhs, const ct::LogEntry& rhs) {
-  // TODO(alcutter): Do this properly
-  std::string l_str, r_str;
-  CHECK(lhs.SerializeToString(&l_str));
-  CHECK(rhs.SerializeToString(&r_str));
-  return l_str == r_str;
-}
-
-
-inline bool operator==(const ct::SignedCertificateTimestamp& lhs,
-                       const ct::SignedCertificateTimestamp& rhs) {
-  // TODO(alcutter): Do this properly
-  std::string l_str, r_str;
-  CHECK(lhs.SerializeToString(&l_str));
-  CHECK(rhs.SerializeToString(&r_str));
-  return l_str == r_str;
-}
+// These compare all the known fields of the messages, including
+// whether they are set. Unknown fields are ignored.
+bool operator==(const LoggedEntry& lhs, const LoggedEntry& rhs);
+bool operator==(const ct::LogEntry& lhs, const ct::LogEntry& rhs);
+bool operator==(const ct::SignedCertificateTimestamp& lhs,
+                const ct::SignedCertificateTimestamp& rhs);
 
 
 }  // namespace cert_trans
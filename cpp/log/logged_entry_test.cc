@@ -1,7 +1,128 @@
 #include "log/logged_entry.h"
 
 #include <gtest/gtest.h>
+#include <string>
+#include <utility>
+
+#include "proto/serializer.h"
 
 typedef testing::Types<cert_trans::LoggedEntry> TestType;
 
 #include "log/logged_test-inl.h"
+
+namespace cert_trans {
+namespace {
+
+
+TEST(LoggedEntryTest, CopyFromClientLogEntry) {
+  LoggedEntry original;
+  original.RandomForTest();
+
+  std::string leaf;
+  ASSERT_TRUE(original.SerializeForLeaf(&leaf));
+
+  AsyncLogClient::Entry fetched;
+  ASSERT_EQ(serialization::DeserializeResult::OK,
+            Deserializer::DeserializeMerkleTreeLeaf(leaf, fetched.leaf));
+  fetched.entry->CopyFrom(original.entry());
+  EXPECT_EQ(fetched.arena.get(), fetched.leaf->GetArena());
+  EXPECT_EQ(fetched.arena.get(), fetched.entry->GetArena());
+
+  // Moving an entry keeps its messages where they are.
+  const ct::MerkleTreeLeaf* const leaf_ptr(fetched.leaf);
+  AsyncLogClient::Entry moved(std::move(fetched));
+  EXPECT_EQ(leaf_ptr, moved.leaf);
+
+  LoggedEntry copy;
+  ASSERT_TRUE(copy.CopyFromClientLogEntry(moved));
+  std::string copy_leaf;
+  ASSERT_TRUE(copy.SerializeForLeaf(&copy_leaf));
+  EXPECT_EQ(leaf, copy_leaf);
+  EXPECT_EQ(original.Hash(), copy.Hash());
+}
+
+
+TEST(LoggedEntryTest, Equality) {
+  LoggedEntry l1;
+  l1.RandomForTest();
+  l1.set_sequence_number(42);
+
+  LoggedEntry l2;
+  l2.CopyFrom(l1);
+  EXPECT_TRUE(l1 == l2);
+  EXPECT_TRUE(l1.entry() == l2.entry());
+  EXPECT_TRUE(l1.sct() == l2.sct());
+
+  l2.set_sequence_number(43);
+  EXPECT_FALSE(l1 == l2);
+  // Only the sequence number differs.
+  EXPECT_TRUE(l1.entry() == l2.entry());
+  EXPECT_TRUE(l1.sct() == l2.sct());
+
+  l2.CopyFrom(l1);
+  l2.mutable_sct()->set_timestamp(l1.sct().timestamp() + 1);
+  EXPECT_FALSE(l1 == l2);
+  EXPECT_FALSE(l1.sct() == l2.sct());
+
+  // Whether a field is set matters, not just its value.
+  l2.CopyFrom(l1);
+  l2.mutable_sct()->mutable_signature();
+  EXPECT_FALSE(l1.sct() == l2.sct());
+  l2.mutable_sct()->clear_signature();
+  EXPECT_TRUE(l1.sct() == l2.sct());
+
+  l2.CopyFrom(l1);
+  ct::LogEntry* const entry(l2.mutable_entry());
+  if (entry->type() == ct::X509_ENTRY) {
+    entry->mutable_x509_entry()->add_certificate_chain("chain");
+  } else {
+    entry->mutable_precert_entry()->add_precertificate_chain("chain");
+  }
+  EXPECT_FALSE(l1.entry() == l2.entry());
+  EXPECT_FALSE(l1 == l2);
+}
+
+
+// operator== compares the fields one by one, update it (and this test)
+// when adding new ones.
+TEST(LoggedEntryTest, EqualityCoversAllFields) {
+  EXPECT_EQ(3, ct::LoggedEntryPB::descriptor()->field_count());
+  EXPECT_EQ(2, ct::LoggedEntryPB::Contents::descriptor()->field_count());
+  EXPECT_EQ(6, ct::SignedCertificateTimestamp::descriptor()->field_count());
+  EXPECT_EQ(3, ct::DigitallySigned::descriptor()->field_count());
+  EXPECT_EQ(1, ct::LogID::descriptor()->field_count());
+  EXPECT_EQ(2, ct::SctExtension::descriptor()->field_count());
+  EXPECT_EQ(4, ct::LogEntry::descriptor()->field_count());
+  EXPECT_EQ(3, ct::X509ChainEntry::descriptor()->field_count());
+  EXPECT_EQ(4, ct::PrecertChainEntry::descriptor()->field_count());
+  EXPECT_EQ(2, ct::PreCert::descriptor()->field_count());
+  EXPECT_EQ(2, ct::CertInfo::descriptor()->field_count());
+  EXPECT_EQ(1, ct::XJSONEntry::descriptor()->field_count());
+}
+
+
+TEST(LoggedEntryTest, Fingerprint) {
+  LoggedEntry l1;
+  l1.mutable_sct()->set_timestamp(1234);
+  l1.mutable_entry()->set_type(ct::X509_ENTRY);
+  l1.mutable_entry()->mutable_x509_entry()->set_leaf_certificate("cert");
+  // The fingerprint must not change from one run or version to the next.
+  EXPECT_EQ(0xc773c44a3ec6ac05ULL, l1.Fingerprint());
+
+  LoggedEntry l2;
+  l2.CopyFrom(l1);
+  l2.set_sequence_number(1);
+  l2.mutable_entry()->mutable_x509_entry()->add_certificate_chain("chain");
+  EXPECT_EQ(l1.Fingerprint(), l2.Fingerprint());
+
+  l2.mutable_sct()->set_timestamp(1235);
+  EXPECT_NE(l1.Fingerprint(), l2.Fingerprint());
+
+  l2.CopyFrom(l1);
+  l2.mutable_entry()->mutable_x509_entry()->set_leaf_certificate("cerT");
+  EXPECT_NE(l1.Fingerprint(), l2.Fingerprint());
+}
+
+
+}  // namespace
+}  // namespace cert_trans
@@ -2,8 +2,11 @@
 #ifndef CERT_TRANS_LOG_LOGGED_TEST_INL_H_
 #define CERT_TRANS_LOG_LOGGED_TEST_INL_H_
 
+#include <memory>
 #include <string>
 
+#include "merkletree/serial_hasher.h"
+#include "merkletree/tree_hasher.h"
 #include "proto/cert_serializer.h"
 #include "util/testing.h"
 
@@ -97,6 +100,19 @@ TYPED_TEST(LoggedTest, DifferentMerkleSerialization) {
   EXPECT_NE(s1, s2);
 }
 
+TYPED_TEST(LoggedTest, ComputeMerkleLeafHash) {
+  TypeParam l1;
+  l1.RandomForTest();
+
+  std::string leaf;
+  EXPECT_TRUE(l1.SerializeForLeaf(&leaf));
+
+  TreeHasher tree_hasher(std::unique_ptr<SerialHasher>(new Sha256Hasher));
+  std::string hash;
+  EXPECT_TRUE(l1.ComputeMerkleLeafHash(tree_hasher, &hash));
+  EXPECT_EQ(tree_hasher.HashLeaf(leaf), hash);
+}
+
 int main(int argc, char** argv) {
   cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
   ConfigureSerializerForV1CT();
@@ -0,0 +1,96 @@
+#include "log/sct_cache.h"
+
+#include <glog/logging.h>
+#include <functional>
+
+#include "monitoring/monitoring.h"
+
+using ct::SignedCertificateTimestamp;
+using std::hash;
+using std::lock_guard;
+using std::make_pair;
+using std::mutex;
+using std::string;
+using std::unique_ptr;
+
+namespace cert_trans {
+namespace {
+
+
+const size_t kNumShards = 16;
+
+
+}  // namespace
+
+
+static Counter<string>* sct_cache_lookups(
+    Counter<string>::New("sct_cache_lookups", "result",
+                         "Number of SCT cache lookups, by result."));
+
+
+SCTCache::SCTCache(size_t max_entries)
+    : max_entries_per_shard_((max_entries + kNumShards - 1) / kNumShards) {
+  CHECK_GT(max_entries, static_cast<size_t>(0));
+  for (size_t i = 0; i < kNumShards; ++i) {
+    shards_.emplace_back(new Shard);
+  }
+}
+
+
+bool SCTCache::Lookup(const string& leaf_hash,
+                      SignedCertificateTimestamp* sct) {
+  CHECK_NOTNULL(sct);
+  Shard* const shard(ShardFor(leaf_hash));
+  lock_guard<mutex> lock(shard->lock);
+
+  const auto it(shard->index.find(leaf_hash));
+  if (it == shard->index.end()) {
+    sct_cache_lookups->Increment("miss");
+    return false;
+  }
+
+  shard->entries.splice(shard->entries.begin(), shard->entries, it->second);
+  sct->CopyFrom(it->second->second);
+  sct_cache_lookups->Increment("hit");
+  return true;
+}
+
+
+void SCTCache::Insert(const string& leaf_hash,
+                      const SignedCertificateTimestamp& sct) {
+  Shard* const shard(ShardFor(leaf_hash));
+  lock_guard<mutex> lock(shard->lock);
+
+  const auto it(shard->index.find(leaf_hash));
+  if (it != shard->index.end()) {
+    it->second->second.CopyFrom(sct);
+    shard->entries.splice(shard->entries.begin(), shard->entries, it->second);
+    return;
+  }
+
+  shard->entries.emplace_front(make_pair(leaf_hash, sct));
+  shard->index.emplace(leaf_hash, shard->entries.begin());
+
+  if (shard->entries.size() > max_entries_per_shard_) {
+    shard->index.erase(shard->entries.back().first);
+    shard->entries.pop_back();
+  }
+}
+
+
+size_t SCTCache::Size() const {
+  size_t size(0);
+  for (const unique_ptr<Shard>& shard : shards_) {
+    lock_guard<mutex> lock(shard->lock);
+    size += shard->entries.size();
+  }
+  return size;
+}
+
+
+SCTCache::Shard* SCTCache::ShardFor(const string& leaf_hash) {
+  return shards_[hash<string>()(leaf_hash) % shards_.size()].get();
+}
+
+
+}  // namespace cert_trans
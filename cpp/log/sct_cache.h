@@ -0,0 +1,63 @@
+#ifndef CERT_TRANS_LOG_SCT_CACHE_H_
+#define CERT_TRANS_LOG_SCT_CACHE_H_
+
+#include <stddef.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "proto/ct.pb.h"
+
+namespace cert_trans {
+
+
+// A bounded, thread-safe index from leaf hash (as returned by
+// LoggedEntry::Hash()) to the SCT the log issued for that leaf. This lets
+// resubmissions of an already logged certificate be answered without
+// validating the chain or signing a new SCT.
+//
+// The capacity is split evenly across a fixed number of independently locked
+// shards, so eviction is only approximately least-recently-used.
+class SCTCache {
+ public:
+  explicit SCTCache(size_t max_entries);
+  SCTCache(const SCTCache&) = delete;
+  SCTCache& operator=(const SCTCache&) = delete;
+
+  // If an SCT was recorded for |leaf_hash|, sets |sct| to it and returns
+  // true.
+  bool Lookup(const std::string& leaf_hash,
+              ct::SignedCertificateTimestamp* sct);
+
+  // Records |sct| as the SCT issued for |leaf_hash|, replacing any
+  // previously recorded one.
+  void Insert(const std::string& leaf_hash,
+              const ct::SignedCertificateTimestamp& sct);
+
+  size_t Size() const;
+
+ private:
+  struct Shard {
+    typedef std::list<std::pair<std::string, ct::SignedCertificateTimestamp>>
+        EntryList;
+
+    mutable std::mutex lock;
+    // Most recently used first.
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> index;
+  };
+
+  Shard* ShardFor(const std::string& leaf_hash);
+
+  const size_t max_entries_per_shard_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+
+}  // namespace cert_trans
+
+#endif  // CERT_TRANS_LOG_SCT_CACHE_H_
@@ -0,0 +1,109 @@
+#include "log/sct_cache.h"
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "proto/ct.pb.h"
+#include "util/testing.h"
+
+namespace cert_trans {
+namespace {
+
+using ct::SignedCertificateTimestamp;
+using std::string;
+using std::thread;
+using std::to_string;
+using std::vector;
+
+
+SignedCertificateTimestamp MakeSCT(uint64_t timestamp) {
+  SignedCertificateTimestamp sct;
+  sct.set_version(ct::V1);
+  sct.set_timestamp(timestamp);
+  return sct;
+}
+
+
+TEST(SCTCacheTest, LookupMissing) {
+  SCTCache cache(10);
+  SignedCertificateTimestamp sct;
+  EXPECT_FALSE(cache.Lookup("hash", &sct));
+}
+
+
+TEST(SCTCacheTest, InsertAndLookup) {
+  SCTCache cache(10);
+  cache.Insert("hash", MakeSCT(1234));
+
+  SignedCertificateTimestamp sct;
+  ASSERT_TRUE(cache.Lookup("hash", &sct));
+  EXPECT_EQ(1234U, sct.timestamp());
+  EXPECT_FALSE(cache.Lookup("other hash", &sct));
+  EXPECT_EQ(1U, cache.Size());
+}
+
+
+TEST(SCTCacheTest, InsertReplaces) {
+  SCTCache cache(10);
+  cache.Insert("hash", MakeSCT(1));
+  cache.Insert("hash", MakeSCT(2));
+
+  SignedCertificateTimestamp sct;
+  ASSERT_TRUE(cache.Lookup("hash", &sct));
+  EXPECT_EQ(2U, sct.timestamp());
+  EXPECT_EQ(1U, cache.Size());
+}
+
+
+TEST(SCTCacheTest, Bounded) {
+  const size_t kMaxEntries(64);
+  SCTCache cache(kMaxEntries);
+  for (int i = 0; i < 10000; ++i) {
+    cache.Insert(to_string(i), MakeSCT(i));
+  }
+
+  // Eviction is per shard, so the cache may go a little over its nominal
+  // size, but never by more than one entry per shard.
+  EXPECT_LE(cache.Size(), kMaxEntries + 16);
+
+  // The most recent entry is always there.
+  SignedCertificateTimestamp sct;
+  ASSERT_TRUE(cache.Lookup("9999", &sct));
+  EXPECT_EQ(9999U, sct.timestamp());
+  EXPECT_FALSE(cache.Lookup("0", &sct));
+}
+
+
+TEST(SCTCacheTest, Concurrent) {
+  SCTCache cache(1000);
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      SignedCertificateTimestamp sct;
+      for (int i = 0; i < 1000; ++i) {
+        const string key(to_string(t) + ":" + to_string(i));
+        cache.Insert(key, MakeSCT(i));
+        cache.Lookup(key, &sct);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  EXPECT_GT(cache.Size(), 0U);
+}
+
+
+}  // namespace
+}  // namespace cert_trans
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -2,22 +2,147 @@
 #include "log/signer.h"
 
 #include <glog/logging.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
 #include <openssl/evp.h>
 #include <openssl/opensslv.h>
+#include <openssl/sha.h>
 #include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
 
 #include "log/verifier.h"
+#include "monitoring/monitoring.h"
 #include "proto/ct.pb.h"
+#include "util/openssl_util.h"
 #include "util/util.h"
 
 #if OPENSSL_VERSION_NUMBER < 0x10000000
 #error "Need OpenSSL >= 1.0.0"
 #endif
 
+// ECDSA_sign_setup() and ECDSA_do_sign_ex(), which nonce precomputation
+// is built on, are deprecated in OpenSSL 3.0 without a replacement.
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#define CT_PRECOMPUTE_NONCES 1
+#endif
+
 using cert_trans::Verifier;
 
 namespace cert_trans {
 
+#ifdef CT_PRECOMPUTE_NONCES
+namespace {
+
+// The nonce inverse is as sensitive as the private key.
+using ScopedSecretBIGNUM = ScopedOpenSSLType<BIGNUM, BN_clear_free>;
+
+}  // namespace
+
+static Counter<std::string>* precomputed_nonces(
+    Counter<std::string>::New("precomputed_nonces", "result",
+                              "Number of ECDSA signatures made with "
+                              "(\"used\") or without (\"exhausted\", "
+                              "\"failed\") a precomputed nonce."));
+
+// Keeps a bounded pool of precomputed ECDSA nonces, refilled by a
+// background thread. Each nonce is handed out exactly once: reusing one
+// would reveal the private key.
+class Signer::NoncePool {
+ public:
+  NoncePool(EC_KEY* key, size_t max_size);
+  ~NoncePool();
+
+  EC_KEY* key() const {
+    return key_.get();
+  }
+
+  // Returns false if the pool is empty.
+  bool Take(ScopedSecretBIGNUM* kinv, ScopedBIGNUM* r);
+
+ private:
+  void Fill();
+
+  const ScopedEC_KEY key_;
+  const size_t max_size_;
+
+  std::mutex lock_;
+  std::condition_variable cond_var_;
+  std::deque<std::pair<ScopedSecretBIGNUM, ScopedBIGNUM>> nonces_;
+  bool exiting_;
+
+  std::thread thread_;
+};
+
+Signer::NoncePool::NoncePool(EC_KEY* key, size_t max_size)
+    : key_(CHECK_NOTNULL(key)),
+      max_size_(max_size),
+      exiting_(false),
+      thread_(&NoncePool::Fill, this) {
+  CHECK_GT(max_size_, static_cast<size_t>(0));
+  std::unique_lock<std::mutex> lock(lock_);
+  cond_var_.wait(lock, [this]() { return nonces_.size() == max_size_; });
+}
+
+Signer::NoncePool::~NoncePool() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    exiting_ = true;
+  }
+  cond_var_.notify_all();
+  thread_.join();
+}
+
+bool Signer::NoncePool::Take(ScopedSecretBIGNUM* kinv, ScopedBIGNUM* r) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (nonces_.empty()) {
+      return false;
+    }
+    *kinv = std::move(nonces_.front().first);
+    *r = std::move(nonces_.front().second);
+    nonces_.pop_front();
+  }
+  cond_var_.notify_one();
+  return true;
+}
+
+void Signer::NoncePool::Fill() {
+  const ScopedBN_CTX bn_ctx(BN_CTX_new());
+  CHECK(bn_ctx);
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      cond_var_.wait(lock, [this]() {
+        return exiting_ || nonces_.size() < max_size_;
+      });
+      if (exiting_) {
+        return;
+      }
+    }
+
+    // The expensive part, done without holding the lock.
+    BIGNUM* kinv(nullptr);
+    BIGNUM* r(nullptr);
+    CHECK_EQ(1, ECDSA_sign_setup(key_.get(), bn_ctx.get(), &kinv, &r));
+
+    std::lock_guard<std::mutex> lock(lock_);
+    nonces_.emplace_back(ScopedSecretBIGNUM(kinv), ScopedBIGNUM(r));
+    if (nonces_.size() == max_size_) {
+      // Wakes up the constructor, the first time around.
+      cond_var_.notify_all();
+    }
+  }
+}
+#else   // CT_PRECOMPUTE_NONCES
+// Never instantiated, see Signer::EnablePrecomputation().
+class Signer::NoncePool {};
+#endif  // CT_PRECOMPUTE_NONCES
+
 Signer::Signer(EVP_PKEY* pkey) : pkey_(pkey) {
   CHECK(pkey != nullptr);
   const int key_type(EVP_PKEY_base_id(pkey_.get()));
@@ -36,6 +161,9 @@ Signer::Signer(EVP_PKEY* pkey) : pkey_(pkey) {
   key_id_ = Verifier::ComputeKeyID(pkey_.get());
 }
 
+Signer::~Signer() {
+}
+
 std::string Signer::KeyID() const {
   return key_id_;
 }
@@ -47,12 +175,117 @@ void Signer::Sign(const std::string& data,
   signature->set_signature(RawSign(data));
 }
 
+std::unique_ptr<Signer::Context> Signer::NewContext() const {
+  if (!pkey_) {
+    return nullptr;
+  }
+
+  std::unique_ptr<Context> context(new Context);
+  context->template_.reset(EVP_MD_CTX_new());
+  context->ctx_.reset(EVP_MD_CTX_new());
+  CHECK(context->template_ && context->ctx_);
+  CHECK_EQ(1, EVP_DigestSignInit(context->template_.get(), nullptr,
+                                 EVP_sha256(), nullptr, pkey_.get()));
+  return context;
+}
+
+void Signer::SignWithContext(const std::string& data, Context* context,
+                             ct::DigitallySigned* signature) const {
+  if (!context) {
+    Sign(data, signature);
+    return;
+  }
+
+  std::string sig;
+  if (PrecomputedSign(data, &sig)) {
+    signature->set_hash_algorithm(hash_algo_);
+    signature->set_sig_algorithm(sig_algo_);
+    signature->set_signature(sig);
+    return;
+  }
+
+  EVP_MD_CTX* const ctx(context->ctx_.get());
+  CHECK_EQ(1, EVP_MD_CTX_copy_ex(ctx, context->template_.get()));
+  CHECK_EQ(1, EVP_DigestSignUpdate(ctx, data.data(), data.size()));
+  size_t sig_size(0);
+  CHECK_EQ(1, EVP_DigestSignFinal(ctx, nullptr, &sig_size));
+  sig.assign(sig_size, '\0');
+  CHECK_EQ(1, EVP_DigestSignFinal(
+                  ctx, reinterpret_cast<unsigned char*>(&sig[0]), &sig_size));
+  sig.resize(sig_size);
+
+  signature->set_hash_algorithm(hash_algo_);
+  signature->set_sig_algorithm(sig_algo_);
+  signature->set_signature(sig);
+}
+
+void Signer::EnablePrecomputation(size_t pool_size) {
+  CHECK(pkey_);
+  if (sig_algo_ != ct::DigitallySigned::ECDSA) {
+    LOG(WARNING) << "Nonce precomputation is only supported for ECDSA keys";
+    return;
+  }
+#ifdef CT_PRECOMPUTE_NONCES
+  nonce_pool_.reset(
+      new NoncePool(EVP_PKEY_get1_EC_KEY(pkey_.get()), pool_size));
+#else
+  LOG(WARNING) << "Nonce precomputation is not supported with OpenSSL "
+               << "3.0 or later";
+#endif
+}
+
 Signer::Signer()
     : hash_algo_(ct::DigitallySigned::NONE),
       sig_algo_(ct::DigitallySigned::ANONYMOUS) {
 }
 
+bool Signer::PrecomputedSign(const std::string& data,
+                             std::string* result) const {
+#ifdef CT_PRECOMPUTE_NONCES
+  if (!nonce_pool_) {
+    return false;
+  }
+
+  ScopedSecretBIGNUM kinv;
+  ScopedBIGNUM r;
+  if (!nonce_pool_->Take(&kinv, &r)) {
+    precomputed_nonces->Increment("exhausted");
+    return false;
+  }
+
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(data.data()), data.size(),
+         digest);
+
+  const ScopedECDSA_SIG sig(ECDSA_do_sign_ex(digest, sizeof(digest),
+                                             kinv.get(), r.get(),
+                                             nonce_pool_->key()));
+  if (!sig) {
+    // The nonce is gone either way, sign with a fresh one instead.
+    LOG(WARNING) << "ECDSA_do_sign_ex failed";
+    LOG_OPENSSL_ERRORS(WARNING);
+    precomputed_nonces->Increment("failed");
+    return false;
+  }
+  precomputed_nonces->Increment("used");
+
+  const int sig_size(i2d_ECDSA_SIG(sig.get(), nullptr));
+  CHECK_GT(sig_size, 0);
+  result->resize(sig_size);
+  unsigned char* out(reinterpret_cast<unsigned char*>(&(*result)[0]));
+  CHECK_EQ(sig_size, i2d_ECDSA_SIG(sig.get(), &out));
+  return true;
+#else
+  return false;
+#endif  // CT_PRECOMPUTE_NONCES
+}
+
 std::string Signer::RawSign(const std::string& data) const {
+  std::string precomputed;
+  if (PrecomputedSign(data, &precomputed)) {
+    return precomputed;
+  }
+
   EVP_MD_CTX* ctx = EVP_MD_CTX_new();
   // NOTE: this syntax for setting the hash function requires OpenSSL >= 1.0.0.
   CHECK_EQ(1, EVP_SignInit(ctx, EVP_sha256()));
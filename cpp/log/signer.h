@@ -5,7 +5,10 @@
 
 #include <openssl/evp.h>
 #include <openssl/x509.h>  // for i2d_PUBKEY
+#include <stddef.h>
 #include <stdint.h>
+#include <memory>
+#include <string>
 
 #include "proto/ct.pb.h"
 #include "util/openssl_scoped_types.h"
@@ -15,7 +18,7 @@ namespace cert_trans {
 class Signer {
  public:
   explicit Signer(EVP_PKEY* pkey);
-  virtual ~Signer() = default;
+  virtual ~Signer();
   Signer(const Signer&) = delete;
   Signer& operator=(const Signer&) = delete;
 
@@ -24,17 +27,61 @@ class Signer {
   virtual void Sign(const std::string& data,
                     ct::DigitallySigned* signature) const;
 
+  // Reusable signing state, which saves setting up a new OpenSSL context
+  // for every signature. A context must not be used concurrently.
+  class Context;
+
+  // Returns null for signers without a key (such as mocks).
+  std::unique_ptr<Context> NewContext() const;
+
+  // Like Sign(), but using a |context| created by this signer. If
+  // |context| is null, this is the same as Sign().
+  void SignWithContext(const std::string& data, Context* context,
+                       ct::DigitallySigned* signature) const;
+
+  // For ECDSA keys, starts a background thread keeping up to |pool_size|
+  // per-signature nonces (k^-1, r) precomputed, which leaves only a few
+  // modular operations to do at signing time. When the pool runs dry,
+  // signing falls back to computing the nonce inline. This has no effect
+  // for other key types, or when built with OpenSSL 3.0 or later, which
+  // deprecates the ECDSA functions this needs.
+  // Blocks until the pool is full. Must be called before the signer is
+  // used.
+  void EnablePrecomputation(size_t pool_size);
+
  protected:
   // A constructor for mocking.
   Signer();
 
  private:
+  class NoncePool;
+
   std::string RawSign(const std::string& data) const;
+  // Returns false if no precomputed nonce was available.
+  bool PrecomputedSign(const std::string& data, std::string* result) const;
 
   ScopedEVP_PKEY pkey_;
   ct::DigitallySigned::HashAlgorithm hash_algo_;
   ct::DigitallySigned::SignatureAlgorithm sig_algo_;
   std::string key_id_;
+  std::unique_ptr<NoncePool> nonce_pool_;
+};
+
+
+class Signer::Context {
+ public:
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+
+ private:
+  friend class Signer;
+
+  Context() = default;
+
+  // Initialised for signing with the key, and copied into |ctx_| for each
+  // signature.
+  ScopedEVP_MD_CTX template_;
+  ScopedEVP_MD_CTX ctx_;
 };
 
 }  // namespace cert_trans
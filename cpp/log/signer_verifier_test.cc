@@ -2,6 +2,7 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <stdint.h>
+#include <memory>
 #include <string>
 
 #include "log/signer.h"
@@ -91,6 +92,83 @@ TEST_F(SignerVerifierTest, SignAndVerify) {
   EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature2));
 }
 
+// Check that signatures made with a reusable context verify, and that the
+// context can be used repeatedly.
+TEST_F(SignerVerifierTest, SignWithContext) {
+  std::unique_ptr<Signer::Context> context(signer_->NewContext());
+  ASSERT_TRUE(context);
+
+  DigitallySigned signature1;
+  signer_->SignWithContext(kTestString, context.get(), &signature1);
+  EXPECT_EQ(DigitallySigned::SHA256, signature1.hash_algorithm());
+  EXPECT_EQ(DigitallySigned::ECDSA, signature1.sig_algorithm());
+  EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature1));
+
+  DigitallySigned signature2;
+  signer_->SignWithContext("def", context.get(), &signature2);
+  EXPECT_EQ(Verifier::OK, verifier_->Verify("def", signature2));
+  EXPECT_NE(Verifier::OK, verifier_->Verify(kTestString, signature2));
+
+  // No context falls back to Sign().
+  DigitallySigned signature3;
+  signer_->SignWithContext(kTestString, nullptr, &signature3);
+  EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature3));
+}
+
+// Check that signatures made with precomputed nonces verify, including
+// through a Signer::Context.
+TEST_F(SignerVerifierTest, SignWithPrecomputation) {
+  signer_->EnablePrecomputation(2);
+  std::unique_ptr<Signer::Context> context(signer_->NewContext());
+
+  for (int i = 0; i < 4; ++i) {
+    DigitallySigned signature1;
+    signer_->Sign(kTestString, &signature1);
+    EXPECT_EQ(DigitallySigned::ECDSA, signature1.sig_algorithm());
+    EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature1));
+
+    DigitallySigned signature2;
+    signer_->SignWithContext(kTestString, context.get(), &signature2);
+    EXPECT_EQ(DigitallySigned::ECDSA, signature2.sig_algorithm());
+    EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature2));
+    EXPECT_NE(signature1.signature(), signature2.signature());
+  }
+}
+
+// Check that a reusable verification context gives the same results as
+// Verify().
+TEST_F(SignerVerifierTest, VerifyWithContext) {
+  std::unique_ptr<Verifier::Context> context(verifier_->NewContext());
+  ASSERT_TRUE(context);
+
+  DigitallySigned signature;
+  signer_->Sign(kTestString, &signature);
+  EXPECT_EQ(Verifier::OK,
+            verifier_->VerifyWithContext(kTestString, signature,
+                                         context.get()));
+  EXPECT_EQ(Verifier::INVALID_SIGNATURE,
+            verifier_->VerifyWithContext("def", signature, context.get()));
+  EXPECT_EQ(Verifier::OK,
+            verifier_->VerifyWithContext(kTestString, signature,
+                                         context.get()));
+
+  signature.set_hash_algorithm(DigitallySigned::MD5);
+  EXPECT_EQ(Verifier::HASH_ALGORITHM_MISMATCH,
+            verifier_->VerifyWithContext(kTestString, signature,
+                                         context.get()));
+  signature.set_hash_algorithm(DigitallySigned::SHA256);
+  signature.set_sig_algorithm(DigitallySigned::RSA);
+  EXPECT_EQ(Verifier::SIGNATURE_ALGORITHM_MISMATCH,
+            verifier_->VerifyWithContext(kTestString, signature,
+                                         context.get()));
+
+  signature.set_sig_algorithm(DigitallySigned::ECDSA);
+  signature.set_signature("garbage");
+  EXPECT_EQ(Verifier::INVALID_SIGNATURE,
+            verifier_->VerifyWithContext(kTestString, signature,
+                                         context.get()));
+}
+
 // Check various error cases.
 TEST_F(SignerVerifierTest, Errors) {
   DigitallySigned signature;
@@ -0,0 +1,188 @@
+#include "log/signing_service.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "monitoring/monitoring.h"
+#include "proto/serializer.h"
+
+using cert_trans::serialization::SerializeResult;
+using ct::DigitallySigned;
+using ct::LogEntry;
+using ct::SignedCertificateTimestamp;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+using std::lock_guard;
+using std::min;
+using std::move;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::unique_ptr;
+using std::vector;
+using util::Status;
+using util::Task;
+
+namespace cert_trans {
+namespace {
+
+
+// Upper bound on the number of requests a signing thread takes off the
+// queue at once.
+const size_t kMaxBatchSize = 32;
+
+
+}  // namespace
+
+
+static Gauge<>* signing_queue_depth(
+    Gauge<>::New("signing_queue_depth",
+                 "Number of signing requests waiting for a signing thread."));
+
+static Counter<>* signatures_total(
+    Counter<>::New("signatures_total",
+                   "Number of signatures made by the signing service."));
+
+static Counter<>* signing_latency_ms(
+    Counter<>::New("signing_latency_ms",
+                   "Total time spent signing, in milliseconds. Divide by "
+                   "signatures_total for the average."));
+
+
+SigningService::SigningService(const Signer* signer,
+                               const LogSerializer* serializer,
+                               size_t num_threads)
+    : signer_(CHECK_NOTNULL(signer)),
+      serializer_(serializer ? serializer : &Serializer::Configured()),
+      key_id_(signer_->KeyID()),
+      num_threads_(num_threads),
+      exiting_(false) {
+  CHECK_GT(num_threads, static_cast<size_t>(0));
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&SigningService::Worker, this);
+  }
+}
+
+
+SigningService::~SigningService() {
+  {
+    lock_guard<mutex> lock(lock_);
+    exiting_ = true;
+  }
+  queue_cond_var_.notify_all();
+
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+
+  CHECK(queue_.empty());
+}
+
+
+void SigningService::Sign(const string& data, DigitallySigned* signature,
+                          Task* task) {
+  CHECK_NOTNULL(signature);
+  CHECK_NOTNULL(task);
+  Enqueue([this, data, signature, task](Signer::Context* context) {
+    if (task->CancelRequested()) {
+      task->Return(Status::CANCELLED);
+      return;
+    }
+
+    const steady_clock::time_point start(steady_clock::now());
+    signer_->SignWithContext(data, context, signature);
+    signing_latency_ms->IncrementBy(
+        duration<double, std::milli>(steady_clock::now() - start).count());
+    signatures_total->Increment();
+    task->Return();
+  });
+}
+
+
+void SigningService::SignCertificateTimestamp(const LogEntry& entry,
+                                              SignedCertificateTimestamp* sct,
+                                              Task* task) {
+  CHECK_NOTNULL(sct);
+  CHECK_NOTNULL(task);
+  CHECK(sct->has_timestamp())
+      << "Attempt to sign an SCT with a missing timestamp";
+  const LogEntry* const entry_ptr(&entry);
+  Enqueue([this, entry_ptr, sct, task](Signer::Context* context) {
+    if (task->CancelRequested()) {
+      task->Return(Status::CANCELLED);
+      return;
+    }
+
+    // Serialize on the signing thread as well, it is not free either.
+    string serialized_input;
+    const SerializeResult res(serializer_->SerializeSCTSignatureInput(
+        *sct, *entry_ptr, &serialized_input));
+    if (res != SerializeResult::OK) {
+      task->Return(Status(util::error::INVALID_ARGUMENT,
+                          "failed to serialize the SCT signature input"));
+      return;
+    }
+
+    const steady_clock::time_point start(steady_clock::now());
+    signer_->SignWithContext(serialized_input, context,
+                             sct->mutable_signature());
+    signing_latency_ms->IncrementBy(
+        duration<double, std::milli>(steady_clock::now() - start).count());
+    signatures_total->Increment();
+    sct->mutable_id()->set_key_id(key_id_);
+    task->Return();
+  });
+}
+
+
+void SigningService::Enqueue(const Request& request) {
+  {
+    lock_guard<mutex> lock(lock_);
+    CHECK(!exiting_);
+    queue_.push_back(request);
+    signing_queue_depth->Set(queue_.size());
+  }
+  queue_cond_var_.notify_one();
+}
+
+
+void SigningService::Worker() {
+  const unique_ptr<Signer::Context> context(signer_->NewContext());
+  vector<Request> batch;
+
+  while (true) {
+    {
+      unique_lock<mutex> lock(lock_);
+      queue_cond_var_.wait(lock,
+                           [this]() { return exiting_ || !queue_.empty(); });
+
+      // Drain the queue before exiting.
+      if (queue_.empty()) {
+        CHECK(exiting_);
+        return;
+      }
+
+      // Take our share of what is queued, so that a burst of requests is
+      // still spread over all the threads.
+      const size_t batch_size(
+          min(kMaxBatchSize,
+              (queue_.size() + num_threads_ - 1) / num_threads_));
+      for (size_t i = 0; i < batch_size; ++i) {
+        batch.emplace_back(move(queue_.front()));
+        queue_.pop_front();
+      }
+      signing_queue_depth->Set(queue_.size());
+    }
+
+    for (const auto& request : batch) {
+      request(context.get());
+    }
+    batch.clear();
+  }
+}
+
+
+}  // namespace cert_trans
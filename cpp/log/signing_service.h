@@ -0,0 +1,76 @@
+#ifndef CERT_TRANS_LOG_SIGNING_SERVICE_H_
+#define CERT_TRANS_LOG_SIGNING_SERVICE_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log/signer.h"
+#include "proto/ct.pb.h"
+#include "proto/serializer.h"
+#include "util/task.h"
+
+namespace cert_trans {
+
+
+// Runs signing operations for a Signer on a dedicated pool of threads,
+// keeping them off the calling threads (typically event loops). Each
+// signing thread has its own Signer::Context, and picks up queued requests
+// in batches.
+class SigningService {
+ public:
+  // Does not take ownership of |signer|, which must outlive this object.
+  // SCT signature inputs are serialized with |serializer|, which must
+  // also outlive it, or with Serializer::Configured() if it is null.
+  SigningService(const Signer* signer, const LogSerializer* serializer,
+                 size_t num_threads);
+  SigningService(const Signer* signer, size_t num_threads)
+      : SigningService(signer, nullptr, num_threads) {
+  }
+  SigningService(const SigningService&) = delete;
+  SigningService& operator=(const SigningService&) = delete;
+
+  // Waits for all queued requests to complete.
+  ~SigningService();
+
+  // Signs |data| into |signature|, then returns |task|. |signature| must
+  // remain valid until the task is done. If the task is cancelled before a
+  // signing thread gets to it, it is returned with CANCELLED instead.
+  void Sign(const std::string& data, ct::DigitallySigned* signature,
+            util::Task* task);
+
+  // Asynchronous version of LogSigner::SignCertificateTimestamp(). |entry|
+  // and |sct| must remain valid until |task| is done. If the signature input
+  // cannot be serialized, the task is returned with INVALID_ARGUMENT.
+  void SignCertificateTimestamp(const ct::LogEntry& entry,
+                                ct::SignedCertificateTimestamp* sct,
+                                util::Task* task);
+
+ private:
+  typedef std::function<void(Signer::Context*)> Request;
+
+  void Enqueue(const Request& request);
+  void Worker();
+
+  const Signer* const signer_;
+  const LogSerializer* const serializer_;
+  const std::string key_id_;
+  const size_t num_threads_;
+
+  std::mutex lock_;
+  std::condition_variable queue_cond_var_;
+  std::deque<Request> queue_;
+  bool exiting_;
+
+  std::vector<std::thread> threads_;
+};
+
+
+}  // namespace cert_trans
+
+#endif  // CERT_TRANS_LOG_SIGNING_SERVICE_H_
@@ -0,0 +1,137 @@
+/* -*- indent-tabs-mode: nil -*- */
+#include "log/signing_service.h"
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "log/log_signer.h"
+#include "log/test_signer.h"
+#include "proto/cert_serializer.h"
+#include "proto/ct.pb.h"
+#include "util/status_test_util.h"
+#include "util/sync_task.h"
+#include "util/testing.h"
+#include "util/thread_pool.h"
+
+namespace cert_trans {
+namespace {
+
+using ct::DigitallySigned;
+using ct::LogEntry;
+using ct::SignedCertificateTimestamp;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using util::Status;
+using util::SyncTask;
+
+const char kTestString[] = "abc";
+const int kNumRequests = 200;
+
+
+class SigningServiceTest : public ::testing::Test {
+ protected:
+  SigningServiceTest()
+      : signer_(TestSigner::DefaultLogSigner()),
+        verifier_(TestSigner::DefaultLogSigVerifier()),
+        service_(signer_.get(), 3) {
+  }
+
+  ThreadPool pool_;
+  const unique_ptr<LogSigner> signer_;
+  const unique_ptr<LogSigVerifier> verifier_;
+  SigningService service_;
+};
+
+
+TEST_F(SigningServiceTest, Sign) {
+  DigitallySigned signature;
+  SyncTask task(&pool_);
+  service_.Sign(kTestString, &signature, task.task());
+  task.Wait();
+  EXPECT_OK(task.status());
+  EXPECT_EQ(DigitallySigned::SHA256, signature.hash_algorithm());
+  EXPECT_EQ(DigitallySigned::ECDSA, signature.sig_algorithm());
+  EXPECT_EQ(Verifier::OK, verifier_->Verify(kTestString, signature));
+}
+
+
+TEST_F(SigningServiceTest, SignCertificateTimestamp) {
+  LogEntry entry;
+  SignedCertificateTimestamp sct;
+  TestSigner::SetDefaults(&entry);
+  TestSigner::SetDefaults(&sct);
+  sct.clear_id();
+  sct.clear_signature();
+
+  SyncTask task(&pool_);
+  service_.SignCertificateTimestamp(entry, &sct, task.task());
+  task.Wait();
+  EXPECT_OK(task.status());
+  EXPECT_EQ(signer_->KeyID(), sct.id().key_id());
+  EXPECT_EQ(LogSigVerifier::OK, verifier_->VerifySCTSignature(entry, sct));
+}
+
+
+TEST_F(SigningServiceTest, SignCertificateTimestampSerializeError) {
+  LogEntry entry;
+  SignedCertificateTimestamp sct;
+  TestSigner::SetDefaults(&entry);
+  TestSigner::SetDefaults(&sct);
+  sct.clear_signature();
+  entry.mutable_x509_entry()->clear_leaf_certificate();
+
+  SyncTask task(&pool_);
+  service_.SignCertificateTimestamp(entry, &sct, task.task());
+  task.Wait();
+  EXPECT_EQ(util::error::INVALID_ARGUMENT, task.status().CanonicalCode());
+  EXPECT_FALSE(sct.has_signature());
+}
+
+
+TEST_F(SigningServiceTest, ManyRequests) {
+  LogEntry entry;
+  TestSigner::SetDefaults(&entry);
+
+  vector<unique_ptr<SyncTask>> tasks;
+  vector<SignedCertificateTimestamp> scts(kNumRequests);
+  for (int i = 0; i < kNumRequests; ++i) {
+    TestSigner::SetDefaults(&scts[i]);
+    scts[i].set_timestamp(scts[i].timestamp() + i);
+    scts[i].clear_signature();
+    tasks.emplace_back(new SyncTask(&pool_));
+    service_.SignCertificateTimestamp(entry, &scts[i], tasks.back()->task());
+  }
+
+  for (int i = 0; i < kNumRequests; ++i) {
+    tasks[i]->Wait();
+    EXPECT_OK(tasks[i]->status());
+    EXPECT_EQ(LogSigVerifier::OK,
+              verifier_->VerifySCTSignature(entry, scts[i]));
+  }
+}
+
+
+TEST_F(SigningServiceTest, Cancelled) {
+  DigitallySigned signature;
+  SyncTask task(&pool_);
+  task.Cancel();
+  service_.Sign(kTestString, &signature, task.task());
+  task.Wait();
+  EXPECT_EQ(Status::CANCELLED, task.status());
+  EXPECT_FALSE(signature.has_signature());
+}
+
+
+}  // namespace
+}  // namespace cert_trans
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  ConfigureSerializerForV1CT();
+  return RUN_ALL_TESTS();
+}
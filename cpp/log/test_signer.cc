@@ -209,6 +209,14 @@ LogSigner* TestSigner::DefaultLogSigner() {
   return new LogSigner(pkey);
 }
 
+// Caller owns result.
+// static
+LogSigner* TestSigner::DefaultLogSigner(const LogSerializer* serializer) {
+  EVP_PKEY* pkey = PrivateKeyFromPem(kEcP256PrivateKey);
+  CHECK(pkey != nullptr);
+  return new LogSigner(pkey, serializer);
+}
+
 // Caller owns result.
 // Call as many times as required to get a fresh copy every time.
 // static
@@ -227,6 +235,15 @@ LogSigVerifier* TestSigner::DefaultLogSigVerifier() {
   return new LogSigVerifier(pubkey);
 }
 
+// Caller owns result.
+// static
+LogSigVerifier* TestSigner::DefaultLogSigVerifier(
+    const LogSerializer* serializer) {
+  EVP_PKEY* pubkey = PublicKeyFromPem(kEcP256PublicKey);
+  CHECK(pubkey != nullptr);
+  return new LogSigVerifier(pubkey, serializer);
+}
+
 // static
 void TestSigner::SetDefaults(string* data, string* signature) {
   *data = B(kDefaultSTHSerialized);
@@ -23,9 +23,12 @@ class TestSigner {
 
   static cert_trans::Signer* DefaultSigner();
   static LogSigner* DefaultLogSigner();
+  static LogSigner* DefaultLogSigner(const LogSerializer* serializer);
 
   static cert_trans::Verifier* DefaultVerifier();
   static LogSigVerifier* DefaultLogSigVerifier();
+  static LogSigVerifier* DefaultLogSigVerifier(
+      const LogSerializer* serializer);
 
   // A string and its signature.
   static void SetDefaults(std::string* data, std::string* signature);
@@ -51,6 +51,44 @@ Verifier::Status Verifier::Verify(const std::string& input,
   return OK;
 }
 
+std::unique_ptr<Verifier::Context> Verifier::NewContext() const {
+  if (!pkey_) {
+    return nullptr;
+  }
+
+  std::unique_ptr<Context> context(new Context);
+  context->template_.reset(EVP_MD_CTX_new());
+  context->ctx_.reset(EVP_MD_CTX_new());
+  CHECK(context->template_ && context->ctx_);
+  CHECK_EQ(1, EVP_DigestVerifyInit(context->template_.get(), nullptr,
+                                   EVP_sha256(), nullptr, pkey_.get()));
+  return context;
+}
+
+Verifier::Status Verifier::VerifyWithContext(const std::string& input,
+                                             const DigitallySigned& signature,
+                                             Context* context) const {
+  if (!context) {
+    return Verify(input, signature);
+  }
+
+  if (signature.hash_algorithm() != hash_algo_)
+    return HASH_ALGORITHM_MISMATCH;
+  if (signature.sig_algorithm() != sig_algo_)
+    return SIGNATURE_ALGORITHM_MISMATCH;
+
+  EVP_MD_CTX* const ctx(context->ctx_.get());
+  CHECK_EQ(1, EVP_MD_CTX_copy_ex(ctx, context->template_.get()));
+  CHECK_EQ(1, EVP_DigestVerifyUpdate(ctx, input.data(), input.size()));
+  const std::string& sig(signature.signature());
+  if (EVP_DigestVerifyFinal(ctx,
+                            reinterpret_cast<const unsigned char*>(sig.data()),
+                            sig.size()) != 1) {
+    return INVALID_SIGNATURE;
+  }
+  return OK;
+}
+
 // static
 std::string Verifier::ComputeKeyID(EVP_PKEY* pkey) {
   // i2d_PUBKEY sets the algorithm and (for ECDSA) named curve parameter and
@@ -7,6 +7,8 @@
 #include <openssl/evp.h>
 #include <openssl/x509.h>  // for i2d_PUBKEY
 #include <stdint.h>
+#include <memory>
+#include <string>
 
 #include "proto/ct.pb.h"
 #include "util/openssl_scoped_types.h"
@@ -32,6 +34,19 @@ class Verifier {
   virtual Status Verify(const std::string& input,
                         const ct::DigitallySigned& signature) const;
 
+  // Reusable verification state, which saves setting up a new OpenSSL
+  // context for every signature. A context must not be used concurrently.
+  class Context;
+
+  // Returns null for verifiers without a key (such as mocks).
+  std::unique_ptr<Context> NewContext() const;
+
+  // Like Verify(), but using a |context| created by this verifier. If
+  // |context| is null, this is the same as Verify().
+  Status VerifyWithContext(const std::string& input,
+                           const ct::DigitallySigned& signature,
+                           Context* context) const;
+
   static std::string ComputeKeyID(EVP_PKEY* pkey);
 
  protected:
@@ -47,6 +62,23 @@ class Verifier {
   std::string key_id_;
 };
 
+
+class Verifier::Context {
+ public:
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+
+ private:
+  friend class Verifier;
+
+  Context() = default;
+
+  // Initialised for verifying with the key, and copied into |ctx_| for
+  // each signature.
+  ScopedEVP_MD_CTX template_;
+  ScopedEVP_MD_CTX ctx_;
+};
+
 }  // namespace cert_trans
 
 #endif  // CERT_TRANS_LOG_VERIFIER_H_
@@ -17,10 +17,14 @@ void Sha256Hasher::Reset() {
 }
 
 void Sha256Hasher::Update(const std::string& data) {
+  Update(data.data(), data.size());
+}
+
+void Sha256Hasher::Update(const char* data, size_t size) {
   if (!initialized_)
     Reset();
 
-  SHA256_Update(&ctx_, data.data(), data.size());
+  SHA256_Update(&ctx_, data, size);
 }
 
 string Sha256Hasher::Final() {
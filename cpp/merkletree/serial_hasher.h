@@ -23,6 +23,7 @@ class SerialHasher {
 
   // Update the hash context with (binary) data.
   virtual void Update(const std::string& data) = 0;
+  virtual void Update(const char* data, size_t size) = 0;
 
   // Finalize the hash context and return the binary digest blob.
   virtual std::string Final() = 0;
@@ -43,6 +44,7 @@ class Sha256Hasher : public SerialHasher {
 
   void Reset();
   void Update(const std::string& data);
+  void Update(const char* data, size_t size);
   std::string Final();
   std::unique_ptr<SerialHasher> Create() const;
 
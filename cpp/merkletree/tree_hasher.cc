@@ -30,16 +30,23 @@ TreeHasher::TreeHasher(unique_ptr<SerialHasher> hasher)
 string TreeHasher::HashLeaf(const string& data) const {
   lock_guard<mutex> lock(lock_);
   hasher_->Reset();
-  hasher_->Update(string(1, kLeafPrefix));
+  hasher_->Update(&kLeafPrefix, 1);
   hasher_->Update(data);
   return hasher_->Final();
 }
 
+unique_ptr<SerialHasher> TreeHasher::NewLeafHasher() const {
+  unique_ptr<SerialHasher> hasher(hasher_->Create());
+  hasher->Reset();
+  hasher->Update(&kLeafPrefix, 1);
+  return hasher;
+}
+
 string TreeHasher::HashChildren(const string& left_child,
                                 const string& right_child) const {
   lock_guard<mutex> lock(lock_);
   hasher_->Reset();
-  hasher_->Update(string(1, kNodePrefix));
+  hasher_->Update(&kNodePrefix, 1);
   hasher_->Update(left_child);
   hasher_->Update(right_child);
   return hasher_->Final();
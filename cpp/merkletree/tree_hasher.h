@@ -24,6 +24,12 @@ class TreeHasher {
 
   std::string HashLeaf(const std::string& data) const;
 
+  // Returns a new hasher, set up so that passing it the leaf data with
+  // Update() and then calling Final() gives the same result as
+  // HashLeaf(). This is for leaves that are produced piecewise, and
+  // does not hold the lock of this TreeHasher while hashing.
+  std::unique_ptr<SerialHasher> NewLeafHasher() const;
+
   // Accepts arbitrary strings as children. When hashing digests, it
   // is the responsibility of the caller to ensure the inputs are of
   // correct size.
@@ -149,6 +149,20 @@ TYPED_TEST(TreeHasherTest, TestVectors) {
   }
 }
 
+TYPED_TEST(TreeHasherTest, NewLeafHasher) {
+  for (size_t i = 0; this->test_vectors_->leaves[i].input != NULL; ++i) {
+    const string input(S(this->test_vectors_->leaves[i].input,
+                         this->test_vectors_->leaves[i].input_length));
+    // Feed the leaf one byte at a time.
+    std::unique_ptr<SerialHasher> hasher(this->tree_hasher_.NewLeafHasher());
+    for (size_t j = 0; j < input.size(); ++j) {
+      hasher->Update(input.data() + j, 1);
+    }
+    EXPECT_STREQ(this->test_vectors_->leaves[i].output,
+                 H(hasher->Final()).c_str());
+  }
+}
+
 #undef S
 #undef H
 
@@ -20,12 +20,14 @@ using std::chrono::seconds;
 using std::chrono::system_clock;
 using std::lock_guard;
 using std::make_pair;
+using std::make_shared;
 using std::map;
 using std::move;
 using std::mutex;
 using std::pair;
 using std::placeholders::_1;
 using std::placeholders::_2;
+using std::recursive_mutex;
 using std::string;
 using std::to_string;
 using std::unique_lock;
@@ -50,6 +52,14 @@ DEFINE_string(trusted_root_certs, "",
               "connections.");
 DEFINE_int32(url_fetcher_max_conn_per_host_port, 4,
              "maximum number of URL fetcher connections per host:port");
+DEFINE_int32(url_fetcher_max_active_conn_per_host_port, 16,
+             "maximum number of URL fetcher connections per host:port that "
+             "can be in use at the same time, further requests wait for one "
+             "of them to be available (0 for no limit)");
+
+DEFINE_bool(tls_client_session_resumption, true,
+            "Resume TLS sessions, with session tickets or IDs, when "
+            "reconnecting to a server, rather than doing a full handshake.");
 
 DEFINE_string(tls_client_minimum_protocol, "tlsv12",
               "Minimum acceptable TLS "
@@ -81,6 +91,21 @@ static Gauge<string>* connections_per_host_port(
     Gauge<string>::New("connections_per_host_port", "host_port",
                        "Number of cached connections port host:port"));
 
+static Gauge<string>* requests_in_flight_per_host_port(
+    Gauge<string>::New("requests_in_flight_per_host_port", "host_port",
+                       "Number of connections in use per host:port"));
+
+static Gauge<string>* connection_waiters_per_host_port(
+    Gauge<string>::New("connection_waiters_per_host_port", "host_port",
+                       "Number of requests waiting for a connection per "
+                       "host:port"));
+
+static Counter<string, string>* tls_handshakes_per_host_port(
+    Counter<string, string>::New("tls_handshakes_per_host_port", "host_port",
+                                 "type",
+                                 "Number of completed TLS handshakes per "
+                                 "host:port, by type (full or resumed)"));
+
 
 namespace {
 
@@ -92,11 +117,24 @@ int GetSSLConnectionIndex() {
 }
 
 
+int GetSSLCTXPoolIndex() {
+  static const int ssl_ctx_pool_index(
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr));
+  return ssl_ctx_pool_index;
+}
+
+
 string HostPortString(const HostPortPair& pair) {
   return pair.first + ":" + to_string(pair.second);
 }
 
 
+HostPortPair HostPortForURL(const URL& url) {
+  const uint16_t default_port(url.Protocol() == "https" ? 443 : 80);
+  return HostPortPair(url.Host(), url.Port() != 0 ? url.Port() : default_port);
+}
+
+
 }  // namespace
 
 
@@ -118,6 +156,7 @@ class EvConnection {
   EvConnection(evhtp_connection_t* conn, HostPortPair&& other_end)
       : ev_conn_(CHECK_NOTNULL(conn)),
         other_end_(move(other_end)),
+        handshake_done_(false),
         errored_(false) {
     if (ev_conn_->ssl) {
       SSL_set_ex_data(ev_conn_->ssl, GetSSLConnectionIndex(),
@@ -144,10 +183,21 @@ class EvConnection {
     return errored_;
   }
 
+  // Returns true the first time it is called. Must only be called on
+  // the event loop thread.
+  bool FirstHandshakeDone() {
+    const bool first(!handshake_done_);
+    handshake_done_ = true;
+    return first;
+  }
+
  private:
   // We never really own this, evhtp does, as it likes to remind us.
   evhtp_connection_t* ev_conn_;
   const HostPortPair other_end_;
+  // With TLS 1.3, OpenSSL signals the end of the handshake again when
+  // it receives session tickets, this is so we count it only once.
+  bool handshake_done_;
 
   mutable std::mutex lock_;
   bool errored_;
@@ -283,6 +333,7 @@ SSL_CTX* CreateSSLCTXFromFlags() {
 
 ConnectionPool::ConnectionPool(libevent::Base* base)
     : base_(CHECK_NOTNULL(base)),
+      owner_(make_shared<Owner>(this)),
       cleanup_scheduled_(false),
       ssl_ctx_(CreateSSLCTXFromFlags(), SSL_CTX_free) {
   CHECK(ssl_ctx_) << "could not build SSL context: "
@@ -309,6 +360,77 @@ ConnectionPool::ConnectionPool(libevent::Base* base)
 
   SSL_CTX_set_verify(ssl_ctx_.get(), SSL_VERIFY_PEER,
                      EvConnection::SSLVerifyCallback);
+
+  CHECK_EQ(1, SSL_CTX_set_ex_data(ssl_ctx_.get(), GetSSLCTXPoolIndex(),
+                                  static_cast<void*>(this)));
+  SSL_CTX_set_info_callback(ssl_ctx_.get(), &ConnectionPool::InfoCallback);
+  if (FLAGS_tls_client_session_resumption) {
+    // OpenSSL does not look up client sessions by itself, so it only
+    // needs to give them to us.
+    SSL_CTX_set_session_cache_mode(ssl_ctx_.get(),
+                                   SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssl_ctx_.get(),
+                            &ConnectionPool::NewSessionCallback);
+    SSL_CTX_clear_options(ssl_ctx_.get(), SSL_OP_NO_TICKET);
+  } else {
+    SSL_CTX_set_session_cache_mode(ssl_ctx_.get(), SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_options(ssl_ctx_.get(), SSL_OP_NO_TICKET);
+  }
+}
+
+
+// static
+int ConnectionPool::NewSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  ConnectionPool* const pool(static_cast<ConnectionPool*>(SSL_CTX_get_ex_data(
+      SSL_get_SSL_CTX(ssl), GetSSLCTXPoolIndex())));
+  const EvConnection* const connection(static_cast<const EvConnection*>(
+      SSL_get_ex_data(ssl, GetSSLConnectionIndex())));
+  if (!pool || !connection) {
+    // Not ours to keep.
+    return 0;
+  }
+
+  VLOG(1) << "new TLS session for " << HostPortString(connection->other_end());
+  lock_guard<mutex> lock(pool->sessions_lock_);
+  // This takes over the reference that OpenSSL passed us.
+  pool->sessions_[connection->other_end()].reset(session);
+  return 1;
+}
+
+
+// static
+void ConnectionPool::InfoCallback(const SSL* ssl, int where, int ret) {
+  if (!(where & SSL_CB_HANDSHAKE_DONE)) {
+    return;
+  }
+
+  EvConnection* const connection(static_cast<EvConnection*>(
+      SSL_get_ex_data(ssl, GetSSLConnectionIndex())));
+  if (!connection || !connection->FirstHandshakeDone()) {
+    return;
+  }
+
+  // SSL_session_reused() is not const-correct in older versions of
+  // OpenSSL.
+  const bool resumed(SSL_session_reused(const_cast<SSL*>(ssl)) == 1);
+  const string hostport(HostPortString(connection->other_end()));
+  VLOG(1) << (resumed ? "resumed" : "full") << " TLS handshake with "
+          << hostport;
+  tls_handshakes_per_host_port->Increment(hostport,
+                                          resumed ? "resumed" : "full");
+}
+
+
+ConnectionPool::~ConnectionPool() {
+  // Lookups still in progress must not call us back.
+  {
+    lock_guard<recursive_mutex> lock(owner_->lock);
+    owner_->pool = nullptr;
+  }
+
+  // Connections could still be around, and call NewSessionCallback.
+  SSL_CTX_set_ex_data(ssl_ctx_.get(), GetSSLCTXPoolIndex(), nullptr);
 }
 
 
@@ -419,61 +541,126 @@ void ConnectionPool::RemoveDeadConnectionsFromDeque(
 }
 
 
-unique_ptr<ConnectionPool::Connection> ConnectionPool::Get(const URL& url) {
+void ConnectionPool::Get(const URL& url, const GetCallback& cb) {
   CHECK(url.Protocol() == "http" || url.Protocol() == "https");
-  const uint16_t default_port(url.Protocol() == "https" ? 443 : 80);
-  HostPortPair key(url.Host(), url.Port() != 0 ? url.Port() : default_port);
+  HostPortPair key(HostPortForURL(url));
   unique_lock<mutex> lock(lock_);
+  HostPortState& state(conns_[key]);
+
+  RemoveDeadConnectionsFromDeque(lock, &state.idle);
+
+  if (!state.idle.empty()) {
+    VLOG(1) << "cached evhtp_connection for " << key.first << ":"
+            << key.second;
+    unique_ptr<ConnectionPool::Connection> retval(
+        move(state.idle.back().second));
+    state.idle.pop_back();
+    CHECK_NOTNULL(retval->connection());
+    ++state.in_use;
+    UpdateGauges(lock, key, state);
+    lock.unlock();
+    cb(move(retval));
+    return;
+  }
+
+  CHECK_GE(FLAGS_url_fetcher_max_active_conn_per_host_port, 0);
+  if (FLAGS_url_fetcher_max_active_conn_per_host_port > 0 &&
+      state.in_use >= FLAGS_url_fetcher_max_active_conn_per_host_port) {
+    VLOG(1) << "waiting for a connection to " << key.first << ":"
+            << key.second;
+    state.waiters.push_back(Waiter{url, cb});
+    UpdateGauges(lock, key, state);
+    return;
+  }
+
+  ++state.in_use;
+  UpdateGauges(lock, key, state);
+  lock.unlock();
+  NewConnection(url, key, cb);
+}
 
-  auto it(conns_.find(key));
 
-  if (it != conns_.end() && !it->second.empty()) {
-    RemoveDeadConnectionsFromDeque(lock, &it->second);
+void ConnectionPool::NewConnection(const URL& url, const HostPortPair& key,
+                                   const GetCallback& cb) {
+  VLOG(1) << "new evhtp_connection for " << key.first << ":" << key.second;
+  const libevent::Base::ConnectionCallback connected(
+      bind(&ConnectionPool::ConnectedIfAlive, owner_, key, cb, _1));
+  if (url.Protocol() == "https") {
+    base_->HttpsConnectionNew(key.first, key.second, ssl_ctx_.get(),
+                              connected);
+  } else {
+    base_->HttpConnectionNew(key.first, key.second, connected);
   }
+}
 
-  if (it == conns_.end() || it->second.empty()) {
-    VLOG(1) << "new evhtp_connection for " << key.first << ":" << key.second;
-    // This EvConnection has a slightly complicated lifetime; it needs to hang
-    // around until libevhtp/libevent have entirely finished with the
-    // evhtp_connection_t it references, and for at least as long as the life
-    // of the Connection we return from this method.
-    //
-    // This is accomplished through the use of a couple of shared_ptrs;
-    // this one, which goes inside the returned Connection object, and another
-    // created further below which gets passed in to the
-    // ConnectionFinishedHook.
-    auto conn(std::make_shared<EvConnection>(
-        url.Protocol() == "https"
-            ? base_->HttpsConnectionNew(key.first, key.second, ssl_ctx_.get())
-            : base_->HttpConnectionNew(key.first, key.second),
-        move(key)));
-    unique_ptr<ConnectionPool::Connection> handle(new Connection(conn));
-    struct timeval read_timeout = {FLAGS_connection_read_timeout_seconds,
-                                   kZeroMillis};
-    struct timeval write_timeout = {FLAGS_connection_write_timeout_seconds,
-                                    kZeroMillis};
-    evhtp_connection_set_timeouts(handle->connection(), &read_timeout,
-                                  &write_timeout);
-    evhtp_connection_set_hook(handle->connection(), evhtp_hook_on_conn_error,
-                           reinterpret_cast<evhtp_hook>(
-                               EvConnection::ConnectionErrorHook),
-                           reinterpret_cast<void*>(conn.get()));
-    evhtp_connection_set_hook(
-        handle->connection(), evhtp_hook_on_connection_fini,
-        reinterpret_cast<evhtp_hook>(EvConnection::ConnectionFinishedHook),
-        // We'll hold on to another shared_ptr to the Connection
-        // until evhtp tells us that it's finished with the cnxn.
-        reinterpret_cast<void*>(new shared_ptr<EvConnection>(conn)));
-    return handle;
+
+// static
+void ConnectionPool::ConnectedIfAlive(const shared_ptr<Owner>& owner,
+                                      const HostPortPair& key,
+                                      const GetCallback& cb,
+                                      evhtp_connection_t* ev_conn) {
+  // This is recursive, as |cb| can make another request, which can
+  // get its connection right away.
+  lock_guard<recursive_mutex> lock(owner->lock);
+  if (!owner->pool) {
+    VLOG(1) << "pool destroyed while connecting to " << HostPortString(key);
+    if (ev_conn) {
+      evhtp_connection_free(ev_conn);
+    }
+    return;
   }
+  owner->pool->Connected(key, cb, ev_conn);
+}
 
-  VLOG(1) << "cached evhtp_connection for " << key.first << ":" << key.second;
-  unique_ptr<ConnectionPool::Connection> retval(
-      move(it->second.back().second));
-  it->second.pop_back();
-  CHECK_NOTNULL(retval->connection());
 
-  return retval;
+void ConnectionPool::Connected(const HostPortPair& key,
+                               const GetCallback& cb,
+                               evhtp_connection_t* ev_conn) {
+  if (!ev_conn) {
+    LOG(WARNING) << "could not connect to " << HostPortString(key);
+    Return(key, nullptr);
+    cb(nullptr);
+    return;
+  }
+
+  // This EvConnection has a slightly complicated lifetime; it needs to hang
+  // around until libevhtp/libevent have entirely finished with the
+  // evhtp_connection_t it references, and for at least as long as the life
+  // of the Connection we pass to |cb|.
+  //
+  // This is accomplished through the use of a couple of shared_ptrs;
+  // this one, which goes inside the returned Connection object, and another
+  // created further below which gets passed in to the
+  // ConnectionFinishedHook.
+  auto conn(std::make_shared<EvConnection>(ev_conn, HostPortPair(key)));
+  if (conn->connection()->ssl && FLAGS_tls_client_session_resumption) {
+    lock_guard<mutex> lock(sessions_lock_);
+    const auto it(sessions_.find(conn->other_end()));
+    if (it != sessions_.end()) {
+      VLOG(1) << "resuming TLS session for "
+              << HostPortString(conn->other_end());
+      // This takes its own reference to the session.
+      CHECK_EQ(1, SSL_set_session(conn->connection()->ssl, it->second.get()));
+    }
+  }
+  unique_ptr<ConnectionPool::Connection> handle(new Connection(conn));
+  struct timeval read_timeout = {FLAGS_connection_read_timeout_seconds,
+                                 kZeroMillis};
+  struct timeval write_timeout = {FLAGS_connection_write_timeout_seconds,
+                                  kZeroMillis};
+  evhtp_connection_set_timeouts(handle->connection(), &read_timeout,
+                                &write_timeout);
+  evhtp_connection_set_hook(handle->connection(), evhtp_hook_on_conn_error,
+                            reinterpret_cast<evhtp_hook>(
+                                EvConnection::ConnectionErrorHook),
+                            reinterpret_cast<void*>(conn.get()));
+  evhtp_connection_set_hook(
+      handle->connection(), evhtp_hook_on_connection_fini,
+      reinterpret_cast<evhtp_hook>(EvConnection::ConnectionFinishedHook),
+      // We'll hold on to another shared_ptr to the Connection
+      // until evhtp tells us that it's finished with the cnxn.
+      reinterpret_cast<void*>(new shared_ptr<EvConnection>(conn)));
+  cb(move(handle));
 }
 
 
@@ -483,34 +670,74 @@ void ConnectionPool::Put(unique_ptr<ConnectionPool::Connection> handle) {
     return;
   }
 
+  const HostPortPair key(handle->other_end());
+  bool reusable(true);
   if (!handle->connection()) {
     VLOG(1) << "returned dead Connection";
+    reusable = false;
+  } else if (handle->GetErrored()) {
+    VLOG(1) << "returned errored Connection";
+    reusable = false;
+  }
+  if (!reusable) {
     handle.reset();
-    return;
   }
 
-  if (handle->GetErrored()) {
-    VLOG(1) << "returned errored Connection";
-    handle.reset();
+  VLOG(1) << "returned Connection for " << key.first << ":" << key.second;
+  Return(key, move(handle));
+}
+
+
+void ConnectionPool::Return(const HostPortPair& key,
+                            unique_ptr<ConnectionPool::Connection> handle) {
+  const bool reusable(handle != nullptr);
+  unique_lock<mutex> lock(lock_);
+  HostPortState& state(conns_[key]);
+
+  if (!state.waiters.empty()) {
+    // The next waiter gets this connection or, if it cannot be reused,
+    // its place, without going through the idle connections.
+    Waiter waiter(move(state.waiters.front()));
+    state.waiters.pop_front();
+    UpdateGauges(lock, key, state);
+    lock.unlock();
+    if (reusable) {
+      waiter.cb(move(handle));
+    } else {
+      // Going through the event loop keeps a series of failures from
+      // recursing.
+      base_->Add(bind(&ConnectionPool::NewConnection, this, waiter.url, key,
+                      waiter.cb));
+    }
     return;
   }
 
-  const HostPortPair& key(handle->other_end());
-  VLOG(1) << "returned Connection for " << key.first << ":" << key.second;
-  lock_guard<mutex> lock(lock_);
-  auto& entry(conns_[key]);
+  CHECK_GT(state.in_use, 0);
+  --state.in_use;
+  if (reusable) {
+    CHECK_GE(FLAGS_url_fetcher_max_conn_per_host_port, 0);
+    state.idle.emplace_back(make_pair(system_clock::now(), move(handle)));
+    VLOG(1) << "ConnectionPool for " << HostPortString(key)
+            << " size : " << state.idle.size();
+    if (!cleanup_scheduled_ &&
+        state.idle.size() >
+            static_cast<uint>(FLAGS_url_fetcher_max_conn_per_host_port)) {
+      cleanup_scheduled_ = true;
+      base_->Add(bind(&ConnectionPool::Cleanup, this));
+    }
+  }
+  UpdateGauges(lock, key, state);
+}
+
 
-  CHECK_GE(FLAGS_url_fetcher_max_conn_per_host_port, 0);
-  entry.emplace_back(make_pair(system_clock::now(), move(handle)));
+void ConnectionPool::UpdateGauges(const unique_lock<mutex>& lock,
+                                  const HostPortPair& key,
+                                  const HostPortState& state) {
+  CHECK(lock.owns_lock());
   const string hostport(HostPortString(key));
-  VLOG(1) << "ConnectionPool for " << hostport << " size : " << entry.size();
-  connections_per_host_port->Set(hostport, entry.size());
-  if (!cleanup_scheduled_ &&
-      entry.size() >
-          static_cast<uint>(FLAGS_url_fetcher_max_conn_per_host_port)) {
-    cleanup_scheduled_ = true;
-    base_->Add(bind(&ConnectionPool::Cleanup, this));
-  }
+  connections_per_host_port->Set(hostport, state.idle.size());
+  requests_in_flight_per_host_port->Set(hostport, state.in_use);
+  connection_waiters_per_host_port->Set(hostport, state.waiters.size());
 }
 
 
@@ -521,18 +748,18 @@ void ConnectionPool::Cleanup() {
       system_clock::now() -
       seconds(FLAGS_connection_pool_max_unused_age_seconds));
 
-  // conns_ is a std::map<HostPortPair, std::deque<TimestampedConnection>>
+  // conns_ is a std::map<HostPortPair, HostPortState>
   for (auto& entry : conns_) {
-    RemoveDeadConnectionsFromDeque(lock, &entry.second);
-    while (entry.second.front().first < cutoff &&
-           entry.second.size() >
+    std::deque<TimestampedConnection>* const idle(&entry.second.idle);
+    RemoveDeadConnectionsFromDeque(lock, idle);
+    while (!idle->empty() && idle->front().first < cutoff &&
+           idle->size() >
                static_cast<uint>(FLAGS_url_fetcher_max_conn_per_host_port)) {
-      entry.second.pop_front();
+      idle->pop_front();
     }
-    const string hostport(HostPortString(entry.first));
-    VLOG(1) << "ConnectionPool for " << hostport
-            << " size : " << entry.second.size();
-    connections_per_host_port->Set(hostport, entry.second.size());
+    VLOG(1) << "ConnectionPool for " << HostPortString(entry.first)
+            << " size : " << idle->size();
+    UpdateGauges(lock, entry.first, entry.second);
   }
 }
 
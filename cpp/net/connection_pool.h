@@ -4,6 +4,7 @@
 #include <openssl/ssl.h>
 #include <stdint.h>
 #include <deque>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -35,6 +36,13 @@ struct evhtp_connection_deleter {
 };
 
 
+struct ssl_session_deleter {
+  void operator()(SSL_SESSION* session) const {
+    SSL_SESSION_free(session);
+  }
+};
+
+
 typedef std::pair<std::string, uint16_t> HostPortPair;
 class EvConnection;
 
@@ -58,32 +66,101 @@ class ConnectionPool {
     friend class ConnectionPool;
   };
 
-  ConnectionPool(libevent::Base* base);
+  typedef std::function<void(std::unique_ptr<Connection>)> GetCallback;
+
+  explicit ConnectionPool(libevent::Base* base);
+  ~ConnectionPool();
   ConnectionPool(const ConnectionPool&) = delete;
   ConnectionPool& operator=(const ConnectionPool&) = delete;
 
-  std::unique_ptr<Connection> Get(const URL& url);
+  // Calls |cb| with a connection to the host and port of |url|. If
+  // there are already --url_fetcher_max_active_conn_per_host_port
+  // connections in use for it, this waits until one of them is
+  // returned, in the order the requests were made. |cb| is either run
+  // before this returns, or later on the event loop thread, and it
+  // gets nullptr if the host could not be resolved. This does not
+  // block.
+  void Get(const URL& url, const GetCallback& cb);
+
+  // Every connection obtained from Get() must be returned here, even
+  // if it is broken.
   void Put(std::unique_ptr<Connection> conn);
 
  private:
   typedef std::pair<std::chrono::system_clock::time_point,
                     std::unique_ptr<Connection>> TimestampedConnection;
 
+  struct Waiter {
+    URL url;
+    GetCallback cb;
+  };
+
+  // Shared with the callbacks of the connections being made, which
+  // can outlive the pool: a DNS lookup can still be in progress when
+  // it is destroyed. |pool| is cleared then, with |lock| held, and the
+  // callbacks hold |lock| while they use it.
+  struct Owner {
+    explicit Owner(ConnectionPool* p) : pool(p) {
+    }
+
+    std::recursive_mutex lock;
+    ConnectionPool* pool;
+  };
+
+  struct HostPortState {
+    HostPortState() : in_use(0) {
+    }
+
+    // We get and put connections from the back of the deque, and
+    // when there are too many, we prune them from the front (LIFO).
+    std::deque<TimestampedConnection> idle;
+    // Connections handed out, or being made for a waiter.
+    int in_use;
+    std::deque<Waiter> waiters;
+  };
+
+  // Called by OpenSSL when a server gives us a session that can be
+  // resumed later.
+  static int NewSessionCallback(SSL* ssl, SSL_SESSION* session);
+  // Called by OpenSSL as the handshake progresses.
+  static void InfoCallback(const SSL* ssl, int where, int ret);
+
   static void RemoveDeadConnectionsFromDeque(
       const std::unique_lock<std::mutex>& lock,
       std::deque<TimestampedConnection>* deque);
 
+  void NewConnection(const URL& url, const HostPortPair& key,
+                     const GetCallback& cb);
+  // Calls Connected() on the pool of |owner|, unless it has been
+  // destroyed, in which case |ev_conn| is freed and |cb| is dropped.
+  static void ConnectedIfAlive(const std::shared_ptr<Owner>& owner,
+                               const HostPortPair& key,
+                               const GetCallback& cb,
+                               evhtp_connection_t* ev_conn);
+  void Connected(const HostPortPair& key, const GetCallback& cb,
+                 evhtp_connection_t* ev_conn);
+  // Gives the slot of a connection that was in use for |key| to the
+  // next waiter, with |handle| if it can be reused (otherwise, it is
+  // nullptr).
+  void Return(const HostPortPair& key, std::unique_ptr<Connection> handle);
+  void UpdateGauges(const std::unique_lock<std::mutex>& lock,
+                    const HostPortPair& key, const HostPortState& state);
   void Cleanup();
 
   libevent::Base* const base_;
+  const std::shared_ptr<Owner> owner_;
 
   std::mutex lock_;
-  // We get and put connections from the back of the deque, and when
-  // there are too many, we prune them from the front (LIFO).
-  std::map<HostPortPair, std::deque<TimestampedConnection>> conns_;
+  std::map<HostPortPair, HostPortState> conns_;
   bool cleanup_scheduled_;
 
   std::unique_ptr<evhtp_ssl_ctx_t, void (*)(evhtp_ssl_ctx_t*)> ssl_ctx_;
+
+  std::mutex sessions_lock_;
+  // The most recent TLS session for each host:port, which new
+  // connections to it will try to resume.
+  std::map<HostPortPair, std::unique_ptr<SSL_SESSION, ssl_session_deleter>>
+      sessions_;
 };
 
 
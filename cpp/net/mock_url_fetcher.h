@@ -12,6 +12,9 @@ class MockUrlFetcher : public UrlFetcher {
  public:
   MOCK_METHOD3(Fetch,
                void(const Request& req, Response* resp, util::Task* task));
+  MOCK_METHOD4(FetchStreaming,
+               void(const Request& req, Response* resp,
+                    const BodyCallback& body_cb, util::Task* task));
 };
 
 
@@ -5,19 +5,27 @@
 #include <evhtp.h>
 #include <evhtp/parser.h>
 #include <glog/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include "net/connection_pool.h"
-#include "util/thread_pool.h"
 
 using cert_trans::internal::ConnectionPool;
+using std::atomic;
 using std::bind;
 using std::endl;
+using std::hash;
 using std::make_pair;
+using std::make_shared;
 using std::move;
 using std::ostream;
+using std::placeholders::_1;
+using std::shared_ptr;
 using std::string;
 using std::to_string;
 using std::unique_ptr;
+using std::vector;
 using util::Status;
 using util::Task;
 using util::TaskHold;
@@ -25,19 +33,89 @@ using util::TaskHold;
 namespace cert_trans {
 
 
-struct UrlFetcher::Impl {
-  Impl(libevent::Base* base, ThreadPool* thread_pool)
+namespace {
+
+
+// An event loop, and the connections that are used on it.
+struct EventLoop {
+  // Uses a loop that is dispatched by someone else.
+  EventLoop(libevent::Base* base)
       : base_(CHECK_NOTNULL(base)),
-        thread_pool_(CHECK_NOTNULL(thread_pool)),
-        pool_(base_) {
+        pool_(base_),
+        in_flight_(0) {
+  }
+
+  // Takes ownership of |base|, and starts a thread to dispatch it.
+  EventLoop(const shared_ptr<libevent::Base>& base)
+      : owned_base_(base),
+        base_(CHECK_NOTNULL(owned_base_.get())),
+        pool_(base_),
+        in_flight_(0),
+        pump_(new libevent::EventPumpThread(owned_base_)) {
   }
 
+  const shared_ptr<libevent::Base> owned_base_;
   libevent::Base* const base_;
-  ThreadPool* const thread_pool_;
   internal::ConnectionPool pool_;
+  // Number of requests started on this loop that are not done yet.
+  atomic<int> in_flight_;
+  // Must be last, so that the thread is stopped before anything else
+  // is destroyed.
+  const unique_ptr<libevent::EventPumpThread> pump_;
+};
+
+
+}  // namespace
+
+
+struct UrlFetcher::Impl {
+  Impl(libevent::Base* base) : selection_(LoopSelection::HOST_HASH) {
+    loops_.emplace_back(new EventLoop(base));
+  }
+
+  Impl(int num_loops, LoopSelection selection,
+       const ResolverFactory& resolver_factory)
+      : selection_(selection) {
+    CHECK_GT(num_loops, 0);
+    for (int i = 0; i < num_loops; ++i) {
+      const shared_ptr<libevent::Base> base(
+          resolver_factory ? make_shared<libevent::Base>(resolver_factory())
+                           : make_shared<libevent::Base>());
+      loops_.emplace_back(new EventLoop(base));
+    }
+  }
+
+  EventLoop* PickLoop(const URL& url) const;
+
+  const LoopSelection selection_;
+  vector<unique_ptr<EventLoop>> loops_;
 };
 
 
+EventLoop* UrlFetcher::Impl::PickLoop(const URL& url) const {
+  if (loops_.size() == 1) {
+    return loops_.front().get();
+  }
+
+  switch (selection_) {
+    case LoopSelection::HOST_HASH:
+      return loops_[hash<string>()(url.Host()) % loops_.size()].get();
+
+    case LoopSelection::LEAST_LOADED:
+      return std::min_element(loops_.begin(), loops_.end(),
+                              [](const unique_ptr<EventLoop>& a,
+                                 const unique_ptr<EventLoop>& b) {
+                                return a->in_flight_.load() <
+                                       b->in_flight_.load();
+                              })
+          ->get();
+  }
+
+  LOG(FATAL) << "unknown UrlFetcher::LoopSelection: "
+             << static_cast<int>(selection_);
+}
+
+
 namespace {
 
 
@@ -61,28 +139,36 @@ htp_method VerbToCmdType(UrlFetcher::Verb verb) {
 
 
 struct State {
-  State(libevent::Base* base, ConnectionPool* pool,
-        const UrlFetcher::Request& request, UrlFetcher::Response* response,
-        Task* task);
+  State(EventLoop* loop, const UrlFetcher::Request& request,
+        UrlFetcher::Response* response,
+        const UrlFetcher::BodyCallback& body_cb, Task* task);
 
   ~State() {
     CHECK(!conn_) << "request state object still had a connection at cleanup?";
+    --loop_->in_flight_;
   }
 
   void MakeRequest();
+  void ConnectionReady(unique_ptr<ConnectionPool::Connection> conn);
 
   // The following methods must only be called on the libevent
   // dispatch thread.
   void RunRequest();
+  void HeadersReceived(evhtp_request_t* req);
+  void BodyReceived(evbuffer* buf);
   void RequestDone(evhtp_request_t* req);
 
+  EventLoop* const loop_;
   libevent::Base* const base_;
   ConnectionPool* const pool_;
   const UrlFetcher::Request request_;
   UrlFetcher::Response* const response_;
+  const UrlFetcher::BodyCallback body_cb_;
   Task* const task_;
 
   unique_ptr<ConnectionPool::Connection> conn_;
+  // Set once |body_cb_| returns false.
+  bool body_aborted_;
 };
 
 
@@ -91,6 +177,27 @@ void RequestCallback(evhtp_request_t* req, void* userdata) {
 }
 
 
+evhtp_res HeadersCallback(evhtp_request_t* req, evhtp_headers_t* headers,
+                          void* userdata) {
+  static_cast<State*>(CHECK_NOTNULL(userdata))->HeadersReceived(req);
+  return EVHTP_RES_OK;
+}
+
+
+evhtp_res ReadCallback(evhtp_request_t* req, evbuffer* buf, void* userdata) {
+  static_cast<State*>(CHECK_NOTNULL(userdata))->BodyReceived(buf);
+  return EVHTP_RES_OK;
+}
+
+
+void CopyHeaders(evhtp_headers_t* from, UrlFetcher::Headers* to) {
+  to->clear();
+  for (evhtp_kv* ptr = from->tqh_first; ptr; ptr = ptr->next.tqe_next) {
+    to->insert(make_pair(ptr->key, ptr->val));
+  }
+}
+
+
 UrlFetcher::Request NormaliseRequest(UrlFetcher::Request req) {
   if (req.url.Path().empty()) {
     req.url.SetPath("/");
@@ -104,14 +211,18 @@ UrlFetcher::Request NormaliseRequest(UrlFetcher::Request req) {
 }
 
 
-State::State(libevent::Base* base, ConnectionPool* pool,
-             const UrlFetcher::Request& request,
-             UrlFetcher::Response* response, Task* task)
-    : base_(CHECK_NOTNULL(base)),
-      pool_(CHECK_NOTNULL(pool)),
+State::State(EventLoop* loop, const UrlFetcher::Request& request,
+             UrlFetcher::Response* response,
+             const UrlFetcher::BodyCallback& body_cb, Task* task)
+    : loop_(CHECK_NOTNULL(loop)),
+      base_(loop_->base_),
+      pool_(&loop_->pool_),
       request_(NormaliseRequest(request)),
       response_(CHECK_NOTNULL(response)),
-      task_(CHECK_NOTNULL(task)) {
+      body_cb_(body_cb),
+      task_(CHECK_NOTNULL(task)),
+      body_aborted_(false) {
+  ++loop_->in_flight_;
   if (request_.url.Protocol() != "http" &&
       request_.url.Protocol() != "https") {
     VLOG(1) << "unsupported protocol: " << request_.url.Protocol();
@@ -124,8 +235,16 @@ State::State(libevent::Base* base, ConnectionPool* pool,
 
 
 void State::MakeRequest() {
-  CHECK(!libevent::Base::OnEventThread());
-  conn_ = pool_->Get(request_.url);
+  pool_->Get(request_.url, bind(&State::ConnectionReady, this, _1));
+}
+
+
+void State::ConnectionReady(unique_ptr<ConnectionPool::Connection> conn) {
+  if (!conn) {
+    task_->Return(Status(util::error::UNAVAILABLE, "could not resolve host."));
+    return;
+  }
+  conn_ = move(conn);
   base_->Add(bind(&State::RunRequest, this));
 }
 
@@ -146,9 +265,16 @@ void State::RunRequest() {
                              evhtp_header_new(header.first.c_str(),
                                               header.second.c_str(), 1, 1));
   }
+  if (body_cb_) {
+    evhtp_request_set_hook(http_req, evhtp_hook_on_headers,
+                           reinterpret_cast<evhtp_hook>(&HeadersCallback),
+                           this);
+    evhtp_request_set_hook(http_req, evhtp_hook_on_read,
+                           reinterpret_cast<evhtp_hook>(&ReadCallback), this);
+  }
 
   if (!conn_->connection() || conn_->GetErrored()) {
-    conn_.reset();
+    pool_->Put(move(conn_));
     task_->Return(Status(util::error::UNAVAILABLE, "connection failed."));
     return;
   }
@@ -184,6 +310,38 @@ void State::RunRequest() {
 }
 
 
+void State::HeadersReceived(evhtp_request_t* req) {
+  CHECK(libevent::Base::OnEventThread());
+  // Make these available to |body_cb_|.
+  response_->status_code = evhtp_request_status(req);
+  CopyHeaders(req->headers_in, &response_->headers);
+}
+
+
+void State::BodyReceived(evbuffer* buf) {
+  CHECK(libevent::Base::OnEventThread());
+  if (!body_aborted_) {
+    const int num_chunks(evbuffer_peek(buf, -1, nullptr, nullptr, 0));
+    vector<evbuffer_iovec> chunks(num_chunks);
+    CHECK_EQ(num_chunks,
+             evbuffer_peek(buf, -1, nullptr, chunks.data(), num_chunks));
+    for (const evbuffer_iovec& chunk : chunks) {
+      const util::StringView data(static_cast<const char*>(chunk.iov_base),
+                                  chunk.iov_len);
+      if (!body_cb_(data)) {
+        VLOG(1) << "body callback aborted the request";
+        body_aborted_ = true;
+        break;
+      }
+    }
+  }
+
+  // Whatever is left in the buffer would be accumulated in the
+  // request's input buffer, which is what we're trying to avoid.
+  evbuffer_drain(buf, evbuffer_get_length(buf));
+}
+
+
 struct evhtp_request_deleter {
   void operator()(evhtp_request_t* r) const {
     evhtp_request_free(r);
@@ -235,17 +393,36 @@ void State::RequestDone(evhtp_request_t* req) {
     return;
   }
 
-  response_->headers.clear();
-  for (evhtp_kv* ptr = req->headers_in->tqh_first; ptr;
-       ptr = ptr->next.tqe_next) {
-    response_->headers.insert(make_pair(ptr->key, ptr->val));
-  }
+  CopyHeaders(req->headers_in, &response_->headers);
 
-  const size_t body_length(evbuffer_get_length(req->buffer_in));
-  string body(reinterpret_cast<const char*>(
-                  evbuffer_pullup(req->buffer_in, body_length)),
-              body_length);
-  response_->body.swap(body);
+  if (body_cb_) {
+    // The body has already been handed over.
+    response_->body.clear();
+    response_->body_buffer.reset();
+    if (body_aborted_) {
+      task_->Return(
+          Status(util::error::CANCELLED, "request aborted by body callback"));
+      return;
+    }
+  } else if (request_.buffer_response_body) {
+    // This only moves the chain of chunks over, without copying them.
+    response_->body.clear();
+    response_->body_buffer.reset(CHECK_NOTNULL(evbuffer_new()),
+                                 evbuffer_free);
+    CHECK_EQ(0, evbuffer_add_buffer(response_->body_buffer.get(),
+                                    req->buffer_in));
+  } else {
+    // Copy out the chunks directly, rather than having evbuffer_pullup
+    // linearize them first.
+    const size_t body_length(evbuffer_get_length(req->buffer_in));
+    response_->body.resize(body_length);
+    if (body_length > 0) {
+      CHECK_EQ(static_cast<ev_ssize_t>(body_length),
+               evbuffer_copyout(req->buffer_in, &response_->body[0],
+                                body_length));
+    }
+    response_->body_buffer.reset();
+  }
 
   VLOG(2) << *response_;
 
@@ -261,8 +438,25 @@ UrlFetcher::UrlFetcher() {
 }
 
 
-UrlFetcher::UrlFetcher(libevent::Base* base, ThreadPool* thread_pool)
-    : impl_(new Impl(CHECK_NOTNULL(base), CHECK_NOTNULL(thread_pool))) {
+UrlFetcher::UrlFetcher(libevent::Base* base)
+    : impl_(new Impl(CHECK_NOTNULL(base))) {
+}
+
+
+UrlFetcher::UrlFetcher(int num_loops, LoopSelection selection,
+                       const ResolverFactory& resolver_factory)
+    : impl_(new Impl(num_loops, selection, resolver_factory)) {
+}
+
+
+UrlFetcher::UrlFetcher(libevent::Base* base, ThreadPool*)
+    : UrlFetcher(base) {
+}
+
+
+UrlFetcher::UrlFetcher(int num_loops, LoopSelection selection, ThreadPool*,
+                       const ResolverFactory& resolver_factory)
+    : UrlFetcher(num_loops, selection, resolver_factory) {
 }
 
 
@@ -274,14 +468,24 @@ UrlFetcher::~UrlFetcher() {
 void UrlFetcher::Fetch(const Request& req, Response* resp, Task* task) {
   TaskHold hold(task);
 
-  State* const state(new State(impl_->base_, &impl_->pool_, req, resp, task));
+  EventLoop* const loop(impl_->PickLoop(req.url));
+  State* const state(new State(loop, req, resp, BodyCallback(), task));
   task->DeleteWhenDone(state);
 
-  // Run State::MakeRequest() on the task's executor because it may
-  // block doing DNS resolution etc.
-  // TODO(alcutter): this can go back to being put straight on the event Base
-  // once evhtp supports creating SSL connections to a DNS name.
-  impl_->thread_pool_->Add(bind(&State::MakeRequest, state));
+  loop->base_->Add(bind(&State::MakeRequest, state));
+}
+
+
+void UrlFetcher::FetchStreaming(const Request& req, Response* resp,
+                                const BodyCallback& body_cb, Task* task) {
+  CHECK(body_cb);
+  TaskHold hold(task);
+
+  EventLoop* const loop(impl_->PickLoop(req.url));
+  State* const state(new State(loop, req, resp, body_cb, task));
+  task->DeleteWhenDone(state);
+
+  loop->base_->Add(bind(&State::MakeRequest, state));
 }
 
 
@@ -290,7 +494,13 @@ ostream& operator<<(ostream& output, const UrlFetcher::Response& resp) {
   for (const auto& header : resp.headers) {
     output << "  " << header.first << ": " << header.second << endl;
   }
-  output << "}" << endl << "body: <<EOF" << endl << resp.body << "EOF" << endl;
+  output << "}" << endl;
+  if (resp.body_buffer) {
+    output << "body_buffer: " << evbuffer_get_length(resp.body_buffer.get())
+           << " bytes" << endl;
+  } else {
+    output << "body: <<EOF" << endl << resp.body << "EOF" << endl;
+  }
 
   return output;
 }
@@ -1,7 +1,9 @@
 #ifndef CERT_TRANS_NET_URL_FETCHER_H_
 #define CERT_TRANS_NET_URL_FETCHER_H_
 
+#include <event2/buffer.h>
 #include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
 #include <ostream>
@@ -9,13 +11,18 @@
 
 #include "net/url.h"
 #include "util/compare.h"
+#include "util/libevent_wrapper.h"
+#include "util/string_view.h"
 #include "util/task.h"
 
-namespace cert_trans {
+#if __cplusplus >= 202002L
+#include <utility>
 
-namespace libevent {
-class Base;
-}
+#include "util/coro.h"
+#include "util/statusor.h"
+#endif
+
+namespace cert_trans {
 
 class ThreadPool;
 
@@ -33,15 +40,20 @@ class UrlFetcher {
   };
 
   struct Request {
-    Request() : verb(Verb::GET) {
+    Request() : verb(Verb::GET), buffer_response_body(false) {
     }
-    Request(const URL& input_url) : verb(Verb::GET), url(input_url) {
+    Request(const URL& input_url)
+        : verb(Verb::GET), url(input_url), buffer_response_body(false) {
     }
 
     Verb verb;
     URL url;
     Headers headers;
     std::string body;
+    // If set, the response body is handed over in
+    // Response::body_buffer, as it was received, rather than being
+    // copied into Response::body.
+    bool buffer_response_body;
   };
 
   struct Response {
@@ -51,9 +63,47 @@ class UrlFetcher {
     int status_code;
     Headers headers;
     std::string body;
+    // Only set if the request had buffer_response_body set, in which
+    // case |body| is left empty. Callers should still be prepared to
+    // find the body in |body| instead, as not all fetchers support
+    // this.
+    std::shared_ptr<evbuffer> body_buffer;
+  };
+
+  // How a fetcher with several event loops picks the one a request
+  // runs on.
+  enum class LoopSelection {
+    // Requests for a given host always go to the same loop, so that
+    // they can reuse its pooled connections.
+    HOST_HASH,
+    // Requests go to the loop with the fewest requests in flight.
+    LEAST_LOADED,
   };
 
-  UrlFetcher(libevent::Base* base, ThreadPool* thread_pool);
+  typedef std::function<std::unique_ptr<libevent::Base::Resolver>()>
+      ResolverFactory;
+
+  // Receives the response body, piece by piece, as it arrives. It is
+  // called on an event loop thread, so it must not block. Returning
+  // false stops the delivery of the body.
+  typedef std::function<bool(util::StringView data)> BodyCallback;
+
+  // Runs all the requests on |base|, which must be dispatched by the
+  // caller.
+  explicit UrlFetcher(libevent::Base* base);
+  // Creates |num_loops| event loops, each with its own thread and
+  // connection pool, and spreads the requests over them according to
+  // |selection|. If |resolver_factory| is set, it is used to create the
+  // resolver of each loop.
+  UrlFetcher(int num_loops, LoopSelection selection,
+             const ResolverFactory& resolver_factory = ResolverFactory());
+  // Deprecated: |thread_pool| is not used (nothing here blocks). Use
+  // the constructors above instead.
+  UrlFetcher(libevent::Base* base, ThreadPool* thread_pool)
+      __attribute__((deprecated));
+  UrlFetcher(int num_loops, LoopSelection selection, ThreadPool* thread_pool,
+             const ResolverFactory& resolver_factory = ResolverFactory())
+      __attribute__((deprecated));
   virtual ~UrlFetcher();
   UrlFetcher(const UrlFetcher&) = delete;
   UrlFetcher& operator=(const UrlFetcher&) = delete;
@@ -64,6 +114,23 @@ class UrlFetcher {
   // Response::status_code.
   virtual void Fetch(const Request& req, Response* resp, util::Task* task);
 
+  // Like Fetch(), but the body is passed to |body_cb| as it is
+  // received, instead of being kept in |resp|. The status code and
+  // headers of |resp| are set before the first call to |body_cb|. If
+  // |body_cb| stops the delivery, the rest of the body is discarded
+  // and the task returns CANCELLED.
+  virtual void FetchStreaming(const Request& req, Response* resp,
+                              const BodyCallback& body_cb, util::Task* task);
+
+#if __cplusplus >= 202002L
+  class FetchAwaiter;
+
+  // Version of Fetch() for coroutines (see util/coro.h), which gives
+  // the response if the status of the task is OK. It has a name of its
+  // own, so that subclasses overriding Fetch() do not hide it.
+  FetchAwaiter FetchAsync(Request req);
+#endif
+
  protected:
   UrlFetcher();
 
@@ -73,6 +140,40 @@ class UrlFetcher {
 };
 
 
+#if __cplusplus >= 202002L
+class UrlFetcher::FetchAwaiter : public util::TaskAwaiter<FetchAwaiter> {
+ public:
+  FetchAwaiter(UrlFetcher* fetcher, Request req)
+      : fetcher_(fetcher), req_(std::move(req)) {
+  }
+
+  void Run(util::Task* task) {
+    fetcher_->Fetch(req_, &resp_, task);
+  }
+
+  util::StatusOr<Response> await_resume() {
+    const util::Status status(TaskAwaiter::await_resume());
+    if (!status.ok()) {
+      return status;
+    }
+    return std::move(resp_);
+  }
+
+ private:
+  UrlFetcher* const fetcher_;
+  const Request req_;
+  Response resp_;
+};
+
+
+inline UrlFetcher::FetchAwaiter UrlFetcher::FetchAsync(Request req) {
+  return FetchAwaiter(this, std::move(req));
+}
+
+
+#endif
+
+
 std::ostream& operator<<(std::ostream& output, const UrlFetcher::Request& req);
 std::ostream& operator<<(std::ostream& output,
                          const UrlFetcher::Response& resp);
@@ -27,6 +27,8 @@
 #include <vfork.h>
 #endif
 
+#include "monitoring/metric.h"
+#include "monitoring/registry.h"
 #include "net/connection_pool.h"
 #include "net/url_fetcher.h"
 #include "util/libevent_wrapper.h"
@@ -37,6 +39,8 @@
 
 DECLARE_int32(connection_read_timeout_seconds);
 DECLARE_int32(connection_write_timeout_seconds);
+DECLARE_int32(url_fetcher_max_active_conn_per_host_port);
+DECLARE_bool(tls_client_session_resumption);
 DECLARE_string(trusted_root_certs);
 
 namespace cert_trans {
@@ -46,6 +50,7 @@ using std::shared_ptr;
 using std::string;
 using std::to_string;
 using std::unique_ptr;
+using std::vector;
 using util::SyncTask;
 using util::testing::StatusIs;
 
@@ -67,12 +72,26 @@ namespace {
 
 class LocalhostResolver : public libevent::Base::Resolver {
  public:
-  string Resolve(const std::string& name) override {
-    return "127.0.0.1";
+  void Resolve(const std::string& name, const Callback& cb) override {
+    cb("127.0.0.1");
   }
 };
 
 
+// Returns how many TLS handshakes of |type| ("full" or "resumed") the
+// connection pools have done with localhost:|port| so far.
+double TLSHandshakes(uint16_t port, const string& type) {
+  for (const Metric* metric : Registry::Instance()->GetMetrics()) {
+    if (metric->Name() == "tls_handshakes_per_host_port") {
+      const auto values(metric->CurrentValues());
+      const auto it(values.find({"localhost:" + to_string(port), type}));
+      return it == values.end() ? 0 : it->second.second;
+    }
+  }
+  return 0;
+}
+
+
 pid_t RunOpenSSLServer(uint16_t port, const std::string& cert_file,
                        const std::string& key_file,
                        const std::string& mode = "-www") {
@@ -110,7 +129,7 @@ class UrlFetcherTest : public ::testing::Test {
         event_pump_(base_),
         pool_() {
     FLAGS_trusted_root_certs = FLAGS_cert_dir + "/ca-cert.pem";
-    fetcher_.reset(new UrlFetcher(base_.get(), &pool_));
+    fetcher_.reset(new UrlFetcher(base_.get()));
   }
 
  protected:
@@ -134,6 +153,136 @@ TEST_F(UrlFetcherTest, TestCertMatchesHost) {
 }
 
 
+TEST_F(UrlFetcherTest, TestBufferResponseBody) {
+  UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kLocalHostPort)));
+  req.buffer_response_body = true;
+  UrlFetcher::Response resp;
+
+  SyncTask task(&pool_);
+  fetcher_->Fetch(req, &resp, task.task());
+  task.Wait();
+  EXPECT_OK(task.status());
+  EXPECT_EQ(200, resp.status_code);
+  EXPECT_TRUE(resp.body.empty());
+  ASSERT_TRUE(resp.body_buffer);
+  EXPECT_LT(0U, evbuffer_get_length(resp.body_buffer.get()));
+}
+
+
+TEST_F(UrlFetcherTest, TestFetchStreaming) {
+  UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kLocalHostPort)));
+  UrlFetcher::Response resp;
+  string body;
+
+  SyncTask task(&pool_);
+  fetcher_->FetchStreaming(req, &resp,
+                           [&resp, &body](util::StringView data) {
+                             EXPECT_EQ(200, resp.status_code);
+                             body.append(data.data(), data.size());
+                             return true;
+                           },
+                           task.task());
+  task.Wait();
+  EXPECT_OK(task.status());
+  EXPECT_EQ(200, resp.status_code);
+  EXPECT_TRUE(resp.body.empty());
+  EXPECT_FALSE(body.empty());
+}
+
+
+TEST_F(UrlFetcherTest, TestFetchStreamingAbort) {
+  UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kLocalHostPort)));
+  UrlFetcher::Response resp;
+  int calls(0);
+
+  SyncTask task(&pool_);
+  fetcher_->FetchStreaming(req, &resp,
+                           [&calls](util::StringView data) {
+                             ++calls;
+                             return false;
+                           },
+                           task.task());
+  task.Wait();
+  EXPECT_THAT(task.status(), StatusIs(util::error::CANCELLED));
+  EXPECT_EQ(1, calls);
+}
+
+
+TEST_F(UrlFetcherTest, TestConnectionLimit) {
+  const int saved_limit(FLAGS_url_fetcher_max_active_conn_per_host_port);
+  FLAGS_url_fetcher_max_active_conn_per_host_port = 1;
+  const int kNumFetches(8);
+
+  UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kLocalHostPort)));
+  vector<UrlFetcher::Response> resps(kNumFetches);
+  vector<unique_ptr<SyncTask>> tasks;
+  for (int i = 0; i < kNumFetches; ++i) {
+    tasks.emplace_back(new SyncTask(&pool_));
+    fetcher_->Fetch(req, &resps[i], tasks.back()->task());
+  }
+
+  // They all go through the one connection, in turn.
+  for (int i = 0; i < kNumFetches; ++i) {
+    tasks[i]->Wait();
+    EXPECT_OK(tasks[i]->status());
+    EXPECT_EQ(200, resps[i].status_code);
+  }
+
+  FLAGS_url_fetcher_max_active_conn_per_host_port = saved_limit;
+}
+
+
+// "openssl s_server -www" closes the connection after each response,
+// so every fetch has to reconnect.
+void FetchSeveralTimes(UrlFetcher* fetcher, ThreadPool* pool, int count) {
+  const UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kLocalHostPort)));
+  for (int i = 0; i < count; ++i) {
+    UrlFetcher::Response resp;
+    SyncTask task(pool);
+    fetcher->Fetch(req, &resp, task.task());
+    task.Wait();
+    EXPECT_OK(task.status());
+    EXPECT_EQ(200, resp.status_code);
+  }
+}
+
+
+TEST_F(UrlFetcherTest, TestTLSSessionResumption) {
+  const double full_before(TLSHandshakes(kLocalHostPort, "full"));
+  const double resumed_before(TLSHandshakes(kLocalHostPort, "resumed"));
+  const int kNumFetches(3);
+
+  FetchSeveralTimes(fetcher_.get(), &pool_, kNumFetches);
+
+  // Only the first connection needs a full handshake.
+  EXPECT_EQ(full_before + 1, TLSHandshakes(kLocalHostPort, "full"));
+  EXPECT_EQ(resumed_before + kNumFetches - 1,
+            TLSHandshakes(kLocalHostPort, "resumed"));
+}
+
+
+TEST_F(UrlFetcherTest, TestTLSSessionResumptionDisabled) {
+  const bool saved_resumption(FLAGS_tls_client_session_resumption);
+  FLAGS_tls_client_session_resumption = false;
+  // The flag is used when the connection pool is created.
+  UrlFetcher fetcher(base_.get());
+  const double full_before(TLSHandshakes(kLocalHostPort, "full"));
+  const double resumed_before(TLSHandshakes(kLocalHostPort, "resumed"));
+  const int kNumFetches(3);
+
+  FetchSeveralTimes(&fetcher, &pool_, kNumFetches);
+
+  EXPECT_EQ(full_before + kNumFetches, TLSHandshakes(kLocalHostPort, "full"));
+  EXPECT_EQ(resumed_before, TLSHandshakes(kLocalHostPort, "resumed"));
+  FLAGS_tls_client_session_resumption = saved_resumption;
+}
+
+
 TEST_F(UrlFetcherTest, TestCertDoesNotMatchHost) {
   UrlFetcher::Request req(
       URL("https://localhost:" + to_string(kNonLocalHostPort)));
@@ -290,6 +439,66 @@ TEST_F(UrlFetcherTest, TestTimeout) {
 }
 
 
+class UrlFetcherMultiLoopTest
+    : public ::testing::TestWithParam<UrlFetcher::LoopSelection> {
+ public:
+  UrlFetcherMultiLoopTest() {
+    FLAGS_trusted_root_certs = FLAGS_cert_dir + "/ca-cert.pem";
+    fetcher_.reset(new UrlFetcher(4, GetParam(), []() {
+      return unique_ptr<libevent::Base::Resolver>(new LocalhostResolver);
+    }));
+  }
+
+ protected:
+  ThreadPool pool_;
+  unique_ptr<UrlFetcher> fetcher_;
+};
+
+
+TEST_P(UrlFetcherMultiLoopTest, TestConcurrentFetches) {
+  const vector<URL> urls{
+      URL("https://localhost:" + to_string(kLocalHostPort)),
+      URL("https://donkey.example.com:" + to_string(kStarExampleComPort)),
+      URL("https://binky.example.com:" + to_string(kBinkyExampleComPort)),
+      URL("https://127.0.0.1:" + to_string(k127_0_0_1Port)),
+  };
+  const int kNumFetches(32);
+
+  vector<UrlFetcher::Response> resps(kNumFetches);
+  vector<unique_ptr<SyncTask>> tasks;
+  for (int i = 0; i < kNumFetches; ++i) {
+    tasks.emplace_back(new SyncTask(&pool_));
+    fetcher_->Fetch(UrlFetcher::Request(urls[i % urls.size()]), &resps[i],
+                    tasks.back()->task());
+  }
+
+  for (int i = 0; i < kNumFetches; ++i) {
+    tasks[i]->Wait();
+    EXPECT_OK(tasks[i]->status()) << urls[i % urls.size()];
+    EXPECT_EQ(200, resps[i].status_code) << urls[i % urls.size()];
+  }
+}
+
+
+TEST_P(UrlFetcherMultiLoopTest, TestCertDoesNotMatchHost) {
+  UrlFetcher::Request req(
+      URL("https://localhost:" + to_string(kNonLocalHostPort)));
+  UrlFetcher::Response resp;
+
+  SyncTask task(&pool_);
+  fetcher_->Fetch(req, &resp, task.task());
+  task.Wait();
+  EXPECT_THAT(task.status(), StatusIs(util::error::UNAVAILABLE));
+  EXPECT_EQ(kSSLErrorStatus, resp.status_code);
+}
+
+
+INSTANTIATE_TEST_CASE_P(LoopSelection, UrlFetcherMultiLoopTest,
+                        ::testing::Values(
+                            UrlFetcher::LoopSelection::HOST_HASH,
+                            UrlFetcher::LoopSelection::LEAST_LOADED));
+
+
 }  // namespace cert_trans
 
 
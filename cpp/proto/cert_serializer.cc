@@ -3,13 +3,16 @@
 
 #include <glog/logging.h>
 #include <math.h>
+#include <algorithm>
 #include <string>
 
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 
+using cert_trans::serialization::ByteSink;
 using cert_trans::serialization::DeserializeResult;
 using cert_trans::serialization::SerializeResult;
+using cert_trans::serialization::TLSWriter;
 using cert_trans::serialization::WriteFixedBytes;
 using cert_trans::serialization::WriteList;
 using cert_trans::serialization::WriteUint;
@@ -29,6 +32,25 @@ const size_t kMaxCertificateLength = (1 << 24) - 1;
 const size_t kMaxCertificateChainLength = (1 << 24) - 1;
 
 
+// Length of the fixed-size fields at the start of V1 signature inputs:
+// version, signature type, timestamp and entry type.
+static size_t V1SignatureInputHeaderLength() {
+  return Serializer::kVersionLengthInBytes +
+         Serializer::kSignatureTypeLengthInBytes +
+         Serializer::kTimestampLengthInBytes +
+         Serializer::kLogEntryTypeLengthInBytes;
+}
+
+
+// Same as above, for V1 Merkle tree leaves.
+static size_t V1MerkleTreeLeafHeaderLength() {
+  return Serializer::kVersionLengthInBytes +
+         Serializer::kMerkleLeafTypeLengthInBytes +
+         Serializer::kTimestampLengthInBytes +
+         Serializer::kLogEntryTypeLengthInBytes;
+}
+
+
 SerializeResult CheckCertificateFormat(const string& cert) {
   if (cert.empty()) {
     return SerializeResult::EMPTY_CERTIFICATE;
@@ -40,7 +62,7 @@ SerializeResult CheckCertificateFormat(const string& cert) {
 }
 
 
-string CertV1LeafData(const LogEntry& entry) {
+const string& CertV1LeafData(const LogEntry& entry) {
   switch (entry.type()) {
     // TODO(mhs): Because there is no X509_ENTRY_V2 we have to assume that
     // whichever of the cert fields is set defines the entry type. In other
@@ -77,13 +99,19 @@ SerializeResult SerializeV1CertSCTSignatureInput(uint64_t timestamp,
   if (res != SerializeResult::OK) {
     return res;
   }
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::CERTIFICATE_TIMESTAMP, Serializer::kSignatureTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteVarBytes(certificate, kMaxCertificateLength, result);
-  WriteVarBytes(extensions, Serializer::kMaxExtensionsLength, result);
+  TLSWriter writer(result);
+  writer.Reserve(V1SignatureInputHeaderLength() +
+                 TLSWriter::VarBytesLength(certificate,
+                                           kMaxCertificateLength) +
+                 TLSWriter::VarBytesLength(extensions,
+                                           Serializer::kMaxExtensionsLength));
+  writer.WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer.WriteUint(ct::CERTIFICATE_TIMESTAMP,
+                   Serializer::kSignatureTypeLengthInBytes);
+  writer.WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer.WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes);
+  writer.WriteVarBytes(certificate, kMaxCertificateLength);
+  writer.WriteVarBytes(extensions, Serializer::kMaxExtensionsLength);
   return SerializeResult::OK;
 }
 
@@ -104,14 +132,20 @@ SerializeResult SerializeV1PrecertSCTSignatureInput(
     return res;
   }
   result->clear();
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::CERTIFICATE_TIMESTAMP, Serializer::kSignatureTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::PRECERT_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteFixedBytes(issuer_key_hash, result);
-  WriteVarBytes(tbs_certificate, kMaxCertificateLength, result);
-  WriteVarBytes(extensions, Serializer::kMaxExtensionsLength, result);
+  TLSWriter writer(result);
+  writer.Reserve(V1SignatureInputHeaderLength() + issuer_key_hash.size() +
+                 TLSWriter::VarBytesLength(tbs_certificate,
+                                           kMaxCertificateLength) +
+                 TLSWriter::VarBytesLength(extensions,
+                                           Serializer::kMaxExtensionsLength));
+  writer.WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer.WriteUint(ct::CERTIFICATE_TIMESTAMP,
+                   Serializer::kSignatureTypeLengthInBytes);
+  writer.WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer.WriteUint(ct::PRECERT_ENTRY, Serializer::kLogEntryTypeLengthInBytes);
+  writer.WriteFixedBytes(issuer_key_hash);
+  writer.WriteVarBytes(tbs_certificate, kMaxCertificateLength);
+  writer.WriteVarBytes(extensions, Serializer::kMaxExtensionsLength);
   return SerializeResult::OK;
 }
 
@@ -139,10 +173,9 @@ SerializeResult SerializeV1SCTSignatureInput(
 }
 
 
-SerializeResult SerializeV1CertSCTMerkleTreeLeaf(uint64_t timestamp,
-                                                 const string& certificate,
-                                                 const string& extensions,
-                                                 string* result) {
+static SerializeResult WriteV1CertSCTMerkleTreeLeaf(
+    uint64_t timestamp, const string& certificate, const string& extensions,
+    TLSWriter* writer) {
   SerializeResult res = CheckCertificateFormat(certificate);
   if (res != SerializeResult::OK) {
     return res;
@@ -151,21 +184,37 @@ SerializeResult SerializeV1CertSCTMerkleTreeLeaf(uint64_t timestamp,
   if (res != SerializeResult::OK) {
     return res;
   }
-  result->clear();
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TIMESTAMPED_ENTRY, Serializer::kMerkleLeafTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteVarBytes(certificate, kMaxCertificateLength, result);
-  WriteVarBytes(extensions, Serializer::kMaxExtensionsLength, result);
+  writer->Reserve(V1MerkleTreeLeafHeaderLength() +
+                  TLSWriter::VarBytesLength(certificate,
+                                            kMaxCertificateLength) +
+                  TLSWriter::VarBytesLength(extensions,
+                                            Serializer::kMaxExtensionsLength));
+  writer->WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer->WriteUint(ct::TIMESTAMPED_ENTRY,
+                    Serializer::kMerkleLeafTypeLengthInBytes);
+  writer->WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer->WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes);
+  writer->WriteVarBytes(certificate, kMaxCertificateLength);
+  writer->WriteVarBytes(extensions, Serializer::kMaxExtensionsLength);
   return SerializeResult::OK;
 }
 
 
-SerializeResult SerializeV1PrecertSCTMerkleTreeLeaf(
+SerializeResult SerializeV1CertSCTMerkleTreeLeaf(uint64_t timestamp,
+                                                 const string& certificate,
+                                                 const string& extensions,
+                                                 string* result) {
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV1CertSCTMerkleTreeLeaf(timestamp, certificate, extensions,
+                                      &writer);
+}
+
+
+static SerializeResult WriteV1PrecertSCTMerkleTreeLeaf(
     uint64_t timestamp, const string& issuer_key_hash,
-    const string& tbs_certificate, const string& extensions, string* result) {
+    const string& tbs_certificate, const string& extensions,
+    TLSWriter* writer) {
   SerializeResult res = CheckCertificateFormat(tbs_certificate);
   if (res != SerializeResult::OK) {
     return res;
@@ -178,36 +227,50 @@ SerializeResult SerializeV1PrecertSCTMerkleTreeLeaf(
   if (res != SerializeResult::OK) {
     return res;
   }
-  result->clear();
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TIMESTAMPED_ENTRY, Serializer::kMerkleLeafTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::PRECERT_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteFixedBytes(issuer_key_hash, result);
-  WriteVarBytes(tbs_certificate, kMaxCertificateLength, result);
-  WriteVarBytes(extensions, Serializer::kMaxExtensionsLength, result);
+  writer->Reserve(V1MerkleTreeLeafHeaderLength() + issuer_key_hash.size() +
+                  TLSWriter::VarBytesLength(tbs_certificate,
+                                            kMaxCertificateLength) +
+                  TLSWriter::VarBytesLength(extensions,
+                                            Serializer::kMaxExtensionsLength));
+  writer->WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer->WriteUint(ct::TIMESTAMPED_ENTRY,
+                    Serializer::kMerkleLeafTypeLengthInBytes);
+  writer->WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer->WriteUint(ct::PRECERT_ENTRY,
+                    Serializer::kLogEntryTypeLengthInBytes);
+  writer->WriteFixedBytes(issuer_key_hash);
+  writer->WriteVarBytes(tbs_certificate, kMaxCertificateLength);
+  writer->WriteVarBytes(extensions, Serializer::kMaxExtensionsLength);
   return SerializeResult::OK;
 }
 
 
-SerializeResult SerializeV1SCTMerkleTreeLeaf(
+SerializeResult SerializeV1PrecertSCTMerkleTreeLeaf(
+    uint64_t timestamp, const string& issuer_key_hash,
+    const string& tbs_certificate, const string& extensions, string* result) {
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV1PrecertSCTMerkleTreeLeaf(timestamp, issuer_key_hash,
+                                         tbs_certificate, extensions, &writer);
+}
+
+
+static SerializeResult WriteV1SCTMerkleTreeLeaf(
     const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-    string* result) {
+    TLSWriter* writer) {
   if (sct.version() != ct::V1) {
     return SerializeResult::UNSUPPORTED_VERSION;
   }
-  result->clear();
   switch (entry.type()) {
     case ct::X509_ENTRY:
-      return SerializeV1CertSCTMerkleTreeLeaf(
+      return WriteV1CertSCTMerkleTreeLeaf(
           sct.timestamp(), entry.x509_entry().leaf_certificate(),
-          sct.extensions(), result);
+          sct.extensions(), writer);
     case ct::PRECERT_ENTRY:
-      return SerializeV1PrecertSCTMerkleTreeLeaf(
+      return WriteV1PrecertSCTMerkleTreeLeaf(
           sct.timestamp(), entry.precert_entry().pre_cert().issuer_key_hash(),
           entry.precert_entry().pre_cert().tbs_certificate(), sct.extensions(),
-          result);
+          writer);
     default:
       break;
   }
@@ -215,8 +278,17 @@ SerializeResult SerializeV1SCTMerkleTreeLeaf(
 }
 
 
-DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
-                                                 MerkleTreeLeaf* leaf) {
+SerializeResult SerializeV1SCTMerkleTreeLeaf(
+    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+    string* result) {
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV1SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
+static DeserializeResult ReadV1MerkleTreeLeaf(TLSDeserializer* des,
+                                              MerkleTreeLeafView* leaf) {
   CHECK(des != nullptr);
   CHECK(leaf != nullptr);
 
@@ -228,7 +300,6 @@ DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
   if (version != ct::V1) {
     return DeserializeResult::UNSUPPORTED_VERSION;
   }
-  leaf->set_version(ct::V1);
 
   unsigned int type;
   if (!des->ReadUint(Serializer::kMerkleLeafTypeLengthInBytes, &type)) {
@@ -237,59 +308,102 @@ DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
   if (type != ct::TIMESTAMPED_ENTRY) {
     return DeserializeResult::UNKNOWN_LEAF_TYPE;
   }
-  leaf->set_type(ct::TIMESTAMPED_ENTRY);
-
-  ct::TimestampedEntry* const entry = leaf->mutable_timestamped_entry();
 
-  uint64_t timestamp;
-  if (!des->ReadUint(Serializer::kTimestampLengthInBytes, &timestamp)) {
+  if (!des->ReadUint(Serializer::kTimestampLengthInBytes, &leaf->timestamp)) {
     return DeserializeResult::INPUT_TOO_SHORT;
   }
-  entry->set_timestamp(timestamp);
 
   unsigned int entry_type;
   if (!des->ReadUint(Serializer::kLogEntryTypeLengthInBytes, &entry_type)) {
     return DeserializeResult::INPUT_TOO_SHORT;
   }
 
-  CHECK(LogEntryType_IsValid(entry_type));
-  entry->set_entry_type(static_cast<ct::LogEntryType>(entry_type));
-
   switch (entry_type) {
-    case ct::X509_ENTRY: {
-      string x509;
-      if (!des->ReadVarBytes(kMaxCertificateLength, &x509)) {
+    case ct::X509_ENTRY:
+      leaf->issuer_key_hash = util::StringView();
+      break;
+
+    case ct::PRECERT_ENTRY:
+      if (!des->ReadFixedBytes(32, &leaf->issuer_key_hash)) {
         return DeserializeResult::INPUT_TOO_SHORT;
       }
-      entry->mutable_signed_entry()->set_x509(x509);
-      return ReadExtensionsV1(des, entry);
-    }
+      break;
+
+    default:
+      return DeserializeResult::UNKNOWN_LOGENTRY_TYPE;
+  }
+  leaf->entry_type = static_cast<ct::LogEntryType>(entry_type);
+
+  if (!des->ReadVarBytes(kMaxCertificateLength, &leaf->certificate)) {
+    return DeserializeResult::INPUT_TOO_SHORT;
+  }
+  if (!des->ReadVarBytes(Serializer::kMaxExtensionsLength,
+                         &leaf->extensions)) {
+    return DeserializeResult::INPUT_TOO_SHORT;
+  }
+  return DeserializeResult::OK;
+}
 
+
+DeserializeResult DeserializeV1MerkleTreeLeaf(util::StringView in,
+                                              MerkleTreeLeafView* leaf) {
+  TLSDeserializer des(in);
+  const DeserializeResult res(ReadV1MerkleTreeLeaf(&des, leaf));
+  if (res != DeserializeResult::OK) {
+    return res;
+  }
+  if (!des.ReachedEnd()) {
+    return DeserializeResult::INPUT_TOO_LONG;
+  }
+  return DeserializeResult::OK;
+}
+
+
+void MerkleTreeLeafView::CopyToProto(MerkleTreeLeaf* leaf) const {
+  CHECK(leaf != nullptr);
+  leaf->Clear();
+  leaf->set_version(ct::V1);
+  leaf->set_type(ct::TIMESTAMPED_ENTRY);
+
+  ct::TimestampedEntry* const entry(leaf->mutable_timestamped_entry());
+  entry->set_timestamp(timestamp);
+  entry->set_entry_type(entry_type);
+  switch (entry_type) {
+    case ct::X509_ENTRY:
+      entry->mutable_signed_entry()->set_x509(certificate.data(),
+                                              certificate.size());
+      break;
     case ct::PRECERT_ENTRY: {
-      string issuer_key_hash;
-      if (!des->ReadFixedBytes(32, &issuer_key_hash)) {
-        return DeserializeResult::INPUT_TOO_SHORT;
-      }
-      entry->mutable_signed_entry()->mutable_precert()->set_issuer_key_hash(
-          issuer_key_hash);
-      string tbs_certificate;
-      if (!des->ReadVarBytes(kMaxCertificateLength, &tbs_certificate)) {
-        return DeserializeResult::INPUT_TOO_SHORT;
-      }
-      entry->mutable_signed_entry()->mutable_precert()->set_tbs_certificate(
-          tbs_certificate);
-      return ReadExtensionsV1(des, entry);
+      ct::PreCert* const precert(
+          entry->mutable_signed_entry()->mutable_precert());
+      precert->set_issuer_key_hash(issuer_key_hash.data(),
+                                   issuer_key_hash.size());
+      precert->set_tbs_certificate(certificate.data(), certificate.size());
+      break;
     }
+    default:
+      LOG(FATAL) << "entry_type: " << entry_type;
   }
+  entry->set_extensions(extensions.data(), extensions.size());
+}
 
-  LOG(FATAL) << "entry_type: " << entry_type;
-  return DeserializeResult::UNKNOWN_LOGENTRY_TYPE;
+
+DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
+                                                 MerkleTreeLeaf* leaf) {
+  CHECK(leaf != nullptr);
+  MerkleTreeLeafView view;
+  const DeserializeResult res(ReadV1MerkleTreeLeaf(des, &view));
+  if (res != DeserializeResult::OK) {
+    return res;
+  }
+  view.CopyToProto(leaf);
+  return DeserializeResult::OK;
 }
 
 
 // ----------------- V2 cert stuff ------------------------
 
-string CertV2LeafData(const LogEntry& entry) {
+const string& CertV2LeafData(const LogEntry& entry) {
   switch (entry.type()) {
     // TODO(mhs): Because there is no X509_ENTRY_V2 we have to assume that
     // whichever of the cert fields is set defines the entry type. In other
@@ -392,10 +506,10 @@ SerializeResult SerializeV2SCTSignatureInput(
 }
 
 
-SerializeResult SerializeV2CertSCTMerkleTreeLeaf(
+static SerializeResult WriteV2CertSCTMerkleTreeLeaf(
     uint64_t timestamp, const string& issuer_key_hash,
     const string& tbs_certificate,
-    const RepeatedPtrField<SctExtension>& sct_extension, string* result) {
+    const RepeatedPtrField<SctExtension>& sct_extension, TLSWriter* writer) {
   SerializeResult res = CheckCertificateFormat(tbs_certificate);
   if (res != SerializeResult::OK) {
     return res;
@@ -404,24 +518,34 @@ SerializeResult SerializeV2CertSCTMerkleTreeLeaf(
   if (res != SerializeResult::OK) {
     return res;
   }
-  result->clear();
-  WriteUint(ct::V2, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TIMESTAMPED_ENTRY, Serializer::kMerkleLeafTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteFixedBytes(issuer_key_hash, result);
-  WriteVarBytes(tbs_certificate, kMaxCertificateLength, result);
-  WriteSctExtension(sct_extension, result);
+  writer->WriteUint(ct::V2, Serializer::kVersionLengthInBytes);
+  writer->WriteUint(ct::TIMESTAMPED_ENTRY,
+                    Serializer::kMerkleLeafTypeLengthInBytes);
+  writer->WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer->WriteUint(ct::X509_ENTRY, Serializer::kLogEntryTypeLengthInBytes);
+  writer->WriteFixedBytes(issuer_key_hash);
+  writer->WriteVarBytes(tbs_certificate, kMaxCertificateLength);
+  WriteSctExtension(sct_extension, writer);
   return SerializeResult::OK;
 }
 
 
-SerializeResult SerializeV2PrecertSCTMerkleTreeLeaf(
+SerializeResult SerializeV2CertSCTMerkleTreeLeaf(
     uint64_t timestamp, const string& issuer_key_hash,
     const string& tbs_certificate,
-    const google::protobuf::RepeatedPtrField<ct::SctExtension>& sct_extension,
-    string* result) {
+    const RepeatedPtrField<SctExtension>& sct_extension, string* result) {
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV2CertSCTMerkleTreeLeaf(timestamp, issuer_key_hash,
+                                      tbs_certificate, sct_extension,
+                                      &writer);
+}
+
+
+static SerializeResult WriteV2PrecertSCTMerkleTreeLeaf(
+    uint64_t timestamp, const string& issuer_key_hash,
+    const string& tbs_certificate,
+    const RepeatedPtrField<SctExtension>& sct_extension, TLSWriter* writer) {
   SerializeResult res = CheckCertificateFormat(tbs_certificate);
   if (res != SerializeResult::OK) {
     return res;
@@ -434,36 +558,47 @@ SerializeResult SerializeV2PrecertSCTMerkleTreeLeaf(
   if (res != SerializeResult::OK) {
     return res;
   }
-  result->clear();
-  WriteUint(ct::V2, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TIMESTAMPED_ENTRY, Serializer::kMerkleLeafTypeLengthInBytes,
-            result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::PRECERT_ENTRY_V2, Serializer::kLogEntryTypeLengthInBytes,
-            result);
-  WriteFixedBytes(issuer_key_hash, result);
-  WriteVarBytes(tbs_certificate, kMaxCertificateLength, result);
-  WriteSctExtension(sct_extension, result);
+  writer->WriteUint(ct::V2, Serializer::kVersionLengthInBytes);
+  writer->WriteUint(ct::TIMESTAMPED_ENTRY,
+                    Serializer::kMerkleLeafTypeLengthInBytes);
+  writer->WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer->WriteUint(ct::PRECERT_ENTRY_V2,
+                    Serializer::kLogEntryTypeLengthInBytes);
+  writer->WriteFixedBytes(issuer_key_hash);
+  writer->WriteVarBytes(tbs_certificate, kMaxCertificateLength);
+  WriteSctExtension(sct_extension, writer);
   return SerializeResult::OK;
 }
 
 
-SerializeResult SerializeV2SCTMerkleTreeLeaf(
-    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+SerializeResult SerializeV2PrecertSCTMerkleTreeLeaf(
+    uint64_t timestamp, const string& issuer_key_hash,
+    const string& tbs_certificate,
+    const google::protobuf::RepeatedPtrField<ct::SctExtension>& sct_extension,
     string* result) {
-  CHECK_EQ(ct::V2, sct.version());
   result->clear();
+  TLSWriter writer(result);
+  return WriteV2PrecertSCTMerkleTreeLeaf(timestamp, issuer_key_hash,
+                                         tbs_certificate, sct_extension,
+                                         &writer);
+}
+
+
+static SerializeResult WriteV2SCTMerkleTreeLeaf(
+    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+    TLSWriter* writer) {
+  CHECK_EQ(ct::V2, sct.version());
   switch (entry.type()) {
     case ct::X509_ENTRY:
-      return SerializeV2CertSCTMerkleTreeLeaf(
+      return WriteV2CertSCTMerkleTreeLeaf(
           sct.timestamp(), entry.x509_entry().cert_info().issuer_key_hash(),
           entry.x509_entry().cert_info().tbs_certificate(),
-          sct.sct_extension(), result);
+          sct.sct_extension(), writer);
     case ct::PRECERT_ENTRY_V2:
-      return SerializeV2PrecertSCTMerkleTreeLeaf(
+      return WriteV2PrecertSCTMerkleTreeLeaf(
           sct.timestamp(), entry.precert_entry().cert_info().issuer_key_hash(),
           entry.precert_entry().cert_info().tbs_certificate(),
-          sct.sct_extension(), result);
+          sct.sct_extension(), writer);
     default:
       break;
   }
@@ -471,6 +606,15 @@ SerializeResult SerializeV2SCTMerkleTreeLeaf(
 }
 
 
+SerializeResult SerializeV2SCTMerkleTreeLeaf(
+    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+    string* result) {
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV2SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
 DeserializeResult DeserializeV2SCTMerkleTreeLeaf(TLSDeserializer* des,
                                                  MerkleTreeLeaf* leaf) {
   CHECK(des != nullptr);
@@ -542,17 +686,89 @@ DeserializeResult DeserializeV2SCTMerkleTreeLeaf(TLSDeserializer* des,
 }
 
 
+// static
+const string& CertV1Policy::LeafData(const LogEntry& entry) {
+  return CertV1LeafData(entry);
+}
+
+
+// static
+SerializeResult CertV1Policy::SerializeSCTSignatureInput(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV1SCTSignatureInput(sct, entry, result);
+}
+
+
+// static
+SerializeResult CertV1Policy::SerializeSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV1SCTMerkleTreeLeaf(sct, entry, result);
+}
+
+
+// static
+SerializeResult CertV1Policy::WriteSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    ByteSink* sink) {
+  TLSWriter writer(sink);
+  return WriteV1SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
+// static
+DeserializeResult CertV1Policy::ReadMerkleTreeLeaf(TLSDeserializer* des,
+                                                    MerkleTreeLeaf* leaf) {
+  return DeserializeV1SCTMerkleTreeLeaf(des, leaf);
+}
+
+
+// static
+const string& CertV2Policy::LeafData(const LogEntry& entry) {
+  return CertV2LeafData(entry);
+}
+
+
+// static
+SerializeResult CertV2Policy::SerializeSCTSignatureInput(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV2SCTSignatureInput(sct, entry, result);
+}
+
+
+// static
+SerializeResult CertV2Policy::SerializeSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV2SCTMerkleTreeLeaf(sct, entry, result);
+}
+
+
+// static
+SerializeResult CertV2Policy::WriteSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    ByteSink* sink) {
+  TLSWriter writer(sink);
+  return WriteV2SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
+// static
+DeserializeResult CertV2Policy::ReadMerkleTreeLeaf(TLSDeserializer* des,
+                                                    MerkleTreeLeaf* leaf) {
+  return DeserializeV2SCTMerkleTreeLeaf(des, leaf);
+}
+
+
 void ConfigureSerializerForV1CT() {
-  Serializer::ConfigureV1(CertV1LeafData, SerializeV1SCTSignatureInput,
-                          SerializeV1SCTMerkleTreeLeaf);
-  Deserializer::Configure(DeserializeV1SCTMerkleTreeLeaf);
+  Serializer::Configure(LogSerializer::ForPolicy<CertV1Policy>());
 }
 
 
 void ConfigureSerializerForV2CT() {
-  Serializer::ConfigureV2(CertV2LeafData, SerializeV2SCTSignatureInput,
-                          SerializeV2SCTMerkleTreeLeaf);
-  Deserializer::Configure(DeserializeV2SCTMerkleTreeLeaf);
+  Serializer::Configure(LogSerializer::ForPolicy<CertV2Policy>());
 }
 
 
@@ -632,19 +848,20 @@ SerializeResult SerializeV1SignedPrecertEntryWithType(
 
 
 // static
-DeserializeResult DeserializeX509Chain(const std::string& in,
+DeserializeResult DeserializeX509Chain(util::StringView in,
                                        X509ChainEntry* x509_chain_entry) {
   // Empty list is ok.
   x509_chain_entry->clear_certificate_chain();
-  return Deserializer::DeserializeList(
-      in, kMaxCertificateChainLength, kMaxCertificateLength,
-      x509_chain_entry->mutable_certificate_chain());
+  TLSDeserializer deserializer(in);
+  return deserializer.ReadList(kMaxCertificateChainLength,
+                               kMaxCertificateLength,
+                               x509_chain_entry->mutable_certificate_chain());
 }
 
 
 // static
 DeserializeResult DeserializePrecertChainEntry(
-    const std::string& in, ct::PrecertChainEntry* precert_chain_entry) {
+    util::StringView in, ct::PrecertChainEntry* precert_chain_entry) {
   TLSDeserializer deserializer(in);
   if (!deserializer.ReadVarBytes(
           kMaxCertificateLength,
@@ -663,3 +880,143 @@ DeserializeResult DeserializePrecertChainEntry(
   }
   return DeserializeResult::OK;
 }
+
+
+const char kBinaryEntriesContentType[] = "application/x-ct-entries";
+
+
+namespace {
+
+
+const size_t kMaxLeafInputLength = (1 << 24) - 1;
+const size_t kMaxExtraDataLength = (1 << 24) - 1;
+
+
+enum class RecordStatus {
+  COMPLETE,
+  INCOMPLETE,
+  INVALID,
+};
+
+
+// Parses the EntryRecord at the start of |in|. If it is complete, sets
+// |length| to its encoded length, otherwise to the number of bytes
+// needed to make further progress with it.
+RecordStatus ParseRecord(util::StringView in,
+                         BinaryEntriesDecoder::Record* record,
+                         size_t* length) {
+  util::StringView* const fields[] = {&record->leaf_input,
+                                      &record->extra_data, &record->sct};
+  const size_t max_lengths[] = {kMaxLeafInputLength, kMaxExtraDataLength,
+                                Serializer::kMaxSerializedSCTLength};
+
+  size_t pos(0);
+  for (int i = 0; i < 3; ++i) {
+    const size_t prefix_length(
+        cert_trans::serialization::internal::PrefixLength(max_lengths[i]));
+    if (in.size() < pos + prefix_length) {
+      *length = pos + prefix_length;
+      return RecordStatus::INCOMPLETE;
+    }
+    size_t field_length(0);
+    for (size_t j = 0; j < prefix_length; ++j) {
+      field_length =
+          (field_length << 8) | static_cast<unsigned char>(in[pos + j]);
+    }
+    pos += prefix_length;
+    if (in.size() < pos + field_length) {
+      *length = pos + field_length;
+      return RecordStatus::INCOMPLETE;
+    }
+    *fields[i] = in.substr(pos, field_length);
+    pos += field_length;
+  }
+
+  if (record->leaf_input.empty()) {
+    return RecordStatus::INVALID;
+  }
+  *length = pos;
+  return RecordStatus::COMPLETE;
+}
+
+
+}  // namespace
+
+
+SerializeResult WriteBinaryEntry(util::StringView leaf_input,
+                                 util::StringView extra_data,
+                                 util::StringView sct, string* output) {
+  if (leaf_input.empty()) {
+    return SerializeResult::EMPTY_ELEM_IN_LIST;
+  }
+  if (leaf_input.size() > kMaxLeafInputLength ||
+      extra_data.size() > kMaxExtraDataLength ||
+      sct.size() > Serializer::kMaxSerializedSCTLength) {
+    return SerializeResult::LIST_ELEM_TOO_LONG;
+  }
+
+  TLSWriter writer(output);
+  writer.Reserve(
+      TLSWriter::VarBytesLength(leaf_input, kMaxLeafInputLength) +
+      TLSWriter::VarBytesLength(extra_data, kMaxExtraDataLength) +
+      TLSWriter::VarBytesLength(sct, Serializer::kMaxSerializedSCTLength));
+  writer.WriteVarBytes(leaf_input, kMaxLeafInputLength);
+  writer.WriteVarBytes(extra_data, kMaxExtraDataLength);
+  writer.WriteVarBytes(sct, Serializer::kMaxSerializedSCTLength);
+  return SerializeResult::OK;
+}
+
+
+BinaryEntriesDecoder::BinaryEntriesDecoder(const RecordCallback& callback)
+    : callback_(callback), status_(DeserializeResult::OK) {
+  CHECK(callback_);
+}
+
+
+DeserializeResult BinaryEntriesDecoder::Append(util::StringView data) {
+  Record record;
+  size_t length;
+
+  // First complete the record left over from the last chunk, copying
+  // no more of |data| than it needs.
+  while (status_ == DeserializeResult::OK && !pending_.empty() &&
+         !data.empty()) {
+    RecordStatus record_status(ParseRecord(pending_, &record, &length));
+    CHECK(record_status == RecordStatus::INCOMPLETE);
+    const size_t needed(std::min(length - pending_.size(), data.size()));
+    pending_.append(data.data(), needed);
+    data = data.substr(needed);
+
+    record_status = ParseRecord(pending_, &record, &length);
+    if (record_status == RecordStatus::INVALID) {
+      status_ = DeserializeResult::EMPTY_ELEM_IN_LIST;
+    } else if (record_status == RecordStatus::COMPLETE) {
+      status_ = callback_(record);
+      pending_.clear();
+    }
+  }
+
+  // The remaining records are decoded in place.
+  while (status_ == DeserializeResult::OK && !data.empty()) {
+    const RecordStatus record_status(ParseRecord(data, &record, &length));
+    if (record_status == RecordStatus::INVALID) {
+      status_ = DeserializeResult::EMPTY_ELEM_IN_LIST;
+    } else if (record_status == RecordStatus::INCOMPLETE) {
+      pending_.assign(data.data(), data.size());
+      break;
+    } else {
+      status_ = callback_(record);
+      data = data.substr(length);
+    }
+  }
+
+  return status_;
+}
+
+
+DeserializeResult BinaryEntriesDecoder::Finish() const {
+  if (status_ == DeserializeResult::OK && !pending_.empty()) {
+    return DeserializeResult::INPUT_TOO_SHORT;
+  }
+  return status_;
+}
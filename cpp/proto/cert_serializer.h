@@ -5,12 +5,52 @@
 #include <glog/logging.h>
 #include <google/protobuf/repeated_field.h>
 #include <stdint.h>
+#include <functional>
 #include <string>
 
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
-
-
+#include "util/string_view.h"
+
+
+// Serialization policies for X.509 certificate logs, to be used with
+// LogSerializer::ForPolicy<>().
+struct CertV1Policy {
+  static const ct::Version kVersion = ct::V1;
+
+  static const std::string& LeafData(const ct::LogEntry& entry);
+  static cert_trans::serialization::SerializeResult SerializeSCTSignatureInput(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult SerializeSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult WriteSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink);
+  static cert_trans::serialization::DeserializeResult ReadMerkleTreeLeaf(
+      TLSDeserializer* des, ct::MerkleTreeLeaf* leaf);
+};
+
+struct CertV2Policy {
+  static const ct::Version kVersion = ct::V2;
+
+  static const std::string& LeafData(const ct::LogEntry& entry);
+  static cert_trans::serialization::SerializeResult SerializeSCTSignatureInput(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult SerializeSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult WriteSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink);
+  static cert_trans::serialization::DeserializeResult ReadMerkleTreeLeaf(
+      TLSDeserializer* des, ct::MerkleTreeLeaf* leaf);
+};
+
+
+// Configure the static Serializer for one of the policies above.
 void ConfigureSerializerForV1CT();
 void ConfigureSerializerForV2CT();
 
@@ -39,10 +79,33 @@ SerializeV1SignedPrecertEntryWithType(const std::string& issuer_key_hash,
                                       std::string* result);
 
 cert_trans::serialization::DeserializeResult DeserializeX509Chain(
-    const std::string& in, ct::X509ChainEntry* x509_chain_entry);
+    util::StringView in, ct::X509ChainEntry* x509_chain_entry);
 
 cert_trans::serialization::DeserializeResult DeserializePrecertChainEntry(
-    const std::string& in, ct::PrecertChainEntry* precert_chain_entry);
+    util::StringView in, ct::PrecertChainEntry* precert_chain_entry);
+
+// A V1 Merkle tree leaf, decoded without copying any of its fields: they
+// refer to the serialized leaf, which must outlive this object. This is
+// for readers that only need some of the fields, the leaf can still be
+// copied into a protobuf with CopyToProto().
+struct MerkleTreeLeafView {
+  MerkleTreeLeafView() : timestamp(0), entry_type(ct::X509_ENTRY) {
+  }
+
+  void CopyToProto(ct::MerkleTreeLeaf* leaf) const;
+
+  uint64_t timestamp;
+  ct::LogEntryType entry_type;
+  // Only set for PRECERT_ENTRY.
+  util::StringView issuer_key_hash;
+  // The leaf certificate for X509_ENTRY, or the TBS certificate for
+  // PRECERT_ENTRY.
+  util::StringView certificate;
+  util::StringView extensions;
+};
+
+cert_trans::serialization::DeserializeResult DeserializeV1MerkleTreeLeaf(
+    util::StringView in, MerkleTreeLeafView* leaf);
 
 // Test helpers
 //
@@ -88,4 +151,65 @@ cert_trans::serialization::SerializeResult SerializeV2PrecertSCTSignatureInput(
     const google::protobuf::RepeatedPtrField<ct::SctExtension>& sct_extension,
     std::string* result);
 
+
+// Binary get-entries responses.
+//
+// Instead of JSON, a log can return get-entries results (with this
+// content type) as a sequence of records, each of them being
+//
+//   struct {
+//     opaque leaf_input<1..2^24-1>;
+//     opaque extra_data<0..2^24-1>;
+//     opaque sct<0..2^16-1>;
+//   } EntryRecord;
+//
+// where |leaf_input| and |extra_data| are the same as the (base64
+// decoded) fields of the JSON response, and |sct| is an encoded SCT, or
+// empty when the SCTs were not requested.
+extern const char kBinaryEntriesContentType[];
+
+// Appends an EntryRecord to |output|.
+cert_trans::serialization::SerializeResult WriteBinaryEntry(
+    util::StringView leaf_input, util::StringView extra_data,
+    util::StringView sct, std::string* output);
+
+
+// Decodes a binary get-entries response as it arrives, one chunk at a
+// time. Records entirely contained in a chunk are not copied, only the
+// ones that straddle two chunks are.
+class BinaryEntriesDecoder {
+ public:
+  // The fields of an EntryRecord, which are only valid for the duration
+  // of the callback.
+  struct Record {
+    util::StringView leaf_input;
+    util::StringView extra_data;
+    util::StringView sct;
+  };
+
+  // Anything other than OK stops the decoding, and is returned by
+  // Append() and Finish().
+  typedef std::function<cert_trans::serialization::DeserializeResult(
+      const Record&)> RecordCallback;
+
+  explicit BinaryEntriesDecoder(const RecordCallback& callback);
+  BinaryEntriesDecoder(const BinaryEntriesDecoder&) = delete;
+  BinaryEntriesDecoder& operator=(const BinaryEntriesDecoder&) = delete;
+
+  // Decodes the next part of the response, calling the callback for
+  // each record completed by it.
+  cert_trans::serialization::DeserializeResult Append(util::StringView data);
+
+  // To be called at the end of the response, which must not end in the
+  // middle of a record.
+  cert_trans::serialization::DeserializeResult Finish() const;
+
+ private:
+  const RecordCallback callback_;
+  cert_trans::serialization::DeserializeResult status_;
+  // The beginning of a record which was incomplete at the end of the
+  // last chunk.
+  std::string pending_;
+};
+
 #endif  // CERT_TRANS_PROTO_CERT_SERIALIZER_H_
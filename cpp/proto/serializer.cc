@@ -5,11 +5,15 @@
 #include <glog/logging.h>
 #include <math.h>
 #include <string>
+#include <utility>
 
 #include "proto/ct.pb.h"
 
+using cert_trans::serialization::ByteSink;
 using cert_trans::serialization::DeserializeResult;
 using cert_trans::serialization::SerializeResult;
+using cert_trans::serialization::DigitallySignedLength;
+using cert_trans::serialization::TLSWriter;
 using cert_trans::serialization::WriteDigitallySigned;
 using cert_trans::serialization::WriteFixedBytes;
 using cert_trans::serialization::WriteUint;
@@ -23,7 +27,6 @@ using ct::SignedCertificateTimestampList;
 using ct::SthExtension;
 using ct::Version_IsValid;
 using google::protobuf::RepeatedPtrField;
-using std::function;
 using std::string;
 
 const size_t Serializer::kMaxV2ExtensionType = (1 << 16) - 1;
@@ -53,37 +56,59 @@ SerializeResult CheckSthExtensionsFormat(
 namespace {
 
 
-function<string(const ct::LogEntry&)> leaf_data;
+// The serialization used by the static Serializer and Deserializer
+// methods, set by Serializer::Configure().
+const LogSerializer* configured_serializer = nullptr;
 
-function<SerializeResult(const ct::SignedCertificateTimestamp& sct,
-                         const ct::LogEntry& entry, std::string* result)>
-    serialize_sct_sig_input;
 
-function<SerializeResult(const ct::SignedCertificateTimestamp& sct,
-                         const ct::LogEntry& entry, std::string* result)>
-    serialize_sct_merkle_leaf;
+}  // namespace
 
-function<SerializeResult(uint64_t timestamp, int64_t tree_size,
-                         const std::string& root_hash, std::string* result)>
-    serialize_sth_sig_input_v1;
 
-function<SerializeResult(uint64_t timestamp, int64_t tree_size,
-                         const std::string& root_hash,
-                         const repeated_sth_extension& sth_extension,
-                         const std::string& log_id, std::string* result)>
-    serialize_sth_sig_input_v2;
+LogSerializer::LogSerializer(ct::Version version, LeafDataFunc leaf_data,
+                             SerializeSCTFunc sct_signature_input,
+                             SerializeSCTFunc sct_merkle_tree_leaf,
+                             WriteSCTFunc write_sct_merkle_tree_leaf,
+                             ReadMerkleTreeLeafFunc read_merkle_tree_leaf)
+    : version_(version),
+      leaf_data_(CHECK_NOTNULL(leaf_data)),
+      sct_signature_input_(CHECK_NOTNULL(sct_signature_input)),
+      sct_merkle_tree_leaf_(CHECK_NOTNULL(sct_merkle_tree_leaf)),
+      write_sct_merkle_tree_leaf_(CHECK_NOTNULL(write_sct_merkle_tree_leaf)),
+      read_merkle_tree_leaf_(CHECK_NOTNULL(read_merkle_tree_leaf)) {
+}
 
-function<DeserializeResult(TLSDeserializer* d, ct::MerkleTreeLeaf* leaf)>
-    read_merkle_tree_leaf;
 
+DeserializeResult LogSerializer::DeserializeMerkleTreeLeaf(
+    util::StringView in, MerkleTreeLeaf* leaf) const {
+  TLSDeserializer des(in);
 
-}  // namespace
+  const DeserializeResult ret(read_merkle_tree_leaf_(&des, leaf));
+  if (ret != DeserializeResult::OK) {
+    return ret;
+  }
+
+  if (!des.ReachedEnd()) {
+    return DeserializeResult::INPUT_TOO_LONG;
+  }
+
+  return DeserializeResult::OK;
+}
+
+
+static SerializeResult SerializeV1STHSignatureInput(uint64_t timestamp,
+                                                    int64_t tree_size,
+                                                    const string& root_hash,
+                                                    string* result);
+static SerializeResult SerializeV2STHSignatureInput(
+    uint64_t timestamp, int64_t tree_size, const string& root_hash,
+    const RepeatedPtrField<SthExtension>& sth_extension, const string& log_id,
+    string* result);
 
 
 // static
-string Serializer::LeafData(const LogEntry& entry) {
-  CHECK(leaf_data);
-  return leaf_data(entry);
+const string& Serializer::LeafData(const LogEntry& entry) {
+  CHECK(configured_serializer);
+  return configured_serializer->LeafData(entry);
 }
 
 
@@ -93,8 +118,8 @@ SerializeResult Serializer::SerializeV1STHSignatureInput(
     string* result) {
   CHECK(result);
   // result will be cleared by SerializeV1STHSignatureInput
-  CHECK(serialize_sth_sig_input_v1);
-  return serialize_sth_sig_input_v1(timestamp, tree_size, root_hash, result);
+  return ::SerializeV1STHSignatureInput(timestamp, tree_size, root_hash,
+                                        result);
 }
 
 
@@ -106,11 +131,15 @@ static SerializeResult SerializeV1STHSignatureInput(uint64_t timestamp,
   result->clear();
   if (root_hash.size() != 32)
     return SerializeResult::INVALID_HASH_LENGTH;
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TREE_HEAD, Serializer::kSignatureTypeLengthInBytes, result);
-  WriteUint(timestamp, Serializer::kTimestampLengthInBytes, result);
-  WriteUint(tree_size, 8, result);
-  WriteFixedBytes(root_hash, result);
+  TLSWriter writer(result);
+  writer.Reserve(Serializer::kVersionLengthInBytes +
+                 Serializer::kSignatureTypeLengthInBytes +
+                 Serializer::kTimestampLengthInBytes + 8 + root_hash.size());
+  writer.WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer.WriteUint(ct::TREE_HEAD, Serializer::kSignatureTypeLengthInBytes);
+  writer.WriteUint(timestamp, Serializer::kTimestampLengthInBytes);
+  writer.WriteUint(tree_size, 8);
+  writer.WriteFixedBytes(root_hash);
   return SerializeResult::OK;
 }
 
@@ -121,9 +150,8 @@ SerializeResult Serializer::SerializeV2STHSignatureInput(
     const repeated_sth_extension& sth_extension, const string& log_id,
     string* result) {
   CHECK(result);
-  CHECK(serialize_sth_sig_input_v2);
-  return serialize_sth_sig_input_v2(timestamp, tree_size, root_hash,
-                                     sth_extension, log_id, result);
+  return ::SerializeV2STHSignatureInput(timestamp, tree_size, root_hash,
+                                        sth_extension, log_id, result);
 }
 
 
@@ -192,8 +220,18 @@ SerializeResult Serializer::SerializeSCTMerkleTreeLeaf(
     const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
     std::string* result) {
   CHECK(result);
-  CHECK(serialize_sct_merkle_leaf);
-  return serialize_sct_merkle_leaf(sct, entry, result);
+  CHECK(configured_serializer);
+  return configured_serializer->SerializeSCTMerkleTreeLeaf(sct, entry, result);
+}
+
+
+// static
+SerializeResult Serializer::WriteSCTMerkleTreeLeaf(
+    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+    ByteSink* sink) {
+  CHECK_NOTNULL(sink);
+  CHECK(configured_serializer);
+  return configured_serializer->WriteSCTMerkleTreeLeaf(sct, entry, sink);
 }
 
 
@@ -202,8 +240,8 @@ SerializeResult Serializer::SerializeSCTSignatureInput(
     const SignedCertificateTimestamp& sct, const LogEntry& entry,
     string* result) {
   CHECK(result);
-  CHECK(serialize_sct_sig_input);
-  return serialize_sct_sig_input(sct, entry, result);
+  CHECK(configured_serializer);
+  return configured_serializer->SerializeSCTSignatureInput(sct, entry, result);
 }
 
 SerializeResult WriteSCTV1(const SignedCertificateTimestamp& sct,
@@ -217,20 +255,33 @@ SerializeResult WriteSCTV1(const SignedCertificateTimestamp& sct,
   if (sct.id().key_id().size() != Serializer::kKeyIDLengthInBytes) {
     return SerializeResult::INVALID_KEYID_LENGTH;
   }
-  WriteUint(sct.version(), Serializer::kVersionLengthInBytes, output);
-  WriteFixedBytes(sct.id().key_id(), output);
-  WriteUint(sct.timestamp(), Serializer::kTimestampLengthInBytes, output);
-  WriteVarBytes(sct.extensions(), Serializer::kMaxExtensionsLength, output);
+  TLSWriter writer(output);
+  writer.Reserve(Serializer::kVersionLengthInBytes +
+                 sct.id().key_id().size() +
+                 Serializer::kTimestampLengthInBytes +
+                 TLSWriter::VarBytesLength(sct.extensions(),
+                                           Serializer::kMaxExtensionsLength) +
+                 DigitallySignedLength(sct.signature()));
+  writer.WriteUint(sct.version(), Serializer::kVersionLengthInBytes);
+  writer.WriteFixedBytes(sct.id().key_id());
+  writer.WriteUint(sct.timestamp(), Serializer::kTimestampLengthInBytes);
+  writer.WriteVarBytes(sct.extensions(), Serializer::kMaxExtensionsLength);
   return WriteDigitallySigned(sct.signature(), output);
 }
 
 void WriteSctExtension(const RepeatedPtrField<SctExtension>& extension,
                        std::string* output) {
-  WriteUint(extension.size(), 2, output);
+  TLSWriter writer(output);
+  WriteSctExtension(extension, &writer);
+}
+
+void WriteSctExtension(const RepeatedPtrField<SctExtension>& extension,
+                       TLSWriter* writer) {
+  writer->WriteUint(extension.size(), 2);
   for (auto it = extension.begin(); it != extension.end(); ++it) {
-    WriteUint(it->sct_extension_type(), 2, output);
-    WriteVarBytes(it->sct_extension_data(), Serializer::kMaxExtensionsLength,
-                  output);
+    writer->WriteUint(it->sct_extension_type(), 2);
+    writer->WriteVarBytes(it->sct_extension_data(),
+                          Serializer::kMaxExtensionsLength);
   }
 }
 
@@ -300,14 +351,11 @@ SerializeResult Serializer::SerializeList(const repeated_string& in,
                                           size_t max_elem_length,
                                           size_t max_total_length,
                                           string* result) {
-  std::string output;
-  SerializeResult res =
-      cert_trans::serialization::WriteList(in, max_elem_length,
-                                           max_total_length, &output);
-  if (res != SerializeResult::OK)
-    return res;
-  result->assign(output);
-  return SerializeResult::OK;
+  // WriteList() does all its checks before writing anything, so this can
+  // write straight into |result|.
+  result->clear();
+  return cert_trans::serialization::WriteList(in, max_elem_length,
+                                              max_total_length, result);
 }
 
 SerializeResult CheckKeyHashFormat(const string& key_hash) {
@@ -404,7 +452,7 @@ DeserializeResult ReadSCTV1(TLSDeserializer* deserializer,
     return DeserializeResult::INPUT_TOO_SHORT;
   }
   sct->set_timestamp(timestamp);
-  string extensions;
+  util::StringView extensions;
   if (!deserializer->ReadVarBytes(Serializer::kMaxExtensionsLength,
                                   &extensions)) {
     // In theory, could also be an invalid length prefix, but not if
@@ -434,7 +482,7 @@ DeserializeResult ReadSctExtension(TLSDeserializer* deserializer,
       return DeserializeResult::INPUT_TOO_SHORT;
     }
 
-    string ext_data;
+    util::StringView ext_data;
     if (!deserializer->ReadVarBytes(Serializer::kMaxExtensionsLength,
                                     &ext_data)) {
       return DeserializeResult::INPUT_TOO_SHORT;
@@ -442,7 +490,7 @@ DeserializeResult ReadSctExtension(TLSDeserializer* deserializer,
 
     SctExtension* new_ext = extension->Add();
     new_ext->set_sct_extension_type(ext_type);
-    new_ext->set_sct_extension_data(ext_data);
+    new_ext->set_sct_extension_data(ext_data.data(), ext_data.size());
   }
 
   // This makes sure they're correctly ordered (See RFC section 5.3)
@@ -480,13 +528,13 @@ DeserializeResult ReadSCTV2(TLSDeserializer* deserializer,
 DeserializeResult ReadExtensionsV1(TLSDeserializer* deserializer,
                                    ct::TimestampedEntry* entry) {
   CHECK(deserializer != nullptr);
-  string extensions;
+  util::StringView extensions;
   if (!deserializer->ReadVarBytes(Serializer::kMaxExtensionsLength,
                                   &extensions)) {
     return DeserializeResult::INPUT_TOO_SHORT;
   }
   CHECK(entry != nullptr);
-  entry->set_extensions(extensions);
+  entry->set_extensions(extensions.data(), extensions.size());
   return DeserializeResult::OK;
 }
 
@@ -519,7 +567,7 @@ DeserializeResult ReadSCT(TLSDeserializer* deserializer,
 
 // static
 DeserializeResult Deserializer::DeserializeSCT(
-    const string& in, SignedCertificateTimestamp* sct) {
+    util::StringView in, SignedCertificateTimestamp* sct) {
   TLSDeserializer deserializer(in);
   DeserializeResult res = ReadSCT(&deserializer, sct);
   if (res != DeserializeResult::OK) {
@@ -536,13 +584,29 @@ DeserializeResult Deserializer::DeserializeSCT(
 DeserializeResult Deserializer::DeserializeSCTList(
     const string& in, SignedCertificateTimestampList* sct_list) {
   sct_list->clear_sct_list();
-  DeserializeResult res = DeserializeList(in, Serializer::kMaxSCTListLength,
-                                          Serializer::kMaxSerializedSCTLength,
-                                          sct_list->mutable_sct_list());
-  if (res != DeserializeResult::OK)
-    return res;
-  if (sct_list->sct_list_size() == 0)
-    return DeserializeResult::EMPTY_LIST;
+  SCTListReader reader(in);
+  if (reader.status() != DeserializeResult::OK)
+    return reader.status();
+  sct_list->mutable_sct_list()->Reserve(reader.size());
+  util::StringView sct;
+  while (reader.Next(&sct))
+    sct_list->add_sct_list(sct.data(), sct.size());
+  return DeserializeResult::OK;
+}
+
+
+// static
+DeserializeResult Deserializer::DeserializeSCTList(
+    util::StringView in, std::vector<util::StringView>* sct_list) {
+  CHECK_NOTNULL(sct_list);
+  sct_list->clear();
+  SCTListReader reader(in);
+  if (reader.status() != DeserializeResult::OK)
+    return reader.status();
+  sct_list->reserve(reader.size());
+  util::StringView sct;
+  while (reader.Next(&sct))
+    sct_list->push_back(sct);
   return DeserializeResult::OK;
 }
 
@@ -579,69 +643,91 @@ DeserializeResult Deserializer::DeserializeList(const string& in,
 
 
 DeserializeResult Deserializer::DeserializeMerkleTreeLeaf(
-    const std::string& in, ct::MerkleTreeLeaf* leaf) {
-  TLSDeserializer des(in);
+    util::StringView in, ct::MerkleTreeLeaf* leaf) {
+  CHECK(configured_serializer);
+  return configured_serializer->DeserializeMerkleTreeLeaf(in, leaf);
+}
 
-  DeserializeResult ret = read_merkle_tree_leaf(&des, leaf);
-  if (ret != DeserializeResult::OK) {
-    return ret;
-  }
 
-  if (!des.ReachedEnd()) {
+// static
+void Serializer::Configure(const LogSerializer& log_serializer) {
+  CHECK(FLAGS_allow_reconfigure_serializer_test_only ||
+        !configured_serializer)
+      << "Serializer already configured";
+  configured_serializer = &log_serializer;
+}
+
+
+// static
+const LogSerializer& Serializer::Configured() {
+  CHECK(configured_serializer) << "Serializer not configured";
+  return *configured_serializer;
+}
+
+
+namespace {
+
+
+// Checks that |in| is a non-empty list of non-empty SCTs, and sets |list|
+// to its contents and |size| to the number of SCTs.
+DeserializeResult CheckSCTList(util::StringView in, util::StringView* list,
+                               size_t* size) {
+  TLSDeserializer deserializer(in);
+  if (!deserializer.ReadVarBytes(Serializer::kMaxSCTListLength, list))
+    return DeserializeResult::INPUT_TOO_SHORT;
+  if (!deserializer.ReachedEnd())
     return DeserializeResult::INPUT_TOO_LONG;
-  }
 
+  *size = 0;
+  TLSDeserializer list_reader(*list);
+  while (!list_reader.ReachedEnd()) {
+    util::StringView sct;
+    if (!list_reader.ReadVarBytes(Serializer::kMaxSerializedSCTLength, &sct))
+      return DeserializeResult::INVALID_LIST_ENCODING;
+    if (sct.empty())
+      return DeserializeResult::EMPTY_ELEM_IN_LIST;
+    ++*size;
+  }
+  if (*size == 0)
+    return DeserializeResult::EMPTY_LIST;
   return DeserializeResult::OK;
 }
 
 
-// static
-void Serializer::ConfigureV1(
-    const function<string(const ct::LogEntry&)>& leaf_data_func,
-    const function<SerializeResult(
-        const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-        std::string* result)>& serialize_sct_sig_input_func,
-    const function<SerializeResult(
-        const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-        std::string* result)>& serialize_sct_merkle_leaf_func) {
-  CHECK(FLAGS_allow_reconfigure_serializer_test_only ||
-        (!leaf_data&& !serialize_sct_sig_input &&
-         !serialize_sct_merkle_leaf))
-      << "Serializer already configured";
-  leaf_data = leaf_data_func;
-  serialize_sct_sig_input = serialize_sct_sig_input_func;
-  serialize_sct_merkle_leaf = serialize_sct_merkle_leaf_func;
-  serialize_sth_sig_input_v1 = ::SerializeV1STHSignatureInput;
+}  // namespace
+
+
+SCTListReader::SCTListReader(util::StringView in) : size_(0) {
+  status_ = CheckSCTList(in, &remaining_, &size_);
+  if (status_ != DeserializeResult::OK) {
+    size_ = 0;
+    remaining_ = util::StringView();
+  }
 }
 
 
-// static
-void Serializer::ConfigureV2(
-    const function<string(const ct::LogEntry&)>& leaf_data_func,
-    const function<SerializeResult(
-        const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-        std::string* result)>& serialize_sct_sig_input_func,
-    const function<SerializeResult(
-        const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-        std::string* result)>& serialize_sct_merkle_leaf_func) {
-  CHECK(FLAGS_allow_reconfigure_serializer_test_only ||
-        (!leaf_data && !serialize_sct_sig_input &&
-         !serialize_sct_merkle_leaf))
-      << "Serializer already configured";
-  leaf_data = leaf_data_func;
-  serialize_sct_sig_input = serialize_sct_sig_input_func;
-  serialize_sct_merkle_leaf = serialize_sct_merkle_leaf_func;
-  serialize_sth_sig_input_v2 = ::SerializeV2STHSignatureInput;
+bool SCTListReader::Next(util::StringView* sct) {
+  CHECK_NOTNULL(sct);
+  if (remaining_.empty())
+    return false;
+  TLSDeserializer deserializer(remaining_);
+  // The constructor already checked the encoding.
+  CHECK(deserializer.ReadVarBytes(Serializer::kMaxSerializedSCTLength, sct));
+  remaining_ = remaining_.substr(sct->end() - remaining_.begin());
+  return true;
 }
 
 
 // static
-void Deserializer::Configure(
-    const function<DeserializeResult(TLSDeserializer* d,
-                                     ct::MerkleTreeLeaf* leaf)>&
-        read_merkle_tree_leaf_func) {
-  CHECK(FLAGS_allow_reconfigure_serializer_test_only ||
-        !read_merkle_tree_leaf)
-      << "Deserializer already configured";
-  read_merkle_tree_leaf = read_merkle_tree_leaf_func;
+SerializeResult EncodedSCTList::Create(
+    const SignedCertificateTimestampList& sct_list,
+    std::shared_ptr<const EncodedSCTList>* result) {
+  CHECK_NOTNULL(result);
+  string encoded;
+  const SerializeResult res(Serializer::SerializeSCTList(sct_list, &encoded));
+  if (res != SerializeResult::OK)
+    return res;
+  result->reset(
+      new EncodedSCTList(std::move(encoded), sct_list.sct_list_size()));
+  return SerializeResult::OK;
 }
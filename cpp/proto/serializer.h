@@ -3,12 +3,15 @@
 
 #include <glog/logging.h>
 #include <google/protobuf/repeated_field.h>
+#include <memory>
 #include <stdint.h>
-#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "proto/ct.pb.h"
 #include "proto/tls_encoding.h"
+#include "util/string_view.h"
 
 typedef google::protobuf::RepeatedPtrField<ct::SthExtension>
     repeated_sth_extension;
@@ -24,6 +27,8 @@ cert_trans::serialization::SerializeResult CheckSctExtensionsFormat(
 
 void WriteSctExtension(const repeated_sct_extension& extension,
                        std::string* output);
+void WriteSctExtension(const repeated_sct_extension& extension,
+                       cert_trans::serialization::TLSWriter* writer);
 
 cert_trans::serialization::DeserializeResult ReadExtensionsV1(
     TLSDeserializer* deserializer, ct::TimestampedEntry* entry);
@@ -34,6 +39,90 @@ cert_trans::serialization::DeserializeResult ReadSCT(
 cert_trans::serialization::DeserializeResult ReadMerkleTreeLeaf(
     TLSDeserializer* deserializer, ct::MerkleTreeLeaf* leaf);
 
+// The version-specific parts of the serialization for a log: its leaf
+// data, SCT signature input and Merkle tree leaf encodings, and how to
+// read back a Merkle tree leaf. Instances are immutable, so one process
+// can hold several of them (e.g. for a V1 and a V2 log) side by side.
+//
+// They are normally obtained with ForPolicy<>(), from a policy type
+// such as CertV1Policy (see proto/cert_serializer.h).
+class LogSerializer {
+ public:
+  typedef const std::string& (*LeafDataFunc)(const ct::LogEntry& entry);
+  typedef cert_trans::serialization::SerializeResult (*SerializeSCTFunc)(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  typedef cert_trans::serialization::SerializeResult (*WriteSCTFunc)(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink);
+  typedef cert_trans::serialization::DeserializeResult (
+      *ReadMerkleTreeLeafFunc)(TLSDeserializer* des, ct::MerkleTreeLeaf* leaf);
+
+  LogSerializer(ct::Version version, LeafDataFunc leaf_data,
+                SerializeSCTFunc sct_signature_input,
+                SerializeSCTFunc sct_merkle_tree_leaf,
+                WriteSCTFunc write_sct_merkle_tree_leaf,
+                ReadMerkleTreeLeafFunc read_merkle_tree_leaf);
+
+  LogSerializer(const LogSerializer&) = delete;
+  LogSerializer& operator=(const LogSerializer&) = delete;
+
+  // Returns the instance for |Policy|, which must have a |kVersion|
+  // constant, and static LeafData(), SerializeSCTSignatureInput(),
+  // SerializeSCTMerkleTreeLeaf(), WriteSCTMerkleTreeLeaf() and
+  // ReadMerkleTreeLeaf() functions matching the types above.
+  template <class Policy>
+  static const LogSerializer& ForPolicy() {
+    static const LogSerializer instance(Policy::kVersion, &Policy::LeafData,
+                                        &Policy::SerializeSCTSignatureInput,
+                                        &Policy::SerializeSCTMerkleTreeLeaf,
+                                        &Policy::WriteSCTMerkleTreeLeaf,
+                                        &Policy::ReadMerkleTreeLeaf);
+    return instance;
+  }
+
+  ct::Version version() const {
+    return version_;
+  }
+
+  // The result refers to a field of |entry|.
+  const std::string& LeafData(const ct::LogEntry& entry) const {
+    return leaf_data_(entry);
+  }
+
+  cert_trans::serialization::SerializeResult SerializeSCTSignatureInput(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result) const {
+    return sct_signature_input_(sct, entry, result);
+  }
+
+  cert_trans::serialization::SerializeResult SerializeSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result) const {
+    return sct_merkle_tree_leaf_(sct, entry, result);
+  }
+
+  // Same as above, but passes the leaf to |sink| as it is encoded, so
+  // that it can be hashed without being buffered.
+  cert_trans::serialization::SerializeResult WriteSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink) const {
+    return write_sct_merkle_tree_leaf_(sct, entry, sink);
+  }
+
+  cert_trans::serialization::DeserializeResult DeserializeMerkleTreeLeaf(
+      util::StringView in, ct::MerkleTreeLeaf* leaf) const;
+
+ private:
+  const ct::Version version_;
+  const LeafDataFunc leaf_data_;
+  const SerializeSCTFunc sct_signature_input_;
+  const SerializeSCTFunc sct_merkle_tree_leaf_;
+  const WriteSCTFunc write_sct_merkle_tree_leaf_;
+  const ReadMerkleTreeLeafFunc read_merkle_tree_leaf_;
+};
+
+
 // A utility class for writing protocol buffer fields in canonical TLS style.
 class Serializer {
  public:
@@ -54,26 +143,18 @@ class Serializer {
   static const size_t kTimestampLengthInBytes;
 
   // API
-  // TODO(alcutter): typedef these function<> bits
-  static void ConfigureV1(
-      const std::function<std::string(const ct::LogEntry&)>& leaf_data,
-      const std::function<cert_trans::serialization::SerializeResult(
-          const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-          std::string* result)>& serialize_sct_sig_input,
-      const std::function<cert_trans::serialization::SerializeResult(
-          const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-          std::string* result)>& serialize_sct_merkle_leaf);
-
-  static void ConfigureV2(
-      const std::function<std::string(const ct::LogEntry&)>& leaf_data,
-      const std::function<cert_trans::serialization::SerializeResult(
-          const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-          std::string* result)>& serialize_sct_sig_input,
-      const std::function<cert_trans::serialization::SerializeResult(
-          const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-          std::string* result)>& serialize_sct_merkle_leaf);
-
-  static std::string LeafData(const ct::LogEntry& entry);
+  // Sets the serialization used by the static methods below, as well
+  // as by Deserializer::DeserializeMerkleTreeLeaf(). |log_serializer|
+  // must outlive all uses of those.
+  static void Configure(const LogSerializer& log_serializer);
+
+  // The LogSerializer set by Configure(). Classes which can be given a
+  // LogSerializer of their own (LogSigner, LogSigVerifier, LoggedEntry,
+  // SigningService, AsyncLogClient) only fall back to this one when
+  // they were not.
+  static const LogSerializer& Configured();
+
+  static const std::string& LeafData(const ct::LogEntry& entry);
 
   static cert_trans::serialization::SerializeResult SerializeSTHSignatureInput(
       const ct::SignedTreeHead& sth, std::string* result);
@@ -82,6 +163,10 @@ class Serializer {
       const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
       std::string* result);
 
+  static cert_trans::serialization::SerializeResult WriteSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink);
+
   static cert_trans::serialization::SerializeResult SerializeSCTSignatureInput(
       const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
       std::string* result);
@@ -132,17 +217,17 @@ class Deserializer {
   Deserializer(const Deserializer&) = delete;
   Deserializer& operator=(const Deserializer&) = delete;
 
-  static void Configure(
-      const std::function<cert_trans::serialization::DeserializeResult(
-          TLSDeserializer* d, ct::MerkleTreeLeaf* leaf)>&
-          read_merkle_tree_leaf_body);
-
   static cert_trans::serialization::DeserializeResult DeserializeSCT(
-      const std::string& in, ct::SignedCertificateTimestamp* sct);
+      util::StringView in, ct::SignedCertificateTimestamp* sct);
 
   static cert_trans::serialization::DeserializeResult DeserializeSCTList(
       const std::string& in, ct::SignedCertificateTimestampList* sct_list);
 
+  // Same as above, but without copying the SCTs: the elements of
+  // |sct_list| refer to |in|, and are only valid for as long as it is.
+  static cert_trans::serialization::DeserializeResult DeserializeSCTList(
+      util::StringView in, std::vector<util::StringView>* sct_list);
+
   static cert_trans::serialization::DeserializeResult
   DeserializeDigitallySigned(const std::string& in, ct::DigitallySigned* sig);
 
@@ -154,7 +239,7 @@ class Deserializer {
       repeated_string* out);
 
   static cert_trans::serialization::DeserializeResult
-  DeserializeMerkleTreeLeaf(const std::string& in, ct::MerkleTreeLeaf* leaf);
+  DeserializeMerkleTreeLeaf(util::StringView in, ct::MerkleTreeLeaf* leaf);
 
   // TODO(pphaneuf): Maybe the users of this should just use
   // TLSDeserializer directly?
@@ -176,4 +261,80 @@ class Deserializer {
   Deserializer() = delete;
 };
 
+
+// Walks the SCTs of an encoded SCT list (as found in the TLS extension,
+// certificates and OCSP responses) without copying or allocating. The
+// whole list is checked on construction, so iterating cannot fail.
+//
+// Usage:
+//   SCTListReader reader(serialized_list);
+//   if (reader.status() != DeserializeResult::OK) { ... }
+//   util::StringView sct;
+//   while (reader.Next(&sct)) { ... }
+class SCTListReader {
+ public:
+  // |in| must remain valid for as long as the reader and the SCTs it
+  // returns are in use.
+  explicit SCTListReader(util::StringView in);
+
+  // The result of checking the list. Same as Deserializer::
+  // DeserializeSCTList(); if not OK, Next() returns nothing.
+  cert_trans::serialization::DeserializeResult status() const {
+    return status_;
+  }
+
+  // The number of SCTs in the list.
+  size_t size() const {
+    return size_;
+  }
+
+  // Sets |sct| to the next encoded SCT and returns true, or returns
+  // false once the end of the list is reached.
+  bool Next(util::StringView* sct);
+
+ private:
+  cert_trans::serialization::DeserializeResult status_;
+  size_t size_;
+  // The SCTs not yet returned by Next().
+  util::StringView remaining_;
+};
+
+
+// An encoded SCT list which does not change once built, for example the
+// one a TLS server sends in every handshake. Build it once and share it
+// by reference, rather than encoding the list again each time.
+class EncodedSCTList {
+ public:
+  EncodedSCTList(const EncodedSCTList&) = delete;
+  EncodedSCTList& operator=(const EncodedSCTList&) = delete;
+
+  // On success, sets |result| to the encoding of |sct_list|, whose
+  // elements are encoded SCTs.
+  static cert_trans::serialization::SerializeResult Create(
+      const ct::SignedCertificateTimestampList& sct_list,
+      std::shared_ptr<const EncodedSCTList>* result);
+
+  const std::string& encoded() const {
+    return encoded_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  // Iterates over the SCTs in the list. The reader must not outlive
+  // this object.
+  SCTListReader Reader() const {
+    return SCTListReader(encoded_);
+  }
+
+ private:
+  EncodedSCTList(std::string encoded, size_t size)
+      : encoded_(std::move(encoded)), size_(size) {
+  }
+
+  const std::string encoded_;
+  const size_t size_;
+};
+
 #endif  // CERT_TRANS_PROTO_SERIALIZER_H_
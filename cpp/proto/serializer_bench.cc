@@ -0,0 +1,409 @@
+// Throughput benchmarks and fuzzing for the TLS serialization code.
+//
+// "make check" builds this but does not run it, as it takes a while and
+// its results depend on the machine. Run it by hand before and after
+// changing anything in proto/, and compare the MB/s and allocations per
+// operation it reports (which are also recorded as test properties, for
+// --gtest_output=xml).
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "proto/cert_serializer.h"
+#include "proto/ct.pb.h"
+#include "proto/serializer.h"
+#include "util/benchmark.h"
+#include "util/string_view.h"
+#include "util/testing.h"
+
+DEFINE_int32(serializer_bench_iterations, 100000,
+             "Number of operations to time, for each benchmark.");
+DEFINE_int32(serializer_fuzz_iterations, 100000,
+             "Number of mutated inputs to feed to each deserializer.");
+DEFINE_int32(serializer_bench_corpus_size, 100,
+             "Number of distinct entries to generate.");
+DEFINE_int32(serializer_bench_seed, 1,
+             "Seed for generating the corpus and the fuzzed inputs.");
+
+namespace cert_trans {
+namespace {
+
+using ct::LogEntry;
+using ct::MerkleTreeLeaf;
+using ct::PrecertChainEntry;
+using ct::SignedCertificateTimestamp;
+using ct::SignedCertificateTimestampList;
+using ct::X509ChainEntry;
+using serialization::DeserializeResult;
+using serialization::SerializeResult;
+using std::mt19937;
+using std::ostringstream;
+using std::string;
+using std::vector;
+using test::BenchmarkResult;
+using test::ReportBenchmark;
+using test::RunBenchmark;
+
+// Typical sizes of the things found in a log, in bytes.
+const size_t kMinCertLength = 800;
+const size_t kMaxCertLength = 2500;
+const size_t kSignatureLength = 72;
+const size_t kKeyIDLength = 32;
+const int kMaxChainLength = 4;
+const int kMaxSCTsPerList = 5;
+
+
+string RandomBytes(mt19937* rng, size_t min_length, size_t max_length) {
+  const size_t length(std::uniform_int_distribution<size_t>(
+      min_length, max_length)(*rng));
+  string ret;
+  ret.reserve(length);
+  for (size_t i = 0; i < length; ++i) {
+    ret.push_back(static_cast<char>((*rng)() & 0xff));
+  }
+  return ret;
+}
+
+
+string RandomCert(mt19937* rng) {
+  return RandomBytes(rng, kMinCertLength, kMaxCertLength);
+}
+
+
+SignedCertificateTimestamp RandomSCT(mt19937* rng) {
+  SignedCertificateTimestamp sct;
+  sct.set_version(ct::V1);
+  sct.mutable_id()->set_key_id(RandomBytes(rng, kKeyIDLength, kKeyIDLength));
+  sct.set_timestamp(1400000000000ULL + (*rng)());
+  sct.mutable_signature()->set_hash_algorithm(ct::DigitallySigned::SHA256);
+  sct.mutable_signature()->set_sig_algorithm(ct::DigitallySigned::ECDSA);
+  sct.mutable_signature()->set_signature(
+      RandomBytes(rng, kSignatureLength - 2, kSignatureLength));
+  return sct;
+}
+
+
+LogEntry RandomEntry(mt19937* rng) {
+  LogEntry entry;
+  const int chain_length(
+      std::uniform_int_distribution<int>(1, kMaxChainLength)(*rng));
+  if ((*rng)() & 1) {
+    entry.set_type(ct::X509_ENTRY);
+    X509ChainEntry* const x509(entry.mutable_x509_entry());
+    x509->set_leaf_certificate(RandomCert(rng));
+    for (int i = 0; i < chain_length; ++i) {
+      x509->add_certificate_chain(RandomCert(rng));
+    }
+  } else {
+    entry.set_type(ct::PRECERT_ENTRY);
+    PrecertChainEntry* const precert(entry.mutable_precert_entry());
+    precert->set_pre_certificate(RandomCert(rng));
+    precert->mutable_pre_cert()->set_issuer_key_hash(
+        RandomBytes(rng, kKeyIDLength, kKeyIDLength));
+    precert->mutable_pre_cert()->set_tbs_certificate(RandomCert(rng));
+    for (int i = 0; i < chain_length; ++i) {
+      precert->add_precertificate_chain(RandomCert(rng));
+    }
+  }
+  return entry;
+}
+
+
+// Randomly generated entries and SCTs, along with their encodings.
+class Corpus {
+ public:
+  Corpus(int size, mt19937* rng) {
+    for (int i = 0; i < size; ++i) {
+      entries_.push_back(RandomEntry(rng));
+      scts_.push_back(RandomSCT(rng));
+
+      string leaf;
+      CHECK_EQ(SerializeResult::OK,
+               Serializer::SerializeSCTMerkleTreeLeaf(scts_.back(),
+                                                      entries_.back(),
+                                                      &leaf));
+      leaves_.push_back(leaf);
+
+      string chain;
+      if (entries_.back().type() == ct::X509_ENTRY) {
+        CHECK_EQ(SerializeResult::OK,
+                 SerializeX509Chain(entries_.back().x509_entry(), &chain));
+        x509_chains_.push_back(chain);
+      } else {
+        CHECK_EQ(SerializeResult::OK,
+                 SerializePrecertChainEntry(entries_.back().precert_entry(),
+                                            &chain));
+        precert_chains_.push_back(chain);
+      }
+
+      SignedCertificateTimestampList sct_list;
+      const int num_scts(
+          std::uniform_int_distribution<int>(1, kMaxSCTsPerList)(*rng));
+      for (int j = 0; j < num_scts; ++j) {
+        CHECK_EQ(SerializeResult::OK,
+                 Serializer::SerializeSCT(RandomSCT(rng),
+                                          sct_list.add_sct_list()));
+      }
+      string encoded;
+      CHECK_EQ(SerializeResult::OK,
+               Serializer::SerializeSCTList(sct_list, &encoded));
+      sct_lists_.push_back(encoded);
+    }
+    CHECK(!x509_chains_.empty());
+    CHECK(!precert_chains_.empty());
+  }
+
+  const vector<LogEntry>& entries() const {
+    return entries_;
+  }
+
+  const vector<SignedCertificateTimestamp>& scts() const {
+    return scts_;
+  }
+
+  const vector<string>& leaves() const {
+    return leaves_;
+  }
+
+  const vector<string>& sct_lists() const {
+    return sct_lists_;
+  }
+
+  const vector<string>& x509_chains() const {
+    return x509_chains_;
+  }
+
+  const vector<string>& precert_chains() const {
+    return precert_chains_;
+  }
+
+ private:
+  vector<LogEntry> entries_;
+  vector<SignedCertificateTimestamp> scts_;
+  vector<string> leaves_;
+  vector<string> sct_lists_;
+  vector<string> x509_chains_;
+  vector<string> precert_chains_;
+};
+
+
+class SerializerBench : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    mt19937 rng(FLAGS_serializer_bench_seed);
+    corpus_ = new Corpus(FLAGS_serializer_bench_corpus_size, &rng);
+  }
+
+  static void TearDownTestCase() {
+    delete corpus_;
+    corpus_ = nullptr;
+  }
+
+  // Calls |op| with 0 to --serializer_bench_iterations - 1, and reports
+  // the throughput and the number of allocations per call. |op| returns
+  // the number of (encoded) bytes it handled.
+  template <class Op>
+  void Measure(const Op& op) {
+    uint64_t bytes(0);
+    const BenchmarkResult result(
+        RunBenchmark(FLAGS_serializer_bench_iterations,
+                     [&op, &bytes](int i) { bytes += op(i); }));
+
+    const double mb_per_s(bytes / result.elapsed.count() / (1 << 20));
+    ostringstream summary;
+    summary << mb_per_s << " MB/s";
+    ReportBenchmark(result, summary.str());
+    RecordProperty("kb_per_s", static_cast<int>(mb_per_s * 1024));
+  }
+
+  static const Corpus& corpus() {
+    return *corpus_;
+  }
+
+ private:
+  static Corpus* corpus_;
+};
+
+
+Corpus* SerializerBench::corpus_ = nullptr;
+
+
+template <class T>
+const T& Pick(const vector<T>& items, int i) {
+  return items[i % items.size()];
+}
+
+
+TEST_F(SerializerBench, SerializeSCTMerkleTreeLeaf) {
+  string result;
+  Measure([&result](int i) {
+    CHECK_EQ(SerializeResult::OK,
+             Serializer::SerializeSCTMerkleTreeLeaf(
+                 Pick(corpus().scts(), i), Pick(corpus().entries(), i),
+                 &result));
+    return result.size();
+  });
+}
+
+
+TEST_F(SerializerBench, SerializeSCTSignatureInput) {
+  string result;
+  Measure([&result](int i) {
+    CHECK_EQ(SerializeResult::OK,
+             Serializer::SerializeSCTSignatureInput(
+                 Pick(corpus().scts(), i), Pick(corpus().entries(), i),
+                 &result));
+    return result.size();
+  });
+}
+
+
+TEST_F(SerializerBench, DeserializeMerkleTreeLeaf) {
+  MerkleTreeLeaf leaf;
+  Measure([&leaf](int i) {
+    const string& in(Pick(corpus().leaves(), i));
+    CHECK_EQ(DeserializeResult::OK,
+             Deserializer::DeserializeMerkleTreeLeaf(in, &leaf));
+    return in.size();
+  });
+}
+
+
+TEST_F(SerializerBench, DeserializeSCTList) {
+  SignedCertificateTimestampList sct_list;
+  Measure([&sct_list](int i) {
+    const string& in(Pick(corpus().sct_lists(), i));
+    CHECK_EQ(DeserializeResult::OK,
+             Deserializer::DeserializeSCTList(in, &sct_list));
+    return in.size();
+  });
+}
+
+
+TEST_F(SerializerBench, SCTListReader) {
+  Measure([](int i) {
+    const string& in(Pick(corpus().sct_lists(), i));
+    SCTListReader reader(in);
+    CHECK_EQ(DeserializeResult::OK, reader.status());
+    util::StringView sct;
+    while (reader.Next(&sct)) {
+    }
+    return in.size();
+  });
+}
+
+
+TEST_F(SerializerBench, DeserializeX509Chain) {
+  X509ChainEntry entry;
+  Measure([&entry](int i) {
+    const string& in(Pick(corpus().x509_chains(), i));
+    CHECK_EQ(DeserializeResult::OK, DeserializeX509Chain(in, &entry));
+    return in.size();
+  });
+}
+
+
+TEST_F(SerializerBench, DeserializePrecertChainEntry) {
+  PrecertChainEntry entry;
+  Measure([&entry](int i) {
+    const string& in(Pick(corpus().precert_chains(), i));
+    CHECK_EQ(DeserializeResult::OK, DeserializePrecertChainEntry(in, &entry));
+    return in.size();
+  });
+}
+
+
+// Returns a copy of |in| with a random change: bytes flipped,
+// truncated, extended, or a length prefix made up.
+string Mutate(const string& in, mt19937* rng) {
+  string out(in);
+  const size_t pos(
+      std::uniform_int_distribution<size_t>(0, in.size())(*rng));
+  switch ((*rng)() % 5) {
+    case 0:
+      if (pos < out.size()) {
+        out[pos] ^= static_cast<char>(1 + (*rng)() % 255);
+      }
+      break;
+    case 1:
+      out.resize(pos);
+      break;
+    case 2:
+      out.insert(pos, RandomBytes(rng, 1, 8));
+      break;
+    case 3:
+      out.append(RandomBytes(rng, 1, 8));
+      break;
+    case 4:
+      // The list and element lengths are at most three bytes.
+      out.replace(pos, 3, RandomBytes(rng, 1, 3));
+      break;
+  }
+  return out;
+}
+
+
+// Feeds mutations of |inputs| to all the deserializers. They must not
+// crash, and the two ways to read an SCT list must agree.
+void Fuzz(const vector<string>& inputs) {
+  mt19937 rng(FLAGS_serializer_bench_seed);
+  MerkleTreeLeaf leaf;
+  SignedCertificateTimestampList sct_list;
+  X509ChainEntry x509_chain;
+  PrecertChainEntry precert_chain;
+  for (int i = 0; i < FLAGS_serializer_fuzz_iterations; ++i) {
+    const string in(Mutate(Pick(inputs, i), &rng));
+
+    Deserializer::DeserializeMerkleTreeLeaf(in, &leaf);
+    DeserializeX509Chain(in, &x509_chain);
+    DeserializePrecertChainEntry(in, &precert_chain);
+
+    const DeserializeResult res(
+        Deserializer::DeserializeSCTList(in, &sct_list));
+    SCTListReader reader(in);
+    ASSERT_EQ(res, reader.status()) << i;
+    if (res == DeserializeResult::OK) {
+      ASSERT_EQ(static_cast<size_t>(sct_list.sct_list_size()), reader.size());
+      string reencoded;
+      ASSERT_EQ(SerializeResult::OK,
+                Serializer::SerializeSCTList(sct_list, &reencoded));
+      ASSERT_EQ(in, reencoded) << i;
+    }
+  }
+}
+
+
+TEST_F(SerializerBench, FuzzMerkleTreeLeaves) {
+  Fuzz(corpus().leaves());
+}
+
+
+TEST_F(SerializerBench, FuzzSCTLists) {
+  Fuzz(corpus().sct_lists());
+}
+
+
+TEST_F(SerializerBench, FuzzX509Chains) {
+  Fuzz(corpus().x509_chains());
+}
+
+
+TEST_F(SerializerBench, FuzzPrecertChains) {
+  Fuzz(corpus().precert_chains());
+}
+
+
+}  // namespace
+}  // namespace cert_trans
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  ConfigureSerializerForV1CT();
+  return RUN_ALL_TESTS();
+}
@@ -4,10 +4,12 @@
 #include <google/protobuf/repeated_field.h>
 #include <gtest/gtest.h>
 #include <string>
+#include <vector>
 
 #include "proto/cert_serializer.h"
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
+#include "util/string_view.h"
 #include "util/testing.h"
 #include "util/util.h"
 
@@ -17,6 +19,7 @@ namespace {
 
 using cert_trans::serialization::SerializeResult;
 using cert_trans::serialization::DeserializeResult;
+using cert_trans::serialization::TLSWriter;
 using ct::DigitallySigned;
 using ct::LogEntry;
 using ct::LogEntryType;
@@ -31,6 +34,7 @@ using ct::Version;
 using ct::X509ChainEntry;
 using google::protobuf::RepeatedPtrField;
 using std::string;
+using std::vector;
 
 // A slightly shorter notation for constructing binary blobs from test vectors.
 string B(const string& hexstring) {
@@ -744,6 +748,22 @@ TEST_F(SerializerTestV1, DeserializeSCTListKatTest) {
   EXPECT_EQ(string(kDefaultSCTHexString), H(sct_list.sct_list(0)));
 }
 
+TEST_F(SerializerTestV1, DeserializeSCTListViewKatTest) {
+  const string serialized(B(kDefaultSCTListHexString));
+  std::vector<util::StringView> sct_list;
+  EXPECT_EQ(DeserializeResult::OK,
+            Deserializer::DeserializeSCTList(serialized, &sct_list));
+  ASSERT_EQ(1U, sct_list.size());
+  EXPECT_EQ(string(kDefaultSCTHexString), H(sct_list[0].ToString()));
+  EXPECT_TRUE(sct_list[0].data() > serialized.data() &&
+              sct_list[0].end() <= serialized.data() + serialized.size());
+
+  EXPECT_EQ(DeserializeResult::EMPTY_LIST,
+            Deserializer::DeserializeSCTList(B("0000"), &sct_list));
+  EXPECT_EQ(DeserializeResult::EMPTY_ELEM_IN_LIST,
+            Deserializer::DeserializeSCTList(B("00020000"), &sct_list));
+}
+
 TEST_F(SerializerTestV1, SerializeSCTSignatureInputKatTestV1) {
   string cert_result, precert_result;
   EXPECT_EQ(SerializeResult::OK,
@@ -882,6 +902,106 @@ TEST_F(SerializerTestV2, SerializeSCTMerkleTreeLeafKatTestV2) {
   EXPECT_EQ(string(kDefaultPrecertSCTLeafHexStringV2), H(precert_result));
 }
 
+TEST_F(SerializerTest, LogSerializersSideBySide) {
+  const LogSerializer& v1(LogSerializer::ForPolicy<CertV1Policy>());
+  const LogSerializer& v2(LogSerializer::ForPolicy<CertV2Policy>());
+  EXPECT_EQ(ct::V1, v1.version());
+  EXPECT_EQ(ct::V2, v2.version());
+  EXPECT_EQ(&v1, &LogSerializer::ForPolicy<CertV1Policy>());
+
+  string v1_result, v2_result;
+  EXPECT_EQ(SerializeResult::OK,
+            v1.SerializeSCTMerkleTreeLeaf(DefaultSCT(), DefaultCertEntry(),
+                                          &v1_result));
+  EXPECT_EQ(SerializeResult::OK,
+            v2.SerializeSCTMerkleTreeLeaf(DefaultSCTV2(), DefaultCertEntryV2(),
+                                          &v2_result));
+  EXPECT_EQ(string(kDefaultCertSCTLeafHexString), H(v1_result));
+  EXPECT_EQ(string(kDefaultCertSCTLeafHexStringV2), H(v2_result));
+
+  MerkleTreeLeaf leaf;
+  EXPECT_EQ(DeserializeResult::OK,
+            v1.DeserializeMerkleTreeLeaf(v1_result, &leaf));
+  EXPECT_EQ(ct::V1, leaf.version());
+  EXPECT_EQ(DeserializeResult::OK,
+            v2.DeserializeMerkleTreeLeaf(v2_result, &leaf));
+  EXPECT_EQ(ct::V2, leaf.version());
+  EXPECT_EQ(DeserializeResult::INPUT_TOO_LONG,
+            v1.DeserializeMerkleTreeLeaf(v1_result + "x", &leaf));
+
+  EXPECT_EQ(SerializeResult::OK,
+            v1.SerializeSCTSignatureInput(DefaultSCT(), DefaultCertEntry(),
+                                          &v1_result));
+  EXPECT_EQ(SerializeResult::UNSUPPORTED_VERSION,
+            v2.SerializeSCTSignatureInput(DefaultSCT(), DefaultCertEntry(),
+                                          &v2_result));
+}
+
+// Collects what is written to it, one Append() call per element.
+class CollectingSink : public cert_trans::serialization::ByteSink {
+ public:
+  void Append(const char* data, size_t size) override {
+    pieces.push_back(string(data, size));
+  }
+
+  string Joined() const {
+    string joined;
+    for (const auto& piece : pieces) {
+      joined.append(piece);
+    }
+    return joined;
+  }
+
+  std::vector<string> pieces;
+};
+
+
+TEST_F(SerializerTestV1, WriteSCTMerkleTreeLeafKatTestV1) {
+  CollectingSink cert_sink;
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::WriteSCTMerkleTreeLeaf(DefaultSCT(),
+                                               DefaultCertEntry(),
+                                               &cert_sink));
+  EXPECT_EQ(string(kDefaultCertSCTLeafHexString), H(cert_sink.Joined()));
+  // The certificate is passed through, not copied into a buffer first.
+  EXPECT_LT(1U, cert_sink.pieces.size());
+
+  CollectingSink precert_sink;
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::WriteSCTMerkleTreeLeaf(DefaultSCT(),
+                                               DefaultPrecertEntry(),
+                                               &precert_sink));
+  EXPECT_EQ(string(kDefaultPrecertSCTLeafHexString),
+            H(precert_sink.Joined()));
+
+  LogEntry entry(DefaultCertEntry());
+  entry.mutable_x509_entry()->clear_leaf_certificate();
+  CollectingSink error_sink;
+  EXPECT_EQ(SerializeResult::EMPTY_CERTIFICATE,
+            Serializer::WriteSCTMerkleTreeLeaf(DefaultSCT(), entry,
+                                               &error_sink));
+  EXPECT_TRUE(error_sink.pieces.empty());
+}
+
+
+TEST_F(SerializerTestV2, WriteSCTMerkleTreeLeafKatTestV2) {
+  CollectingSink sink;
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::WriteSCTMerkleTreeLeaf(DefaultSCTV2(),
+                                               DefaultCertEntryV2(), &sink));
+  EXPECT_EQ(string(kDefaultCertSCTLeafHexStringV2), H(sink.Joined()));
+  EXPECT_LT(1U, sink.pieces.size());
+
+  CollectingSink precert_sink;
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::WriteSCTMerkleTreeLeaf(DefaultSCTV2(),
+                                               DefaultPrecertEntryV2(),
+                                               &precert_sink));
+  EXPECT_EQ(string(kDefaultPrecertSCTLeafHexStringV2),
+            H(precert_sink.Joined()));
+}
+
+
 TEST_F(SerializerTestV1, DeserializeMerkleTreeLeafKATV1Cert) {
   MerkleTreeLeaf leaf;
   EXPECT_EQ(DeserializeResult::OK,
@@ -914,6 +1034,69 @@ TEST_F(SerializerTestV1, DeserializeMerkleTreeLeafKATV1Precert) {
       DefaultTbsCertificate());
 }
 
+// Checks that |view| lies within |buffer|, i.e. that nothing was copied.
+bool PointsInto(const util::StringView& view, const string& buffer) {
+  return view.data() >= buffer.data() &&
+         view.data() + view.size() <= buffer.data() + buffer.size();
+}
+
+TEST_F(SerializerTestV1, DeserializeMerkleTreeLeafViewKATV1Cert) {
+  const string serialized(B(kDefaultCertSCTLeafHexString));
+  MerkleTreeLeafView view;
+  EXPECT_EQ(DeserializeResult::OK,
+            DeserializeV1MerkleTreeLeaf(serialized, &view));
+  EXPECT_EQ(DefaultSCTTimestamp(), view.timestamp);
+  EXPECT_EQ(ct::X509_ENTRY, view.entry_type);
+  EXPECT_TRUE(view.issuer_key_hash.empty());
+  EXPECT_EQ(DefaultCertEntry().x509_entry().leaf_certificate(),
+            view.certificate.ToString());
+  EXPECT_TRUE(PointsInto(view.certificate, serialized));
+
+  MerkleTreeLeaf leaf, expected_leaf;
+  view.CopyToProto(&leaf);
+  EXPECT_EQ(DeserializeResult::OK,
+            Deserializer::DeserializeMerkleTreeLeaf(serialized,
+                                                    &expected_leaf));
+  EXPECT_EQ(expected_leaf.DebugString(), leaf.DebugString());
+}
+
+TEST_F(SerializerTestV1, DeserializeMerkleTreeLeafViewKATV1Precert) {
+  const string serialized(B(kDefaultPrecertSCTLeafHexString));
+  MerkleTreeLeafView view;
+  EXPECT_EQ(DeserializeResult::OK,
+            DeserializeV1MerkleTreeLeaf(serialized, &view));
+  EXPECT_EQ(DefaultSCTTimestamp(), view.timestamp);
+  EXPECT_EQ(ct::PRECERT_ENTRY, view.entry_type);
+  EXPECT_EQ(DefaultIssuerKeyHash(), view.issuer_key_hash.ToString());
+  EXPECT_EQ(DefaultTbsCertificate(), view.certificate.ToString());
+  EXPECT_TRUE(PointsInto(view.issuer_key_hash, serialized));
+  EXPECT_TRUE(PointsInto(view.certificate, serialized));
+
+  MerkleTreeLeaf leaf, expected_leaf;
+  view.CopyToProto(&leaf);
+  EXPECT_EQ(DeserializeResult::OK,
+            Deserializer::DeserializeMerkleTreeLeaf(serialized,
+                                                    &expected_leaf));
+  EXPECT_EQ(expected_leaf.DebugString(), leaf.DebugString());
+}
+
+TEST_F(SerializerTestV1, DeserializeMerkleTreeLeafViewErrors) {
+  const string serialized(B(kDefaultCertSCTLeafHexString));
+  MerkleTreeLeafView view;
+  EXPECT_EQ(DeserializeResult::INPUT_TOO_SHORT,
+            DeserializeV1MerkleTreeLeaf(
+                util::StringView(serialized.data(), serialized.size() - 1),
+                &view));
+  EXPECT_EQ(DeserializeResult::INPUT_TOO_LONG,
+            DeserializeV1MerkleTreeLeaf(serialized + "x", &view));
+
+  // Version, leaf type, timestamp, then an unknown entry type.
+  string bad_type(serialized);
+  bad_type[1 + 1 + 8 + 1] = 0x7f;
+  EXPECT_EQ(DeserializeResult::UNKNOWN_LOGENTRY_TYPE,
+            DeserializeV1MerkleTreeLeaf(bad_type, &view));
+}
+
 TEST_F(SerializerTestV2, DeserializeMerkleTreeLeafKATV2Cert) {
   MerkleTreeLeaf leaf;
   EXPECT_EQ(DeserializeResult::OK,
@@ -1425,6 +1608,75 @@ TEST_F(SerializerTestV1, SerializeDeserializeMultiSCTList) {
   EXPECT_EQ(B(kDefaultSCTHexString), read_sct_list.sct_list(1));
 }
 
+TEST_F(SerializerTestV1, SCTListReader) {
+  SignedCertificateTimestampList sct_list;
+  sct_list.add_sct_list("hello");
+  sct_list.add_sct_list(B(kDefaultSCTHexString));
+  string serialized;
+  ASSERT_EQ(SerializeResult::OK,
+            Serializer::SerializeSCTList(sct_list, &serialized));
+
+  SCTListReader reader(serialized);
+  EXPECT_EQ(DeserializeResult::OK, reader.status());
+  EXPECT_EQ(2U, reader.size());
+  util::StringView sct;
+  ASSERT_TRUE(reader.Next(&sct));
+  EXPECT_EQ("hello", sct.ToString());
+  // The SCTs refer to the input.
+  EXPECT_EQ(serialized.data() + 4, sct.data());
+  ASSERT_TRUE(reader.Next(&sct));
+  EXPECT_EQ(B(kDefaultSCTHexString), sct.ToString());
+  EXPECT_FALSE(reader.Next(&sct));
+  EXPECT_FALSE(reader.Next(&sct));
+}
+
+TEST_F(SerializerTestV1, SCTListReaderErrors) {
+  const string too_long(B(kDefaultSCTListHexString) + "x");
+  const string too_short(B("0002"));
+  const string empty_list(B("0000"));
+  const string empty_elem(B("00020000"));
+  const string invalid(B("00020001"));
+  const struct {
+    const string& in;
+    DeserializeResult expected;
+  } cases[] = {
+      {too_long, DeserializeResult::INPUT_TOO_LONG},
+      {too_short, DeserializeResult::INPUT_TOO_SHORT},
+      {empty_list, DeserializeResult::EMPTY_LIST},
+      {empty_elem, DeserializeResult::EMPTY_ELEM_IN_LIST},
+      {invalid, DeserializeResult::INVALID_LIST_ENCODING},
+  };
+
+  for (const auto& c : cases) {
+    SCTListReader reader(c.in);
+    EXPECT_EQ(c.expected, reader.status()) << H(c.in);
+    EXPECT_EQ(0U, reader.size());
+    util::StringView sct;
+    EXPECT_FALSE(reader.Next(&sct));
+  }
+}
+
+TEST_F(SerializerTestV1, EncodedSCTList) {
+  std::shared_ptr<const EncodedSCTList> encoded;
+  EXPECT_EQ(SerializeResult::EMPTY_LIST,
+            EncodedSCTList::Create(SignedCertificateTimestampList(),
+                                   &encoded));
+  EXPECT_FALSE(encoded);
+
+  ASSERT_EQ(SerializeResult::OK,
+            EncodedSCTList::Create(DefaultSCTList(), &encoded));
+  ASSERT_TRUE(encoded.get() != nullptr);
+  EXPECT_EQ(string(kDefaultSCTListHexString), H(encoded->encoded()));
+  EXPECT_EQ(1U, encoded->size());
+
+  SCTListReader reader(encoded->Reader());
+  EXPECT_EQ(DeserializeResult::OK, reader.status());
+  util::StringView sct;
+  ASSERT_TRUE(reader.Next(&sct));
+  EXPECT_EQ(string(kDefaultSCTHexString), H(sct.ToString()));
+  EXPECT_FALSE(reader.Next(&sct));
+}
+
 TEST_F(SerializerTestV1, DeserializeSCTListTooLong) {
   string sct_string(B(kDefaultSCTListHexString));
   sct_string.push_back('x');
@@ -1525,6 +1777,117 @@ TEST_F(SerializerTestV1,
             SerializePrecertChainEntry(entry, &result));
 }
 
+// Collects the records decoded by a BinaryEntriesDecoder.
+class BinaryEntriesCollector {
+ public:
+  BinaryEntriesCollector()
+      : decoder_([this](const BinaryEntriesDecoder::Record& record) {
+          records_.push_back(record.leaf_input.ToString() + "/" +
+                             record.extra_data.ToString() + "/" +
+                             record.sct.ToString());
+          return DeserializeResult::OK;
+        }) {
+  }
+
+  BinaryEntriesDecoder* decoder() {
+    return &decoder_;
+  }
+
+  const vector<string>& records() const {
+    return records_;
+  }
+
+ private:
+  vector<string> records_;
+  BinaryEntriesDecoder decoder_;
+};
+
+TEST_F(SerializerTestV1, BinaryEntries) {
+  string encoded;
+  EXPECT_EQ(SerializeResult::OK,
+            WriteBinaryEntry("leaf", "extra", "", &encoded));
+  EXPECT_EQ("0000046c656166000005657874726100" "00", H(encoded));
+  EXPECT_EQ(SerializeResult::OK,
+            WriteBinaryEntry("leaf2", "", "sct", &encoded));
+  EXPECT_EQ(SerializeResult::EMPTY_ELEM_IN_LIST,
+            WriteBinaryEntry("", "extra", "sct", &encoded));
+
+  // Decoded all at once.
+  {
+    BinaryEntriesCollector collector;
+    EXPECT_EQ(DeserializeResult::OK, collector.decoder()->Append(encoded));
+    EXPECT_EQ(DeserializeResult::OK, collector.decoder()->Finish());
+    EXPECT_EQ((vector<string>{"leaf/extra/", "leaf2//sct"}),
+              collector.records());
+  }
+
+  // And split at every possible position.
+  for (size_t split = 0; split <= encoded.size(); ++split) {
+    BinaryEntriesCollector collector;
+    const util::StringView view(encoded);
+    EXPECT_EQ(DeserializeResult::OK,
+              collector.decoder()->Append(view.substr(0, split)));
+    EXPECT_EQ(DeserializeResult::OK,
+              collector.decoder()->Append(view.substr(split)));
+    EXPECT_EQ(DeserializeResult::OK, collector.decoder()->Finish());
+    EXPECT_EQ((vector<string>{"leaf/extra/", "leaf2//sct"}),
+              collector.records())
+        << split;
+  }
+
+  // One byte at a time.
+  {
+    BinaryEntriesCollector collector;
+    for (size_t i = 0; i < encoded.size(); ++i) {
+      EXPECT_EQ(DeserializeResult::OK,
+                collector.decoder()->Append(util::StringView(&encoded[i], 1)));
+    }
+    EXPECT_EQ(DeserializeResult::OK, collector.decoder()->Finish());
+    EXPECT_EQ(2U, collector.records().size());
+  }
+}
+
+TEST_F(SerializerTestV1, BinaryEntriesErrors) {
+  string encoded;
+  ASSERT_EQ(SerializeResult::OK,
+            WriteBinaryEntry("leaf", "extra", "sct", &encoded));
+
+  {
+    BinaryEntriesCollector collector;
+    EXPECT_EQ(DeserializeResult::OK,
+              collector.decoder()->Append(
+                  util::StringView(encoded).substr(0, encoded.size() - 1)));
+    EXPECT_EQ(DeserializeResult::INPUT_TOO_SHORT,
+              collector.decoder()->Finish());
+    EXPECT_TRUE(collector.records().empty());
+  }
+
+  {
+    BinaryEntriesCollector collector;
+    EXPECT_EQ(DeserializeResult::EMPTY_ELEM_IN_LIST,
+              collector.decoder()->Append(B("000000000000" "0000")));
+    // Decoding stops at the first error.
+    EXPECT_EQ(DeserializeResult::EMPTY_ELEM_IN_LIST,
+              collector.decoder()->Append(encoded));
+    EXPECT_EQ(DeserializeResult::EMPTY_ELEM_IN_LIST,
+              collector.decoder()->Finish());
+    EXPECT_TRUE(collector.records().empty());
+  }
+
+  {
+    int calls(0);
+    BinaryEntriesDecoder decoder([&calls](
+        const BinaryEntriesDecoder::Record&) {
+      ++calls;
+      return DeserializeResult::UNKNOWN_LEAF_TYPE;
+    });
+    EXPECT_EQ(DeserializeResult::UNKNOWN_LEAF_TYPE,
+              decoder.Append(encoded + encoded));
+    EXPECT_EQ(DeserializeResult::UNKNOWN_LEAF_TYPE, decoder.Finish());
+    EXPECT_EQ(1, calls);
+  }
+}
+
 TEST_F(SerializerTest, SerializeSCTSignedEntryWithType_KatTest) {
   string cert_result, precert_result;
   EXPECT_EQ(SerializeResult::OK,
@@ -1564,6 +1927,64 @@ TEST_F(SerializerTest, SerializeSCTSignedEntryWithType_BadIssuerKeyHash) {
                                                   &result));
 }
 
+TEST(TLSWriterTest, WriteUint) {
+  string result;
+  TLSWriter writer(&result);
+  writer.WriteUint(0x01, 1);
+  writer.WriteUint(0x0203, 2);
+  writer.WriteUint(0x040506, 3);
+  writer.WriteUint(static_cast<uint64_t>(0x0708090a0b0c0d0e), 8);
+  writer.WriteUint(ct::PRECERT_ENTRY, 2);
+  EXPECT_EQ("0102030405060708090a0b0c0d0e0001", H(result));
+}
+
+TEST(TLSWriterTest, WriteVarBytes) {
+  string result;
+  TLSWriter writer(&result);
+  writer.Reserve(TLSWriter::VarBytesLength("abc", 0xff) +
+                 TLSWriter::VarBytesLength("de", 0xffffff));
+  const size_t capacity(result.capacity());
+  writer.WriteVarBytes("abc", 0xff);
+  writer.WriteVarBytes("de", 0xffffff);
+  EXPECT_EQ("03616263" "0000026465", H(result));
+  EXPECT_EQ(TLSWriter::VarBytesLength("abc", 0xff) +
+                TLSWriter::VarBytesLength("de", 0xffffff),
+            result.size());
+  // The reservation covered everything.
+  EXPECT_EQ(capacity, result.capacity());
+}
+
+TEST(TLSWriterTest, PrefixLength) {
+  using cert_trans::serialization::internal::PrefixLength;
+  EXPECT_EQ(0U, PrefixLength(1));
+  EXPECT_EQ(1U, PrefixLength(2));
+  EXPECT_EQ(1U, PrefixLength(255));
+  EXPECT_EQ(1U, PrefixLength(256));
+  EXPECT_EQ(2U, PrefixLength(257));
+  EXPECT_EQ(2U, PrefixLength((1 << 16) - 1));
+  EXPECT_EQ(3U, PrefixLength((1 << 24) - 1));
+  EXPECT_EQ(4U, PrefixLength(static_cast<size_t>(1) << 32));
+}
+
+TEST_F(SerializerTestV1, SerializeIntoReusedString) {
+  string result;
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::SerializeSCTSignatureInput(DefaultSCT(),
+                                                   DefaultCertEntry(),
+                                                   &result));
+  const string first(result);
+
+  // A second serialization into the same string gives the same result,
+  // without needing to grow it.
+  const size_t capacity(result.capacity());
+  EXPECT_EQ(SerializeResult::OK,
+            Serializer::SerializeSCTSignatureInput(DefaultSCT(),
+                                                   DefaultCertEntry(),
+                                                   &result));
+  EXPECT_EQ(H(first), H(result));
+  EXPECT_EQ(capacity, result.capacity());
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
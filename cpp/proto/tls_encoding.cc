@@ -1,7 +1,6 @@
 /* -*- indent-tabs-mode: nil -*- */
 #include "proto/tls_encoding.h"
 
-#include <math.h>
 #include <ostream>
 #include <string>
 
@@ -119,16 +118,12 @@ std::ostream& operator<<(std::ostream& stream, const DeserializeResult& r) {
 }
 
 void WriteFixedBytes(const std::string& in, std::string* output) {
-  output->append(in);
+  TLSWriter(output).WriteFixedBytes(in);
 }
 
 void WriteVarBytes(const std::string& in, size_t max_length,
                    std::string* output) {
-  CHECK_LE(in.size(), max_length);
-
-  size_t prefix_length = internal::PrefixLength(max_length);
-  WriteUint(in.size(), prefix_length, output);
-  WriteFixedBytes(in, output);
+  TLSWriter(output).WriteVarBytes(in, max_length);
 }
 
 SerializeResult WriteList(const repeated_string& in, size_t max_elem_length,
@@ -145,10 +140,12 @@ SerializeResult WriteList(const repeated_string& in, size_t max_elem_length,
   size_t prefix_length = internal::PrefixLength(max_total_length);
   CHECK_GE(length, prefix_length);
 
-  WriteUint(length - prefix_length, prefix_length, output);
+  TLSWriter writer(output);
+  writer.Reserve(length);
+  writer.WriteUint(length - prefix_length, prefix_length);
 
   for (int i = 0; i < in.size(); ++i)
-    WriteVarBytes(in.Get(i), max_elem_length, output);
+    writer.WriteVarBytes(in.Get(i), max_elem_length);
   return SerializeResult::OK;
 }
 
@@ -157,19 +154,33 @@ SerializeResult WriteDigitallySigned(const DigitallySigned& sig,
   SerializeResult res = CheckSignatureFormat(sig);
   if (res != SerializeResult::OK)
     return res;
-  WriteUint(sig.hash_algorithm(), constants::kHashAlgorithmLengthInBytes,
-            output);
-  WriteUint(sig.sig_algorithm(), constants::kSigAlgorithmLengthInBytes,
-            output);
-  WriteVarBytes(sig.signature(), constants::kMaxSignatureLength, output);
+  TLSWriter writer(output);
+  writer.Reserve(DigitallySignedLength(sig));
+  writer.WriteUint(sig.hash_algorithm(),
+                   constants::kHashAlgorithmLengthInBytes);
+  writer.WriteUint(sig.sig_algorithm(), constants::kSigAlgorithmLengthInBytes);
+  writer.WriteVarBytes(sig.signature(), constants::kMaxSignatureLength);
   return SerializeResult::OK;
 }
 
+size_t DigitallySignedLength(const DigitallySigned& sig) {
+  return constants::kHashAlgorithmLengthInBytes +
+         constants::kSigAlgorithmLengthInBytes +
+         TLSWriter::VarBytesLength(sig.signature(),
+                                   constants::kMaxSignatureLength);
+}
+
 namespace internal {
 
 size_t PrefixLength(size_t max_length) {
   CHECK_GT(max_length, 0U);
-  return ceil(log2(max_length) / float(8));
+  // This is ceil(log2(max_length) / 8), without going through floating
+  // point: it is on the path of every variable-length field.
+  size_t bits(0);
+  for (size_t v = max_length - 1; v != 0; v >>= 1) {
+    ++bits;
+  }
+  return (bits + 7) / 8;
 }
 
 }  // namespace internal
@@ -187,15 +198,24 @@ using cert_trans::serialization::DeserializeResult;
 namespace constants = cert_trans::serialization::constants;
 
 
-TLSDeserializer::TLSDeserializer(const std::string& input)
+TLSDeserializer::TLSDeserializer(util::StringView input)
     : current_pos_(input.data()), bytes_remaining_(input.size()) {
 }
 
 
 bool TLSDeserializer::ReadFixedBytes(size_t bytes, std::string* result) {
+  util::StringView view;
+  if (!ReadFixedBytes(bytes, &view))
+    return false;
+  result->assign(view.data(), view.size());
+  return true;
+}
+
+
+bool TLSDeserializer::ReadFixedBytes(size_t bytes, util::StringView* result) {
   if (bytes_remaining_ < bytes)
     return false;
-  result->assign(current_pos_, bytes);
+  *result = util::StringView(current_pos_, bytes);
   current_pos_ += bytes;
   bytes_remaining_ -= bytes;
   return true;
@@ -219,10 +239,21 @@ bool TLSDeserializer::ReadVarBytes(size_t max_length, std::string* result) {
   return ReadFixedBytes(length, result);
 }
 
-DeserializeResult TLSDeserializer::ReadList(size_t max_total_length,
-                                            size_t max_elem_length,
-                                            repeated_string* out) {
-  std::string serialized_list;
+
+bool TLSDeserializer::ReadVarBytes(size_t max_length,
+                                   util::StringView* result) {
+  size_t length;
+  if (!ReadLengthPrefix(max_length, &length))
+    return false;
+  return ReadFixedBytes(length, result);
+}
+
+
+template <class AddFunc>
+DeserializeResult TLSDeserializer::ReadListElements(size_t max_total_length,
+                                                    size_t max_elem_length,
+                                                    const AddFunc& add) {
+  util::StringView serialized_list;
   if (!ReadVarBytes(max_total_length, &serialized_list))
     // TODO(ekasper): could also be a length that's too large, if
     // length limits don't follow byte boundaries.
@@ -232,17 +263,37 @@ DeserializeResult TLSDeserializer::ReadList(size_t max_total_length,
 
   TLSDeserializer list_reader(serialized_list);
   while (!list_reader.ReachedEnd()) {
-    std::string elem;
+    util::StringView elem;
     if (!list_reader.ReadVarBytes(max_elem_length, &elem))
       return DeserializeResult::INVALID_LIST_ENCODING;
     if (elem.empty())
       return DeserializeResult::EMPTY_ELEM_IN_LIST;
-    *(out->Add()) = elem;
+    add(elem);
   }
   return DeserializeResult::OK;
 }
 
 
+DeserializeResult TLSDeserializer::ReadList(size_t max_total_length,
+                                            size_t max_elem_length,
+                                            repeated_string* out) {
+  return ReadListElements(max_total_length, max_elem_length,
+                          [out](const util::StringView& elem) {
+                            out->Add()->assign(elem.data(), elem.size());
+                          });
+}
+
+
+DeserializeResult TLSDeserializer::ReadList(
+    size_t max_total_length, size_t max_elem_length,
+    std::vector<util::StringView>* out) {
+  return ReadListElements(max_total_length, max_elem_length,
+                          [out](const util::StringView& elem) {
+                            out->push_back(elem);
+                          });
+}
+
+
 DeserializeResult TLSDeserializer::ReadDigitallySigned(DigitallySigned* sig) {
   int hash_algo = -1, sig_algo = -1;
   if (!ReadUint(constants::kHashAlgorithmLengthInBytes, &hash_algo))
@@ -254,13 +305,13 @@ DeserializeResult TLSDeserializer::ReadDigitallySigned(DigitallySigned* sig) {
   if (!ct::DigitallySigned_SignatureAlgorithm_IsValid(sig_algo))
     return DeserializeResult::INVALID_SIGNATURE_ALGORITHM;
 
-  std::string sig_string;
+  util::StringView sig_string;
   if (!ReadVarBytes(constants::kMaxSignatureLength, &sig_string))
     return DeserializeResult::INPUT_TOO_SHORT;
   sig->set_hash_algorithm(
       static_cast<DigitallySigned::HashAlgorithm>(hash_algo));
   sig->set_sig_algorithm(
       static_cast<DigitallySigned::SignatureAlgorithm>(sig_algo));
-  sig->set_signature(sig_string);
+  sig->set_signature(sig_string.data(), sig_string.size());
   return DeserializeResult::OK;
 }
@@ -2,9 +2,12 @@
 #define CERT_TRANS_PROTO_TLS_ENCODING_H_
 
 #include <glog/logging.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "proto/ct.pb.h"
+#include "util/string_view.h"
 
 typedef google::protobuf::RepeatedPtrField<std::string> repeated_string;
 
@@ -60,13 +63,7 @@ std::ostream& operator<<(std::ostream& stream, const DeserializeResult& r);
 // Basic serialization functions.                                            //
 ///////////////////////////////////////////////////////////////////////////////
 template <class T>
-void WriteUint(T in, size_t bytes, std::string* output) {
-  CHECK_LE(bytes, sizeof(in));
-  CHECK(bytes == sizeof(in) || in >> (bytes * 8) == 0);
-  for (; bytes > 0; --bytes)
-    output->push_back(((in & (static_cast<T>(0xff) << ((bytes - 1) * 8))) >>
-                       ((bytes - 1) * 8)));
-}
+void WriteUint(T in, size_t bytes, std::string* output);
 
 // Fixed-length byte array.
 void WriteFixedBytes(const std::string& in, std::string* output);
@@ -89,6 +86,9 @@ static const size_t kHashAlgorithmLengthInBytes = 1;
 static const size_t kSigAlgorithmLengthInBytes = 1;
 }  // namespace constants
 
+// Returns the encoded length of |sig|, which must be valid.
+size_t DigitallySignedLength(const ct::DigitallySigned& sig);
+
 namespace internal {
 
 // Returns the number of bytes needed to store a value up to max_length.
@@ -96,6 +96,95 @@ size_t PrefixLength(size_t max_length);
 
 }  // namespace internal
 
+// Receives encoded output as it is produced, for consumers that do not
+// need it in a contiguous buffer (for example, to hash it).
+class ByteSink {
+ public:
+  virtual ~ByteSink() = default;
+
+  virtual void Append(const char* data, size_t size) = 0;
+};
+
+
+// Appends TLS encoded data to a string. Callers that know the encoded
+// length up front should Reserve() it, so that the output is allocated at
+// most once (and not at all, if a string is reused across calls and has
+// enough capacity left from before).
+class TLSWriter {
+ public:
+  explicit TLSWriter(std::string* output)
+      : output_(CHECK_NOTNULL(output)), sink_(nullptr) {
+  }
+  // Passes the data to |sink| instead, in which case Reserve() does
+  // nothing.
+  explicit TLSWriter(ByteSink* sink)
+      : output_(nullptr), sink_(CHECK_NOTNULL(sink)) {
+  }
+  TLSWriter(const TLSWriter&) = delete;
+  TLSWriter& operator=(const TLSWriter&) = delete;
+
+  // Makes room for |bytes| more bytes of output.
+  void Reserve(size_t bytes) {
+    if (output_) {
+      output_->reserve(output_->size() + bytes);
+    }
+  }
+
+  template <class T>
+  void WriteUint(T in, size_t bytes);
+
+  // Fixed-length byte array.
+  void WriteFixedBytes(util::StringView in) {
+    Append(in.data(), in.size());
+  }
+
+  // Variable-length byte array.
+  // Caller is responsible for checking |in| <= max_length
+  void WriteVarBytes(util::StringView in, size_t max_length) {
+    CHECK_LE(in.size(), max_length);
+    WriteUint(in.size(), internal::PrefixLength(max_length));
+    WriteFixedBytes(in);
+  }
+
+  // Returns the encoded length of WriteVarBytes(in, max_length).
+  static size_t VarBytesLength(util::StringView in, size_t max_length) {
+    return internal::PrefixLength(max_length) + in.size();
+  }
+
+ private:
+  void Append(const char* data, size_t size) {
+    if (output_) {
+      output_->append(data, size);
+    } else {
+      sink_->Append(data, size);
+    }
+  }
+
+  std::string* const output_;
+  ByteSink* const sink_;
+};
+
+
+template <class T>
+void TLSWriter::WriteUint(T in, size_t bytes) {
+  CHECK_LE(bytes, sizeof(in));
+  CHECK(bytes == sizeof(in) || in >> (bytes * 8) == 0);
+  // Big-endian, assembled on the stack and appended in one go.
+  uint64_t value(static_cast<uint64_t>(in));
+  char buf[sizeof(value)];
+  for (size_t i = bytes; i > 0; --i) {
+    buf[i - 1] = static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+  Append(buf, bytes);
+}
+
+
+template <class T>
+void WriteUint(T in, size_t bytes, std::string* output) {
+  TLSWriter(output).WriteUint(in, bytes);
+}
+
 }  // namespace serializer
 
 }  // namespace cert_trans
@@ -106,7 +195,7 @@ class TLSDeserializer {
   // TODO(pphaneuf): And so we should take a string *, not a string &
   // (which could be to a temporary, and not valid once the
   // constructor returns).
-  explicit TLSDeserializer(const std::string& input);
+  explicit TLSDeserializer(util::StringView input);
   TLSDeserializer(const TLSDeserializer&) = delete;
   TLSDeserializer& operator=(const TLSDeserializer&) = delete;
 
@@ -114,9 +203,20 @@ class TLSDeserializer {
 
   bool ReadVarBytes(size_t max_length, std::string* result);
 
+  // Same as above, but without copying: |result| refers to the input, and
+  // is only valid for as long as the input is.
+  bool ReadFixedBytes(size_t bytes, util::StringView* result);
+
+  bool ReadVarBytes(size_t max_length, util::StringView* result);
+
   cert_trans::serialization::DeserializeResult ReadList(
       size_t max_total_length, size_t max_elem_length, repeated_string* out);
 
+  // Same as above, with the elements referring to the input.
+  cert_trans::serialization::DeserializeResult ReadList(
+      size_t max_total_length, size_t max_elem_length,
+      std::vector<util::StringView>* out);
+
   cert_trans::serialization::DeserializeResult ReadDigitallySigned(
       ct::DigitallySigned* sig);
 
@@ -141,6 +241,12 @@ class TLSDeserializer {
 
  private:
   bool ReadLengthPrefix(size_t max_length, size_t* result);
+
+  // Calls |add| for each element of a list.
+  template <class AddFunc>
+  cert_trans::serialization::DeserializeResult ReadListElements(
+      size_t max_total_length, size_t max_elem_length, const AddFunc& add);
+
   const char* current_pos_;
   size_t bytes_remaining_;
 };
@@ -8,8 +8,10 @@
 #include "proto/ct.pb.h"
 #include "proto/serializer.h"
 
+using cert_trans::serialization::ByteSink;
 using cert_trans::serialization::SerializeResult;
 using cert_trans::serialization::DeserializeResult;
+using cert_trans::serialization::TLSWriter;
 using cert_trans::serialization::WriteDigitallySigned;
 using cert_trans::serialization::WriteFixedBytes;
 using cert_trans::serialization::WriteUint;
@@ -44,7 +46,7 @@ SerializeResult CheckJsonFormat(const string& json) {
 }
 
 
-string V1LeafData(const LogEntry& entry) {
+const string& V1LeafData(const LogEntry& entry) {
   CHECK(entry.has_x_json_entry());
   return entry.x_json_entry().json();
 }
@@ -79,35 +81,43 @@ SerializeResult SerializeV1SCTSignatureInput(
 }
 
 
-SerializeResult SerializeV1SCTMerkleTreeLeaf(
-    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
-    string* result) {
-  CHECK_NOTNULL(result);
+SerializeResult WriteV1SCTMerkleTreeLeaf(const SignedCertificateTimestamp& sct,
+                                        const LogEntry& entry,
+                                        TLSWriter* writer) {
   if (sct.version() != ct::V1) {
     return SerializeResult::UNSUPPORTED_VERSION;
   }
-  const string json(entry.x_json_entry().json());
+  const string& json(entry.x_json_entry().json());
   SerializeResult res = CheckJsonFormat(json);
   if (res != SerializeResult::OK) {
     return res;
   }
-  const string extensions(sct.extensions());
+  const string& extensions(sct.extensions());
   res = CheckExtensionsFormat(extensions);
   if (res != SerializeResult::OK) {
     return res;
   }
-  result->clear();
-  WriteUint(ct::V1, Serializer::kVersionLengthInBytes, result);
-  WriteUint(ct::TIMESTAMPED_ENTRY, Serializer::kMerkleLeafTypeLengthInBytes,
-            result);
-  WriteUint(sct.timestamp(), Serializer::kTimestampLengthInBytes, result);
-  WriteUint(ct::X_JSON_ENTRY, Serializer::kLogEntryTypeLengthInBytes, result);
-  WriteVarBytes(json, kMaxJsonLength, result);
-  WriteVarBytes(extensions, Serializer::kMaxExtensionsLength, result);
+  writer->WriteUint(ct::V1, Serializer::kVersionLengthInBytes);
+  writer->WriteUint(ct::TIMESTAMPED_ENTRY,
+                    Serializer::kMerkleLeafTypeLengthInBytes);
+  writer->WriteUint(sct.timestamp(), Serializer::kTimestampLengthInBytes);
+  writer->WriteUint(ct::X_JSON_ENTRY, Serializer::kLogEntryTypeLengthInBytes);
+  writer->WriteVarBytes(json, kMaxJsonLength);
+  writer->WriteVarBytes(extensions, Serializer::kMaxExtensionsLength);
   return SerializeResult::OK;
 }
 
 
+SerializeResult SerializeV1SCTMerkleTreeLeaf(
+    const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+    string* result) {
+  CHECK_NOTNULL(result);
+  result->clear();
+  TLSWriter writer(result);
+  return WriteV1SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
 DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
                                                  MerkleTreeLeaf* leaf) {
   CHECK_NOTNULL(des);
@@ -170,8 +180,44 @@ DeserializeResult DeserializeV1SCTMerkleTreeLeaf(TLSDeserializer* des,
 }  // namespace
 
 
+// static
+const string& V1XJSONPolicy::LeafData(const LogEntry& entry) {
+  return V1LeafData(entry);
+}
+
+
+// static
+SerializeResult V1XJSONPolicy::SerializeSCTSignatureInput(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV1SCTSignatureInput(sct, entry, result);
+}
+
+
+// static
+SerializeResult V1XJSONPolicy::SerializeSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    string* result) {
+  return SerializeV1SCTMerkleTreeLeaf(sct, entry, result);
+}
+
+
+// static
+SerializeResult V1XJSONPolicy::WriteSCTMerkleTreeLeaf(
+    const SignedCertificateTimestamp& sct, const LogEntry& entry,
+    ByteSink* sink) {
+  TLSWriter writer(sink);
+  return WriteV1SCTMerkleTreeLeaf(sct, entry, &writer);
+}
+
+
+// static
+DeserializeResult V1XJSONPolicy::ReadMerkleTreeLeaf(TLSDeserializer* des,
+                                                    MerkleTreeLeaf* leaf) {
+  return DeserializeV1SCTMerkleTreeLeaf(des, leaf);
+}
+
+
 void ConfigureSerializerForV1XJSON() {
-  Serializer::ConfigureV1(V1LeafData, SerializeV1SCTSignatureInput,
-                          SerializeV1SCTMerkleTreeLeaf);
-  Deserializer::Configure(DeserializeV1SCTMerkleTreeLeaf);
+  Serializer::Configure(LogSerializer::ForPolicy<V1XJSONPolicy>());
 }
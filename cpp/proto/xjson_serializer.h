@@ -8,8 +8,30 @@
 #include <string>
 
 #include "proto/ct.pb.h"
+#include "proto/serializer.h"
 
 
+// Serialization policy for JSON logs, to be used with
+// LogSerializer::ForPolicy<>().
+struct V1XJSONPolicy {
+  static const ct::Version kVersion = ct::V1;
+
+  static const std::string& LeafData(const ct::LogEntry& entry);
+  static cert_trans::serialization::SerializeResult SerializeSCTSignatureInput(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult SerializeSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      std::string* result);
+  static cert_trans::serialization::SerializeResult WriteSCTMerkleTreeLeaf(
+      const ct::SignedCertificateTimestamp& sct, const ct::LogEntry& entry,
+      cert_trans::serialization::ByteSink* sink);
+  static cert_trans::serialization::DeserializeResult ReadMerkleTreeLeaf(
+      TLSDeserializer* des, ct::MerkleTreeLeaf* leaf);
+};
+
+
+// Configure the static Serializer for V1XJSONPolicy.
 void ConfigureSerializerForV1XJSON();
 
 
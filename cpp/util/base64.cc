@@ -0,0 +1,287 @@
+#include "config.h"
+#include "util/base64.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+
+#ifdef HAVE_SSSE3_TARGET
+#include <tmmintrin.h>
+#endif
+
+namespace util {
+
+namespace {
+
+
+const char kEncodeTable[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char kPad = '=';
+// Marks the characters which are not in the alphabet.
+const uint8_t kInvalid = 0x80;
+
+
+class DecodeTable {
+ public:
+  DecodeTable() {
+    for (int i = 0; i < 256; ++i) {
+      values_[i] = kInvalid;
+    }
+    for (uint8_t i = 0; i < 64; ++i) {
+      values_[static_cast<uint8_t>(kEncodeTable[i])] = i;
+    }
+  }
+
+  uint8_t operator[](char c) const {
+    return values_[static_cast<uint8_t>(c)];
+  }
+
+ private:
+  uint8_t values_[256];
+};
+
+
+const DecodeTable& Decoder() {
+  static const DecodeTable* const table(new DecodeTable);
+  return *table;
+}
+
+
+#ifdef HAVE_SSSE3_TARGET
+
+// The vector code follows the approach described by Wojciech Muła and
+// Daniel Lemire in "Faster Base64 Encoding and Decoding Using AVX2
+// Instructions" (ACM Transactions on the Web, 2018), on 128-bit vectors.
+// It is compiled for SSSE3 whatever the flags of the build, and only used
+// if the CPU has it.
+
+#define SSSE3_FUNCTION __attribute__((target("ssse3")))
+
+
+bool HaveSSSE3() {
+#ifdef __SSSE3__
+  return true;
+#else
+  static const bool have_ssse3(__builtin_cpu_supports("ssse3"));
+  return have_ssse3;
+#endif
+}
+
+
+// Encodes the first 12 bytes of |in| (which must have 16 readable bytes)
+// into 16 characters at |out|.
+SSSE3_FUNCTION inline void EncodeBlock(const char* in, char* out) {
+  __m128i v(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+
+  // Spread each group of 3 bytes over a 32-bit lane, then move each
+  // 6-bit value into a byte of its own.
+  v = _mm_shuffle_epi8(v, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4,
+                                       1, 2, 0, 1));
+  const __m128i t0(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)));
+  const __m128i t1(_mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040)));
+  const __m128i t2(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)));
+  const __m128i t3(_mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010)));
+  const __m128i indices(_mm_or_si128(t1, t3));
+
+  // Map the values to characters by adding an offset, which depends on
+  // the range the value is in: A-Z, a-z, 0-9, + or /.
+  const __m128i offsets(_mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4,
+                                      -4, -4, -19, -16, 0, 0));
+  __m128i ranges(_mm_subs_epu8(indices, _mm_set1_epi8(51)));
+  ranges = _mm_sub_epi8(ranges,
+                        _mm_cmpgt_epi8(indices, _mm_set1_epi8(25)));
+  const __m128i chars(
+      _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, ranges)));
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+}
+
+
+// Decodes 16 characters from |in| into 12 bytes at |out|, which must
+// have room for 16. Returns false if any of them is not in the alphabet
+// (including padding), in which case nothing is written.
+SSSE3_FUNCTION inline bool DecodeBlock(const char* in, char* out) {
+  const __m128i v(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+
+  // Classify the characters by their nibbles: a character is valid if
+  // the bits for its high and low nibbles have nothing in common.
+  const __m128i mask_2f(_mm_set1_epi8(0x2f));
+  const __m128i lut_lo(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                     0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                     0x1b, 0x1b, 0x1b, 0x1a));
+  const __m128i lut_hi(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                     0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                     0x10, 0x10, 0x10, 0x10));
+  const __m128i hi_nibbles(_mm_and_si128(_mm_srli_epi32(v, 4), mask_2f));
+  const __m128i lo_nibbles(_mm_and_si128(v, mask_2f));
+  const __m128i hi(_mm_shuffle_epi8(lut_hi, hi_nibbles));
+  const __m128i lo(_mm_shuffle_epi8(lut_lo, lo_nibbles));
+  if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi),
+                                       _mm_setzero_si128())) != 0) {
+    return false;
+  }
+
+  // Map the characters to their values, by adding an offset which
+  // depends on the high nibble ('/' being the odd one out).
+  const __m128i lut_roll(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0,
+                                       0, 0, 0, 0, 0, 0, 0));
+  const __m128i eq_2f(_mm_cmpeq_epi8(v, mask_2f));
+  const __m128i values(_mm_add_epi8(
+      v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles))));
+
+  // Pack each group of four 6-bit values into 3 bytes.
+  const __m128i merged_pairs(
+      _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)));
+  const __m128i merged(
+      _mm_madd_epi16(merged_pairs, _mm_set1_epi32(0x00011000)));
+  const __m128i bytes(_mm_shuffle_epi8(
+      merged,
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+  return true;
+}
+
+
+// Encodes whole blocks of |*in|, as long as there are 16 bytes left, and
+// advances |in|, |remaining| and |out| past them.
+SSSE3_FUNCTION void EncodeBlocks(const char** in, size_t* remaining,
+                                 char** out) {
+  // Blocks read 16 bytes, but only use 12 of them.
+  while (*remaining >= 16) {
+    EncodeBlock(*in, *out);
+    *in += 12;
+    *remaining -= 12;
+    *out += 16;
+  }
+}
+
+
+// Decodes whole blocks of |*in|, as long as there are 24 characters left
+// and they are valid, and advances |in|, |remaining| and |out| past them.
+SSSE3_FUNCTION void DecodeBlocks(const char** in, size_t* remaining,
+                                 char** out) {
+  // Blocks write 16 bytes, but only 12 of them are used. Leaving the last
+  // two quanta to the scalar code guarantees that the extra bytes still
+  // fall within the output, and keeps the padding out of the blocks. A
+  // block with invalid characters is left to the scalar code as well,
+  // which then reports the error.
+  while (*remaining >= 24 && DecodeBlock(*in, *out)) {
+    *in += 16;
+    *remaining -= 16;
+    *out += 12;
+  }
+}
+
+#endif  // HAVE_SSSE3_TARGET
+
+
+}  // namespace
+
+
+void Base64Encode(StringView in, char* out) {
+  const char* src(in.data());
+  size_t remaining(in.size());
+
+#ifdef HAVE_SSSE3_TARGET
+  if (HaveSSSE3()) {
+    EncodeBlocks(&src, &remaining, &out);
+  }
+#endif
+
+  while (remaining >= 3) {
+    const uint32_t v((static_cast<uint8_t>(src[0]) << 16) |
+                     (static_cast<uint8_t>(src[1]) << 8) |
+                     static_cast<uint8_t>(src[2]));
+    out[0] = kEncodeTable[v >> 18];
+    out[1] = kEncodeTable[(v >> 12) & 0x3f];
+    out[2] = kEncodeTable[(v >> 6) & 0x3f];
+    out[3] = kEncodeTable[v & 0x3f];
+    src += 3;
+    remaining -= 3;
+    out += 4;
+  }
+
+  if (remaining > 0) {
+    const uint32_t v(
+        (static_cast<uint8_t>(src[0]) << 16) |
+        (remaining > 1 ? static_cast<uint8_t>(src[1]) << 8 : 0));
+    out[0] = kEncodeTable[v >> 18];
+    out[1] = kEncodeTable[(v >> 12) & 0x3f];
+    out[2] = remaining > 1 ? kEncodeTable[(v >> 6) & 0x3f] : kPad;
+    out[3] = kPad;
+  }
+}
+
+
+bool Base64Decode(StringView in, char* out, size_t* out_length) {
+  CHECK_NOTNULL(out_length);
+  if (in.size() % 4 != 0) {
+    return false;
+  }
+  const DecodeTable& table(Decoder());
+  const char* src(in.data());
+  size_t remaining(in.size());
+  char* const out_start(out);
+
+#ifdef HAVE_SSSE3_TARGET
+  if (HaveSSSE3()) {
+    DecodeBlocks(&src, &remaining, &out);
+  }
+#endif
+
+  // All the quanta but the last are complete.
+  while (remaining > 4) {
+    const uint8_t a(table[src[0]]), b(table[src[1]]), c(table[src[2]]),
+        d(table[src[3]]);
+    if ((a | b | c | d) & kInvalid) {
+      return false;
+    }
+    const uint32_t v((a << 18) | (b << 12) | (c << 6) | d);
+    out[0] = static_cast<char>(v >> 16);
+    out[1] = static_cast<char>(v >> 8);
+    out[2] = static_cast<char>(v);
+    src += 4;
+    remaining -= 4;
+    out += 3;
+  }
+
+  if (remaining == 4) {
+    const uint8_t a(table[src[0]]), b(table[src[1]]);
+    if ((a | b) & kInvalid) {
+      return false;
+    }
+    out[0] = static_cast<char>((a << 2) | (b >> 4));
+    if (src[2] == kPad) {
+      // Two padding characters, for one byte of data.
+      if (src[3] != kPad || (b & 0x0f) != 0) {
+        return false;
+      }
+      out += 1;
+    } else {
+      const uint8_t c(table[src[2]]);
+      if (c & kInvalid) {
+        return false;
+      }
+      out[1] = static_cast<char>((b << 4) | (c >> 2));
+      if (src[3] == kPad) {
+        if ((c & 0x03) != 0) {
+          return false;
+        }
+        out += 2;
+      } else {
+        const uint8_t d(table[src[3]]);
+        if (d & kInvalid) {
+          return false;
+        }
+        out[2] = static_cast<char>((c << 6) | d);
+        out += 3;
+      }
+    }
+  }
+
+  *out_length = out - out_start;
+  return true;
+}
+
+
+}  // namespace util
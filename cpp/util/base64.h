@@ -0,0 +1,46 @@
+#ifndef CERT_TRANS_UTIL_BASE64_H_
+#define CERT_TRANS_UTIL_BASE64_H_
+
+#include <stddef.h>
+
+#include "util/string_view.h"
+
+namespace util {
+
+
+// Base64 (RFC 4648, with the standard alphabet) into and out of buffers
+// provided by the caller. On CPUs with SSSE3, these process 12 bytes (16
+// characters) at a time with vector instructions, and fall back to table
+// lookups otherwise.
+
+// Returns the length of the encoding of |length| bytes, padding
+// included.
+inline size_t Base64EncodedLength(size_t length) {
+  return (length + 2) / 3 * 4;
+}
+
+
+// Returns an upper bound of the length of the data decoded from
+// |length| characters.
+inline size_t Base64DecodedMaxLength(size_t length) {
+  return length / 4 * 3;
+}
+
+
+// Encodes |in| into |out|, which must have room for
+// Base64EncodedLength(in.size()) characters. No NUL is appended.
+void Base64Encode(StringView in, char* out);
+
+
+// Decodes |in| into |out|, which must have room for
+// Base64DecodedMaxLength(in.size()) bytes, and sets |out_length| to the
+// number of bytes written. Only the canonical encoding is accepted: it
+// must be padded, have no whitespace, and have the unused bits of the
+// last character set to zero. Returns false if |in| is not valid, in
+// which case the contents of |out| are unspecified.
+bool Base64Decode(StringView in, char* out, size_t* out_length);
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_BASE64_H_
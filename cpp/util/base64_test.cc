@@ -0,0 +1,146 @@
+#include "util/base64.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string>
+
+#include "util/testing.h"
+#include "util/util.h"
+
+namespace util {
+namespace {
+
+using std::string;
+
+
+string Encode(const string& in) {
+  string out(Base64EncodedLength(in.size()), 'x');
+  Base64Encode(in, &out[0]);
+  return out;
+}
+
+
+bool Decode(const string& in, string* out) {
+  // Surround the output with guard bytes, to catch overruns.
+  string buf(Base64DecodedMaxLength(in.size()) + 2, '!');
+  size_t length;
+  if (!Base64Decode(in, &buf[1], &length)) {
+    return false;
+  }
+  EXPECT_EQ('!', buf.front());
+  EXPECT_EQ('!', buf.back());
+  out->assign(buf, 1, length);
+  return true;
+}
+
+
+TEST(Base64Test, KnownAnswers) {
+  // From RFC 4648.
+  const struct {
+    const char* decoded;
+    const char* encoded;
+  } kTests[] = {
+      {"", ""},
+      {"f", "Zg=="},
+      {"fo", "Zm8="},
+      {"foo", "Zm9v"},
+      {"foob", "Zm9vYg=="},
+      {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"},
+      {"The quick brown fox jumps over the lazy dog",
+       "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZw=="},
+  };
+
+  for (const auto& test : kTests) {
+    EXPECT_EQ(test.encoded, Encode(test.decoded));
+    EXPECT_EQ(test.encoded, ToBase64(test.decoded));
+    string decoded;
+    EXPECT_TRUE(Decode(test.encoded, &decoded)) << test.encoded;
+    EXPECT_EQ(test.decoded, decoded);
+    EXPECT_EQ(test.decoded, FromBase64(test.encoded));
+  }
+}
+
+
+TEST(Base64Test, AllBytes) {
+  string all;
+  for (int i = 0; i < 256; ++i) {
+    all.push_back(static_cast<char>(i));
+  }
+  const string encoded(Encode(all));
+  EXPECT_EQ(
+      "AAECAwQFBgcICQoLDA0ODxAREhMUFRYXGBkaGxwdHh8gISIjJCUmJygpKissLS4vMDEy"
+      "MzQ1Njc4OTo7PD0+P0BBQkNERUZHSElKS0xNTk9QUVJTVFVWV1hZWltcXV5fYGFiY2Rl"
+      "ZmdoaWprbG1ub3BxcnN0dXZ3eHl6e3x9fn+AgYKDhIWGh4iJiouMjY6PkJGSk5SVlpeY"
+      "mZqbnJ2en6ChoqOkpaanqKmqq6ytrq+wsbKztLW2t7i5uru8vb6/wMHCw8TFxsfIycrL"
+      "zM3Oz9DR0tPU1dbX2Nna29zd3t/g4eLj5OXm5+jp6uvs7e7v8PHy8/T19vf4+fr7/P3+"
+      "/w==",
+      encoded);
+  string decoded;
+  EXPECT_TRUE(Decode(encoded, &decoded));
+  EXPECT_EQ(all, decoded);
+}
+
+
+TEST(Base64Test, RoundTrip) {
+  srand(1);
+  for (size_t length = 0; length < 300; ++length) {
+    const string data(RandomString(length, length));
+    const string encoded(Encode(data));
+    string decoded;
+    EXPECT_TRUE(Decode(encoded, &decoded)) << length;
+    EXPECT_EQ(data, decoded) << length;
+  }
+}
+
+
+TEST(Base64Test, RejectsInvalidInput) {
+  const char* const kTests[] = {
+      // Not a multiple of 4.
+      "Zg", "Zg=", "Zm9vY",
+      // Misplaced or missing padding.
+      "Z===", "=g==", "Zg=a", "Zg==Zg==", "Zm9vYmFy====",
+      // Unused bits set.
+      "Zh==", "Zm9=",
+      // Whitespace and other characters outside the alphabet.
+      "Zm9v\n", "Zm 9v", "Zm9v-_==", "Zm9\x80",
+  };
+  for (const char* test : kTests) {
+    string decoded;
+    EXPECT_FALSE(Decode(test, &decoded)) << test;
+    EXPECT_EQ("", FromBase64(test)) << test;
+    EXPECT_FALSE(FromBase64(test, &decoded)) << test;
+  }
+}
+
+
+TEST(Base64Test, RejectsInvalidCharacterAnywhere) {
+  // Long enough to go through the vector code, if enabled.
+  const string valid(Encode(string(100, 'a')));
+  for (size_t i = 0; i < valid.size(); ++i) {
+    for (const char c : {'\0', ' ', '-', '=', '\x80', '\xff'}) {
+      string invalid(valid);
+      if (invalid[i] == c) {
+        continue;
+      }
+      invalid[i] = c;
+      string decoded;
+      // The only acceptable replacement is padding in the last quantum,
+      // for which the unused bits happen to be zero.
+      if (Decode(invalid, &decoded)) {
+        EXPECT_EQ('=', c);
+        EXPECT_GE(i, valid.size() - 2);
+      }
+    }
+  }
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+#include "util/benchmark.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <sstream>
+
+namespace {
+
+std::atomic<uint64_t> allocation_count(0);
+
+}  // namespace
+
+
+// These are not inlined, as GCC then mistakes the malloc()/free() pairs
+// for mismatched new/free.
+__attribute__((noinline)) void* operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  void* const ret(malloc(size == 0 ? 1 : size));
+  if (!ret) {
+    abort();
+  }
+  return ret;
+}
+
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+
+__attribute__((noinline)) void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+
+namespace cert_trans {
+namespace test {
+
+
+uint64_t AllocationCount() {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+
+void ReportBenchmark(const BenchmarkResult& result,
+                     const std::string& summary) {
+  const double ns_per_op(result.elapsed.count() * 1e9 / result.iterations);
+  const double allocations_per_op(static_cast<double>(result.allocations) /
+                                  result.iterations);
+
+  std::ostringstream message;
+  message << ::testing::UnitTest::GetInstance()->current_test_info()->name()
+          << ": ";
+  if (!summary.empty()) {
+    message << summary << ", ";
+  }
+  message << ns_per_op << " ns/op, " << allocations_per_op
+          << " allocations/op";
+  LOG(WARNING) << message.str();
+
+  ::testing::Test::RecordProperty("ns_per_op", static_cast<int>(ns_per_op));
+  ::testing::Test::RecordProperty("allocations_per_1000_ops",
+                                  static_cast<int>(allocations_per_op *
+                                                   1000));
+}
+
+
+}  // namespace test
+}  // namespace cert_trans
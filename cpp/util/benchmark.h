@@ -0,0 +1,64 @@
+#ifndef CERT_TRANS_UTIL_BENCHMARK_H_
+#define CERT_TRANS_UTIL_BENCHMARK_H_
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <string>
+
+// Scaffolding for the microbenchmarks, which run as Google Test tests.
+//
+// benchmark.cc replaces the global operator new and delete, to count
+// the allocations. This is why it is not part of libtest.a (where it
+// would be pulled into every test): benchmarks list it in their
+// sources instead.
+
+namespace cert_trans {
+namespace test {
+
+
+// The number of allocations made so far, by all the threads.
+uint64_t AllocationCount();
+
+
+struct BenchmarkResult {
+  int iterations;
+  std::chrono::duration<double> elapsed;
+  uint64_t allocations;
+};
+
+
+// Calls |op| with 0 to |iterations| - 1, then |wait| if it is set, and
+// returns how long it all took, and how many allocations were made.
+template <class Op>
+BenchmarkResult RunBenchmark(int iterations, const Op& op,
+                             const std::function<void()>& wait = nullptr) {
+  CHECK_GT(iterations, 0);
+  const uint64_t allocations_before(AllocationCount());
+  const std::chrono::steady_clock::time_point start(
+      std::chrono::steady_clock::now());
+  for (int i = 0; i < iterations; ++i) {
+    op(i);
+  }
+  if (wait) {
+    wait();
+  }
+  return BenchmarkResult{iterations,
+                         std::chrono::steady_clock::now() - start,
+                         AllocationCount() - allocations_before};
+}
+
+
+// Logs the time and the number of allocations per call of |result|
+// for the current test, after |summary| if it is not empty, and
+// records them as the "ns_per_op" and "allocations_per_1000_ops" test
+// properties (for --gtest_output=xml).
+void ReportBenchmark(const BenchmarkResult& result,
+                     const std::string& summary = std::string());
+
+
+}  // namespace test
+}  // namespace cert_trans
+
+#endif  // CERT_TRANS_UTIL_BENCHMARK_H_
@@ -0,0 +1,487 @@
+// Adapters for writing asynchronous code as C++20 coroutines, on top
+// of util::Task and util::Executor.
+//
+// A util::Coroutine<T> does nothing until it is awaited by another
+// coroutine, or handed to util::Spawn(), which runs it on the executor
+// of a util::Task, and returns that task with its result. A coroutine
+// knows its executor and the task it was spawned for, and passes them
+// on to the coroutines it awaits.
+//
+// Asynchronous operations are awaited through TaskAwaiter (for the
+// ones taking a util::Task) and CallbackAwaiter (for the ones taking a
+// callback). The awaiters hold everything needed while the operation
+// runs, including the util::Task itself, so awaiting does not allocate
+// anything beyond what the operation does. The coroutine is resumed by
+// the done callback of the task, so it continues on its executor.
+//
+// For example:
+//
+//   util::Coroutine<util::Status> FetchAll(UrlFetcher* fetcher,
+//                                          const vector<URL>& urls) {
+//     for (const auto& url : urls) {
+//       util::StatusOr<UrlFetcher::Response> resp(
+//           co_await fetcher->FetchAsync(UrlFetcher::Request(url)));
+//       if (!resp.ok()) {
+//         co_return resp.status();
+//       }
+//       ...
+//     }
+//     co_return util::OkStatus();
+//   }
+//
+//   util::Spawn(FetchAll(fetcher, urls), task);
+//
+// Cancelling the spawned task cancels the operations awaited through
+// TaskAwaiter after that, which will usually make them return
+// CANCELLED. Operations awaited through CallbackAwaiter cannot be
+// cancelled, as there is no telling what result they should then give,
+// so they always run to completion.
+//
+// This is only available when compiling as C++20 or later, nothing
+// else depends on it.
+
+#ifndef CERT_TRANS_UTIL_CORO_H_
+#define CERT_TRANS_UTIL_CORO_H_
+
+#if __cplusplus >= 202002L
+
+#include <glog/logging.h>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+#include "util/executor.h"
+#include "util/status.h"
+#include "util/task.h"
+
+namespace util {
+namespace internal {
+
+
+// What the promises of all the coroutines have in common.
+class PromiseBase {
+ public:
+  Executor* executor() const {
+    return executor_;
+  }
+
+  void set_executor(Executor* executor) {
+    executor_ = CHECK_NOTNULL(executor);
+  }
+
+  // The task the coroutine was spawned for, or nullptr.
+  Task* task() const {
+    return task_;
+  }
+
+  // Resumed once the coroutine is finished.
+  std::coroutine_handle<> continuation() const {
+    return continuation_;
+  }
+
+  // Called when |parent| awaits this coroutine.
+  void AwaitedBy(const PromiseBase& parent, std::coroutine_handle<> handle) {
+    executor_ = parent.executor_;
+    task_ = parent.task_;
+    continuation_ = handle;
+  }
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  // Exceptions are disabled.
+  void unhandled_exception() {
+    LOG(FATAL) << "exception thrown in a coroutine";
+  }
+
+ protected:
+  Executor* executor_ = nullptr;
+  Task* task_ = nullptr;
+
+ private:
+  std::coroutine_handle<> continuation_ = std::noop_coroutine();
+};
+
+
+template <class T>
+class ValuePromise : public PromiseBase {
+ public:
+  void return_value(T value) {
+    value_.emplace(std::move(value));
+  }
+
+  T TakeValue() {
+    CHECK(value_);
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+
+template <>
+class ValuePromise<void> : public PromiseBase {
+ public:
+  void return_void() {
+  }
+
+  void TakeValue() {
+  }
+};
+
+
+// A coroutine which runs by itself, and frees itself once it is done.
+class Detached {
+ public:
+  class promise_type : public PromiseBase {
+   public:
+    Detached get_return_object() {
+      return Detached(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() {
+    }
+
+    void set_task(Task* task) {
+      task_ = task;
+    }
+  };
+
+  // Starts the coroutine on the executor of |task|.
+  void Start(Task* task) {
+    handle_.promise().set_executor(task->executor());
+    handle_.promise().set_task(task);
+    const std::coroutine_handle<> handle(handle_);
+    task->executor()->Add([handle]() { handle.resume(); });
+  }
+
+ private:
+  explicit Detached(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {
+  }
+
+  const std::coroutine_handle<promise_type> handle_;
+};
+
+
+}  // namespace internal
+
+
+// A coroutine returning a T, started when it is awaited. It can only
+// be awaited once.
+template <class T>
+class Coroutine {
+ public:
+  class promise_type : public internal::ValuePromise<T> {
+   public:
+    Coroutine get_return_object() {
+      return Coroutine(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    // Hands control back to whoever awaited us, without growing the
+    // stack.
+    auto final_suspend() noexcept {
+      struct FinalAwaiter {
+        bool await_ready() noexcept {
+          return false;
+        }
+        std::coroutine_handle<> await_suspend(
+            std::coroutine_handle<promise_type> handle) noexcept {
+          return handle.promise().continuation();
+        }
+        void await_resume() noexcept {
+        }
+      };
+      return FinalAwaiter();
+    }
+  };
+
+  Coroutine(Coroutine&& other) : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+  Coroutine(const Coroutine&) = delete;
+  Coroutine& operator=(const Coroutine&) = delete;
+
+  ~Coroutine() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  class Awaiter;
+
+  Awaiter operator co_await() && {
+    CHECK(handle_);
+    return Awaiter(handle_);
+  }
+
+ private:
+  explicit Coroutine(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+
+template <class T>
+class Coroutine<T>::Awaiter {
+ public:
+  explicit Awaiter(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {
+  }
+
+  bool await_ready() const {
+    return false;
+  }
+
+  // Starts the coroutine, which inherits the executor and task of
+  // |caller|.
+  template <class P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) {
+    handle_.promise().AwaitedBy(caller.promise(), caller);
+    return handle_;
+  }
+
+  T await_resume() {
+    return handle_.promise().TakeValue();
+  }
+
+ private:
+  const std::coroutine_handle<promise_type> handle_;
+};
+
+
+namespace internal {
+
+
+inline Detached SpawnAndReturn(Coroutine<Status> coro, Task* task) {
+  const Status status(co_await std::move(coro));
+  task->Return(status);
+}
+
+
+}  // namespace internal
+
+
+// Runs |coro| on the executor of |task|, and returns |task| with its
+// result.
+inline void Spawn(Coroutine<Status> coro, Task* task) {
+  internal::SpawnAndReturn(std::move(coro), CHECK_NOTNULL(task)).Start(task);
+}
+
+
+// Base class for awaiting an operation which takes a util::Task, which
+// Derived starts in its Run(util::Task*) method. The task uses the
+// executor of the coroutine, and is cancelled straight away if the
+// spawning task has been cancelled. The result of co_await is the
+// status of the task, unless Derived has its own await_resume().
+template <class Derived>
+class TaskAwaiter {
+ public:
+  TaskAwaiter() : completed_(false) {
+  }
+  TaskAwaiter(const TaskAwaiter&) = delete;
+  TaskAwaiter& operator=(const TaskAwaiter&) = delete;
+
+  bool await_ready() const {
+    return false;
+  }
+
+  template <class P>
+  bool await_suspend(std::coroutine_handle<P> caller) {
+    caller_ = caller;
+    task_.emplace([this](Task*) { Completed(); }, caller.promise().executor());
+    static_cast<Derived*>(this)->Run(&*task_);
+    Task* const caller_task(caller.promise().task());
+    if (caller_task && caller_task->CancelRequested()) {
+      task_->Cancel();
+    }
+    // If the operation is already done, carry on without suspending.
+    return !completed_.exchange(true);
+  }
+
+  Status await_resume() const {
+    return task_->status();
+  }
+
+ private:
+  void Completed() {
+    // Only resume if await_suspend() got to the point of suspending.
+    if (completed_.exchange(true)) {
+      caller_.resume();
+    }
+  }
+
+  std::coroutine_handle<> caller_;
+  std::optional<Task> task_;
+  std::atomic<bool> completed_;
+};
+
+
+// Base class for awaiting an operation which reports its result of
+// type R to a callback, which Derived starts in its
+// Run(const std::function<void(R)>&) method. The coroutine is resumed
+// wherever the callback is called, and the result of co_await is what
+// was passed to it. Cancelling the spawning task does not affect the
+// operation.
+template <class Derived, class R>
+class CallbackAwaiter {
+ public:
+  CallbackAwaiter() : completed_(false) {
+  }
+  CallbackAwaiter(const CallbackAwaiter&) = delete;
+  CallbackAwaiter& operator=(const CallbackAwaiter&) = delete;
+
+  bool await_ready() const {
+    return false;
+  }
+
+  template <class P>
+  bool await_suspend(std::coroutine_handle<P> caller) {
+    caller_ = caller;
+    static_cast<Derived*>(this)->Run([this](R result) {
+      result_.emplace(std::move(result));
+      if (completed_.exchange(true)) {
+        caller_.resume();
+      }
+    });
+    return !completed_.exchange(true);
+  }
+
+  R await_resume() {
+    return std::move(*result_);
+  }
+
+ private:
+  std::coroutine_handle<> caller_;
+  std::optional<R> result_;
+  std::atomic<bool> completed_;
+};
+
+
+namespace internal {
+
+
+template <class Start>
+class FunctorTaskAwaiter : public TaskAwaiter<FunctorTaskAwaiter<Start>> {
+ public:
+  explicit FunctorTaskAwaiter(Start start) : start_(std::move(start)) {
+  }
+
+  void Run(Task* task) {
+    start_(task);
+  }
+
+ private:
+  Start start_;
+};
+
+
+template <class R, class Start>
+class FunctorCallbackAwaiter
+    : public CallbackAwaiter<FunctorCallbackAwaiter<R, Start>, R> {
+ public:
+  explicit FunctorCallbackAwaiter(Start start) : start_(std::move(start)) {
+  }
+
+  template <class Callback>
+  void Run(const Callback& cb) {
+    start_(cb);
+  }
+
+ private:
+  Start start_;
+};
+
+
+class SleepAwaiter : public TaskAwaiter<SleepAwaiter> {
+ public:
+  explicit SleepAwaiter(const std::chrono::duration<double>& delay)
+      : delay_(delay) {
+  }
+
+  void Run(Task* task) {
+    task->executor()->Delay(delay_, task);
+  }
+
+ private:
+  const std::chrono::duration<double> delay_;
+};
+
+
+class ResumeOnAwaiter {
+ public:
+  explicit ResumeOnAwaiter(Executor* executor)
+      : executor_(CHECK_NOTNULL(executor)) {
+  }
+
+  bool await_ready() const {
+    return false;
+  }
+
+  template <class P>
+  void await_suspend(std::coroutine_handle<P> caller) {
+    caller.promise().set_executor(executor_);
+    const std::coroutine_handle<> handle(caller);
+    executor_->Add([handle]() { handle.resume(); });
+  }
+
+  void await_resume() const {
+  }
+
+ private:
+  Executor* const executor_;
+};
+
+
+}  // namespace internal
+
+
+// Awaits an operation started by |start|, a functor taking a
+// util::Task*.
+template <class Start>
+internal::FunctorTaskAwaiter<Start> AwaitTask(Start start) {
+  return internal::FunctorTaskAwaiter<Start>(std::move(start));
+}
+
+
+// Awaits an operation started by |start|, a functor taking a callback
+// to pass an R to.
+template <class R, class Start>
+internal::FunctorCallbackAwaiter<R, Start> AwaitCallback(Start start) {
+  return internal::FunctorCallbackAwaiter<R, Start>(std::move(start));
+}
+
+
+// Resumes the coroutine after |delay|, using Executor::Delay(). The
+// result is the status of the delay task (CANCELLED if the executor
+// goes away first).
+inline internal::SleepAwaiter Sleep(
+    const std::chrono::duration<double>& delay) {
+  return internal::SleepAwaiter(delay);
+}
+
+
+// Moves the coroutine over to |executor|, which it then passes on to
+// what it awaits.
+inline internal::ResumeOnAwaiter ResumeOn(Executor* executor) {
+  return internal::ResumeOnAwaiter(executor);
+}
+
+
+}  // namespace util
+
+#endif  // __cplusplus >= 202002L
+
+#endif  // CERT_TRANS_UTIL_CORO_H_
@@ -0,0 +1,363 @@
+#include "util/coro.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "base/notification.h"
+#include "client/async_log_client.h"
+#include "net/mock_url_fetcher.h"
+#include "util/status_test_util.h"
+#include "util/sync_task.h"
+#include "util/testing.h"
+#include "util/thread_pool.h"
+
+// The coroutine adapters need C++20, there is nothing to test without.
+#if __cplusplus >= 202002L
+
+namespace util {
+namespace {
+
+using cert_trans::AsyncLogClient;
+using cert_trans::MockUrlFetcher;
+using cert_trans::Notification;
+using cert_trans::ThreadPool;
+using cert_trans::URL;
+using cert_trans::UrlFetcher;
+using std::atomic;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::function;
+using std::string;
+using std::vector;
+using ::testing::Invoke;
+using ::testing::_;
+
+
+class CoroTest : public ::testing::Test {
+ protected:
+  // Spawns |coro| and waits for it to finish.
+  Status Run(Coroutine<Status> coro) {
+    SyncTask s(&pool_);
+    Spawn(std::move(coro), s.task());
+    s.Wait();
+    return s.status();
+  }
+
+  ThreadPool pool_;
+};
+
+
+Coroutine<int> Add(int a, int b) {
+  co_return a + b;
+}
+
+
+Coroutine<void> Increment(int* value) {
+  ++*value;
+  co_return;
+}
+
+
+Coroutine<Status> AddThenIncrement(int* value) {
+  *value = co_await Add(1, 2);
+  co_await Increment(value);
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, AwaitsCoroutines) {
+  int value(0);
+  EXPECT_OK(Run(AddThenIncrement(&value)));
+  EXPECT_EQ(4, value);
+}
+
+
+Coroutine<Status> ReturnError() {
+  co_return Status(error::NOT_FOUND, "nope");
+}
+
+
+TEST_F(CoroTest, ReturnsStatus) {
+  EXPECT_EQ(error::NOT_FOUND, Run(ReturnError()).CanonicalCode());
+}
+
+
+Coroutine<Status> AwaitTasks(ThreadPool* pool, vector<Status>* statuses) {
+  // Returned before AwaitTask() gets to suspend.
+  statuses->push_back(co_await AwaitTask([](Task* task) {
+    task->Return(Status(error::NOT_FOUND, "inline"));
+  }));
+  // Returned from another thread.
+  statuses->push_back(co_await AwaitTask([pool](Task* task) {
+    pool->Add([task]() { task->Return(); });
+  }));
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, AwaitsTasks) {
+  vector<Status> statuses;
+  EXPECT_OK(Run(AwaitTasks(&pool_, &statuses)));
+  ASSERT_EQ(2U, statuses.size());
+  EXPECT_EQ(error::NOT_FOUND, statuses[0].CanonicalCode());
+  EXPECT_OK(statuses[1]);
+}
+
+
+Coroutine<Status> AwaitCallbacks(ThreadPool* pool, vector<int>* values) {
+  values->push_back(co_await AwaitCallback<int>(
+      [](const function<void(int)>& cb) { cb(1); }));
+  values->push_back(co_await AwaitCallback<int>(
+      [pool](const function<void(int)>& cb) {
+        pool->Add([cb]() { cb(2); });
+      }));
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, AwaitsCallbacks) {
+  vector<int> values;
+  EXPECT_OK(Run(AwaitCallbacks(&pool_, &values)));
+  EXPECT_EQ(vector<int>({1, 2}), values);
+}
+
+
+Coroutine<Status> SleepFor(milliseconds delay) {
+  return [](milliseconds delay) -> Coroutine<Status> {
+    co_return co_await Sleep(delay);
+  }(delay);
+}
+
+
+TEST_F(CoroTest, Sleep) {
+  const steady_clock::time_point start(steady_clock::now());
+  EXPECT_OK(Run(SleepFor(milliseconds(50))));
+  EXPECT_GE(steady_clock::now() - start, milliseconds(50));
+}
+
+
+Coroutine<Status> SwitchExecutor(ThreadPool* other,
+                                 vector<Executor*>* executors) {
+  const auto record([executors](Task* task) {
+    executors->push_back(task->executor());
+    task->Return();
+  });
+  co_await AwaitTask(record);
+  co_await ResumeOn(other);
+  co_await AwaitTask(record);
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, ResumeOn) {
+  ThreadPool other(1);
+  vector<Executor*> executors;
+  EXPECT_OK(Run(SwitchExecutor(&other, &executors)));
+  EXPECT_EQ(vector<Executor*>({&pool_, &other}), executors);
+}
+
+
+Coroutine<Status> CancelledHalfway(Notification* started,
+                                   Notification* cancelled) {
+  // Only finishes once the test has cancelled the spawning task.
+  co_await AwaitTask([started, cancelled](Task* task) {
+    started->Notify();
+    std::thread([cancelled, task]() {
+      cancelled->WaitForNotification();
+      task->Return();
+    }).detach();
+  });
+  // This one only returns if it is cancelled.
+  co_return co_await AwaitTask([](Task* task) {
+    task->WhenCancelled([task]() { task->Return(Status::CANCELLED); });
+  });
+}
+
+
+TEST_F(CoroTest, Cancel) {
+  Notification started;
+  Notification cancelled;
+  SyncTask s(&pool_);
+  Spawn(CancelledHalfway(&started, &cancelled), s.task());
+  started.WaitForNotification();
+  s.Cancel();
+  cancelled.Notify();
+  s.Wait();
+  EXPECT_EQ(error::CANCELLED, s.status().CanonicalCode());
+}
+
+
+Coroutine<Status> FetchStatusCode(UrlFetcher* fetcher, int* status_code) {
+  StatusOr<UrlFetcher::Response> resp(co_await fetcher->FetchAsync(
+      UrlFetcher::Request(URL("http://example.com/"))));
+  if (!resp.ok()) {
+    co_return resp.status();
+  }
+  *status_code = resp.ValueOrDie().status_code;
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, FetchAsync) {
+  // Overriding Fetch() must not hide FetchAsync().
+  MockUrlFetcher fetcher;
+  EXPECT_CALL(fetcher, Fetch(_, _, _))
+      .WillOnce(Invoke([](const UrlFetcher::Request& req,
+                          UrlFetcher::Response* resp, Task* task) {
+        resp->status_code = 200;
+        task->Return();
+      }));
+
+  int status_code(0);
+  EXPECT_OK(Run(FetchStatusCode(&fetcher, &status_code)));
+  EXPECT_EQ(200, status_code);
+}
+
+
+// Gets a consistency proof, then the STH, from |client|.
+Coroutine<Status> GetProofThenSTH(AsyncLogClient* client,
+                                  vector<string>* proof,
+                                  AsyncLogClient::Status* proof_status,
+                                  AsyncLogClient::Status* sth_status) {
+  *proof_status = co_await client->GetSTHConsistency(1, 2, proof);
+  ct::SignedTreeHead sth;
+  *sth_status = co_await client->GetSTH(&sth);
+  co_return OkStatus();
+}
+
+
+TEST_F(CoroTest, AsyncLogClient) {
+  MockUrlFetcher fetcher;
+  EXPECT_CALL(fetcher, Fetch(_, _, _))
+      .WillOnce(Invoke([](const UrlFetcher::Request& req,
+                          UrlFetcher::Response* resp, Task* task) {
+        EXPECT_EQ("/ct/v1/get-sth-consistency", req.url.Path());
+        resp->status_code = 200;
+        resp->body = "{\"consistency\": [\"YWJj\", \"ZGVm\"]}";
+        task->Return();
+      }))
+      .WillOnce(Invoke([](const UrlFetcher::Request& req,
+                          UrlFetcher::Response* resp, Task* task) {
+        EXPECT_EQ("/ct/v1/get-sth", req.url.Path());
+        resp->status_code = 500;
+        task->Return();
+      }));
+  AsyncLogClient client(&pool_, &fetcher, "http://example.com/");
+
+  vector<string> proof;
+  AsyncLogClient::Status proof_status(AsyncLogClient::UNKNOWN_ERROR);
+  AsyncLogClient::Status sth_status(AsyncLogClient::OK);
+  EXPECT_OK(
+      Run(GetProofThenSTH(&client, &proof, &proof_status, &sth_status)));
+  EXPECT_EQ(AsyncLogClient::OK, proof_status);
+  EXPECT_EQ(vector<string>({"abc", "def"}), proof);
+  EXPECT_EQ(AsyncLogClient::UNKNOWN_ERROR, sth_status);
+}
+
+
+// Fetches ranges of a made up log asynchronously, keeping track of how
+// many fetches are going on at the same time.
+class FakeLog {
+ public:
+  explicit FakeLog(ThreadPool* pool) : pool_(pool), in_flight_(0), max_(0) {
+  }
+
+  void GetEntries(int first, int last, vector<int>* entries, Task* task) {
+    const int in_flight(++in_flight_);
+    int max(max_.load());
+    while (in_flight > max && !max_.compare_exchange_weak(max, in_flight)) {
+    }
+    pool_->Add([this, first, last, entries, task]() {
+      for (int i = first; i <= last; ++i) {
+        entries->push_back(i);
+      }
+      --in_flight_;
+      task->Return();
+    });
+  }
+
+  int max_in_flight() const {
+    return max_.load();
+  }
+
+ private:
+  ThreadPool* const pool_;
+  atomic<int> in_flight_;
+  atomic<int> max_;
+};
+
+
+// Takes ranges of |range_size| entries, starting at |*next|, until it
+// gets to |end|.
+Coroutine<Status> FetchRanges(FakeLog* log, atomic<int>* next, int end,
+                              int range_size, vector<atomic<int>>* fetched) {
+  while (true) {
+    const int first(next->fetch_add(range_size));
+    if (first >= end) {
+      co_return OkStatus();
+    }
+    const int last(std::min(first + range_size, end) - 1);
+    vector<int> entries;
+    const Status status(co_await AwaitTask(
+        [log, first, last, &entries](Task* task) {
+          log->GetEntries(first, last, &entries, task);
+        }));
+    if (!status.ok()) {
+      co_return status;
+    }
+    for (const int entry : entries) {
+      ++(*fetched)[entry];
+    }
+  }
+}
+
+
+TEST_F(CoroTest, ParallelRangesWithBackPressure) {
+  const int kEntries(10000);
+  const int kRangeSize(7);
+  const int kWorkers(4);
+  FakeLog log(&pool_);
+  atomic<int> next(0);
+  vector<atomic<int>> fetched(kEntries);
+  for (auto& count : fetched) {
+    count = 0;
+  }
+
+  // Each worker only has one fetch going at a time, which bounds how
+  // many there are overall.
+  SyncTask s(&pool_);
+  atomic<int> running(kWorkers);
+  for (int i = 0; i < kWorkers; ++i) {
+    Spawn(FetchRanges(&log, &next, kEntries, kRangeSize, &fetched),
+          s.task()->AddChild([&s, &running](Task* child) {
+            EXPECT_OK(child->status());
+            if (--running == 0) {
+              s.task()->Return();
+            }
+          }));
+  }
+  s.Wait();
+
+  EXPECT_OK(s.status());
+  EXPECT_LE(log.max_in_flight(), kWorkers);
+  for (int i = 0; i < kEntries; ++i) {
+    ASSERT_EQ(1, fetched[i].load()) << i;
+  }
+}
+
+
+}  // namespace
+}  // namespace util
+
+#endif  // __cplusplus >= 202002L
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -1,20 +1,18 @@
 #include "json_wrapper.h"
 
+#include <limits.h>
 #include <memory>
 
-using std::unique_ptr;
-
 
 JsonObject::JsonObject(evbuffer* buffer) : obj_(NULL) {
-  const unique_ptr<json_tokener, void (*)(json_tokener*)> tokener(
-      json_tokener_new(), json_tokener_free);
+  JsonTokenizer tokenizer;
 
   evbuffer_ptr ptr;
   evbuffer_ptr_set(buffer, &ptr, 0, EVBUFFER_PTR_SET);
 
-  unsigned amount_consumed(0);
+  size_t amount_consumed(0);
 
-  while (!obj_ && amount_consumed < evbuffer_get_length(buffer)) {
+  while (!tokenizer.Done() && amount_consumed < evbuffer_get_length(buffer)) {
     evbuffer_iovec chunk;
 
     if (evbuffer_peek(buffer, -1, &ptr, &chunk, 1) < 1) {
@@ -22,39 +20,25 @@ JsonObject::JsonObject(evbuffer* buffer) : obj_(NULL) {
       break;
     }
 
-    // This function can be called repeatedly with each chunk of
-    // data. It keeps its state in "*tokener", and will return a
-    // non-NULL value once it finds a full object. If it returns NULL
-    // and the error is "json_tokener_continue", this simply means
-    // that it hasn't yet found an object, we just need to keep
-    // calling it with more data.
-    obj_ = json_tokener_parse_ex(tokener.get(),
-                                 static_cast<char*>(chunk.iov_base),
-                                 chunk.iov_len);
-
-    // Check for a parsing error.
-    if (!obj_ &&
-        json_tokener_get_error(tokener.get()) != json_tokener_continue) {
-      VLOG(1) << "json_tokener_parse_ex: "
-              << json_tokener_error_desc(
-                     json_tokener_get_error(tokener.get()));
+    const util::StringView data(static_cast<char*>(chunk.iov_base),
+                                chunk.iov_len);
+    size_t chunk_consumed;
+    if (!tokenizer.Append(data, &chunk_consumed)) {
       break;
     }
 
-    if (obj_) {
-      // At the end of the parsing, we might not have consumed all the
-      // bytes in the iovec.
-      amount_consumed += tokener->char_offset;
-      // No need to update "ptr" here, we're done.
-    } else {
-      amount_consumed += chunk.iov_len;
+    // At the end of the parsing, we might not have consumed all the
+    // bytes in the iovec. No need to update "ptr" then, we're done.
+    amount_consumed += chunk_consumed;
+    if (!tokenizer.Done()) {
       evbuffer_ptr_set(buffer, &ptr, chunk.iov_len, EVBUFFER_PTR_ADD);
     }
   }
 
   // If the parsing was successful, drain the number of bytes
   // consumed.
-  if (obj_) {
+  if (tokenizer.Done()) {
+    obj_ = tokenizer.Extract();
     evbuffer_drain(buffer, amount_consumed);
   }
 }
@@ -75,3 +59,44 @@ JsonObject::JsonObject(const JsonArray& from, int offset, json_type type) {
   }
   json_object_get(obj_);
 }
+
+
+JsonTokenizer::JsonTokenizer()
+    : tokener_(CHECK_NOTNULL(json_tokener_new()), json_tokener_free),
+      obj_(NULL),
+      error_(false) {
+}
+
+
+JsonTokenizer::~JsonTokenizer() {
+  if (obj_)
+    json_object_put(obj_);
+}
+
+
+bool JsonTokenizer::Append(util::StringView data, size_t* consumed) {
+  CHECK(!obj_) << "the object is already complete";
+  CHECK(!error_) << "the input already had an error";
+  // json-c takes the length as an int.
+  CHECK_LE(data.size(), static_cast<size_t>(INT_MAX));
+
+  // This keeps its state in "*tokener_", and returns a non-NULL value
+  // once it finds a full object. If it returns NULL and the error is
+  // "json_tokener_continue", this simply means that it hasn't yet
+  // found an object, we just need to keep calling it with more data.
+  obj_ = json_tokener_parse_ex(tokener_.get(), data.data(), data.size());
+
+  if (!obj_ &&
+      json_tokener_get_error(tokener_.get()) != json_tokener_continue) {
+    VLOG(1) << "json_tokener_parse_ex: "
+            << json_tokener_error_desc(json_tokener_get_error(tokener_.get()));
+    error_ = true;
+    return false;
+  }
+
+  if (consumed) {
+    *consumed = obj_ ? tokener_->char_offset : data.size();
+  }
+
+  return true;
+}
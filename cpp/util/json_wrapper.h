@@ -7,6 +7,7 @@
 #undef FALSE  // json.h pollution
 
 #include <event2/buffer.h>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -166,7 +167,8 @@ class JsonString : public JsonObject {
   }
 
   std::string FromBase64() {
-    return util::FromBase64(Value());
+    return util::FromBase64(
+        util::StringView(Value(), json_object_get_string_len(obj_)));
   }
 };
 
@@ -213,4 +215,38 @@ class JsonArray : public JsonObject {
   }
 };
 
+// Parses a JSON object that is received in pieces, so that the parsing
+// can start before all of it has arrived.
+class JsonTokenizer {
+ public:
+  JsonTokenizer();
+  ~JsonTokenizer();
+  JsonTokenizer(const JsonTokenizer&) = delete;
+  JsonTokenizer& operator=(const JsonTokenizer&) = delete;
+
+  // Parses the next piece of the input, and returns false if it is not
+  // valid JSON. Once the object is complete, Done() returns true, and
+  // |consumed| (if not NULL) is set to the number of bytes of |data|
+  // that were part of it. It must not be called again after that, or
+  // after an error.
+  bool Append(util::StringView data, size_t* consumed = NULL);
+
+  bool Done() const {
+    return obj_ != NULL;
+  }
+
+  // Returns the parsed object, and passes its ownership to the caller.
+  // Returns NULL if the object is not complete.
+  json_object* Extract() {
+    json_object* tmp = obj_;
+    obj_ = NULL;
+    return tmp;
+  }
+
+ private:
+  const std::unique_ptr<json_tokener, void (*)(json_tokener*)> tokener_;
+  json_object* obj_;
+  bool error_;
+};
+
 #endif  // CERT_TRANS_UTIL_JSON_WRAPPER_H_
@@ -83,6 +83,46 @@ TEST_F(JsonWrapperTest, FragmentedEvBuffer) {
   EXPECT_EQ(0U, evbuffer_get_length(buffer.get()));
 }
 
+TEST_F(JsonWrapperTest, TokenizerByteByByte) {
+  const string input("{ \"foo\": [ 1, \"two\" ], \"bar\": { } }trailing");
+  const size_t object_length(input.find("trailing"));
+
+  JsonTokenizer tokenizer;
+  for (size_t i = 0; i < object_length; ++i) {
+    EXPECT_FALSE(tokenizer.Done());
+    size_t consumed;
+    ASSERT_TRUE(
+        tokenizer.Append(util::StringView(input.data() + i, 1), &consumed));
+    EXPECT_EQ(1U, consumed);
+  }
+  ASSERT_TRUE(tokenizer.Done());
+
+  JsonObject obj(tokenizer.Extract());
+  ASSERT_TRUE(obj.Ok());
+  JsonArray foo(obj, "foo");
+  ASSERT_TRUE(foo.Ok());
+  EXPECT_EQ(2, foo.Length());
+  EXPECT_FALSE(tokenizer.Done());
+}
+
+TEST_F(JsonWrapperTest, TokenizerConsumed) {
+  const string input("{ \"foo\": 42 }{ \"bar\": 43 }");
+
+  JsonTokenizer tokenizer;
+  size_t consumed;
+  ASSERT_TRUE(tokenizer.Append(input, &consumed));
+  ASSERT_TRUE(tokenizer.Done());
+  EXPECT_EQ(input.find('}') + 1, consumed);
+}
+
+TEST_F(JsonWrapperTest, TokenizerError) {
+  JsonTokenizer tokenizer;
+  EXPECT_TRUE(tokenizer.Append("{ \"foo\": "));
+  EXPECT_FALSE(tokenizer.Append("]"));
+  EXPECT_FALSE(tokenizer.Done());
+  EXPECT_TRUE(tokenizer.Extract() == NULL);
+}
+
 int main(int argc, char** argv) {
   cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
   return RUN_ALL_TESTS();
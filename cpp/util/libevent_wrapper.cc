@@ -9,9 +9,13 @@
 #include <event2/keyvalq_struct.h>
 #include <event2/thread.h>
 #include <evhtp.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <math.h>
+#include <algorithm>
 #include <climits>
+#include <fstream>
+#include <sstream>
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -32,11 +36,16 @@ using std::chrono::duration_cast;
 using std::chrono::microseconds;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
+using std::chrono::steady_clock;
 using std::chrono::system_clock;
 using std::function;
+using std::ifstream;
+using std::istringstream;
 using std::lock_guard;
 using std::make_pair;
+using std::map;
 using std::multimap;
+using std::move;
 using std::mutex;
 using std::placeholders::_1;
 using std::recursive_mutex;
@@ -46,6 +55,15 @@ using std::unique_ptr;
 using std::vector;
 using util::TaskHold;
 
+DEFINE_int32(dns_cache_max_ttl_seconds, 300,
+             "Maximum time for which a DNS lookup result is cached, "
+             "regardless of its TTL.");
+DEFINE_int32(dns_negative_cache_ttl_seconds, 30,
+             "Time for which failing to resolve a name is cached.");
+DEFINE_string(dns_hosts_file, "/etc/hosts",
+              "File of static host names, which are looked up before "
+              "using DNS. Empty for none.");
+
 namespace {
 
 void FreeEvDns(evdns_base* dns) {
@@ -80,6 +98,60 @@ void DelayDispatch(evutil_socket_t, short, void* userdata) {
 }
 
 
+string ToLower(string str) {
+  std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+  return str;
+}
+
+
+// Returns the IPv4 addresses of the names in the hosts file at |path|,
+// by lower case name. The first address given for a name wins.
+map<string, string> ReadHostsFile(const string& path) {
+  map<string, string> hosts;
+  if (path.empty()) {
+    return hosts;
+  }
+  ifstream file(path);
+  if (!file) {
+    LOG(WARNING) << "Could not open hosts file " << path;
+    return hosts;
+  }
+
+  string line;
+  while (std::getline(file, line)) {
+    istringstream fields(line.substr(0, line.find('#')));
+    string addr;
+    in_addr parsed;
+    if (!(fields >> addr) ||
+        evutil_inet_pton(AF_INET, addr.c_str(), &parsed) != 1) {
+      continue;
+    }
+    string name;
+    while (fields >> name) {
+      hosts.insert(make_pair(ToLower(name), addr));
+    }
+  }
+  return hosts;
+}
+
+
+// Returns the hosts file at |path|, which is only read again when the
+// path changes, rather than for every resolver.
+shared_ptr<const map<string, string>> SharedHostsFile(const string& path) {
+  static mutex* const lock(new mutex);
+  static string* const last_path(new string);
+  static shared_ptr<const map<string, string>>* const last_hosts(
+      new shared_ptr<const map<string, string>>);
+
+  lock_guard<mutex> guard(*lock);
+  if (!*last_hosts || *last_path != path) {
+    last_hosts->reset(new map<string, string>(ReadHostsFile(path)));
+    *last_path = path;
+  }
+  return *last_hosts;
+}
+
+
 #ifdef HAVE_THREAD_LOCAL
 thread_local bool on_event_thread = false;
 #elif HAVE___THREAD
@@ -89,12 +161,118 @@ __thread bool on_event_thread = false;
 #endif
 
 
+#ifdef HAVE_THREAD_LOCAL
+// Closures are usually created by one thread, and deleted by the event
+// loop thread, so the freed ones go back on a list shared by all the
+// threads. Threads take the whole list at once, which avoids the ABA
+// problem of popping single items off a lock-free stack, and use it up
+// by themselves before taking the list again.
+
+// Most freed closures kept on the shared list.
+const size_t kMaxFreeClosures = 1024;
+
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+
+util::MpscQueue<FreeBlock> shared_free_closures;
+// Can be a little more than the length of the list, while blocks are
+// being added.
+std::atomic<size_t> num_shared_free_closures(0);
+
+
+class LocalFreeClosures {
+ public:
+  LocalFreeClosures() : head_(nullptr) {
+  }
+  ~LocalFreeClosures();
+
+  // Returns nullptr if there are none left, here or on the shared
+  // list.
+  void* Pop() {
+    if (!head_) {
+      head_ = shared_free_closures.PopAll();
+      size_t count(0);
+      for (const FreeBlock* block = head_; block; block = block->next) {
+        ++count;
+      }
+      num_shared_free_closures.fetch_sub(count, std::memory_order_relaxed);
+    }
+    FreeBlock* const block(head_);
+    if (block) {
+      head_ = block->next;
+    }
+    return block;
+  }
+
+ private:
+  FreeBlock* head_;
+};
+
+
+// Closures can still be created after the local list of the thread is
+// gone, by the destructors of other thread-local objects.
+thread_local bool local_free_closures_destroyed(false);
+thread_local LocalFreeClosures local_free_closures;
+
+
+LocalFreeClosures::~LocalFreeClosures() {
+  while (FreeBlock* const block = head_) {
+    head_ = block->next;
+    ::operator delete(block);
+  }
+  local_free_closures_destroyed = true;
+}
+#endif  // HAVE_THREAD_LOCAL
+
+
 }  // namespace
 
 namespace cert_trans {
 namespace libevent {
 
 
+struct Base::Closure {
+  explicit Closure(function<void()>&& _cb) : cb(move(_cb)), next(nullptr) {
+  }
+
+  // Recycles the memory of freed closures.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  const function<void()> cb;
+  Closure* next;
+};
+
+
+void* Base::Closure::operator new(size_t size) {
+#ifdef HAVE_THREAD_LOCAL
+  if (!local_free_closures_destroyed) {
+    void* const ptr(local_free_closures.Pop());
+    if (ptr) {
+      return ptr;
+    }
+  }
+#endif
+  return ::operator new(size);
+}
+
+
+void Base::Closure::operator delete(void* ptr) {
+#ifdef HAVE_THREAD_LOCAL
+  if (num_shared_free_closures.fetch_add(1, std::memory_order_relaxed) <
+      kMaxFreeClosures) {
+    shared_free_closures.Push(static_cast<FreeBlock*>(ptr));
+    return;
+  }
+  num_shared_free_closures.fetch_sub(1, std::memory_order_relaxed);
+#endif
+  ::operator delete(ptr);
+}
+
+
 struct HttpServer::Handler {
   Handler(const string& _path, const HandlerCallback& _cb)
       : path(_path), cb(_cb) {
@@ -105,57 +283,140 @@ struct HttpServer::Handler {
 };
 
 
-class ResolverImpl : public Base::Resolver {
- public:
-  string Resolve(const string& host) override {
-    struct addrinfo* info;
-    struct addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    // It seems evhtp doesn't support IPv6 addresses because it uses
-    // inet_addr() to parse the passed in "stringified" address.
-    // Restrict to IPv4 addresses for now:
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    const int resolved(getaddrinfo(host.c_str(), AF_UNSPEC, &hints, &info));
-    if (resolved != 0) {
-      LOG(WARNING) << "Failed to resolve HTTPS hostname " << host << ": "
-                   << gai_strerror(resolved);
-      return nullptr;
+struct DnsResolver::State {
+  struct Entry {
+    // Empty for names which could not be resolved.
+    string addr;
+    steady_clock::time_point expiry;
+  };
+
+  mutex lock;
+  map<string, Entry> cache;
+  // Callbacks waiting for the lookups in progress, by name.
+  map<string, vector<Callback>> waiters;
+};
+
+
+struct DnsResolver::Lookup {
+  Lookup(const shared_ptr<State>& state, const string& host)
+      : state_(state), host_(host) {
+  }
+
+  // Caches |addr| for |ttl_seconds| (or the negative TTL, if |addr| is
+  // empty), passes it to the waiters, and deletes this.
+  void Done(const string& addr, int ttl_seconds);
+
+  const shared_ptr<State> state_;
+  const string host_;
+};
+
+
+void DnsResolver::Lookup::Done(const string& addr, int ttl_seconds) {
+  vector<Callback> waiters;
+  {
+    lock_guard<mutex> lock(state_->lock);
+    if (ttl_seconds > 0) {
+      State::Entry& entry(state_->cache[host_]);
+      entry.addr = addr;
+      entry.expiry = steady_clock::now() + seconds(ttl_seconds);
     }
+    const auto it(state_->waiters.find(host_));
+    CHECK(it != state_->waiters.end());
+    waiters.swap(it->second);
+    state_->waiters.erase(it);
+  }
+
+  VLOG(1) << "Resolved " << host_ << " to \"" << addr << "\"";
+  for (const auto& cb : waiters) {
+    cb(addr);
+  }
+  delete this;
+}
+
+
+DnsResolver::DnsResolver(Base* base)
+    : base_(CHECK_NOTNULL(base)),
+      hosts_(SharedHostsFile(FLAGS_dns_hosts_file)),
+      state_(std::make_shared<State>()) {
+}
+
+
+DnsResolver::~DnsResolver() {
+}
+
+
+void DnsResolver::Resolve(const string& host, const Callback& cb) {
+  in_addr literal;
+  if (evutil_inet_pton(AF_INET, host.c_str(), &literal) == 1) {
+    cb(host);
+    return;
+  }
+
+  // Names are not case sensitive, so they share their entries whatever
+  // their case.
+  const string name(ToLower(host));
+  const auto host_entry(hosts_->find(name));
+  if (host_entry != hosts_->end()) {
+    cb(host_entry->second);
+    return;
+  }
 
-    struct addrinfo* res(info);
-    void* addr(nullptr);
-    while (res && !addr) {
-      switch (res->ai_family) {
-        case AF_INET:
-          addr =
-              &reinterpret_cast<struct sockaddr_in*>(res->ai_addr)->sin_addr;
-          break;
-        case AF_INET6:
-          // Just in case one day evhtp uses inet_pton()
-          addr =
-              &reinterpret_cast<struct sockaddr_in6*>(res->ai_addr)->sin6_addr;
-          break;
-        default:
-          res = res->ai_next;
-          break;
+  {
+    std::unique_lock<mutex> lock(state_->lock);
+    const auto it(state_->cache.find(name));
+    if (it != state_->cache.end()) {
+      if (steady_clock::now() < it->second.expiry) {
+        const string addr(it->second.addr);
+        lock.unlock();
+        cb(addr);
+        return;
       }
+      state_->cache.erase(it);
     }
 
-    if (!addr) {
-      LOG(WARNING) << "Got no usable address for " << host;
-      return nullptr;
+    vector<Callback>& waiters(state_->waiters[name]);
+    waiters.push_back(cb);
+    if (waiters.size() > 1) {
+      // Already being looked up.
+      return;
     }
+  }
 
-    char addr_str[INET6_ADDRSTRLEN];
-    inet_ntop(res->ai_family, addr, addr_str, INET6_ADDRSTRLEN);
-    freeaddrinfo(info);
-    return string(addr_str);
+  evdns_base* const dns(base_->GetDns());
+  Lookup* const lookup(new Lookup(state_, name));
+  if (!evdns_base_resolve_ipv4(dns, name.c_str(), 0, &DnsResolver::LookupDone,
+                               lookup)) {
+    LOG(WARNING) << "Could not start DNS lookup of " << name;
+    lookup->Done(string(), 0);
   }
-};
+}
 
 
-Base::Base() : Base(unique_ptr<Resolver>(new ResolverImpl)) {
+// static
+void DnsResolver::LookupDone(int result, char type, int count, int ttl,
+                             void* addresses, void* arg) {
+  Lookup* const lookup(static_cast<Lookup*>(CHECK_NOTNULL(arg)));
+
+  if (result == DNS_ERR_NONE && type == DNS_IPv4_A && count > 0) {
+    char addr[INET_ADDRSTRLEN];
+    CHECK_NOTNULL(evutil_inet_ntop(AF_INET, addresses, addr, sizeof(addr)));
+    lookup->Done(addr, std::min(ttl, FLAGS_dns_cache_max_ttl_seconds));
+    return;
+  }
+
+  if (result == DNS_ERR_SHUTDOWN || result == DNS_ERR_CANCEL) {
+    lookup->Done(string(), 0);
+    return;
+  }
+
+  LOG(WARNING) << "Failed to resolve hostname " << lookup->host_ << ": "
+               << evdns_err_to_string(result);
+  lookup->Done(string(), FLAGS_dns_negative_cache_ttl_seconds);
+}
+
+
+Base::Base() : Base(unique_ptr<Resolver>()) {
+  resolver_.reset(new DnsResolver(this));
 }
 
 
@@ -174,6 +435,12 @@ Base::Base(unique_ptr<Resolver> resolver)
 
 
 Base::~Base() {
+  // Closures which did not get to run are dropped.
+  Closure* closure(closures_.PopAll());
+  while (closure) {
+    unique_ptr<Closure> done(closure);
+    closure = closure->next;
+  }
 }
 
 
@@ -190,9 +457,16 @@ void Base::CheckNotOnEventThread() {
 
 
 void Base::Add(const function<void()>& cb) {
-  lock_guard<mutex> lock(closures_lock_);
-  closures_.push_back(cb);
-  event_active(wake_closures_.get(), 0, 0);
+  Add(function<void()>(cb));
+}
+
+
+void Base::Add(function<void()>&& cb) {
+  // If the queue was not empty, the loop has already been woken up,
+  // and RunClosures() will see this one too.
+  if (closures_.Push(new Closure(move(cb)))) {
+    event_active(wake_closures_.get(), 0, 0);
+  }
 }
 
 
@@ -292,39 +566,49 @@ evdns_base* Base::GetDns() {
 }
 
 
-evhtp_connection_t* Base::HttpConnectionNew(const string& host,
-                                            unsigned short port) {
-  return CHECK_NOTNULL(
-      evhtp_connection_new_dns(base_.get(), GetDns(), host.c_str(), port));
+void Base::HttpConnectionNew(const string& host, unsigned short port,
+                             const ConnectionCallback& cb) {
+  resolver_->Resolve(host, [this, host, port, cb](const string& addr) {
+    if (addr.empty()) {
+      cb(nullptr);
+      return;
+    }
+    VLOG(1) << "Connecting to " << host << " at " << addr << ":" << port;
+    cb(CHECK_NOTNULL(evhtp_connection_new(base_.get(), addr.c_str(), port)));
+  });
 }
 
 
-evhtp_connection_t* Base::HttpsConnectionNew(const string& host,
-                                             unsigned short port,
-                                             SSL_CTX* ssl_ctx) {
+void Base::HttpsConnectionNew(const string& host, unsigned short port,
+                              SSL_CTX* ssl_ctx,
+                              const ConnectionCallback& cb) {
   CHECK_NOTNULL(ssl_ctx);
 
   // TODO(alcutter): remove this all temporary name resolution stuff when this
   // PR is merged: https://github.com/ellzey/libevhtp/pull/163
-  const string addr_str(resolver_->Resolve(host));
-  VLOG(1) << "Got addr: " << addr_str << ":" << port;
-  evhtp_connection_t* ret(CHECK_NOTNULL(
-      evhtp_connection_ssl_new(base_.get(), addr_str.c_str(), port, ssl_ctx)));
-  return ret;
+  resolver_->Resolve(host, [this, host, port, ssl_ctx,
+                            cb](const string& addr) {
+    if (addr.empty()) {
+      cb(nullptr);
+      return;
+    }
+    VLOG(1) << "Connecting to " << host << " at " << addr << ":" << port;
+    cb(CHECK_NOTNULL(
+        evhtp_connection_ssl_new(base_.get(), addr.c_str(), port, ssl_ctx)));
+  });
 }
 
 
 void Base::RunClosures(evutil_socket_t, short, void* userdata) {
   Base* self(static_cast<Base*>(CHECK_NOTNULL(userdata)));
 
-  vector<function<void()>> closures;
-  {
-    lock_guard<mutex> lock(self->closures_lock_);
-    closures.swap(self->closures_);
-  }
-
-  for (const auto& closure : closures) {
-    closure();
+  // Closures added while these run go in the next batch, which will
+  // have woken up the loop again.
+  Closure* closure(self->closures_.PopAll());
+  while (closure) {
+    const unique_ptr<Closure> current(closure);
+    closure = closure->next;
+    current->cb();
   }
 }
 
@@ -17,6 +17,7 @@
 #include <vector>
 
 #include "util/executor.h"
+#include "util/mpsc_queue.h"
 #include "util/task.h"
 
 namespace cert_trans {
@@ -30,20 +31,36 @@ class Base : public util::Executor {
  public:
   class Resolver {
    public:
-    virtual std::string Resolve(const std::string& host) = 0;
+    // Receives an address for the host, or an empty string if it
+    // could not be resolved.
+    typedef std::function<void(const std::string& addr)> Callback;
+
+    virtual ~Resolver() = default;
+
+    // Looks up |host|, and calls |cb| with the result. This must not
+    // block, but |cb| can be called before it returns.
+    virtual void Resolve(const std::string& host, const Callback& cb) = 0;
   };
 
+  // Receives a new connection, or nullptr if the host could not be
+  // resolved.
+  typedef std::function<void(evhtp_connection_t*)> ConnectionCallback;
+
   static bool OnEventThread();
   static void CheckNotOnEventThread();
 
+  // Uses a DnsResolver.
   Base();
   Base(std::unique_ptr<Resolver> resolver);
   ~Base();
   Base(const Base&) = delete;
   Base& operator=(const Base&) = delete;
 
-  // Arranges to run the closure on the main loop.
+  // Arranges to run the closure on the main loop. This does not take
+  // any lock, and only wakes up the loop if nothing else is queued.
   void Add(const std::function<void()>& cb) override;
+  // Same, but saves copying |cb|.
+  void Add(std::function<void()>&& cb);
 
   void Delay(const std::chrono::duration<double>& delay,
              util::Task* task) override;
@@ -55,13 +72,17 @@ class Base : public util::Executor {
   event* EventNew(evutil_socket_t& sock, short events, Event* event) const;
   evhttp* HttpNew() const;
   evdns_base* GetDns();
-  evhtp_connection_t* HttpConnectionNew(const std::string& host,
-                                        unsigned short port);
-  evhtp_connection_t* HttpsConnectionNew(const std::string& host,
-                                         unsigned short port,
-                                         SSL_CTX* ssl_ctx);
+  // These resolve |host| with the resolver, then call |cb| with the
+  // new connection, on the event loop thread unless the resolver
+  // answers right away.
+  void HttpConnectionNew(const std::string& host, unsigned short port,
+                         const ConnectionCallback& cb);
+  void HttpsConnectionNew(const std::string& host, unsigned short port,
+                          SSL_CTX* ssl_ctx, const ConnectionCallback& cb);
 
  private:
+  struct Closure;
+
   static void RunClosures(evutil_socket_t sock, short flag, void* userdata);
 
   const std::unique_ptr<event_base, void (*)(event_base*)> base_;
@@ -71,15 +92,45 @@ class Base : public util::Executor {
   // "dns_" should be after base_, so that it gets destroyed first.
   std::unique_ptr<evdns_base, void (*)(evdns_base*)> dns_;
 
-  std::mutex closures_lock_;
   // "wake_closures_" should be after base_, so that it gets destroyed
   // first.
   const std::unique_ptr<event, void (*)(event*)> wake_closures_;
-  std::vector<std::function<void()>> closures_;
+  util::MpscQueue<Closure> closures_;
   std::unique_ptr<Resolver> resolver_;
 };
 
 
+// Resolves names to IPv4 addresses (the only kind evhtp can connect
+// to), first with --dns_hosts_file (read when the first resolver using
+// it is created), then with the evdns_base of a Base, without blocking.
+// DNS results are cached for as long as their TTL allows, failures for
+// --dns_negative_cache_ttl_seconds, and concurrent lookups of the same
+// name (in any case) share a single query.
+class DnsResolver : public Base::Resolver {
+ public:
+  explicit DnsResolver(Base* base);
+  ~DnsResolver();
+  DnsResolver(const DnsResolver&) = delete;
+  DnsResolver& operator=(const DnsResolver&) = delete;
+
+  void Resolve(const std::string& host, const Callback& cb) override;
+
+ private:
+  struct State;
+  struct Lookup;
+
+  static void LookupDone(int result, char type, int count, int ttl,
+                         void* addresses, void* arg);
+
+  Base* const base_;
+  // The IPv4 addresses from --dns_hosts_file, by lower case name,
+  // shared with the other resolvers using the same file.
+  const std::shared_ptr<const std::map<std::string, std::string>> hosts_;
+  // Shared with the lookups in progress, which can outlive us.
+  const std::shared_ptr<State> state_;
+};
+
+
 class Event {
  public:
   typedef std::function<void(evutil_socket_t, short)> Callback;
@@ -1,12 +1,37 @@
 #include "util/libevent_wrapper.h"
 
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <event2/dns.h>
+#include <event2/dns_struct.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "util/testing.h"
+#include "util/util.h"
+
+DECLARE_int32(dns_cache_max_ttl_seconds);
+DECLARE_int32(dns_negative_cache_ttl_seconds);
+DECLARE_string(dns_hosts_file);
 
 namespace cert_trans {
 namespace libevent {
 
+using std::string;
+using std::vector;
+
 void DoNothing() {
 }
 
@@ -43,6 +68,35 @@ TEST_F(LibEventWrapperTest, TestTurtlesAllTheWayDown) {
 }
 
 
+TEST_F(LibEventWrapperTest, TestAddFromManyThreads) {
+  const int kThreads(4);
+  const int kClosures(10000);
+  Base base;
+  vector<int> counts(kThreads, 0);
+  int total(0);
+  vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&base, &counts, &total, i]() {
+      for (int j = 0; j < kClosures; ++j) {
+        // Closures from the same thread run in order.
+        base.Add([&counts, &total, i, j]() {
+          EXPECT_EQ(j, counts[i]);
+          ++counts[i];
+          ++total;
+        });
+      }
+    });
+  }
+  while (total < kThreads * kClosures) {
+    base.DispatchOnce();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(vector<int>(kThreads, kClosures), counts);
+}
+
+
 TEST_F(LibEventWrapperDeathTest, TestCheckNotOnEventThread) {
   // Should be fine:
   Base::CheckNotOnEventThread();
@@ -57,6 +111,239 @@ TEST_F(LibEventWrapperDeathTest, TestCheckNotOnEventThread) {
 }
 
 
+const char kGoodName[] = "good.example";
+const char kGoodAddr[] = "192.0.2.1";
+const char kBadName[] = "bad.example";
+
+
+// Answers the A queries for kGoodName with kGoodAddr, and the others
+// with NXDOMAIN, counting the queries for each name. It runs on an
+// event loop thread of its own, and points the DNS client of |base| at
+// itself.
+class FakeDnsServer {
+ public:
+  FakeDnsServer(Base* base, int ttl)
+      : ttl_(ttl), server_base_(CHECK_NOTNULL(event_base_new())) {
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK_GE(sock_, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK_EQ(0, ::bind(sock_, reinterpret_cast<sockaddr*>(&addr),
+                     sizeof(addr)));
+    socklen_t len(sizeof(addr));
+    CHECK_EQ(0, getsockname(sock_, reinterpret_cast<sockaddr*>(&addr), &len));
+    evutil_make_socket_nonblocking(sock_);
+    port_ = CHECK_NOTNULL(evdns_add_server_port_with_base(
+        server_base_, sock_, 0, &FakeDnsServer::HandleRequest, this));
+    thread_ = std::thread([this]() {
+      event_base_loop(server_base_, EVLOOP_NO_EXIT_ON_EMPTY);
+    });
+    // event_base_loopbreak() would be lost if it were called before the
+    // loop starts, but an active event is not.
+    stop_ =
+        CHECK_NOTNULL(event_new(server_base_, -1, 0, &Stop, server_base_));
+
+    // Send all the lookups our way, without trying search domains.
+    evdns_base* const dns(base->GetDns());
+    CHECK_EQ(0, evdns_base_clear_nameservers_and_suspend(dns));
+    evdns_base_search_clear(dns);
+    const string nameserver("127.0.0.1:" +
+                            std::to_string(ntohs(addr.sin_port)));
+    CHECK_EQ(0, evdns_base_nameserver_ip_add(dns, nameserver.c_str()));
+    CHECK_EQ(0, evdns_base_resume(dns));
+  }
+
+  ~FakeDnsServer() {
+    event_active(stop_, 0, 0);
+    thread_.join();
+    event_free(stop_);
+    evdns_close_server_port(port_);
+    event_base_free(server_base_);
+    close(sock_);
+  }
+
+  int queries(const string& name) const {
+    std::lock_guard<std::mutex> lock(lock_);
+    const auto it(queries_.find(name));
+    return it == queries_.end() ? 0 : it->second;
+  }
+
+ private:
+  static void Stop(evutil_socket_t, short, void* server_base) {
+    event_base_loopbreak(static_cast<event_base*>(server_base));
+  }
+
+  static void HandleRequest(evdns_server_request* req, void* arg) {
+    FakeDnsServer* const self(static_cast<FakeDnsServer*>(arg));
+    int error(DNS_ERR_NOTEXIST);
+    for (int i = 0; i < req->nquestions; ++i) {
+      const evdns_server_question* const q(req->questions[i]);
+      // The client randomizes the case of the names it asks for.
+      string name(q->name);
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+      {
+        std::lock_guard<std::mutex> lock(self->lock_);
+        ++self->queries_[name];
+      }
+      if (q->type == EVDNS_TYPE_A && name == kGoodName) {
+        in_addr addr;
+        CHECK_EQ(1, inet_pton(AF_INET, kGoodAddr, &addr));
+        CHECK_EQ(0, evdns_server_request_add_a_reply(req, q->name, 1, &addr,
+                                                     self->ttl_));
+        error = DNS_ERR_NONE;
+      }
+    }
+    CHECK_EQ(0, evdns_server_request_respond(req, error));
+  }
+
+  const int ttl_;
+  event_base* const server_base_;
+  evutil_socket_t sock_;
+  evdns_server_port* port_;
+  event* stop_;
+  std::thread thread_;
+
+  mutable std::mutex lock_;
+  std::map<string, int> queries_;
+};
+
+
+class DnsResolverTest : public ::testing::Test {
+ protected:
+  DnsResolverTest() : server_(&base_, 60), resolver_(&base_) {
+  }
+
+  // Resolves all of |hosts| at once, and returns the results.
+  vector<string> ResolveAll(const vector<string>& hosts) {
+    vector<string> results(hosts.size());
+    size_t done(0);
+    for (size_t i = 0; i < hosts.size(); ++i) {
+      resolver_.Resolve(hosts[i], [&results, &done, i](const string& addr) {
+        results[i] = addr;
+        ++done;
+      });
+    }
+    while (done < hosts.size()) {
+      base_.DispatchOnce();
+    }
+    return results;
+  }
+
+  string Resolve(const string& host) {
+    return ResolveAll({host})[0];
+  }
+
+  Base base_;
+  FakeDnsServer server_;
+  DnsResolver resolver_;
+};
+
+
+TEST_F(DnsResolverTest, ResolvesAndCaches) {
+  EXPECT_EQ(kGoodAddr, Resolve(kGoodName));
+  EXPECT_EQ(1, server_.queries(kGoodName));
+  EXPECT_EQ(kGoodAddr, Resolve(kGoodName));
+  EXPECT_EQ(1, server_.queries(kGoodName));
+}
+
+
+TEST_F(DnsResolverTest, SharesConcurrentLookups) {
+  EXPECT_EQ(vector<string>(3, kGoodAddr),
+            ResolveAll({kGoodName, kGoodName, kGoodName}));
+  EXPECT_EQ(1, server_.queries(kGoodName));
+}
+
+
+TEST_F(DnsResolverTest, IgnoresCase) {
+  EXPECT_EQ(vector<string>(2, kGoodAddr),
+            ResolveAll({kGoodName, "GOOD.Example"}));
+  EXPECT_EQ(1, server_.queries(kGoodName));
+  EXPECT_EQ(kGoodAddr, Resolve("Good.EXAMPLE"));
+  EXPECT_EQ(1, server_.queries(kGoodName));
+}
+
+
+TEST_F(DnsResolverTest, CachesFailures) {
+  EXPECT_EQ("", Resolve(kBadName));
+  const int queries(server_.queries(kBadName));
+  EXPECT_GT(queries, 0);
+  EXPECT_EQ("", Resolve(kBadName));
+  EXPECT_EQ(queries, server_.queries(kBadName));
+}
+
+
+TEST_F(DnsResolverTest, CapsTtl) {
+  FLAGS_dns_cache_max_ttl_seconds = 0;
+  FLAGS_dns_negative_cache_ttl_seconds = 0;
+  EXPECT_EQ(kGoodAddr, Resolve(kGoodName));
+  EXPECT_EQ(kGoodAddr, Resolve(kGoodName));
+  EXPECT_EQ(2, server_.queries(kGoodName));
+  EXPECT_EQ("", Resolve(kBadName));
+  const int queries(server_.queries(kBadName));
+  EXPECT_EQ("", Resolve(kBadName));
+  EXPECT_EQ(2 * queries, server_.queries(kBadName));
+}
+
+
+TEST_F(DnsResolverTest, HostsFileFirst) {
+  // kGoodName is in DNS as well, but the hosts file wins.
+  const string hosts_file(util::WriteTemporaryBinaryFile(
+      "/tmp/hostsXXXXXX",
+      "# 192.0.2.6 good.example\n"
+      "::1 good.example\n"
+      "192.0.2.7 other.example GOOD.example  # comment\n"
+      "192.0.2.8 good.example\n"));
+  ASSERT_FALSE(hosts_file.empty());
+  const string saved_hosts_file(FLAGS_dns_hosts_file);
+  FLAGS_dns_hosts_file = hosts_file;
+  DnsResolver resolver(&base_);
+  FLAGS_dns_hosts_file = saved_hosts_file;
+  remove(hosts_file.c_str());
+
+  vector<string> results;
+  for (const char* host : {kGoodName, "Other.Example"}) {
+    resolver.Resolve(host, [&results](const string& addr) {
+      results.push_back(addr);
+    });
+  }
+  EXPECT_EQ(vector<string>({"192.0.2.7", "192.0.2.7"}), results);
+  EXPECT_EQ(0, server_.queries(kGoodName));
+}
+
+
+TEST_F(DnsResolverTest, HostsFileReadOnce) {
+  const string hosts_file(util::WriteTemporaryBinaryFile(
+      "/tmp/hostsXXXXXX", "192.0.2.7 good.example\n"));
+  ASSERT_FALSE(hosts_file.empty());
+  const string saved_hosts_file(FLAGS_dns_hosts_file);
+  FLAGS_dns_hosts_file = hosts_file;
+  DnsResolver first(&base_);
+  remove(hosts_file.c_str());
+  // The file is gone, but this one uses what the first one read.
+  DnsResolver second(&base_);
+  FLAGS_dns_hosts_file = saved_hosts_file;
+
+  string result;
+  second.Resolve(kGoodName, [&result](const string& addr) {
+    result = addr;
+  });
+  EXPECT_EQ("192.0.2.7", result);
+  EXPECT_EQ(0, server_.queries(kGoodName));
+}
+
+
+TEST_F(DnsResolverTest, AddressLiteral) {
+  string result;
+  resolver_.Resolve(kGoodAddr, [&result](const string& addr) {
+    result = addr;
+  });
+  EXPECT_EQ(kGoodAddr, result);
+  EXPECT_EQ(0, server_.queries(kGoodAddr));
+}
+
+
 }  // namespace libevent
 }  // namespace cert_trans
 
@@ -0,0 +1,64 @@
+#ifndef CERT_TRANS_UTIL_MPSC_QUEUE_H_
+#define CERT_TRANS_UTIL_MPSC_QUEUE_H_
+
+#include <atomic>
+
+namespace util {
+
+
+// A lock-free queue, which any number of threads can push to, and a
+// single thread takes everything from at once.
+//
+// It is intrusive: T must have a "T* next" member, which belongs to
+// the queue while the item is in it. The queue never allocates, and
+// does not own the items.
+template <class T>
+class MpscQueue {
+ public:
+  constexpr MpscQueue() : head_(nullptr) {
+  }
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Adds |item| to the queue. Returns true if the queue was empty, so
+  // that the consumer only needs to be woken up once per batch.
+  bool Push(T* item) {
+    T* head(head_.load(std::memory_order_relaxed));
+    do {
+      item->next = head;
+    } while (!head_.compare_exchange_weak(head, item,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+    return head == nullptr;
+  }
+
+  // Empties the queue, and returns its items in the order they were
+  // pushed, linked through their "next" member (nullptr if it was
+  // empty). Several threads can call this at once, but each then gets
+  // a separate batch, so the order between them is lost.
+  T* PopAll() {
+    T* item(head_.exchange(nullptr, std::memory_order_acquire));
+    // The items were pushed at the head, reverse them.
+    T* first(nullptr);
+    while (item) {
+      T* const next(item->next);
+      item->next = first;
+      first = item;
+      item = next;
+    }
+    return first;
+  }
+
+  bool Empty() const {
+    return head_.load(std::memory_order_relaxed) == nullptr;
+  }
+
+ private:
+  // The most recently pushed item.
+  std::atomic<T*> head_;
+};
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_MPSC_QUEUE_H_
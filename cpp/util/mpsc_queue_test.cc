@@ -0,0 +1,144 @@
+#include "util/mpsc_queue.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "util/testing.h"
+
+namespace util {
+namespace {
+
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+
+struct Item {
+  Item(int _producer, int _seq) : producer(_producer), seq(_seq) {
+  }
+
+  const int producer;
+  const int seq;
+  Item* next;
+};
+
+
+TEST(MpscQueueTest, Empty) {
+  MpscQueue<Item> queue;
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(nullptr, queue.PopAll());
+}
+
+
+TEST(MpscQueueTest, KeepsOrder) {
+  MpscQueue<Item> queue;
+  Item a(0, 0), b(0, 1), c(0, 2);
+  EXPECT_TRUE(queue.Push(&a));
+  EXPECT_FALSE(queue.Push(&b));
+  EXPECT_FALSE(queue.Push(&c));
+  EXPECT_FALSE(queue.Empty());
+
+  Item* const first(queue.PopAll());
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(&a, first);
+  EXPECT_EQ(&b, a.next);
+  EXPECT_EQ(&c, b.next);
+  EXPECT_EQ(nullptr, c.next);
+
+  // The next push starts a new batch.
+  EXPECT_TRUE(queue.Push(&a));
+  EXPECT_EQ(&a, queue.PopAll());
+  EXPECT_EQ(nullptr, a.next);
+}
+
+
+TEST(MpscQueueTest, ManyProducers) {
+  const int kProducers(8);
+  const int kItems(20000);
+  MpscQueue<Item> queue;
+  vector<thread> producers;
+  for (int i = 0; i < kProducers; ++i) {
+    producers.emplace_back([&queue, i]() {
+      for (int j = 0; j < kItems; ++j) {
+        queue.Push(new Item(i, j));
+      }
+    });
+  }
+
+  // Each producer's items come out in order, exactly once.
+  vector<int> next_seq(kProducers, 0);
+  int received(0);
+  while (received < kProducers * kItems) {
+    Item* item(queue.PopAll());
+    while (item) {
+      const unique_ptr<Item> current(item);
+      item = item->next;
+      ASSERT_EQ(next_seq[current->producer], current->seq);
+      ++next_seq[current->producer];
+      ++received;
+    }
+  }
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_TRUE(queue.Empty());
+}
+
+
+TEST(MpscQueueTest, SeveralConsumers) {
+  const int kProducers(4);
+  const int kConsumers(4);
+  const int kItems(20000);
+  MpscQueue<Item> queue;
+  std::atomic<int> received(0);
+  vector<thread> threads;
+  vector<vector<unique_ptr<Item>>> consumed(kConsumers);
+  for (int i = 0; i < kProducers; ++i) {
+    threads.emplace_back([&queue, i]() {
+      for (int j = 0; j < kItems; ++j) {
+        queue.Push(new Item(i, j));
+      }
+    });
+  }
+  for (int i = 0; i < kConsumers; ++i) {
+    threads.emplace_back([&queue, &received, &consumed, i]() {
+      while (received.load() < kProducers * kItems) {
+        Item* item(queue.PopAll());
+        while (item) {
+          consumed[i].emplace_back(item);
+          item = item->next;
+          ++received;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // Every item comes out exactly once.
+  vector<vector<int>> counts(kProducers, vector<int>(kItems, 0));
+  for (const auto& items : consumed) {
+    for (const auto& item : items) {
+      ++counts[item->producer][item->seq];
+    }
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    EXPECT_EQ(vector<int>(kItems, 1), counts[i]) << i;
+  }
+  EXPECT_TRUE(queue.Empty());
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
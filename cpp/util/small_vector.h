@@ -0,0 +1,170 @@
+#ifndef CERT_TRANS_UTIL_SMALL_VECTOR_H_
+#define CERT_TRANS_UTIL_SMALL_VECTOR_H_
+
+#include <glog/logging.h>
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+
+// A vector that keeps up to N elements inline, only allocating once it
+// grows past that. Once it has, it keeps using the heap until it is
+// cleared.
+//
+// Only the few operations needed so far are provided. Iterators are
+// invalidated by any change.
+template <class T, size_t N>
+class SmallVector {
+ public:
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  SmallVector() : size_(0) {
+  }
+
+  SmallVector(const SmallVector& other) : size_(0) {
+    for (const auto& value : other) {
+      push_back(value);
+    }
+  }
+
+  // Leaves |other| empty.
+  SmallVector(SmallVector&& other) : size_(0) {
+    MoveFrom(&other);
+  }
+
+  ~SmallVector() {
+    clear();
+  }
+
+  SmallVector& operator=(const SmallVector&) = delete;
+
+  SmallVector& operator=(SmallVector&& other) {
+    if (this != &other) {
+      clear();
+      MoveFrom(&other);
+    }
+    return *this;
+  }
+
+  iterator begin() {
+    return on_heap() ? heap_.data() : inline_data();
+  }
+
+  iterator end() {
+    return begin() + size();
+  }
+
+  const_iterator begin() const {
+    return on_heap() ? heap_.data() : inline_data();
+  }
+
+  const_iterator end() const {
+    return begin() + size();
+  }
+
+  size_t size() const {
+    return on_heap() ? heap_.size() : size_;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  template <class... Args>
+  void emplace_back(Args&&... args) {
+    if (on_heap()) {
+      heap_.emplace_back(std::forward<Args>(args)...);
+    } else if (size_ < N) {
+      new (inline_data() + size_) T(std::forward<Args>(args)...);
+      ++size_;
+    } else {
+      // Construct the new element first, in case it refers to one of
+      // the existing ones.
+      T value(std::forward<Args>(args)...);
+      heap_.reserve(N * 2);
+      for (size_t i = 0; i < size_; ++i) {
+        heap_.emplace_back(std::move(inline_data()[i]));
+      }
+      DestroyInline();
+      heap_.emplace_back(std::move(value));
+    }
+  }
+
+  void push_back(const T& value) {
+    emplace_back(value);
+  }
+
+  void push_back(T&& value) {
+    emplace_back(std::move(value));
+  }
+
+  // Removes the element at |it|, keeping the order of the others.
+  void erase(iterator it) {
+    CHECK(it >= begin() && it < end());
+    if (on_heap()) {
+      heap_.erase(heap_.begin() + (it - begin()));
+      return;
+    }
+    for (iterator next = it + 1; next != end(); ++it, ++next) {
+      *it = std::move(*next);
+    }
+    it->~T();
+    --size_;
+  }
+
+  void clear() {
+    if (on_heap()) {
+      // Give the memory back, to go back to the inline storage.
+      std::vector<T>().swap(heap_);
+    } else {
+      DestroyInline();
+    }
+  }
+
+ private:
+  bool on_heap() const {
+    return !heap_.empty();
+  }
+
+  T* inline_data() {
+    return reinterpret_cast<T*>(&inline_);
+  }
+
+  const T* inline_data() const {
+    return reinterpret_cast<const T*>(&inline_);
+  }
+
+  void DestroyInline() {
+    for (size_t i = 0; i < size_; ++i) {
+      inline_data()[i].~T();
+    }
+    size_ = 0;
+  }
+
+  void MoveFrom(SmallVector* other) {
+    if (other->on_heap()) {
+      heap_.swap(other->heap_);
+      return;
+    }
+    for (auto& value : *other) {
+      new (inline_data() + size_) T(std::move(value));
+      ++size_;
+    }
+    other->DestroyInline();
+  }
+
+  typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type inline_;
+  // The number of elements in |inline_|, when |heap_| is not in use.
+  size_t size_;
+  std::vector<T> heap_;
+};
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_SMALL_VECTOR_H_
@@ -0,0 +1,121 @@
+#include "util/small_vector.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/testing.h"
+
+namespace util {
+namespace {
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+
+template <class T, size_t N>
+vector<T> Contents(const SmallVector<T, N>& v) {
+  return vector<T>(v.begin(), v.end());
+}
+
+
+TEST(SmallVectorTest, Empty) {
+  SmallVector<string, 2> v;
+  EXPECT_TRUE(v.empty());
+  EXPECT_EQ(0U, v.size());
+  EXPECT_EQ(v.begin(), v.end());
+}
+
+
+TEST(SmallVectorTest, GrowsPastInline) {
+  SmallVector<string, 2> v;
+  v.push_back("a");
+  v.emplace_back("b");
+  EXPECT_EQ(vector<string>({"a", "b"}), Contents(v));
+  // Refers to an element which moves when the vector grows.
+  v.push_back(*v.begin());
+  v.push_back("d");
+  EXPECT_EQ(vector<string>({"a", "b", "a", "d"}), Contents(v));
+  EXPECT_EQ(4U, v.size());
+
+  v.clear();
+  EXPECT_TRUE(v.empty());
+  v.push_back("e");
+  EXPECT_EQ(vector<string>({"e"}), Contents(v));
+}
+
+
+TEST(SmallVectorTest, Erase) {
+  for (int size = 1; size <= 4; ++size) {
+    for (int i = 0; i < size; ++i) {
+      SmallVector<int, 2> v;
+      vector<int> expected;
+      for (int j = 0; j < size; ++j) {
+        v.push_back(j);
+        if (j != i) {
+          expected.push_back(j);
+        }
+      }
+      v.erase(v.begin() + i);
+      EXPECT_EQ(expected, Contents(v)) << size << " " << i;
+    }
+  }
+}
+
+
+TEST(SmallVectorTest, CopyAndMove) {
+  for (int size = 0; size <= 4; ++size) {
+    SmallVector<int, 2> v;
+    vector<int> expected;
+    for (int i = 0; i < size; ++i) {
+      v.push_back(i);
+      expected.push_back(i);
+    }
+
+    const SmallVector<int, 2> copy(v);
+    EXPECT_EQ(expected, Contents(copy));
+    EXPECT_EQ(expected, Contents(v));
+
+    SmallVector<int, 2> moved(std::move(v));
+    EXPECT_EQ(expected, Contents(moved));
+    EXPECT_TRUE(v.empty());
+
+    v.push_back(42);
+    v = std::move(moved);
+    EXPECT_EQ(expected, Contents(v));
+    EXPECT_TRUE(moved.empty());
+  }
+}
+
+
+TEST(SmallVectorTest, DestroysElements) {
+  const shared_ptr<int> value(make_shared<int>(0));
+  {
+    SmallVector<shared_ptr<int>, 2> v;
+    for (int i = 0; i < 3; ++i) {
+      v.push_back(value);
+    }
+    EXPECT_EQ(4, value.use_count());
+    v.erase(v.begin());
+    EXPECT_EQ(3, value.use_count());
+
+    SmallVector<shared_ptr<int>, 2> inline_only;
+    inline_only.push_back(value);
+    EXPECT_EQ(4, value.use_count());
+  }
+  EXPECT_EQ(1, value.use_count());
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
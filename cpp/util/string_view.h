@@ -0,0 +1,92 @@
+#ifndef CERT_TRANS_UTIL_STRING_VIEW_H_
+#define CERT_TRANS_UTIL_STRING_VIEW_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <ostream>
+#include <string>
+
+namespace util {
+
+
+// A reference to a range of bytes owned by someone else, for parsing
+// without copying. This is a minimal stand-in for std::string_view, which
+// is not available in C++11.
+//
+// The referenced data must outlive the view. In particular, a view of a
+// std::string is invalidated by anything that invalidates its iterators.
+class StringView {
+ public:
+  StringView() : data_(nullptr), size_(0) {
+  }
+
+  StringView(const char* data, size_t size) : data_(data), size_(size) {
+  }
+
+  // Implicit, so that strings can be passed where a view is expected.
+  StringView(const std::string& str) : data_(str.data()), size_(str.size()) {
+  }
+
+  // Same, for NUL-terminated strings.
+  StringView(const char* str) : data_(str), size_(strlen(str)) {
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const char* begin() const {
+    return data_;
+  }
+
+  const char* end() const {
+    return data_ + size_;
+  }
+
+  char operator[](size_t i) const {
+    return data_[i];
+  }
+
+  // Returns the view of at most |n| bytes starting at |pos|, which must
+  // not be past the end.
+  StringView substr(size_t pos, size_t n = std::string::npos) const {
+    return StringView(data_ + pos, n < size_ - pos ? n : size_ - pos);
+  }
+
+  std::string ToString() const {
+    return std::string(data_, size_);
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+};
+
+
+inline bool operator==(const StringView& a, const StringView& b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+
+inline bool operator!=(const StringView& a, const StringView& b) {
+  return !(a == b);
+}
+
+
+inline std::ostream& operator<<(std::ostream& out, const StringView& view) {
+  return out.write(view.data(), view.size());
+}
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_STRING_VIEW_H_
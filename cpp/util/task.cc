@@ -1,58 +1,205 @@
+#include "config.h"
 #include "util/task.h"
 
 #include <glog/logging.h>
+#include <thread>
 
 using std::bind;
 using std::function;
 using std::lock_guard;
 using std::make_shared;
+using std::memory_order_acq_rel;
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::move;
 using std::mutex;
 using std::ostream;
 using std::placeholders::_1;
 using std::shared_ptr;
 using std::unique_lock;
-using std::vector;
 
 namespace util {
 
+namespace {
+
+// Layout of Task::word_:
+//
+//  - bits 0-1: the State
+//  - bit 2: Return() is storing the status, the task is about to be
+//    PREPARED (while the state is still ACTIVE)
+//  - bit 3: Cancel() has been called
+//  - bit 4: something has been added to the lists protected by
+//    Task::lock_
+//  - bits 8 and up: the number of holds
+enum State : uint64_t {
+  ACTIVE = 0,
+  PREPARED = 1,
+  DONE = 2,
+};
+
+const uint64_t kStateMask = 3;
+const uint64_t kReturning = 1 << 2;
+const uint64_t kCancelled = 1 << 3;
+const uint64_t kHasLists = 1 << 4;
+const int kHoldShift = 8;
+const uint64_t kOneHold = uint64_t(1) << kHoldShift;
+
+
+State StateOf(uint64_t word) {
+  return static_cast<State>(word & kStateMask);
+}
+
+
+uint64_t HoldsOf(uint64_t word) {
+  return word >> kHoldShift;
+}
+
+
+bool IsActiveWord(uint64_t word) {
+  return StateOf(word) == ACTIVE && !(word & kReturning);
+}
+
+
+// Returns |word| moved to the DONE state, if it is PREPARED without
+// any holds left, or unchanged otherwise.
+uint64_t MaybeDone(uint64_t word) {
+  if (StateOf(word) == PREPARED && HoldsOf(word) == 0) {
+    return (word & ~kStateMask) | DONE;
+  }
+  return word;
+}
+
+
+#ifdef HAVE_THREAD_LOCAL
+// Most freed tasks kept by each thread.
+const size_t kMaxFreeTasks = 256;
+
+
+class FreeList {
+ public:
+  FreeList() : head_(nullptr), size_(0) {
+  }
+  ~FreeList();
+
+  // Returns nullptr if the list is empty.
+  void* Pop() {
+    Block* const block(head_);
+    if (block) {
+      head_ = block->next;
+      --size_;
+    }
+    return block;
+  }
+
+  // Returns false if the list is full.
+  bool Push(void* ptr) {
+    if (size_ >= kMaxFreeTasks) {
+      return false;
+    }
+    Block* const block(static_cast<Block*>(ptr));
+    block->next = head_;
+    head_ = block;
+    ++size_;
+    return true;
+  }
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  Block* head_;
+  size_t size_;
+};
+
+
+// Tasks can still be deleted after the free list of the thread is
+// gone, by the destructors of other thread-local objects.
+thread_local bool free_list_destroyed(false);
+thread_local FreeList free_list;
+
+
+FreeList::~FreeList() {
+  while (void* const ptr = Pop()) {
+    ::operator delete(ptr);
+  }
+  free_list_destroyed = true;
+}
+#endif  // HAVE_THREAD_LOCAL
+
+
+}  // namespace
+
 
 Task::Task(const function<void(Task*)>& done_callback, Executor* executor)
     : done_callback_(done_callback),
       executor_(CHECK_NOTNULL(executor)),
-      state_(ACTIVE),
-      cancelled_(false),
-      holds_(0) {
+      word_(ACTIVE) {
 }
 
 
 Task::~Task() {
-  CHECK_EQ(state_, DONE);
+  // Gives a readable message when the CHECK fails.
+  const State state(StateOf(word_.load(memory_order_acquire)));
+  CHECK_EQ(state, DONE);
   CHECK(cancel_callbacks_.empty());
 }
 
 
-void Task::Cancel() {
-  unique_lock<mutex> lock(lock_);
+void* Task::operator new(size_t size) {
+#ifdef HAVE_THREAD_LOCAL
+  if (size == sizeof(Task) && !free_list_destroyed) {
+    void* const ptr(free_list.Pop());
+    if (ptr) {
+      return ptr;
+    }
+  }
+#endif
+  return ::operator new(size);
+}
+
 
-  if (state_ == DONE || cancelled_) {
+void Task::operator delete(void* ptr, size_t size) {
+#ifdef HAVE_THREAD_LOCAL
+  if (size == sizeof(Task) && !free_list_destroyed && free_list.Push(ptr)) {
     return;
   }
+#endif
+  ::operator delete(ptr);
+}
 
-  cancelled_ = true;
 
-  vector<function<void()>> cancel_callbacks;
-  cancel_callbacks_.swap(cancel_callbacks);
+void Task::Cancel() {
+  unique_lock<mutex> lock(lock_);
 
-  // Add a hold for each cancellation callback, so that we do not go
-  // into the DONE state until they all have completed.
-  holds_ += cancel_callbacks.size();
+  uint64_t word(word_.load(memory_order_relaxed));
+  size_t num_callbacks;
+  do {
+    if (StateOf(word) == DONE || (word & kCancelled)) {
+      return;
+    }
+    // Return() drops the cancellation callbacks, so they are only run
+    // if it has not been called yet. Add a hold for each of them, so
+    // that we do not go into the DONE state until they all have
+    // completed.
+    num_callbacks = IsActiveWord(word) ? cancel_callbacks_.size() : 0;
+  } while (!word_.compare_exchange_weak(word,
+                                        (word | kCancelled) +
+                                            num_callbacks * kOneHold,
+                                        memory_order_acq_rel,
+                                        memory_order_relaxed));
+
+  CallbackList cancel_callbacks;
+  if (num_callbacks > 0) {
+    cancel_callbacks = move(cancel_callbacks_);
+  }
 
   // Take a copy of the child tasks before giving back the lock. Since
   // these are shared_ptrs, having a copy will protect us in case some
   // of them complete and get removed (which will free them). Any
   // child tasks created after giving back the lock will be already
   // cancelled, so no need to cancel them here.
-  const vector<shared_ptr<Task>> child_tasks(child_tasks_);
+  const SmallVector<shared_ptr<Task>, 2> child_tasks(child_tasks_);
 
   // Give up the lock, in case the executor is synchronous.
   lock.unlock();
@@ -68,36 +215,54 @@ void Task::Cancel() {
 
 
 Status Task::status() const {
-  lock_guard<mutex> lock(lock_);
-  CHECK_NE(state_, ACTIVE);
+  uint64_t word(word_.load(memory_order_acquire));
+  // Return() might still be storing the status.
+  while (word & kReturning) {
+    std::this_thread::yield();
+    word = word_.load(memory_order_acquire);
+  }
+  CHECK_NE(StateOf(word), ACTIVE);
   return status_;
 }
 
 
 bool Task::Return(const Status& status) {
-  unique_lock<mutex> lock(lock_);
-
-  if (state_ != ACTIVE) {
-    return false;
-  }
+  // Claim the task first, so that concurrent calls return false, and
+  // WhenCancelled() and AddChild() know that it is not ACTIVE anymore.
+  uint64_t word(word_.load(memory_order_relaxed));
+  do {
+    if (!IsActiveWord(word)) {
+      return false;
+    }
+  } while (!word_.compare_exchange_weak(word, word | kReturning,
+                                        memory_order_acquire,
+                                        memory_order_relaxed));
 
   status_ = status;
-  state_ = PREPARED;
-  cancel_callbacks_.clear();
 
-  // Take a copy of the child tasks, so we can still access it after
-  // calling TryDoneTransition(). See Task::Cancel() for more
-  // explanation.
-  const vector<shared_ptr<Task>> child_tasks(child_tasks_);
+  // Anything added to the lists after the claim saw kReturning, and
+  // took care of itself, so we only need the lock if the flag was
+  // already set. Take a copy of the child tasks, so we can still
+  // access it after the task is PREPARED (see Task::Cancel() for more
+  // explanation).
+  SmallVector<shared_ptr<Task>, 2> child_tasks;
+  if (word & kHasLists) {
+    lock_guard<mutex> lock(lock_);
+    cancel_callbacks_.clear();
+    child_tasks = SmallVector<shared_ptr<Task>, 2>(child_tasks_);
+  }
+
+  word = word_.load(memory_order_relaxed);
+  uint64_t new_word;
+  do {
+    new_word = MaybeDone((word & ~(kStateMask | kReturning)) | PREPARED);
+  } while (!word_.compare_exchange_weak(word, new_word, memory_order_acq_rel,
+                                        memory_order_relaxed));
 
   // Do not touch any members after this, as the task object might be
   // deleted by the time this method returns.
-  TryDoneTransition(&lock);
-
-  // If we still have the lock (we are not in the DONE state yet),
-  // give it up.
-  if (lock.owns_lock()) {
-    lock.unlock();
+  if (StateOf(new_word) == DONE) {
+    ScheduleDoneCallbacks();
   }
 
   for (const auto& child_task : child_tasks) {
@@ -109,55 +274,59 @@ bool Task::Return(const Status& status) {
 
 
 void Task::AddHold() {
-  lock_guard<mutex> lock(lock_);
-  CHECK_NE(state_, DONE);
-  ++holds_;
+  const uint64_t word(word_.fetch_add(kOneHold, memory_order_relaxed));
+  CHECK_NE(StateOf(word), DONE);
 }
 
 
 void Task::RemoveHold() {
-  unique_lock<mutex> lock(lock_);
-
-  CHECK_GT(holds_, 0);
-  CHECK_NE(state_, DONE);
-  --holds_;
+  uint64_t word(word_.load(memory_order_relaxed));
+  uint64_t new_word;
+  do {
+    CHECK_GT(HoldsOf(word), 0U);
+    CHECK_NE(StateOf(word), DONE);
+    new_word = MaybeDone(word - kOneHold);
+  } while (!word_.compare_exchange_weak(word, new_word, memory_order_acq_rel,
+                                        memory_order_relaxed));
 
   // Do not touch any members after this, as the task object might be
   // deleted by the time this method returns.
-  TryDoneTransition(&lock);
+  if (StateOf(new_word) == DONE) {
+    ScheduleDoneCallbacks();
+  }
 }
 
 
 bool Task::IsActive() const {
-  lock_guard<mutex> lock(lock_);
-  return state_ == ACTIVE;
+  return IsActiveWord(word_.load(memory_order_acquire));
 }
 
 
 bool Task::IsDone() const {
-  lock_guard<mutex> lock(lock_);
-  return state_ == DONE;
+  return StateOf(word_.load(memory_order_acquire)) == DONE;
 }
 
 
 bool Task::CancelRequested() const {
-  lock_guard<mutex> lock(lock_);
-  return cancelled_;
+  return word_.load(memory_order_acquire) & kCancelled;
 }
 
 
 void Task::WhenCancelled(const std::function<void()>& cancel_cb) {
   unique_lock<mutex> lock(lock_);
 
-  if (state_ != ACTIVE) {
-    return;
-  }
+  uint64_t word(word_.load(memory_order_relaxed));
+  do {
+    if (!IsActiveWord(word)) {
+      return;
+    }
+  } while (!word_.compare_exchange_weak(
+      word, (word & kCancelled) ? word + kOneHold : word | kHasLists,
+      memory_order_acq_rel, memory_order_relaxed));
 
-  if (!cancelled_) {
+  if (!(word & kCancelled)) {
     cancel_callbacks_.emplace_back(cancel_cb);
   } else {
-    ++holds_;
-
     // Give up the lock, in case the executor is synchronous.
     lock.unlock();
     executor_->Add(bind(&Task::RunCancelCallback, this, cancel_cb));
@@ -174,12 +343,16 @@ Task* Task::AddChildWithExecutor(const function<void(Task*)>& done_callback,
 
   {
     lock_guard<mutex> lock(lock_);
-    CHECK_NE(state_, DONE);
 
-    child_tasks_.emplace_back(child_task);
-    ++holds_;
+    uint64_t word(word_.load(memory_order_relaxed));
+    do {
+      CHECK_NE(StateOf(word), DONE);
+    } while (!word_.compare_exchange_weak(word, (word | kHasLists) + kOneHold,
+                                          memory_order_acq_rel,
+                                          memory_order_relaxed));
 
-    cancel = state_ != ACTIVE || cancelled_;
+    child_tasks_.emplace_back(child_task);
+    cancel = !IsActiveWord(word) || (word & kCancelled);
   }
 
   if (cancel) {
@@ -192,35 +365,17 @@ Task* Task::AddChildWithExecutor(const function<void(Task*)>& done_callback,
 
 void Task::CleanupWhenDone(const function<void()>& cleanup_cb) {
   lock_guard<mutex> lock(lock_);
-  CHECK_NE(state_, DONE);
+  const uint64_t word(word_.fetch_or(kHasLists, memory_order_acq_rel));
+  CHECK_NE(StateOf(word), DONE);
 
   cleanup_callbacks_.emplace_back(cleanup_cb);
 }
 
 
-// After calling this method, the task object might have become
-// invalid, if the transition to DONE worked, as the done callback is
-// allowed to delete it. So make sure not to use any more member
-// variables after calling this.
-//
-// It will also release "*lock", if that transition succeeds.
-void Task::TryDoneTransition(unique_lock<mutex>* lock) {
-  CHECK(lock->owns_lock());
-  CHECK_NE(state_, DONE);
-
-  if (state_ != PREPARED || holds_ > 0) {
-    return;
-  }
-
-  state_ = DONE;
-
-  // Give up the lock, as the callback is allowed to delete us. We
-  // also do not want to cause a deadlock, in the possibility that the
-  // executor is synchronous.
-  lock->unlock();
-
-  // Once this is called, the task might get deleted.
-  executor_->Add(bind(&Task::RunCleanupAndDoneCallbacks, this));
+void Task::ScheduleDoneCallbacks() {
+  // Once this is called, the task might get deleted. A lambda only
+  // capturing "this" fits in std::function without allocating.
+  executor_->Add([this]() { RunCleanupAndDoneCallbacks(); });
 }
 
 
@@ -231,11 +386,11 @@ void Task::RunCancelCallback(const std::function<void()>& cb) {
 
 
 void Task::RunCleanupAndDoneCallbacks() {
-  vector<function<void()>> cleanup_callbacks;
+  CallbackList cleanup_callbacks;
 
-  {
+  if (word_.load(memory_order_acquire) & kHasLists) {
     lock_guard<mutex> lock(lock_);
-    cleanup_callbacks_.swap(cleanup_callbacks);
+    cleanup_callbacks = move(cleanup_callbacks_);
   }
 
   // We call the cleanup callbacks (and thus, any deleters) before
@@ -256,24 +411,22 @@ void Task::RunChildDoneCallback(const function<void(Task*)>& done_callback,
                                 Task* child_task) {
   done_callback(child_task);
 
-  unique_lock<mutex> lock(lock_);
-  vector<shared_ptr<Task>>::iterator it;
-  for (it = child_tasks_.begin(); it != child_tasks_.end(); ++it) {
-    if (it->get() == child_task) {
-      break;
+  {
+    lock_guard<mutex> lock(lock_);
+    auto it(child_tasks_.begin());
+    for (; it != child_tasks_.end(); ++it) {
+      if (it->get() == child_task) {
+        break;
+      }
     }
-  }
-
-  CHECK(it != child_tasks_.end());
-  CHECK_GT(holds_, 0);
-  CHECK_NE(state_, DONE);
 
-  child_tasks_.erase(it);
-  --holds_;
+    CHECK(it != child_tasks_.end());
+    child_tasks_.erase(it);
+  }
 
   // Do not touch any members after this, as the task object might be
   // deleted by the time this method returns.
-  TryDoneTransition(&lock);
+  RemoveHold();
 }
 
 
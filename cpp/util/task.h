@@ -22,12 +22,15 @@
 #ifndef CERT_TRANS_UTIL_TASK_H_
 #define CERT_TRANS_UTIL_TASK_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <vector>
 
 #include "util/executor.h"
+#include "util/small_vector.h"
 #include "util/status.h"
 
 namespace util {
@@ -55,6 +58,11 @@ class Task {
   // Tasks can be deleted in their done callback.
   ~Task();
 
+  // Tasks are created and deleted for every asynchronous operation,
+  // so each thread keeps a few freed ones around for reuse.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
+
   // Returns the executor passed into the constructor, which will be
   // used for callbacks.
   Executor* executor() const {
@@ -157,13 +165,9 @@ class Task {
   }
 
  private:
-  enum State {
-    ACTIVE = 0,
-    PREPARED = 1,
-    DONE = 2,
-  };
+  typedef SmallVector<std::function<void()>, 2> CallbackList;
 
-  void TryDoneTransition(std::unique_lock<std::mutex>* lock);
+  void ScheduleDoneCallbacks();
   void RunCancelCallback(const std::function<void()>& cb);
   void RunCleanupAndDoneCallbacks();
   void RunChildDoneCallback(const std::function<void(Task*)>& done_callback,
@@ -172,16 +176,20 @@ class Task {
   const std::function<void(Task*)> done_callback_;
   Executor* const executor_;
 
-  mutable std::mutex lock_;
-  State state_;
-  Status status_;  // not protected by lock_
-  bool cancelled_;
-  int holds_;
+  // The state, the number of holds and a few flags, packed together
+  // so that Return() and the holds only need an atomic operation (see
+  // task.cc for the layout).
+  std::atomic<uint64_t> word_;
+  Status status_;  // written once, by Return()
+
+  // Protects the lists below, which are only looked at in Return()
+  // and the DONE transition if something was ever added to them.
+  std::mutex lock_;
   // References to child tasks are kept as shared pointers to avoid
   // some races.
-  std::vector<std::shared_ptr<Task>> child_tasks_;
-  std::vector<std::function<void()>> cancel_callbacks_;
-  std::vector<std::function<void()>> cleanup_callbacks_;
+  SmallVector<std::shared_ptr<Task>, 2> child_tasks_;
+  CallbackList cancel_callbacks_;
+  CallbackList cleanup_callbacks_;
 };
 
 
@@ -0,0 +1,153 @@
+// Microbenchmarks for util::Task, covering the ways asynchronous
+// operations typically use it.
+//
+// "make check" builds this but does not run it, as its results depend
+// on the machine. Run it by hand before and after changing util/task.*,
+// and compare the time and allocations per task it reports (which are
+// also recorded as test properties, for --gtest_output=xml).
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "base/notification.h"
+#include "util/benchmark.h"
+#include "util/executor.h"
+#include "util/task.h"
+#include "util/testing.h"
+#include "util/thread_pool.h"
+
+DEFINE_int32(task_bench_iterations, 1000000,
+             "Number of tasks to run, for each benchmark.");
+DEFINE_int32(task_bench_threads, 4,
+             "Number of threads for the benchmarks using a thread pool.");
+
+namespace util {
+namespace {
+
+using cert_trans::Notification;
+using cert_trans::ThreadPool;
+using std::atomic;
+using cert_trans::test::ReportBenchmark;
+using cert_trans::test::RunBenchmark;
+using std::chrono::duration;
+using std::function;
+
+
+class InlineExecutor : public Executor {
+ public:
+  void Add(const function<void()>& closure) override {
+    closure();
+  }
+
+  void Delay(const duration<double>& delay, Task* task) override {
+    LOG(FATAL) << "Not Implemented.";
+  }
+};
+
+
+void DeleteTask(Task* task) {
+  delete task;
+}
+
+
+void DoNothing() {
+}
+
+
+class TaskBench : public ::testing::Test {
+ protected:
+  // Calls |op| --task_bench_iterations times, then |wait| if it is
+  // set, and reports the time and the number of allocations per call.
+  template <class Op>
+  void Measure(const Op& op, const function<void()>& wait = nullptr) {
+    ReportBenchmark(RunBenchmark(FLAGS_task_bench_iterations,
+                                 [&op](int) { op(); }, wait));
+  }
+
+  InlineExecutor executor_;
+};
+
+
+// The simplest case: create a task, return it, and delete it in its
+// done callback.
+TEST_F(TaskBench, Return) {
+  Measure([this]() { (new Task(DeleteTask, &executor_))->Return(); });
+}
+
+
+TEST_F(TaskBench, ReturnWithHolds) {
+  Measure([this]() {
+    Task* const task(new Task(DeleteTask, &executor_));
+    task->AddHold();
+    task->AddHold();
+    task->RemoveHold();
+    task->Return();
+    task->RemoveHold();
+  });
+}
+
+
+TEST_F(TaskBench, ReturnWithCallbacks) {
+  Measure([this]() {
+    Task* const task(new Task(DeleteTask, &executor_));
+    task->WhenCancelled(DoNothing);
+    task->CleanupWhenDone(DoNothing);
+    task->Return();
+  });
+}
+
+
+TEST_F(TaskBench, ReturnWithChild) {
+  Measure([this]() {
+    Task* const task(new Task(DeleteTask, &executor_));
+    task->AddChild([task](Task* child) { task->Return(child->status()); })
+        ->Return();
+  });
+}
+
+
+TEST_F(TaskBench, Cancel) {
+  Measure([this]() {
+    Task* const task(new Task(DeleteTask, &executor_));
+    task->WhenCancelled([task]() { task->Return(Status::CANCELLED); });
+    task->Cancel();
+  });
+}
+
+
+// Tasks created on one thread, and returned on a thread pool, which
+// also runs their done callbacks.
+TEST_F(TaskBench, ThreadPool) {
+  ThreadPool pool(FLAGS_task_bench_threads);
+  atomic<int> remaining(FLAGS_task_bench_iterations);
+  Notification all_done;
+  const function<void(Task*)> done([&remaining, &all_done](Task* task) {
+    // Deleting the task also deletes this closure.
+    Notification* const notifier(&all_done);
+    const bool last(--remaining == 0);
+    delete task;
+    if (last) {
+      notifier->Notify();
+    }
+  });
+
+  Measure(
+      [&pool, &done]() {
+        Task* const task(new Task(done, &pool));
+        pool.Add([task]() { task->Return(); });
+      },
+      [&all_done]() { all_done.WaitForNotification(); });
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
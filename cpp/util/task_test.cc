@@ -147,7 +147,7 @@ TEST_F(TaskDeathTest, DestroyIncompleteTask) {
   InlineExecutor executor;
 
   EXPECT_DEATH(util::Task(DoNothing, &executor),
-               "Check failed: state_ == DONE");
+               "Check failed: state == DONE");
 }
 
 
@@ -456,6 +456,83 @@ TYPED_TEST(TaskTest, ChildReturn) {
 }
 
 
+// Runs |a| and |b| on two threads, starting them as close together as
+// possible.
+void RunConcurrently(const std::function<void()>& a,
+                     const std::function<void()>& b) {
+  std::atomic<int> ready(0);
+  const auto start([&ready]() {
+    ++ready;
+    while (ready.load() < 2) {
+    }
+  });
+  std::thread thread([&start, &a]() {
+    start();
+    a();
+  });
+  start();
+  b();
+  thread.join();
+}
+
+
+const int kRaceRounds = 1000;
+
+
+TEST(TaskRaceTest, ReturnAndAddChild) {
+  ThreadPool pool(2);
+  for (int i = 0; i < kRaceRounds; ++i) {
+    Notification done;
+    util::Task task([&done](util::Task*) { done.Notify(); }, &pool);
+    // Keeps the task from being done, so that children can still be
+    // added after Return().
+    task.AddHold();
+
+    util::Task* child(nullptr);
+    RunConcurrently([&task, &child]() { child = task.AddChild(DoNothing); },
+                    [&task]() { EXPECT_TRUE(task.Return()); });
+
+    // Whichever came first, the child is cancelled, by Return() or by
+    // AddChild().
+    EXPECT_TRUE(child->CancelRequested());
+    child->Return();
+    task.RemoveHold();
+    done.WaitForNotification();
+    EXPECT_OK(task.status());
+  }
+}
+
+
+TEST(TaskRaceTest, ReturnAndCancel) {
+  ThreadPool pool(2);
+  for (int i = 0; i < kRaceRounds; ++i) {
+    Notification done;
+    util::Task task([&done](util::Task*) { done.Notify(); }, &pool);
+    task.AddHold();
+
+    atomic_int count(0);
+    bool returned(false);
+    RunConcurrently(
+        [&task, &count]() {
+          task.WhenCancelled(bind(Increment, &count));
+          task.Cancel();
+        },
+        [&task, &returned]() {
+          returned = task.Return(util::Status::CANCELLED);
+        });
+
+    EXPECT_TRUE(returned);
+    EXPECT_TRUE(task.CancelRequested());
+    task.RemoveHold();
+    done.WaitForNotification();
+    // The callback only runs if Cancel() came before Return(), and the
+    // task is not done before it has finished.
+    EXPECT_LE(count.load(), 1);
+    EXPECT_EQ(util::Status::CANCELLED, task.status());
+  }
+}
+
+
 }  // namespace
 
 
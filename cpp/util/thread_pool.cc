@@ -1,40 +1,50 @@
+#include "config.h"
 #include "util/thread_pool.h"
 #include "util/task.h"
 
 #include <glog/logging.h>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
-#include <queue>
+#include <random>
 #include <thread>
 #include <vector>
 
+#include "util/timer_wheel.h"
+#include "util/work_stealing_deque.h"
+
+using std::atomic;
+using std::atomic_thread_fence;
 using std::chrono::duration;
 using std::chrono::duration_cast;
-using std::chrono::seconds;
+using std::chrono::milliseconds;
 using std::chrono::steady_clock;
 using std::condition_variable;
+using std::deque;
 using std::function;
-using std::get;
 using std::lock_guard;
+using std::memory_order_relaxed;
+using std::memory_order_seq_cst;
 using std::mutex;
-using std::priority_queue;
 using std::thread;
-using std::tuple;
 using std::unique_lock;
+using std::unique_ptr;
 using std::vector;
+using util::TimerWheel;
+using util::WorkStealingDeque;
 
 namespace cert_trans {
 namespace {
 
-typedef tuple<steady_clock::time_point, function<void()>, util::Task*>
-    QueueEntry;
+typedef function<void()> Closure;
 
-
-struct QueueOrdering {
-  bool operator()(const QueueEntry& lhs, const QueueEntry& rhs) const {
-    return get<0>(lhs) > get<0>(rhs);
-  }
-};
+// How many times an idle worker looks for work to steal, before going
+// to sleep.
+const int kSpinRounds = 64;
+// Most closures a worker takes from the global queue at once.
+const size_t kMaxBatch = 32;
 
 
 }  // namespace
@@ -42,94 +52,296 @@ struct QueueOrdering {
 
 class ThreadPool::Impl {
  public:
+  explicit Impl(size_t num_threads);
   ~Impl();
 
-  void Worker();
+  void Add(Closure* closure);
+  void Delay(steady_clock::time_point deadline, util::Task* task);
+
+ private:
+  struct WorkerState {
+    WorkStealingDeque<Closure> deque;
+  };
+
+  void Worker(int index);
+  // Returns the next closure for worker |index| to run, or nullptr if
+  // there is nothing to do.
+  Closure* FindWork(int index, std::minstd_rand* rng);
+  // Puts the calling worker to sleep until there might be something to
+  // do.
+  void Park();
+  // Wakes up a worker, if any of them is asleep.
+  void Wake();
+  bool HasWork() const;
+  void Timer();
 
   // TODO(pphaneuf): I'd like this to be const, but it required
   // jumping through a few more hoops, keeping it simple for now.
   vector<thread> threads_;
+  vector<unique_ptr<WorkerState>> workers_;
+
+  // Closures added from outside the pool (including by the timer).
+  mutable mutex queue_lock_;
+  deque<Closure*> queue_;
+  atomic<size_t> queue_size_;
+
+  // Workers sleep on this when they find nothing to do.
+  mutex park_lock_;
+  condition_variable park_cond_var_;
+  atomic<int> sleeping_;
+  atomic<bool> exiting_;
+
+  mutex timer_lock_;
+  condition_variable timer_cond_var_;
+  TimerWheel<util::Task*> timers_;
+  // When the timer thread is going to wake up next.
+  steady_clock::time_point timer_wakeup_;
+  bool timer_exiting_;
+  thread timer_thread_;
+};
 
-  mutex queue_lock_;
-  condition_variable queue_cond_var_;
-  priority_queue<QueueEntry, vector<QueueEntry>, QueueOrdering> queue_;
+
+namespace {
+
+
+// The pool and worker the current thread belongs to, if any.
+struct CurrentWorker {
+  const void* pool;
+  int index;
 };
 
+#ifdef HAVE_THREAD_LOCAL
+thread_local CurrentWorker current_worker = {nullptr, -1};
+#elif HAVE___THREAD
+__thread CurrentWorker current_worker = {nullptr, -1};
+#else
+#error No suitable thread local storage available
+#endif
+
+
+}  // namespace
+
+
+ThreadPool::Impl::Impl(size_t num_threads)
+    : queue_size_(0),
+      sleeping_(0),
+      exiting_(false),
+      timers_(steady_clock::now(), milliseconds(1)),
+      timer_wakeup_(steady_clock::time_point::max()),
+      timer_exiting_(false) {
+  CHECK_GT(num_threads, static_cast<size_t>(0));
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new WorkerState);
+  }
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(thread(&Impl::Worker, this, i));
+  }
+  timer_thread_ = thread(&Impl::Timer, this);
+}
+
 
 ThreadPool::Impl::~Impl() {
-  // Start by sending an empty closure to every thread (and notify
-  // them), to have them exit cleanly.
+  // Stop the timers first, as they could still add closures.
   {
-    lock_guard<mutex> lock(queue_lock_);
-    for (int i = threads_.size(); i > 0; --i)
-      queue_.emplace(
-          make_tuple(steady_clock::time_point(), function<void()>(), nullptr));
+    lock_guard<mutex> lock(timer_lock_);
+    timer_exiting_ = true;
   }
-  // Notify all the threads *after* adding all the empty closures, to
-  // avoid any races.
-  queue_cond_var_.notify_all();
+  timer_cond_var_.notify_one();
+  timer_thread_.join();
+  vector<util::Task*> to_be_cancelled;
+  timers_.Clear(&to_be_cancelled);
 
-  // Wait for the threads to exit.
+  // The workers run what has already been added, then exit.
+  {
+    lock_guard<mutex> lock(park_lock_);
+    exiting_.store(true);
+  }
+  park_cond_var_.notify_all();
   for (auto& thread : threads_) {
     thread.join();
   }
 
+  // Cancel the delayed tasks now, so that anyone who tries to Add()
+  // more stuff when they're cancelled causes the CHECK below to fail,
+  // rather than a crash later on.
+  VLOG(1) << "Cancelling delayed tasks...";
+  for (const auto& t : to_be_cancelled) {
+    t->Return(util::Status::CANCELLED);
+  }
+  VLOG(1) << "Cancelled " << to_be_cancelled.size() << " delayed tasks.";
+
   // Workers should've drained everything from the queue.
+  lock_guard<mutex> lock(queue_lock_);
   CHECK(queue_.empty());
 }
 
 
-void ThreadPool::Impl::Worker() {
+void ThreadPool::Impl::Add(Closure* closure) {
+  if (current_worker.pool == this) {
+    // Keep it close, other workers will steal it if they have nothing
+    // better to do.
+    workers_[current_worker.index]->deque.Push(closure);
+  } else {
+    lock_guard<mutex> lock(queue_lock_);
+    queue_.push_back(closure);
+    queue_size_.fetch_add(1, memory_order_relaxed);
+  }
+  Wake();
+}
+
+
+void ThreadPool::Impl::Delay(steady_clock::time_point deadline,
+                             util::Task* task) {
+  bool wake;
+  {
+    lock_guard<mutex> lock(timer_lock_);
+    timers_.Add(deadline, task);
+    wake = deadline < timer_wakeup_;
+  }
+  if (wake) {
+    timer_cond_var_.notify_one();
+  }
+}
+
+
+void ThreadPool::Impl::Worker(int index) {
+  current_worker.pool = this;
+  current_worker.index = index;
+  std::minstd_rand rng(index + 1);
+
+  int idle_rounds(0);
   while (true) {
-    QueueEntry entry;
-
-    {
-      unique_lock<mutex> lock(queue_lock_);
-      while (queue_.empty() || get<0>(queue_.top()) > steady_clock::now()) {
-        if (queue_.empty()) {
-          // If there's nothing to do, wait until there is.
-          queue_cond_var_.wait(lock);
-        } else {
-          // Otherwise, wait until the next thing we currently know about is
-          // ready.
-          const steady_clock::duration duration(get<0>(queue_.top()) -
-                                                steady_clock::now());
-          queue_cond_var_.wait_for(lock, duration);
-        }
+    // This has to be checked before looking for work: closures added
+    // before the pool started exiting are then sure to be seen by
+    // FindWork(), rather than being added just after it gave up.
+    const bool exiting(exiting_.load());
+    unique_ptr<Closure> closure(FindWork(index, &rng));
+    if (closure) {
+      idle_rounds = 0;
+      (*closure)();
+      continue;
+    }
+
+    if (exiting) {
+      // Only this worker adds to its deque, so it is empty for good,
+      // and nobody should be adding to the global queue any more.
+      return;
+    }
+
+    if (++idle_rounds < kSpinRounds) {
+      std::this_thread::yield();
+    } else {
+      idle_rounds = 0;
+      Park();
+    }
+  }
+}
+
+
+Closure* ThreadPool::Impl::FindWork(int index, std::minstd_rand* rng) {
+  WorkerState* const self(workers_[index].get());
+  Closure* closure(self->deque.Pop());
+  if (closure) {
+    return closure;
+  }
+
+  if (queue_size_.load(memory_order_relaxed) > 0) {
+    // Take our share of the global queue, and keep the rest of it in
+    // our deque, for the others to steal.
+    lock_guard<mutex> lock(queue_lock_);
+    if (!queue_.empty()) {
+      closure = queue_.front();
+      queue_.pop_front();
+      const size_t batch(
+          std::min(kMaxBatch, queue_.size() / workers_.size()));
+      for (size_t i = 0; i < batch; ++i) {
+        self->deque.Push(queue_.front());
+        queue_.pop_front();
       }
+      queue_size_.fetch_sub(batch + 1, memory_order_relaxed);
+      return closure;
+    }
+  }
+
+  // Try the others, starting at a random one.
+  const int num_workers(workers_.size());
+  const int start((*rng)() % num_workers);
+  for (int i = 0; i < num_workers; ++i) {
+    const int victim((start + i) % num_workers);
+    if (victim == index) {
+      continue;
+    }
+    closure = workers_[victim]->deque.Steal();
+    if (closure) {
+      return closure;
+    }
+  }
+
+  return nullptr;
+}
+
+
+bool ThreadPool::Impl::HasWork() const {
+  if (queue_size_.load(memory_order_seq_cst) > 0) {
+    return true;
+  }
+  for (const auto& worker : workers_) {
+    if (!worker->deque.Empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void ThreadPool::Impl::Park() {
+  unique_lock<mutex> lock(park_lock_);
+  // Wake() checks for sleepers after adding its closure, and we check
+  // for work after saying that we are sleeping, so one of us will see
+  // the other.
+  sleeping_.fetch_add(1, memory_order_seq_cst);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!exiting_.load() && !HasWork()) {
+    park_cond_var_.wait(lock);
+  }
+  sleeping_.fetch_sub(1, memory_order_seq_cst);
+}
+
+
+void ThreadPool::Impl::Wake() {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (sleeping_.load(memory_order_seq_cst) > 0) {
+    // Taking the lock makes sure that the sleeper is waiting, or has
+    // yet to check for work.
+    lock_guard<mutex> lock(park_lock_);
+    park_cond_var_.notify_one();
+  }
+}
 
-      entry = queue_.top();
-      queue_.pop();
-
-      // If we received an empty entry, exit cleanly.
-      if (!get<1>(entry)) {
-        // Anything left in the queue must be either other exit sentinels, or
-        // future (delayed) tasks, so we'll cancel anything we find, up until
-        // either the next exit sentinel, or the end of the queue.
-        VLOG(1) << "Cancelling delayed tasks...";
-        vector<util::Task*> to_be_cancelled;
-        while (!queue_.empty() && get<2>(queue_.top())) {
-          to_be_cancelled.push_back(CHECK_NOTNULL(get<2>(queue_.top())));
-          queue_.pop();
-        }
-
-        // Cancel the callbacks below outside of the lock to avoid deadlocking
-        // anyone who tries to Add() more stuff when they're cancelled.
-        // Anyone who does that is going to cause a CHECK fail in the d'tor of
-        // the pool anyway, but at least they'll know about it that way.
-        lock.unlock();
-
-        for (const auto& t : to_be_cancelled) {
-          t->Return(util::Status::CANCELLED);
-        }
-
-        VLOG(1) << "Cancelled " << to_be_cancelled.size() << " delayed tasks.";
-        return;
+
+void ThreadPool::Impl::Timer() {
+  unique_lock<mutex> lock(timer_lock_);
+  while (!timer_exiting_) {
+    vector<util::Task*> expired;
+    timers_.Advance(steady_clock::now(), &expired);
+    if (!expired.empty()) {
+      // Don't hold the lock while adding the closures, a worker might
+      // want to add a timer.
+      lock.unlock();
+      for (const auto& task : expired) {
+        Add(new Closure([task]() { task->Return(); }));
       }
+      lock.lock();
+      continue;
     }
 
-    // Make sure not to hold the lock while calling the closure.
-    get<1>(entry)();
+    timer_wakeup_ = timers_.NextDeadline();
+    if (timer_wakeup_ == steady_clock::time_point::max()) {
+      timer_cond_var_.wait(lock);
+    } else {
+      timer_cond_var_.wait_until(lock, timer_wakeup_);
+    }
+    timer_wakeup_ = steady_clock::time_point::max();
   }
 }
 
@@ -141,11 +353,8 @@ ThreadPool::ThreadPool()
 }
 
 
-ThreadPool::ThreadPool(size_t num_threads) : impl_(new Impl) {
-  CHECK_GT(num_threads, static_cast<size_t>(0));
+ThreadPool::ThreadPool(size_t num_threads) : impl_(new Impl(num_threads)) {
   LOG(INFO) << "ThreadPool starting with " << num_threads << " threads";
-  for (int i = 0; i < static_cast<int64_t>(num_threads); ++i)
-    impl_->threads_.emplace_back(thread(&Impl::Worker, impl_.get()));
 }
 
 
@@ -156,29 +365,26 @@ ThreadPool::~ThreadPool() {
 
 
 void ThreadPool::Add(const function<void()>& closure) {
-  // Empty closures signal a thread to exit, don't allow that (also,
-  // it doesn't make sense).
+  // Empty closures used to signal a thread to exit, they are still not
+  // allowed (also, it doesn't make sense).
   if (!closure) {
     return;
   }
 
-  {
-    lock_guard<mutex> lock(impl_->queue_lock_);
-    impl_->queue_.emplace(make_tuple(steady_clock::now(), closure, nullptr));
-  }
-  impl_->queue_cond_var_.notify_one();
+  impl_->Add(new Closure(closure));
 }
 
 
 void ThreadPool::Delay(const duration<double>& delay, util::Task* task) {
   CHECK_NOTNULL(task);
-  {
-    lock_guard<mutex> lock(impl_->queue_lock_);
-    impl_->queue_.emplace(make_tuple(
-        steady_clock::now() + duration_cast<std::chrono::microseconds>(delay),
-        [task]() { task->Return(); }, task));
-  }
-  impl_->queue_cond_var_.notify_one();
+  impl_->Delay(
+      steady_clock::now() + duration_cast<std::chrono::microseconds>(delay),
+      task);
+}
+
+
+bool ThreadPool::OnWorkerThread() const {
+  return current_worker.pool == impl_.get();
 }
 
 
@@ -34,6 +34,11 @@ class ThreadPool : public util::Executor {
   void Delay(const std::chrono::duration<double>& delay,
              util::Task* task) override;
 
+  // Returns true if the calling thread is one of the threads of this
+  // pool. Code running there must not block waiting for closures it
+  // added to the pool, as they might never get a thread to run on.
+  bool OnWorkerThread() const;
+
  private:
   class Impl;
   const std::unique_ptr<Impl> impl_;
@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 #include <atomic>
 #include <memory>
+#include <vector>
 
 #include "base/notification.h"
 #include "util/sync_task.h"
@@ -89,6 +90,75 @@ TEST_F(ThreadPoolTest, CancelsDelayTasks) {
 }
 
 
+TEST(ThreadPoolWorkTest, ClosuresAddingClosures) {
+  const int kOuter(1000);
+  const int kInner(10);
+  ThreadPool pool(4);
+  std::atomic<int> count(0);
+  Notification done;
+  for (int i = 0; i < kOuter; ++i) {
+    pool.Add([&]() {
+      // These go to the worker's own queue, and get stolen by the
+      // others.
+      for (int j = 0; j < kInner; ++j) {
+        pool.Add([&]() {
+          if (++count == kOuter * kInner) {
+            done.Notify();
+          }
+        });
+      }
+    });
+  }
+  done.WaitForNotification();
+  EXPECT_EQ(kOuter * kInner, count.load());
+}
+
+
+TEST(ThreadPoolWorkTest, DestroyingRunsAddedClosures) {
+  const int kClosures(1000);
+  for (int round = 0; round < 20; ++round) {
+    std::atomic<int> count(0);
+    {
+      ThreadPool pool(4);
+      for (int i = 0; i < kClosures; ++i) {
+        pool.Add([&count]() { ++count; });
+      }
+    }
+    EXPECT_EQ(kClosures, count.load());
+  }
+}
+
+
+TEST(ThreadPoolWorkTest, OnWorkerThread) {
+  ThreadPool pool(2);
+  ThreadPool other_pool(1);
+  EXPECT_FALSE(pool.OnWorkerThread());
+  Notification done;
+  pool.Add([&]() {
+    EXPECT_TRUE(pool.OnWorkerThread());
+    EXPECT_FALSE(other_pool.OnWorkerThread());
+    done.Notify();
+  });
+  done.WaitForNotification();
+}
+
+
+TEST(ThreadPoolWorkTest, ManyDelays) {
+  ThreadPool pool(2);
+  const system_clock::time_point start(system_clock::now());
+  std::vector<unique_ptr<SyncTask>> tasks;
+  for (int i = 0; i < 200; ++i) {
+    tasks.emplace_back(new SyncTask(&pool));
+    pool.Delay(milliseconds((i * 7) % 50), tasks.back()->task());
+  }
+  for (int i = 0; i < 200; ++i) {
+    tasks[i]->Wait();
+    EXPECT_TRUE(tasks[i]->status().ok());
+    EXPECT_GE(system_clock::now() - start, milliseconds((i * 7) % 50));
+  }
+}
+
+
 }  // namespace cert_trans
 
 
@@ -0,0 +1,208 @@
+#ifndef CERT_TRANS_UTIL_TIMER_WHEEL_H_
+#define CERT_TRANS_UTIL_TIMER_WHEEL_H_
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+
+// A hierarchical timer wheel, holding values of type T until their
+// deadline.
+//
+// Time is counted in ticks since the wheel was created. There are
+// kLevels levels of kSlots slots each, and a slot of level N covers
+// kSlots^N ticks, so that adding a timer is constant time, and finding
+// the expired ones only looks at the slots that have some. Timers
+// further than kSlots^kLevels ticks away go round the top level more
+// than once, but still expire on time.
+//
+// It is not thread-safe.
+template <class T>
+class TimerWheel {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  TimerWheel(Clock::time_point start, Clock::duration tick)
+      : start_(start), tick_(tick), elapsed_(0), size_(0) {
+    CHECK_GT(tick_.count(), 0);
+    for (auto& level : occupied_) {
+      level = 0;
+    }
+  }
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Adds |value|, to expire at |deadline|. It is rounded up to the
+  // next tick, so it never expires early.
+  void Add(Clock::time_point deadline, T value) {
+    ++size_;
+    Insert(Entry(TickAfter(deadline), std::move(value)));
+  }
+
+  // Returns the earliest time at which Advance() could return
+  // something, or Clock::time_point::max() if the wheel is empty.
+  Clock::time_point NextDeadline() const {
+    if (!due_.empty()) {
+      return start_;
+    }
+    uint64_t tick;
+    int level, slot;
+    if (!NextExpiration(&tick, &level, &slot)) {
+      return Clock::time_point::max();
+    }
+    return start_ + tick_ * static_cast<Clock::rep>(tick);
+  }
+
+  // Moves the wheel to |now|, and appends the values of the timers
+  // that have expired to |expired|, earliest first.
+  void Advance(Clock::time_point now, std::vector<T>* expired) {
+    CHECK_NOTNULL(expired);
+    const uint64_t now_tick(TickBefore(now));
+    for (auto& entry : due_) {
+      expired->emplace_back(std::move(entry.second));
+    }
+    size_ -= due_.size();
+    due_.clear();
+
+    uint64_t tick;
+    int level, slot;
+    while (NextExpiration(&tick, &level, &slot) && tick <= now_tick) {
+      // Either the timers in the slot have expired, or they go down a
+      // level now that we are that close to them.
+      std::vector<Entry> entries;
+      entries.swap(slots_[level][slot]);
+      occupied_[level] &= ~(uint64_t(1) << slot);
+      elapsed_ = tick;
+      for (auto& entry : entries) {
+        if (entry.first <= elapsed_) {
+          expired->emplace_back(std::move(entry.second));
+          --size_;
+        } else {
+          Insert(std::move(entry));
+        }
+      }
+    }
+    if (now_tick > elapsed_) {
+      elapsed_ = now_tick;
+    }
+  }
+
+  // Removes all the timers, appending their values to |values|.
+  void Clear(std::vector<T>* values) {
+    CHECK_NOTNULL(values);
+    for (auto& entry : due_) {
+      values->emplace_back(std::move(entry.second));
+    }
+    due_.clear();
+    for (int level = 0; level < kLevels; ++level) {
+      for (auto& slot : slots_[level]) {
+        for (auto& entry : slot) {
+          values->emplace_back(std::move(entry.second));
+        }
+        slot.clear();
+      }
+      occupied_[level] = 0;
+    }
+    size_ = 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  static const int kLevels = 6;
+  static const int kSlotBits = 6;
+  static const int kSlots = 1 << kSlotBits;
+  static const uint64_t kMaxTicks = uint64_t(1) << (kLevels * kSlotBits);
+
+  // Deadline (in ticks) and value.
+  typedef std::pair<uint64_t, T> Entry;
+
+  uint64_t TickAfter(Clock::time_point t) const {
+    if (t <= start_) {
+      return 0;
+    }
+    return (t - start_ + tick_ - Clock::duration(1)) / tick_;
+  }
+
+  uint64_t TickBefore(Clock::time_point t) const {
+    return t <= start_ ? 0 : (t - start_) / tick_;
+  }
+
+  void Insert(Entry&& entry) {
+    if (entry.first <= elapsed_) {
+      due_.emplace_back(std::move(entry));
+      return;
+    }
+    // The top level only goes round once, ending just before the slot
+    // we are in comes up again. Timers further away than that are put
+    // in its last slot, and inserted again once we get there.
+    const int top_shift((kLevels - 1) * kSlotBits);
+    const uint64_t last(((elapsed_ >> top_shift) << top_shift) + kMaxTicks -
+                        1);
+    const uint64_t position(std::min(entry.first, last));
+    // The level is given by the highest bit in which the deadline
+    // differs from the current time. A deadline in the next round of
+    // the top level can differ above it, but still goes there.
+    const uint64_t masked((position ^ elapsed_) | (kSlots - 1));
+    const int level(
+        std::min((63 - __builtin_clzll(masked)) / kSlotBits, kLevels - 1));
+    const int slot((position >> (level * kSlotBits)) & (kSlots - 1));
+    slots_[level][slot].emplace_back(std::move(entry));
+    occupied_[level] |= uint64_t(1) << slot;
+  }
+
+  // Finds the first slot to process, and the tick at which it starts.
+  // Returns false if there is none.
+  bool NextExpiration(uint64_t* tick, int* level, int* slot) const {
+    for (int l = 0; l < kLevels; ++l) {
+      if (occupied_[l] == 0) {
+        continue;
+      }
+      // All the timers of a level expire before those of the next
+      // one. Within the level, the slots before the current one are
+      // empty (or belong to the next round), so we look for the next
+      // occupied one from it.
+      const int shift(l * kSlotBits);
+      const int now_slot((elapsed_ >> shift) & (kSlots - 1));
+      const uint64_t rotated(now_slot == 0
+                                 ? occupied_[l]
+                                 : (occupied_[l] >> now_slot) |
+                                       (occupied_[l] << (kSlots - now_slot)));
+      const int s((__builtin_ctzll(rotated) + now_slot) % kSlots);
+      const uint64_t level_range(uint64_t(1) << (shift + kSlotBits));
+      uint64_t start((elapsed_ & ~(level_range - 1)) +
+                     (static_cast<uint64_t>(s) << shift));
+      if (s < now_slot) {
+        start += level_range;
+      }
+      *tick = start;
+      *level = l;
+      *slot = s;
+      return true;
+    }
+    return false;
+  }
+
+  const Clock::time_point start_;
+  const Clock::duration tick_;
+  // The current time, in ticks.
+  uint64_t elapsed_;
+  size_t size_;
+  std::vector<Entry> slots_[kLevels][kSlots];
+  // Which slots of each level have timers in them.
+  uint64_t occupied_[kLevels];
+  // Timers added with a deadline which had already passed.
+  std::vector<Entry> due_;
+};
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_TIMER_WHEEL_H_
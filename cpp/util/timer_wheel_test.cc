@@ -0,0 +1,175 @@
+#include "util/timer_wheel.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "util/testing.h"
+
+namespace util {
+namespace {
+
+using std::chrono::milliseconds;
+using std::vector;
+
+typedef TimerWheel<int>::Clock Clock;
+
+
+class TimerWheelTest : public ::testing::Test {
+ protected:
+  TimerWheelTest() : start_(Clock::now()), wheel_(start_, milliseconds(1)) {
+  }
+
+  Clock::time_point At(int64_t ms) const {
+    return start_ + milliseconds(ms);
+  }
+
+  vector<int> AdvanceTo(int64_t ms) {
+    vector<int> expired;
+    wheel_.Advance(At(ms), &expired);
+    return expired;
+  }
+
+  const Clock::time_point start_;
+  TimerWheel<int> wheel_;
+};
+
+
+TEST_F(TimerWheelTest, Empty) {
+  EXPECT_EQ(0U, wheel_.size());
+  EXPECT_EQ(Clock::time_point::max(), wheel_.NextDeadline());
+  EXPECT_TRUE(AdvanceTo(1000).empty());
+}
+
+
+TEST_F(TimerWheelTest, FiresInOrderAndNotEarly) {
+  const int64_t kDeadlines[] = {1, 5, 63, 64, 65, 100, 4095, 4096, 300000};
+  // Add them in reverse, to check that the order comes from the wheel.
+  for (int i = sizeof(kDeadlines) / sizeof(kDeadlines[0]) - 1; i >= 0; --i) {
+    wheel_.Add(At(kDeadlines[i]), kDeadlines[i]);
+  }
+  EXPECT_EQ(9U, wheel_.size());
+
+  for (const int64_t deadline : kDeadlines) {
+    EXPECT_TRUE(AdvanceTo(deadline - 1).empty()) << deadline;
+    EXPECT_LE(wheel_.NextDeadline(), At(deadline)) << deadline;
+    EXPECT_EQ(vector<int>({static_cast<int>(deadline)}), AdvanceTo(deadline));
+  }
+  EXPECT_EQ(0U, wheel_.size());
+  EXPECT_EQ(Clock::time_point::max(), wheel_.NextDeadline());
+}
+
+
+TEST_F(TimerWheelTest, RoundsUp) {
+  wheel_.Add(At(10) + std::chrono::microseconds(1), 1);
+  EXPECT_TRUE(AdvanceTo(10).empty());
+  EXPECT_EQ(vector<int>({1}), AdvanceTo(11));
+}
+
+
+TEST_F(TimerWheelTest, PastDeadlines) {
+  AdvanceTo(1000);
+  wheel_.Add(At(500), 1);
+  wheel_.Add(At(1000), 2);
+  EXPECT_LE(wheel_.NextDeadline(), At(1000));
+  EXPECT_EQ(vector<int>({1, 2}), AdvanceTo(1000));
+}
+
+
+TEST_F(TimerWheelTest, Clear) {
+  wheel_.Add(At(1), 1);
+  wheel_.Add(At(1000000), 2);
+  vector<int> values;
+  wheel_.Clear(&values);
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(vector<int>({1, 2}), values);
+  EXPECT_EQ(0U, wheel_.size());
+  EXPECT_TRUE(AdvanceTo(2000000).empty());
+}
+
+
+// Further than the wheel goes in one round, which is 2^36 ticks.
+TEST_F(TimerWheelTest, VeryLongDelays) {
+  const int64_t kRound(int64_t(1) << 36);
+  wheel_.Add(At(kRound + 1000), 1);
+  wheel_.Add(At(3 * kRound + 5), 2);
+  wheel_.Add(At(10), 3);
+  EXPECT_EQ(vector<int>({3}), AdvanceTo(10));
+  EXPECT_TRUE(AdvanceTo(kRound + 999).empty());
+  EXPECT_EQ(vector<int>({1}), AdvanceTo(kRound + 1000));
+  EXPECT_TRUE(AdvanceTo(3 * kRound + 4).empty());
+  EXPECT_LE(wheel_.NextDeadline(), At(3 * kRound + 5));
+  EXPECT_EQ(vector<int>({2}), AdvanceTo(3 * kRound + 5));
+  EXPECT_EQ(0U, wheel_.size());
+}
+
+
+// Deadlines on both sides of tick 2^36, where the top level wraps
+// around.
+TEST_F(TimerWheelTest, AcrossTopLevelWrapAround) {
+  const int64_t kRound(int64_t(1) << 36);
+  AdvanceTo(kRound - 100);
+  const int64_t kDeadlines[] = {kRound - 50, kRound - 1, kRound, kRound + 1,
+                                kRound + 5000, 2 * kRound - 200, 2 * kRound};
+  for (int i = sizeof(kDeadlines) / sizeof(kDeadlines[0]) - 1; i >= 0; --i) {
+    wheel_.Add(At(kDeadlines[i]), i);
+  }
+
+  int i(0);
+  for (const int64_t deadline : kDeadlines) {
+    EXPECT_TRUE(AdvanceTo(deadline - 1).empty()) << deadline;
+    EXPECT_LE(wheel_.NextDeadline(), At(deadline)) << deadline;
+    EXPECT_EQ(vector<int>({i}), AdvanceTo(deadline)) << deadline;
+    ++i;
+  }
+  EXPECT_EQ(0U, wheel_.size());
+}
+
+
+TEST_F(TimerWheelTest, Random) {
+  srand(1);
+  std::multimap<int64_t, int> pending;
+  int64_t now(0);
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = rand() % 10; i > 0; --i) {
+      // Mostly short, sometimes very long.
+      const int64_t deadline(now + (rand() % 4 == 0 ? rand() % 100000000
+                                                    : rand() % 5000));
+      const int value(pending.size() + round * 10);
+      wheel_.Add(At(deadline), value);
+      pending.emplace(deadline, value);
+    }
+    EXPECT_EQ(pending.size(), wheel_.size());
+
+    // Jump to the next deadline, or somewhere random.
+    if (rand() % 2 == 0 && !pending.empty()) {
+      EXPECT_LE(wheel_.NextDeadline(), At(pending.begin()->first));
+      now = std::max(now, pending.begin()->first);
+    } else {
+      now += rand() % 10000;
+    }
+
+    vector<int> expected;
+    while (!pending.empty() && pending.begin()->first <= now) {
+      expected.push_back(pending.begin()->second);
+      pending.erase(pending.begin());
+    }
+    vector<int> expired(AdvanceTo(now));
+    // Timers expiring on the same tick can come out in any order.
+    std::sort(expected.begin(), expected.end());
+    std::sort(expired.begin(), expired.end());
+    ASSERT_EQ(expected, expired) << "at " << now;
+  }
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
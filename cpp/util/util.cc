@@ -1,8 +1,6 @@
 #include "util/util.h"
 
 #include <glog/logging.h>
-#include <netinet/in.h>  // for resolv.h
-#include <resolv.h>      // for b64_ntop
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,6 +14,7 @@
 #include <vector>
 
 #include "log/ct_extensions.h"
+#include "util/base64.h"
 #include "version.h"
 
 using std::getline;
@@ -175,28 +174,29 @@ string RandomString(size_t min_length, size_t max_length) {
   return ret;
 }
 
-string FromBase64(const char* b64) {
-  size_t length = strlen(b64);
-  // Lazy: base 64 encoding is always >= in length to decoded value
-  // (equality occurs for zero length).
-  u_char* buf = new u_char[length];
-  int rlength = b64_pton(b64, buf, length);
+string FromBase64(StringView b64) {
+  string ret;
   // Treat decode errors as empty strings.
-  if (rlength < 0)
-    rlength = 0;
-  string ret(reinterpret_cast<char*>(buf), rlength);
-  delete[] buf;
+  if (!FromBase64(b64, &ret)) {
+    ret.clear();
+  }
   return ret;
 }
 
-string ToBase64(const string& from) {
-  // base 64 is 4 output bytes for every 3 input bytes (rounded up).
-  size_t length = ((from.size() + 2) / 3) * 4;
-  char* buf = new char[length + 1];
-  length =
-      b64_ntop((const u_char*)from.data(), from.length(), buf, length + 1);
-  string ret(buf, length);
-  delete[] buf;
+bool FromBase64(StringView b64, string* result) {
+  CHECK_NOTNULL(result);
+  result->resize(Base64DecodedMaxLength(b64.size()));
+  size_t length(0);
+  if (!Base64Decode(b64, &(*result)[0], &length)) {
+    return false;
+  }
+  result->resize(length);
+  return true;
+}
+
+string ToBase64(StringView from) {
+  string ret(Base64EncodedLength(from.size()), '\0');
+  Base64Encode(from, &ret[0]);
   return ret;
 }
 
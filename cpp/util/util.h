@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 
+#include "util/string_view.h"
+
 namespace util {
 
 std::string HexString(const std::string& data);
@@ -32,9 +34,14 @@ uint64_t TimeInMilliseconds();
 // srand() is called if needed.
 std::string RandomString(size_t min_length, size_t max_length);
 
-std::string FromBase64(const char* b64);
+// Returns an empty string if |b64| is not valid base64 (see
+// Base64Decode() in util/base64.h).
+std::string FromBase64(StringView b64);
+
+// Same as above, but tells invalid input apart from an empty string.
+bool FromBase64(StringView b64, std::string* result);
 
-std::string ToBase64(const std::string& from);
+std::string ToBase64(StringView from);
 
 std::vector<std::string> split(const std::string& in, char delim = ',');
 
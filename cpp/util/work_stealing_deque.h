@@ -0,0 +1,145 @@
+#ifndef CERT_TRANS_UTIL_WORK_STEALING_DEQUE_H_
+#define CERT_TRANS_UTIL_WORK_STEALING_DEQUE_H_
+
+#include <glog/logging.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace util {
+
+
+// A Chase-Lev work-stealing deque of pointers, as described in
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê,
+// Pop, Cohen and Zappa Nardelli, PPoPP 2013).
+//
+// Its owner pushes and pops at the bottom, without any atomic
+// read-modify-write unless the deque is nearly empty, while any other
+// thread can steal from the top. The deque grows as needed, and never
+// shrinks. It does not own the items.
+template <class T>
+class WorkStealingDeque {
+ public:
+  // |capacity| must be a power of two.
+  explicit WorkStealingDeque(int64_t capacity = 256)
+      : top_(0), bottom_(0), array_(new Array(capacity)) {
+    CHECK_GT(capacity, 0);
+    CHECK_EQ(0, capacity & (capacity - 1));
+    arrays_.emplace_back(array_.load(std::memory_order_relaxed));
+  }
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  // Must only be called by the owner.
+  void Push(T* item) {
+    const int64_t b(bottom_.load(std::memory_order_relaxed));
+    const int64_t t(top_.load(std::memory_order_acquire));
+    Array* a(array_.load(std::memory_order_relaxed));
+    if (b - t > a->capacity() - 1) {
+      a = Grow(a, t, b);
+    }
+    a->Put(b, item);
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // Returns the most recently pushed item, or nullptr if the deque is
+  // empty. Must only be called by the owner.
+  T* Pop() {
+    const int64_t b(bottom_.load(std::memory_order_relaxed) - 1);
+    Array* const a(array_.load(std::memory_order_relaxed));
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t(top_.load(std::memory_order_relaxed));
+
+    if (t > b) {
+      // Empty.
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T* item(a->Get(b));
+    if (t == b) {
+      // The last item, which a thief could be taking as well.
+      if (!top_.compare_exchange_strong(t, t + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Returns the least recently pushed item, or nullptr if the deque is
+  // empty, or if another thread took it first. Can be called by any
+  // thread.
+  T* Steal() {
+    int64_t t(top_.load(std::memory_order_acquire));
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b(bottom_.load(std::memory_order_acquire));
+    if (t >= b) {
+      return nullptr;
+    }
+
+    Array* const a(array_.load(std::memory_order_acquire));
+    T* const item(a->Get(t));
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  // Only a hint, when called by other threads than the owner.
+  bool Empty() const {
+    return bottom_.load(std::memory_order_relaxed) <=
+           top_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  class Array {
+   public:
+    explicit Array(int64_t capacity) : items_(capacity) {
+    }
+
+    int64_t capacity() const {
+      return items_.size();
+    }
+
+    T* Get(int64_t i) const {
+      return items_[i & (capacity() - 1)].load(std::memory_order_relaxed);
+    }
+
+    void Put(int64_t i, T* item) {
+      items_[i & (capacity() - 1)].store(item, std::memory_order_relaxed);
+    }
+
+   private:
+    std::vector<std::atomic<T*>> items_;
+  };
+
+  Array* Grow(Array* old, int64_t t, int64_t b) {
+    Array* const a(new Array(old->capacity() * 2));
+    for (int64_t i = t; i < b; ++i) {
+      a->Put(i, old->Get(i));
+    }
+    // Thieves could still be reading the old array, so it is only
+    // freed along with the deque.
+    arrays_.emplace_back(a);
+    array_.store(a, std::memory_order_release);
+    return a;
+  }
+
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Array*> array_;
+  // All the arrays used so far, the last one being the current one.
+  // Only touched by the owner.
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+
+}  // namespace util
+
+#endif  // CERT_TRANS_UTIL_WORK_STEALING_DEQUE_H_
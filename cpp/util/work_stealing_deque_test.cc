@@ -0,0 +1,106 @@
+#include "util/work_stealing_deque.h"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "util/testing.h"
+
+namespace util {
+namespace {
+
+using std::atomic;
+using std::thread;
+using std::vector;
+
+
+TEST(WorkStealingDequeTest, Empty) {
+  WorkStealingDeque<int> deque;
+  EXPECT_TRUE(deque.Empty());
+  EXPECT_EQ(nullptr, deque.Pop());
+  EXPECT_EQ(nullptr, deque.Steal());
+}
+
+
+TEST(WorkStealingDequeTest, PopIsLifoStealIsFifo) {
+  // Small enough to have to grow.
+  WorkStealingDeque<int> deque(2);
+  vector<int> values(10);
+  for (auto& value : values) {
+    deque.Push(&value);
+  }
+  EXPECT_FALSE(deque.Empty());
+
+  EXPECT_EQ(&values[9], deque.Pop());
+  EXPECT_EQ(&values[0], deque.Steal());
+  EXPECT_EQ(&values[8], deque.Pop());
+  EXPECT_EQ(&values[1], deque.Steal());
+  for (int i = 7; i >= 2; --i) {
+    EXPECT_EQ(&values[i], deque.Pop());
+  }
+  EXPECT_TRUE(deque.Empty());
+  EXPECT_EQ(nullptr, deque.Pop());
+  EXPECT_EQ(nullptr, deque.Steal());
+}
+
+
+TEST(WorkStealingDequeTest, Thieves) {
+  const int kItems(200000);
+  const int kThieves(4);
+  WorkStealingDeque<int> deque(16);
+  vector<int> values(kItems);
+  // How many times each value was taken.
+  vector<atomic<int>> taken(kItems);
+  for (auto& count : taken) {
+    count = 0;
+  }
+  atomic<int> num_taken(0);
+
+  vector<thread> thieves;
+  for (int i = 0; i < kThieves; ++i) {
+    thieves.emplace_back([&]() {
+      while (num_taken.load() < kItems) {
+        int* const value(deque.Steal());
+        if (value) {
+          ++taken[value - &values[0]];
+          ++num_taken;
+        }
+      }
+    });
+  }
+
+  // The owner pushes everything, and pops some of it along the way.
+  for (int i = 0; i < kItems; ++i) {
+    deque.Push(&values[i]);
+    if (i % 3 == 0) {
+      int* const value(deque.Pop());
+      if (value) {
+        ++taken[value - &values[0]];
+        ++num_taken;
+      }
+    }
+  }
+  while (int* const value = deque.Pop()) {
+    ++taken[value - &values[0]];
+    ++num_taken;
+  }
+
+  for (auto& thief : thieves) {
+    thief.join();
+  }
+  EXPECT_EQ(kItems, num_taken.load());
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_EQ(1, taken[i].load()) << i;
+  }
+}
+
+
+}  // namespace
+}  // namespace util
+
+
+int main(int argc, char** argv) {
+  cert_trans::test::InitTesting(argv[0], &argc, &argv, true);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,23 @@
+dnl Checks whether the compiler can build SSSE3 code in functions marked
+dnl with __attribute__((target("ssse3"))), whatever the flags of the
+dnl build, and whether the program can check for SSSE3 at runtime with
+dnl __builtin_cpu_supports(). If so, defines HAVE_SSSE3_TARGET.
+AC_DEFUN([CT_CHECK_SSSE3_TARGET],
+  [AC_CACHE_CHECK(
+     [whether $CXX supports SSSE3 functions with runtime detection],
+     [ct_cv_ssse3_target],
+     [AC_LINK_IFELSE(
+        [AC_LANG_PROGRAM([[
+#include <tmmintrin.h>
+__attribute__((target("ssse3"))) __m128i Shuffle(__m128i a, __m128i b) {
+  return _mm_shuffle_epi8(a, b);
+}
+]], [[return __builtin_cpu_supports("ssse3") ? 0 : 1;]])],
+        [ct_cv_ssse3_target=yes],
+        [ct_cv_ssse3_target=no])])
+   if test $ct_cv_ssse3_target = yes; then
+     AC_DEFINE([HAVE_SSSE3_TARGET], [1],
+               [Define to 1 if the C++ compiler supports SSSE3 functions
+                with __attribute__((target("ssse3"))), and detecting SSSE3
+                with __builtin_cpu_supports().])
+   fi])